@@ -0,0 +1,78 @@
+//
+// Created by Jie Wei on 2024/5/11.
+//
+
+#include "accounting.h"
+#include <iomanip>
+
+namespace cemu {
+
+Accounting::Accounting(Mode mode, uint64_t instret)
+    : mode(mode), segment_insts(instret), segment_start(Clock::now()) {}
+
+void Accounting::switch_to(Mode to, uint64_t instret) {
+  auto now = Clock::now();
+  ModeStats& stats = modes[mode & 0b11];
+  stats.insts += instret - segment_insts;
+  stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(now - segment_start).count();
+  mode = to;
+  segment_insts = instret;
+  segment_start = now;
+}
+
+void Accounting::trap(uint64_t cause, Mode to, uint64_t instret) {
+  switch_to(to, instret);
+  ++traps[cause].count;
+  pending.emplace_back(cause, instret);
+}
+
+void Accounting::trap_return(Mode to, uint64_t instret) {
+  switch_to(to, instret);
+  // 没有对应陷入的 xRET（例如启动代码用 mret 进入低特权级）只切换特权级
+  if (pending.empty()) {
+    return;
+  }
+  auto [cause, entered] = pending.back();
+  pending.pop_back();
+  TrapStats& stats = traps[cause];
+  ++stats.returns;
+  stats.handler_insts += instret - entered;
+}
+
+Accounting::ModeStats Accounting::mode_stats(Mode m, uint64_t instret) const {
+  ModeStats stats = modes[m & 0b11];
+  if (m == mode) {
+    stats.insts += instret - segment_insts;
+    stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - segment_start).count();
+  }
+  return stats;
+}
+
+void Accounting::report(std::ostream& os, uint64_t instret) const {
+  const std::pair<Mode, const char*> names[] = {{User, "user"}, {Supervisor, "supervisor"}, {Machine, "machine"}};
+  std::ios_base::fmtflags flags = os.flags();
+  char fill = os.fill();
+
+  os << std::setw(80) << std::setfill('-') << "privilege modes" << std::setfill(' ') << "\n" << std::dec;
+  for (const auto& [m, name] : names) {
+    ModeStats stats = mode_stats(m, instret);
+    os << std::setw(16) << name << " = " << std::setw(16) << stats.insts << " insts " << std::setw(16)
+       << stats.nanos << " ns\n";
+  }
+
+  // 最高位为 1 的原因是中断
+  os << std::setw(80) << std::setfill('-') << "traps" << std::setfill(' ') << "\n";
+  for (const auto& [cause, stats] : traps) {
+    os << std::setw(12) << (cause >> 63 ? "interrupt " : "exception ") << std::setw(4) << (cause & ~(1ULL << 63))
+       << " = " << std::setw(16) << stats.count << " times";
+    if (stats.returns != 0) {
+      os << ", avg handler " << std::fixed << std::setprecision(1)
+         << static_cast<double>(stats.handler_insts) / static_cast<double>(stats.returns) << " insts";
+    }
+    os << "\n";
+  }
+  os.flags(flags);
+  os.fill(fill);
+}
+
+}
@@ -0,0 +1,68 @@
+//
+// Created by Jie Wei on 2024/5/11.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <vector>
+#include "param.h"
+
+namespace cemu {
+
+// 按特权级和陷入原因统计执行时间。只在特权级切换处（陷入和 xRET）记账，不增加每条指令的开销。
+class Accounting {
+ public:
+  // 在某个特权级下退休的指令数和经过的宿主机时间
+  struct ModeStats {
+    uint64_t insts = 0;
+    uint64_t nanos = 0;
+  };
+
+  // 某个陷入原因的次数，以及从陷入到 xRET 之间退休的指令总数
+  struct TrapStats {
+    uint64_t count = 0;
+    uint64_t returns = 0;
+    uint64_t handler_insts = 0;
+  };
+
+  // 从 instret 条指令、特权级 mode 开始统计，例如恢复快照后接着计数
+  explicit Accounting(Mode mode = Machine, uint64_t instret = 0);
+
+  // 陷入：结束当前特权级的计时，开始 to 的计时，并记录陷入原因
+  void trap(uint64_t cause, Mode to, uint64_t instret);
+
+  // xRET：结束最近一次陷入的处理程序，切换到 to
+  void trap_return(Mode to, uint64_t instret);
+
+  // 截至当前时刻各特权级的统计，包含尚未结束的这一段
+  [[nodiscard]] ModeStats mode_stats(Mode mode, uint64_t instret) const;
+
+  [[nodiscard]] const std::map<uint64_t, TrapStats>& trap_stats() const {
+    return traps;
+  }
+
+  // 写出报告，可在运行过程中随时调用
+  void report(std::ostream& os, uint64_t instret) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // 把从上次切换到现在的一段计入当前特权级，然后切换到 to
+  void switch_to(Mode to, uint64_t instret);
+
+  Mode mode = Machine;
+  uint64_t segment_insts = 0;
+  Clock::time_point segment_start;
+  std::array<ModeStats, 4> modes{};  // 以 Mode 的编码为下标
+
+  // 尚未返回的陷入：原因和陷入时的 instret，嵌套陷入时依次入栈
+  std::vector<std::pair<uint64_t, uint64_t>> pending;
+  std::map<uint64_t, TrapStats> traps;
+};
+
+}
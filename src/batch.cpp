@@ -0,0 +1,206 @@
+//
+// Created by Jie Wei on 2024/5/15.
+//
+
+#include "batch.h"
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "cup.h"
+#include "elf.h"
+
+namespace cemu {
+
+namespace {
+
+// 每个线程一个作业队列：自己从头部取，别的线程从尾部窃取
+class WorkQueue {
+ public:
+  void push(size_t job) {
+    std::lock_guard<std::mutex> lock(mtx);
+    jobs.push_back(job);
+  }
+
+  std::optional<size_t> pop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (jobs.empty()) {
+      return std::nullopt;
+    }
+    size_t job = jobs.front();
+    jobs.pop_front();
+    return job;
+  }
+
+  std::optional<size_t> steal() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (jobs.empty()) {
+      return std::nullopt;
+    }
+    size_t job = jobs.back();
+    jobs.pop_back();
+    return job;
+  }
+
+ private:
+  std::mutex mtx;
+  std::deque<size_t> jobs;
+};
+
+void run_job(Cpu& cpu, Htif& htif, const BatchJob& job, BatchResult& result) {
+  result.path = job.path;
+  auto start = std::chrono::steady_clock::now();
+
+  if (is_elf(job.path)) {
+    cpu.reset({});
+    try {
+      ElfImage image = load_elf(cpu, job.path);
+      htif.locate(image.symbols);
+    } catch (const std::runtime_error& e) {
+      result.status = "error";
+      result.message = e.what();
+      return;
+    }
+  } else {
+    std::ifstream file(job.path, std::ios::binary);
+    if (!file) {
+      result.status = "error";
+      result.message = "Cannot open file: " + job.path;
+      return;
+    }
+    std::vector<uint8_t> code(std::istreambuf_iterator<char>(file), {});
+    cpu.reset(code);
+    htif.tohost = 0;
+  }
+  // 原始二进制和没有 tohost 的 ELF 只能通过半主机调用退出。上一个作业没有关闭的文件不再可用
+  htif.close_files();
+  htif.semihosting = true;
+  cpu.htif = &htif;
+
+  try {
+    result.insts = cpu.run(job.max_insts);
+    result.exit_code = cpu.exit_code;
+    result.status = cpu.exit_code.has_value() ? "finished" : "timeout";
+  } catch (const Exception& e) {
+    std::ostringstream os;
+    os << e;
+    result.status = "exited";
+    result.message = os.str();
+    result.insts = cpu.csr.instret;
+  }
+  result.pc = cpu.pc;
+  result.a0 = cpu.regs[10];
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string escape(const std::string& s) {
+  std::ostringstream os;
+  for (char c : s) {
+    switch (c) {
+      case '"':
+        os << "\\\"";
+        break;
+      case '\\':
+        os << "\\\\";
+        break;
+      case '\n':
+        os << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+          os << c;
+        }
+    }
+  }
+  return os.str();
+}
+
+}  // namespace
+
+std::vector<BatchJob> load_manifest(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Cannot open manifest: " + path);
+  }
+  std::vector<BatchJob> jobs;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream is(line);
+    BatchJob job;
+    if (!(is >> job.path) || job.path[0] == '#') {
+      continue;
+    }
+    uint64_t max_insts;
+    if (is >> max_insts) {
+      job.max_insts = max_insts;
+    }
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs, size_t threads) {
+  std::vector<BatchResult> results(jobs.size());
+  threads = std::max<size_t>(1, std::min(threads, jobs.size()));
+  std::vector<WorkQueue> queues(threads);
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    queues[i % threads].push(i);
+  }
+
+  auto worker = [&](size_t id) {
+    std::optional<Cpu> cpu;
+    Htif htif;
+    while (true) {
+      std::optional<size_t> job = queues[id].pop();
+      for (size_t k = 1; !job && k < threads; ++k) {
+        job = queues[(id + k) % threads].steal();
+      }
+      // 作业不会在运行中产生新作业，所有队列都为空即可结束
+      if (!job) {
+        return;
+      }
+      if (!cpu) {
+        cpu.emplace(std::vector<uint8_t>{});
+      }
+      run_job(*cpu, htif, jobs[*job], results[*job]);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < threads; ++i) {
+    pool.emplace_back(worker, i);
+  }
+  worker(0);
+  for (auto& thread : pool) {
+    thread.join();
+  }
+  return results;
+}
+
+void write_json(std::ostream& os, const std::vector<BatchResult>& results) {
+  std::ios_base::fmtflags flags = os.flags();
+  os << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BatchResult& r = results[i];
+    os << "  {\"path\": \"" << escape(r.path) << "\", \"status\": \"" << r.status << "\", \"message\": \""
+       << escape(r.message) << "\", ";
+    if (r.exit_code.has_value()) {
+      os << "\"exit_code\": " << *r.exit_code << ", ";
+    }
+    os << "\"insts\": " << r.insts << ", \"pc\": " << r.pc << ", \"a0\": " << r.a0
+       << ", \"seconds\": " << std::fixed << std::setprecision(6) << r.seconds << "}"
+       << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "]\n";
+  os.flags(flags);
+}
+
+}
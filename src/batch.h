@@ -0,0 +1,52 @@
+//
+// Created by Jie Wei on 2024/5/15.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cemu {
+
+// 批量运行中的一个客户机程序：原始二进制从 DRAM_BASE 开始执行；ELF 按程序头加载。
+// 客户机可以通过半主机调用 SYS_EXIT 退出，ELF 符号表中有 tohost 时也可以通过 HTIF 退出
+struct BatchJob {
+  std::string path;
+  uint64_t max_insts = std::numeric_limits<uint64_t>::max();
+};
+
+// 一个程序的运行结果
+struct BatchResult {
+  std::string path;
+  std::string status;   // "finished"：客户机通过 HTIF 或半主机调用请求退出；"exited"：因异常停止；"timeout"：达到 max_insts；"error"：无法加载
+  std::string message;  // 停止原因
+  std::optional<uint64_t> exit_code;  // status 为 "finished" 时客户机的返回值
+  uint64_t insts = 0;
+  uint64_t pc = 0;
+  uint64_t a0 = 0;      // 停止时的 a0，通常是程序的返回值
+  double seconds = 0;
+};
+
+// 作业成功：客户机请求退出且返回值为 0
+inline bool batch_succeeded(const BatchResult& result) {
+  return result.status == "finished" && result.exit_code == 0;
+}
+
+// 读取清单文件：每行一个程序路径，可以跟一个最大指令数；空行和 # 开头的行被忽略。
+// 失败时抛出 std::runtime_error
+std::vector<BatchJob> load_manifest(const std::string& path);
+
+// 在 threads 个线程上并行运行所有程序，结果的顺序与 jobs 相同。
+// 每个线程只有一个 Cpu，在作业之间复用它的 DRAM；线程空闲时从其他线程的队列尾部窃取作业，
+// 使长时间运行的程序不会挡住排在后面的短程序
+std::vector<BatchResult> run_batch(const std::vector<BatchJob>& jobs, size_t threads);
+
+// 以 JSON 数组输出结果
+void write_json(std::ostream& os, const std::vector<BatchResult>& results);
+
+}
@@ -0,0 +1,199 @@
+//
+// Created by Jie Wei on 2024/5/8.
+//
+
+#include "block.h"
+#include <algorithm>
+#include "bus.h"
+#include "exception.h"
+#include "instructions.h"
+#include "log.h"
+#include "profiler.h"
+
+namespace cemu {
+
+BlockCache::BlockCache() : code_pages(DRAM_SIZE >> PAGE_SHIFT, 0) {}
+
+Block& BlockCache::lookup(Bus& bus, uint64_t pc) {
+  auto it = blocks.find(pc);
+  if (it != blocks.end()) {
+    return it->second;
+  }
+  return blocks.emplace(pc, build(bus, pc)).first->second;
+}
+
+void BlockCache::flush() {
+  LOG(INFO, "Flushing ", blocks.size(), " cached blocks.");
+  if (profiler != nullptr) {
+    for_each([this](const Block& block) { profiler->collect(block); });
+  }
+  blocks.clear();
+  for (uint8_t& page : code_pages) {
+    page &= ~CODE_PAGE;
+  }
+  needs_flush = false;
+  changed_breakpoints.clear();
+  stale = watch_triggered;
+}
+
+bool BlockCache::refresh() {
+  if (needs_flush) {
+    flush();
+  } else {
+    for (uint64_t addr : changed_breakpoints) {
+      drop_blocks_at(addr);
+    }
+    changed_breakpoints.clear();
+  }
+  stale = false;
+  bool hit = watch_triggered;
+  watch_triggered = false;
+  return hit;
+}
+
+void BlockCache::written(uint64_t addr, uint64_t len, uint8_t flags) {
+  if (flags & CODE_PAGE) {
+    needs_flush = true;
+    stale = true;
+  }
+  if (flags & WATCH_PAGE) {
+    for (const auto& [watch_addr, watch_len] : watchpoints) {
+      if (addr < watch_addr + watch_len && watch_addr < addr + len) {
+        watch_hit = addr;
+        watch_triggered = true;
+        stale = true;
+      }
+    }
+  }
+}
+
+void BlockCache::drop_blocks_at(uint64_t addr) {
+  for (auto it = blocks.begin(); it != blocks.end();) {
+    const Block& block = it->second;
+    if ((block.pc <= addr && addr < block.fallthrough()) || block.fallthrough() == addr) {
+      if (profiler != nullptr) {
+        profiler->collect(block);
+      }
+      it = blocks.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void BlockCache::add_breakpoint(uint64_t addr) {
+  if (breakpoints.insert(addr).second) {
+    changed_breakpoints.push_back(addr);
+    stale = true;
+  }
+}
+
+void BlockCache::remove_breakpoint(uint64_t addr) {
+  if (breakpoints.erase(addr) != 0) {
+    changed_breakpoints.push_back(addr);
+    stale = true;
+  }
+}
+
+void BlockCache::add_watchpoint(uint64_t addr, uint64_t len) {
+  // 第一个观察点使所有块按写指令重新切分
+  if (watchpoints.empty()) {
+    needs_flush = true;
+    stale = true;
+  }
+  watchpoints.emplace_back(addr, len);
+  mark_watch_pages();
+}
+
+void BlockCache::remove_watchpoint(uint64_t addr, uint64_t len) {
+  auto it = std::find(watchpoints.begin(), watchpoints.end(), std::make_pair(addr, len));
+  if (it == watchpoints.end()) {
+    return;
+  }
+  watchpoints.erase(it);
+  mark_watch_pages();
+  if (watchpoints.empty()) {
+    needs_flush = true;
+    stale = true;
+  }
+}
+
+void BlockCache::mark_watch_pages() {
+  for (uint8_t& page : code_pages) {
+    page &= ~WATCH_PAGE;
+  }
+  for (const auto& [addr, len] : watchpoints) {
+    for (uint64_t a = addr & ~((1ULL << PAGE_SHIFT) - 1); a < addr + len; a += 1ULL << PAGE_SHIFT) {
+      if (a >= DRAM_BASE && ((a - DRAM_BASE) >> PAGE_SHIFT) < code_pages.size()) {
+        code_pages[(a - DRAM_BASE) >> PAGE_SHIFT] |= WATCH_PAGE;
+      }
+    }
+  }
+}
+
+Block BlockCache::build(Bus& bus, uint64_t pc) {
+  Block block;
+  block.pc = pc;
+  block.breakpoint = !breakpoints.empty() && breakpoints.count(pc) != 0;
+
+  uint64_t addr = pc;
+  while (block.insts.size() < MAX_BLOCK_INSTS) {
+    // 块不跨页，保证失效检查只需看块所在的页
+    if (addr != pc && (addr & ((1 << PAGE_SHIFT) - 1)) == 0) {
+      break;
+    }
+    // 在断点前结束块
+    if (addr != pc && !breakpoints.empty() && breakpoints.count(addr) != 0) {
+      break;
+    }
+
+    uint32_t inst;
+    try {
+      inst = static_cast<uint32_t>(bus.load(addr, 32).value());
+    } catch (const Exception&) {
+      // 第一条指令就取不到时报告取指错误，否则在此处结束块，等真正执行到时再报告
+      if (addr == pc) {
+        throw Exception(ExceptionType::InstructionAccessFault, pc);
+      }
+      break;
+    }
+
+    uint32_t opcode = inst & 0x7f;
+    // SYSTEM 指令（CSR 访问、xRET 等）单独成块，使得它们执行时性能计数器和特权级统计都是精确的
+    if (opcode == 0x73 && addr != pc) {
+      break;
+    }
+
+    ExecuteFunction fn = InstructionExecutor::decode(inst);
+    block.insts.push_back({fn != nullptr ? InstructionExecutor::specialize(fn, inst) : executeIllegal, inst});
+    addr += 4;
+
+    if (is_load_inst(inst)) {
+      ++block.loads;
+    } else if (is_store_inst(inst)) {
+      ++block.stores;
+    }
+
+    // 跳转、分支、SYSTEM 指令和非法指令结束一个块
+    if (opcode == 0x63) {
+      block.ends_in_branch = true;
+      break;
+    }
+    if (fn == nullptr || opcode == 0x67 || opcode == 0x6f || opcode == 0x73) {
+      break;
+    }
+    // 有观察点时写指令结束一个块，执行引擎在块边界检查是否命中
+    if (!watchpoints.empty() && is_store_inst(inst)) {
+      break;
+    }
+  }
+
+  uint64_t first = (pc - DRAM_BASE) >> PAGE_SHIFT;
+  if (pc >= DRAM_BASE && first < code_pages.size()) {
+    code_pages[first] |= CODE_PAGE;
+  }
+  LOG(INFO, "Built block at 0x", std::hex, pc, std::dec, " with ", block.insts.size(), " instructions.");
+  return block;
+}
+
+}
@@ -0,0 +1,239 @@
+//
+// Created by Jie Wei on 2024/5/8.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "param.h"
+
+namespace cemu {
+
+class Cpu;
+class Bus;
+class Profiler;
+
+// 指令执行函数：返回下一条指令的地址，返回 std::nullopt 表示非法指令
+using ExecuteFunction = std::optional<uint64_t> (*)(Cpu&, uint32_t);
+
+// 访存读指令（标量 LOAD 和向量 LOAD-FP），用于事件统计
+inline bool is_load_inst(uint32_t inst) {
+  uint32_t opcode = inst & 0x7f;
+  return opcode == 0x03 || opcode == 0x07;
+}
+
+// 访存写指令（标量 STORE 和向量 STORE-FP），用于事件统计
+inline bool is_store_inst(uint32_t inst) {
+  uint32_t opcode = inst & 0x7f;
+  return opcode == 0x23 || opcode == 0x27;
+}
+
+// 预解码后的一条指令。fn 是按操作数特化过的执行函数（见 InstructionExecutor::specialize），不会写 x0
+struct DecodedInst {
+  ExecuteFunction fn;
+  uint32_t inst;
+};
+
+// 线索化解释器融合成一次分派的相邻指令对（超级指令），见 threaded.cpp
+enum class Fusion : uint8_t {
+  LuiAddi,        // lui + addi：装入 32 位常数
+  AuipcAddi,      // auipc + addi：装入 pc 相对地址（la）
+  AuipcJalr,      // auipc + jalr：远调用和尾调用
+  AuipcLd,        // auipc + ld：读 pc 相对的数据（如 GOT 表项）
+  SlliSrli,       // slli + srli：零扩展
+  CompareBranch,  // slt/slti/sltiu + beqz/bnez
+  Count,
+};
+
+// 直接线索化解释器使用的指令形式（见 threaded.h）：处理程序标签的地址和预先解码好的操作数
+struct ThreadedInst {
+  const void* handler;
+  ExecuteFunction fn;  // 没有专门处理程序的指令调用它
+  int64_t imm;         // 立即数；依赖 pc 的指令（auipc、跳转、分支）中是算好的绝对地址，融合的指令对见 fuse()
+  uint32_t inst;
+  uint8_t rd, rs1, rs2;
+};
+
+// 基本块：从 pc 开始顺序执行、只在最后一条指令处改变控制流的一段指令
+struct Block {
+  uint64_t pc = 0;
+  std::vector<DecodedInst> insts;
+
+  // insts 翻译成的线索化代码，末尾多一条结束块的哨兵。第一次由线索化解释器执行时生成
+  std::vector<ThreadedInst> threaded;
+
+  // threaded 中各种融合指令对的个数，乘以 exec_count 即为融合处理程序的执行次数
+  std::array<uint32_t, static_cast<size_t>(Fusion::Count)> fusions{};
+
+  // 块内的静态事件数，整块执行完后一次性累加到性能计数器中
+  uint32_t loads = 0;
+  uint32_t stores = 0;
+
+  // 以条件分支结尾的块，执行后 pc 不等于 fallthrough 即为分支跳转
+  bool ends_in_branch = false;
+
+  // 块的起始地址是断点
+  bool breakpoint = false;
+
+  // 整块执行完的次数，供性能分析使用
+  uint64_t exec_count = 0;
+
+  // partial_counts[n]：只退休了前 n 条指令就离开块的次数（异常或指令数用尽），第一次用到时才分配
+  std::vector<uint64_t> partial_counts;
+
+  // 第 i 条指令的执行次数
+  [[nodiscard]] uint64_t inst_count(size_t i) const {
+    uint64_t count = exec_count;
+    for (size_t n = i + 1; n < partial_counts.size(); ++n) {
+      count += partial_counts[n];
+    }
+    return count;
+  }
+
+  // 顺序执行完整个块后的下一条指令地址
+  [[nodiscard]] uint64_t fallthrough() const {
+    return pc + insts.size() * 4;
+  }
+};
+
+// 基本块缓存。以块的起始 pc 为键，每个块只在第一次执行时取指和解码一次。
+class BlockCache {
+ public:
+  BlockCache();
+
+  // 查找以 pc 开始的块，不存在时从 bus 取指并构建
+  Block& lookup(Bus& bus, uint64_t pc);
+
+  // 客户机写入 [addr, addr + len) 时调用。若写到了已缓存的代码页，
+  // 在下一个块边界时清空缓存（执行中的块仍然有效，这与 RISC-V 需要 fence.i 的语义一致）。
+  // 写到设置了观察点的页时检查观察点。两种页共用一个标记数组，没有观察点时不增加任何开销
+  inline void invalidate(uint64_t addr, uint64_t len) {
+    if (uint8_t flags = page_flags(addr, len); flags != 0) [[unlikely]] {
+      written(addr, len, flags);
+    }
+  }
+
+  // 调试器等宿主直接写入客户机内存时调用：只让缓存的代码失效，不触发观察点
+  inline void host_written(uint64_t addr, uint64_t len) {
+    if (page_flags(addr, len) & CODE_PAGE) {
+      written(addr, len, CODE_PAGE);
+    }
+  }
+
+  // 由执行引擎在块边界调用：处理缓存失效和断点的变化。返回 true 表示上一个块触发了观察点，应当停止执行
+  inline bool sync() {
+    if (stale) [[unlikely]] {
+      return refresh();
+    }
+    return false;
+  }
+
+  void flush();
+
+  // 断点总是块的起始地址：块在断点前结束，以断点开始的块带有 breakpoint 标记，执行引擎只需在块边界检查这个标记。
+  // 增删断点只重建受影响的块，在下一个块边界生效
+  void add_breakpoint(uint64_t addr);
+  void remove_breakpoint(uint64_t addr);
+
+  [[nodiscard]] bool has_breakpoints() const {
+    return !breakpoints.empty();
+  }
+
+  [[nodiscard]] bool is_breakpoint(uint64_t addr) const {
+    return breakpoints.count(addr) != 0;
+  }
+
+  // 写观察点：客户机写入与 [addr, addr + len) 重叠的内存后停止执行，命中的地址记录在 watch_hit 中。
+  // 有观察点时每条写指令都结束一个块，使停止的位置是精确的
+  void add_watchpoint(uint64_t addr, uint64_t len);
+  void remove_watchpoint(uint64_t addr, uint64_t len);
+
+  [[nodiscard]] bool has_watchpoints() const {
+    return !watchpoints.empty();
+  }
+
+  // 最近一次命中观察点的写地址，由使用者读取后清除
+  std::optional<uint64_t> watch_hit;
+
+  [[nodiscard]] size_t size() const {
+    return blocks.size();
+  }
+
+  // 遍历当前缓存的所有块
+  template <typename F>
+  void for_each(F&& f) const {
+    for (const auto& [pc, block] : blocks) {
+      f(block);
+    }
+  }
+
+  // 清零所有块的执行计数
+  void reset_counts() {
+    for (auto& [pc, block] : blocks) {
+      block.exec_count = 0;
+      block.partial_counts.clear();
+    }
+  }
+
+  // 非空时，块被丢弃前先把它的执行计数交给 profiler
+  Profiler* profiler = nullptr;
+
+  // 块内最多的指令数
+  static constexpr size_t MAX_BLOCK_INSTS = 64;
+
+ private:
+  static constexpr uint64_t PAGE_SHIFT = 12;
+
+  // code_pages 中每页的标记
+  static constexpr uint8_t CODE_PAGE = 1;   // 含有已缓存的代码
+  static constexpr uint8_t WATCH_PAGE = 2;  // 含有观察点
+
+  Block build(Bus& bus, uint64_t pc);
+
+  // [addr, addr + len) 与 DRAM 重叠的每一页的标记之并。宿主的批量写入可能跨越很多页，
+  // 中间的页也要检查；访存指令最多跨两页，循环只执行一两次
+  [[nodiscard]] inline uint8_t page_flags(uint64_t addr, uint64_t len) const {
+    uint64_t end = addr + len;
+    if (len == 0 || end <= DRAM_BASE || addr >= DRAM_BASE + (code_pages.size() << PAGE_SHIFT)) {
+      return 0;
+    }
+    uint64_t first = addr > DRAM_BASE ? (addr - DRAM_BASE) >> PAGE_SHIFT : 0;
+    uint64_t last = std::min<uint64_t>((end - 1 - DRAM_BASE) >> PAGE_SHIFT, code_pages.size() - 1);
+    uint8_t flags = 0;
+    for (uint64_t page = first; page <= last; ++page) {
+      flags |= code_pages[page];
+    }
+    return flags;
+  }
+
+  // 写到被标记的页时调用
+  void written(uint64_t addr, uint64_t len, uint8_t flags);
+
+  // 处理 stale 标记的各种变化，返回是否命中了观察点
+  bool refresh();
+
+  // 丢弃与 addr 重叠或以 addr 结尾的块，它们会在下次执行时按新的断点重建
+  void drop_blocks_at(uint64_t addr);
+
+  // 重新计算观察点所在的页
+  void mark_watch_pages();
+
+  std::unordered_map<uint64_t, Block> blocks;
+  std::vector<uint8_t> code_pages;  // 每个 DRAM 页的 CODE_PAGE / WATCH_PAGE 标记
+  std::unordered_set<uint64_t> breakpoints;
+  std::vector<std::pair<uint64_t, uint64_t>> watchpoints;  // 起始地址和长度
+
+  // 下一个块边界时需要处理的事情：stale 是它们的汇总，使 sync() 只检查一个标记
+  bool stale = false;
+  bool needs_flush = false;
+  bool watch_triggered = false;
+  std::vector<uint64_t> changed_breakpoints;
+};
+
+}
@@ -8,13 +8,29 @@
 
 namespace cemu {
 
-Bus::Bus(const std::vector<uint8_t>& code) : dram(code) {}
+Bus::Bus(const std::vector<uint8_t>& code) : uart(std::make_unique<Uart>()), dram(code) {}
+
+void Bus::reset(const std::vector<uint8_t>& code) {
+  dram.reset(code);
+  clint = Clint();
+  plic = Plic();
+  uart = std::make_unique<Uart>();
+}
 
 std::optional<uint64_t> Bus::load(uint64_t addr, uint64_t size) {
   if (addr >= DRAM_BASE && addr <= DRAM_END) {
     LOG(INFO, "Bus loading from DRAM address ", std::hex, addr, " with size ", size, " bytes.");
     return dram.load(addr, size);
   }
+  if (addr >= CLINT_BASE && addr <= CLINT_END) {
+    return clint.load(addr, size);
+  }
+  if (addr >= PLIC_BASE && addr <= PLIC_END) {
+    return plic.load(addr, size);
+  }
+  if (addr >= UART_BASE && addr <= UART_END) {
+    return uart->load(addr, size);
+  }
   throw Exception(ExceptionType::LoadAccessFault, addr);
 }
 
@@ -23,8 +39,23 @@ bool Bus::store(uint64_t addr, uint64_t size, uint64_t value) {
     LOG(INFO, "Bus storing value ", std::hex, value, " at DRAM address ", addr, " with size ", size, " bytes.");
     return dram.store(addr, size, value);
   }
+  if (addr >= CLINT_BASE && addr <= CLINT_END) {
+    clint.store(addr, size, value);
+    return true;
+  }
+  if (addr >= PLIC_BASE && addr <= PLIC_END) {
+    plic.store(addr, size, value);
+    return true;
+  }
+  if (addr >= UART_BASE && addr <= UART_END) {
+    uart->store(addr, size, value);
+    return true;
+  }
   throw Exception(ExceptionType::StoreAMOAccessFault, addr);
 }
 
+uint8_t* Bus::dram_ptr(uint64_t addr, uint64_t len) {
+  return dram.host_ptr(addr, len);
+}
 
-}
\ No newline at end of file
+}
@@ -1,9 +1,13 @@
 // Bus.h
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <cstdint>
+#include "clint.h"
 #include "dram.h" // 包含Dram类的定义
+#include "plic.h"
+#include "uart.h"
 
 namespace cemu {
 
@@ -14,6 +18,21 @@ public:
   std::optional<uint64_t> load(uint64_t addr, uint64_t size);
   bool store(uint64_t addr, uint64_t size, uint64_t value);
 
+  // 若 [addr, addr + len) 完全落在 DRAM 中，返回对应的宿主机指针，否则返回 nullptr
+  uint8_t* dram_ptr(uint64_t addr, uint64_t len);
+
+  // 把总线上的内存和外设恢复到刚构造时的状态，DRAM 的地址空间被复用
+  void reset(const std::vector<uint8_t>& code);
+
+  Dram& memory() {
+    return dram;
+  }
+
+  Clint clint;
+  Plic plic;
+  // Uart 的输入线程持有它的地址，放在堆上使 Bus 移动后地址不变
+  std::unique_ptr<Uart> uart;
+
 private:
   Dram dram;
 };
@@ -0,0 +1,26 @@
+//
+// Created by Jie Wei on 2024/5/23.
+//
+
+#pragma once
+
+#include <charconv>
+#include <concepts>
+#include <string_view>
+
+namespace cemu {
+
+// 解析命令行参数中的十进制无符号整数。整个字符串都必须是数字且不溢出，否则返回 false 并保持 value 不变，
+// 调用者据此打印用法，而不是让 std::stoul 抛出未捕获的异常
+template <std::unsigned_integral T>
+bool parse_number(std::string_view s, T& value) {
+  T result{};
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), result);
+  if (s.empty() || ec != std::errc() || end != s.data() + s.size()) {
+    return false;
+  }
+  value = result;
+  return true;
+}
+
+}
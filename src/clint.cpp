@@ -1,6 +1,7 @@
 // clint.cpp
 
 #include "clint.h"
+#include "snapshot.h"
 #include <stdexcept>
 
 namespace cemu {
@@ -35,4 +36,14 @@ void Clint::store(uint64_t addr, uint64_t size, uint64_t value) {
   }
 }
 
-}
\ No newline at end of file
+void Clint::save(std::ostream& os) const {
+  write_pod(os, mtime);
+  write_pod(os, mtimecmp);
+}
+
+void Clint::restore(std::istream& is) {
+  read_pod(is, mtime);
+  read_pod(is, mtimecmp);
+}
+
+}
@@ -2,6 +2,8 @@
 
 #pragma once
 #include <cstdint>
+#include <istream>
+#include <ostream>
 #include "exception.h"
 #include "param.h"
 
@@ -14,6 +16,10 @@ class Clint {
   uint64_t load(uint64_t addr, uint64_t size);
   void store(uint64_t addr, uint64_t size, uint64_t value);
 
+  // 保存和恢复寄存器状态，用于快照
+  void save(std::ostream& os) const;
+  void restore(std::istream& is);
+
  private:
   uint64_t mtime;     // Machine time
   uint64_t mtimecmp;  // Machine time compare
@@ -0,0 +1,82 @@
+//
+// Created by Jie Wei on 2024/5/13.
+//
+
+#include "clone.h"
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+namespace cemu {
+
+namespace {
+
+// 创建一个匿名的内存文件，不支持 memfd 的系统上退回到立即删除的临时文件
+int create_memory_file() {
+#ifdef __linux__
+  int fd = memfd_create("cemu-dram", MFD_CLOEXEC);
+  if (fd >= 0) {
+    return fd;
+  }
+#endif
+  char path[] = "/tmp/cemu-dram-XXXXXX";
+  int fd_tmp = mkstemp(path);
+  if (fd_tmp >= 0) {
+    unlink(path);
+  }
+  return fd_tmp;
+}
+
+}  // namespace
+
+MachineImage::MachineImage(Cpu& cpu) : fd(create_memory_file()) {
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(DRAM_SIZE)) != 0) {
+    throw std::runtime_error("Cannot create memory file for machine image.");
+  }
+
+  // 只写入非零页，其余部分保持为文件空洞，不占用内存
+  const uint8_t* dram = cpu.bus.dram_ptr(DRAM_BASE, DRAM_SIZE);
+  for (uint64_t off = 0; off < DRAM_SIZE; off += Dram::PAGE_SIZE) {
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(dram + off);
+    bool zero = true;
+    for (uint64_t i = 0; i < Dram::PAGE_SIZE / 8 && zero; ++i) {
+      zero = words[i] == 0;
+    }
+    if (!zero && pwrite(fd, dram + off, Dram::PAGE_SIZE, static_cast<off_t>(off)) != static_cast<ssize_t>(Dram::PAGE_SIZE)) {
+      throw std::runtime_error("Cannot write machine image.");
+    }
+  }
+
+  std::ostringstream os;
+  save_machine_state(cpu, os);
+  state = os.str();
+}
+
+MachineImage::~MachineImage() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+Cpu MachineImage::clone() const {
+  Cpu cpu({});
+  reset(cpu);
+  return cpu;
+}
+
+void MachineImage::reset(Cpu& cpu) const {
+  Dram& dram = cpu.bus.memory();
+  if (!dram.map_file(fd, 0, 0, DRAM_SIZE)) {
+    throw std::runtime_error("Cannot map machine image.");
+  }
+  dram.clear_dirty();
+  std::istringstream is(state);
+  restore_machine_state(cpu, is);
+  cpu.blocks.flush();
+  cpu.accounting = Accounting(cpu.mode, cpu.csr.instret);
+}
+
+}
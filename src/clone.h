@@ -0,0 +1,34 @@
+//
+// Created by Jie Wei on 2024/5/13.
+//
+
+#pragma once
+
+#include <string>
+#include "cup.h"
+
+namespace cemu {
+
+// 冻结的机器镜像。DRAM 只写入一次到一个内存文件（Linux 上为 memfd），之后每次克隆都把整个文件
+// 以 MAP_PRIVATE 方式映射为新机器的 DRAM：子机器与镜像按页写时复制，克隆的开销与 DRAM 大小无关。
+class MachineImage {
+ public:
+  // 冻结 cpu 当前的状态，之后对 cpu 的修改不影响镜像。失败时抛出 std::runtime_error
+  explicit MachineImage(Cpu& cpu);
+  ~MachineImage();
+
+  MachineImage(const MachineImage&) = delete;
+  MachineImage& operator=(const MachineImage&) = delete;
+
+  // 创建一台与镜像状态相同、互相独立的新机器。可以在多个线程中并发调用
+  [[nodiscard]] Cpu clone() const;
+
+  // 把已有的机器重置为镜像的状态，省去构造 Cpu 的开销
+  void reset(Cpu& cpu) const;
+
+ private:
+  int fd = -1;
+  std::string state;  // save_machine_state 的输出
+};
+
+}
@@ -0,0 +1,108 @@
+//
+// Created by Jie Wei on 2024/5/20.
+//
+
+#include "compliance.h"
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include "elf.h"
+
+namespace cemu {
+
+std::vector<ComplianceTest> find_compliance_tests(const std::string& dir, const std::vector<std::string>& suites) {
+  std::error_code ec;
+  std::filesystem::directory_iterator it(dir, ec);
+  if (ec) {
+    throw std::runtime_error("Cannot open test directory: " + dir);
+  }
+
+  std::vector<ComplianceTest> tests;
+  for (const auto& entry : it) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    // 文件名为 <套件>-<环境>-<测试>，没有扩展名
+    std::string file = entry.path().filename().string();
+    size_t first = file.find('-');
+    size_t second = first == std::string::npos ? std::string::npos : file.find('-', first + 1);
+    if (second == std::string::npos || file.find('.') != std::string::npos) {
+      continue;
+    }
+    ComplianceTest test{file.substr(0, first), file.substr(first + 1, second - first - 1), file.substr(second + 1),
+                        entry.path().string()};
+    if (std::find(suites.begin(), suites.end(), test.suite) == suites.end() || !is_elf(test.path)) {
+      continue;
+    }
+    tests.push_back(std::move(test));
+  }
+
+  std::sort(tests.begin(), tests.end(), [](const ComplianceTest& a, const ComplianceTest& b) {
+    return std::tie(a.suite, a.env, a.name) < std::tie(b.suite, b.env, b.name);
+  });
+  return tests;
+}
+
+std::vector<BatchResult> run_compliance(const std::vector<ComplianceTest>& tests, size_t threads, uint64_t max_insts) {
+  std::vector<BatchJob> jobs;
+  jobs.reserve(tests.size());
+  for (const ComplianceTest& test : tests) {
+    jobs.push_back({test.path, max_insts});
+  }
+  return run_batch(jobs, threads);
+}
+
+void write_matrix(std::ostream& os, const std::vector<ComplianceTest>& tests, const std::vector<BatchResult>& results) {
+  // 先列出失败的测试
+  std::map<std::pair<std::string, std::string>, std::pair<size_t, size_t>> cells;  // (套件, 环境) -> (通过, 总数)
+  std::set<std::string> envs;
+  size_t passed = 0;
+  for (size_t i = 0; i < tests.size(); ++i) {
+    const ComplianceTest& test = tests[i];
+    const BatchResult& r = results[i];
+    auto& cell = cells[{test.suite, test.env}];
+    envs.insert(test.env);
+    ++cell.second;
+    if (compliance_passed(r)) {
+      ++cell.first;
+      ++passed;
+      continue;
+    }
+    os << "FAIL " << test.suite << "-" << test.env << "-" << test.name << ": ";
+    if (r.status == "finished") {
+      os << "test " << *r.exit_code << " failed";
+    } else if (r.status == "timeout") {
+      os << "no exit after " << r.insts << " instructions (pc = 0x" << std::hex << r.pc << std::dec << ")";
+    } else {
+      os << r.message;
+    }
+    os << "\n";
+  }
+
+  // 每行一个套件，每列一个运行环境，格子里是 通过/总数
+  os << "\n" << std::left << std::setw(10) << "suite";
+  for (const std::string& env : envs) {
+    os << std::setw(10) << env;
+  }
+  os << "\n";
+  std::string suite;
+  for (const auto& [key, cell] : cells) {
+    if (key.first == suite) {
+      continue;
+    }
+    suite = key.first;
+    os << std::setw(10) << suite;
+    for (const std::string& env : envs) {
+      auto it = cells.find({suite, env});
+      os << std::setw(10)
+         << (it == cells.end() ? "-" : std::to_string(it->second.first) + "/" + std::to_string(it->second.second));
+    }
+    os << "\n";
+  }
+  os << std::setw(10) << "total" << passed << "/" << tests.size() << "\n" << std::right;
+}
+
+}
@@ -0,0 +1,45 @@
+//
+// Created by Jie Wei on 2024/5/20.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "batch.h"
+
+namespace cemu {
+
+// riscv-tests 的一个 ISA 测试，如 rv64ui-p-add：套件 rv64ui，运行环境 p，测试 add
+struct ComplianceTest {
+  std::string suite;
+  std::string env;
+  std::string name;
+  std::string path;
+};
+
+// 默认运行的套件。只包含基本整数指令集：M、A、C 扩展尚未实现，rv64um、rv64ua、rv64uc 会全部失败；
+// rv64mi、rv64si 依赖的特权功能只实现了一部分，需要时用 --suites 显式指定
+inline const std::vector<std::string> DEFAULT_SUITES = {"rv64ui"};
+
+// 在 dir 中查找属于 suites 的测试（riscv-tests 构建出的 isa 目录），跳过 .dump 等非 ELF 文件，按套件和名字排序。
+// 目录不存在时抛出 std::runtime_error
+std::vector<ComplianceTest> find_compliance_tests(const std::string& dir,
+                                                  const std::vector<std::string>& suites = DEFAULT_SUITES);
+
+// 测试通过：客户机通过 tohost 以返回值 0 退出。失败时返回值是失败的子测试编号
+inline bool compliance_passed(const BatchResult& result) {
+  return batch_succeeded(result);
+}
+
+// 在 threads 个线程上并行运行所有测试，结果的顺序与 tests 相同
+std::vector<BatchResult> run_compliance(const std::vector<ComplianceTest>& tests, size_t threads,
+                                        uint64_t max_insts = 10'000'000);
+
+// 输出失败的测试及原因，以及按套件和运行环境统计的通过矩阵
+void write_matrix(std::ostream& os, const std::vector<ComplianceTest>& tests, const std::vector<BatchResult>& results);
+
+}
@@ -3,14 +3,233 @@
 //
 
 #include "csr.h"
+#include "exception.h"
+#include "replay.h"
+#include "snapshot.h"
 
 namespace cemu {
 
 // 构造函数
-Csr::Csr() {
-  csrs.fill(0); // 初始化所有CSR为0
+Csr::Csr() : boot_time(std::chrono::steady_clock::now()) {
+  regs[SLOT_VTYPE] = MASK_VILL; // 复位时 vtype 非法，必须先执行 vsetvl
 }
 
+// CSR 编号到描述的映射：index 把 4096 个编号映射到 descs 中的下标，0 表示未实现
+struct Csr::Table {
+  std::array<uint8_t, NUM_CSRS> index{};
+  std::array<Desc, 160> descs{};
+  size_t count = 1;
+
+  constexpr void add(size_t addr, const Desc& d) {
+    index[addr] = static_cast<uint8_t>(count);
+    descs[count++] = d;
+  }
+};
+
+constinit const Csr::Table Csr::table = [] {
+  Table t;
+  t.descs[0] = {read_const, write_ignored, 0, 0, 0};
+
+  auto plain = [&t](size_t addr, CsrSlot slot, uint64_t mask) {
+    t.add(addr, {read_slot, write_slot, mask, 0, slot});
+  };
+  auto constant = [&t](size_t addr, uint64_t value) {
+    t.add(addr, {read_const, write_ignored, 0, value, 0});
+  };
+  constexpr uint64_t ALL = ~0ULL;
+  constexpr uint64_t S_INTERRUPTS = MASK_SSIP | MASK_STIP | MASK_SEIP;
+  constexpr uint64_t M_INTERRUPTS = MASK_MSIP | MASK_MTIP | MASK_MEIP;
+  // mtvec / stvec 的 MODE 只支持 0（直接）和 1（向量）
+  constexpr uint64_t TVEC_MASK = ~0b10ULL;
+  // 没有压缩指令扩展，xepc 的最低位恒为 0
+  constexpr uint64_t EPC_MASK = ~0b1ULL;
+
+  // 向量扩展
+  plain(VSTART, SLOT_VSTART, VLEN - 1);
+  plain(VXSAT, SLOT_VXSAT, 0b1);
+  plain(VXRM, SLOT_VXRM, 0b11);
+  t.add(VCSR, {read_vcsr, write_vcsr, 0b111, 0, 0});
+  plain(VL, SLOT_VL, 0);
+  plain(VTYPE, SLOT_VTYPE, 0);
+  constant(VLENB, VLEN_BYTES);
+
+  // 用户级计数器，只读
+  for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+    t.add(CYCLE + i, {read_counter_csr, write_ignored, 0, 0, 0});
+  }
+
+  // 监管级
+  t.add(SSTATUS, {read_sstatus, write_sstatus, MASK_SSTATUS & ~(MASK_UBE | MASK_XS | MASK_UXL | MASK_SD), 0, 0});
+  t.add(SIE, {read_sie, write_sie, S_INTERRUPTS, 0, 0});
+  plain(STVEC, SLOT_STVEC, TVEC_MASK);
+  plain(SCOUNTEREN, SLOT_SCOUNTEREN, 0xffffffff);
+  plain(SSCRATCH, SLOT_SSCRATCH, ALL);
+  plain(SEPC, SLOT_SEPC, EPC_MASK);
+  plain(SCAUSE, SLOT_SCAUSE, ALL);
+  plain(STVAL, SLOT_STVAL, ALL);
+  t.add(SIP, {read_sip, write_sip, MASK_SSIP, 0, 0});
+  t.add(SATP, {read_slot, write_satp, ALL, 0, SLOT_SATP});
+
+  // 机器级
+  constant(MVENDORID, 0);
+  constant(MARCHID, 0);
+  constant(MIMPID, 0);
+  constant(MHARTID, 0);
+  t.add(MSTATUS, {read_slot, write_mstatus,
+                  MASK_SIE | MASK_MIE | MASK_SPIE | MASK_MPIE | MASK_SPP | MASK_VS | MASK_MPP | MASK_FS | MASK_MPRV |
+                      MASK_SUM | MASK_MXR | MASK_TVM | MASK_TW | MASK_TSR,
+                  0, SLOT_MSTATUS});
+  constant(MISA, MISA_VALUE);
+  // 异常 0 ~ 15 中除了保留的 10、14 和不能委托的 M 模式 ecall（11）
+  plain(MEDELEG, SLOT_MEDELEG, 0xb3ff);
+  t.add(MIDELEG, {read_slot, write_interrupt_slot, S_INTERRUPTS, 0, SLOT_MIDELEG});
+  t.add(MIE, {read_slot, write_interrupt_slot, S_INTERRUPTS | M_INTERRUPTS, 0, SLOT_MIE});
+  plain(MTVEC, SLOT_MTVEC, TVEC_MASK);
+  plain(MCOUNTEREN, SLOT_MCOUNTEREN, 0xffffffff);
+  t.add(MCOUNTINHIBIT, {read_slot, write_inhibit_csr, 0xffffffff & ~0b10ULL, 0, SLOT_MCOUNTINHIBIT});
+  for (size_t i = 0; i < NUM_COUNTERS - 3; ++i) {
+    t.add(MHPMEVENT3 + i, {read_slot, write_event, ALL, 0, static_cast<uint8_t>(SLOT_MHPMEVENT3 + i)});
+  }
+  plain(MSCRATCH, SLOT_MSCRATCH, ALL);
+  plain(MEPC, SLOT_MEPC, EPC_MASK);
+  plain(MCAUSE, SLOT_MCAUSE, ALL);
+  plain(MTVAL, SLOT_MTVAL, ALL);
+  // M 模式的挂起位由设备设置，软件只能写 S 模式的
+  t.add(MIP, {read_slot, write_interrupt_slot, S_INTERRUPTS, 0, SLOT_MIP});
+  // mcycle、minstret 和 mhpmcounter3 ~ 31（0xb01 不存在，time 只有只读的用户级 CSR）
+  for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+    if (i != 1) {
+      t.add(MCYCLE + i, {read_counter_csr, write_counter_csr, ALL, 0, 0});
+    }
+  }
+  return t;
+}();
+
+const Csr::Desc& Csr::describe(size_t addr) {
+  return table.descs[addr < NUM_CSRS ? table.index[addr] : 0];
+}
+
+bool Csr::is_implemented(size_t addr) {
+  return addr < NUM_CSRS && table.index[addr] != 0;
+}
+
+uint64_t Csr::read_slot(const Csr& csr, const Desc& d, size_t) {
+  return csr.regs[d.slot];
+}
+
+void Csr::write_slot(Csr& csr, const Desc& d, size_t, uint64_t value) {
+  csr.regs[d.slot] = value;
+}
+
+uint64_t Csr::read_const(const Csr&, const Desc& d, size_t) {
+  return d.value;
+}
+
+void Csr::write_ignored(Csr&, const Desc&, size_t, uint64_t) {}
+
+// mie、mip、mideleg：影响哪些中断可以响应
+void Csr::write_interrupt_slot(Csr& csr, const Desc& d, size_t, uint64_t value) {
+  csr.regs[d.slot] = value;
+  csr.update_interrupts();
+}
+
+// MPP 不能是保留的 0b10，写入时保持原来的值
+void Csr::write_mstatus(Csr& csr, const Desc&, size_t, uint64_t value) {
+  if ((value & MASK_MPP) == (0b10ULL << 11)) {
+    value = (value & ~MASK_MPP) | (csr.regs[SLOT_MSTATUS] & MASK_MPP);
+  }
+  csr.regs[SLOT_MSTATUS] = value;
+  csr.update_interrupts();
+}
+
+uint64_t Csr::read_sstatus(const Csr& csr, const Desc&, size_t) {
+  return csr.regs[SLOT_MSTATUS] & MASK_SSTATUS;
+}
+
+void Csr::write_sstatus(Csr& csr, const Desc&, size_t, uint64_t value) {
+  csr.regs[SLOT_MSTATUS] = (csr.regs[SLOT_MSTATUS] & ~MASK_SSTATUS) | (value & MASK_SSTATUS);
+  csr.update_interrupts();
+}
+
+uint64_t Csr::read_sie(const Csr& csr, const Desc&, size_t) {
+  return csr.regs[SLOT_MIE] & csr.regs[SLOT_MIDELEG];
+}
+
+void Csr::write_sie(Csr& csr, const Desc&, size_t, uint64_t value) {
+  uint64_t deleg = csr.regs[SLOT_MIDELEG];
+  csr.regs[SLOT_MIE] = (csr.regs[SLOT_MIE] & ~deleg) | (value & deleg);
+  csr.update_interrupts();
+}
+
+uint64_t Csr::read_sip(const Csr& csr, const Desc&, size_t) {
+  return csr.regs[SLOT_MIP] & csr.regs[SLOT_MIDELEG];
+}
+
+void Csr::write_sip(Csr& csr, const Desc&, size_t, uint64_t value) {
+  uint64_t deleg = csr.regs[SLOT_MIDELEG];
+  csr.regs[SLOT_MIP] = (csr.regs[SLOT_MIP] & ~deleg) | (value & deleg);
+  csr.update_interrupts();
+}
+
+// 没有实现分页，只支持 Bare 模式：写入其他模式时整个写操作无效
+void Csr::write_satp(Csr& csr, const Desc&, size_t, uint64_t value) {
+  if ((value >> 60) == 0) {
+    csr.regs[SLOT_SATP] = value;
+  }
+}
+
+// vcsr 由 vxrm 和 vxsat 组成
+uint64_t Csr::read_vcsr(const Csr& csr, const Desc&, size_t) {
+  return (csr.regs[SLOT_VXRM] << 1) | csr.regs[SLOT_VXSAT];
+}
+
+void Csr::write_vcsr(Csr& csr, const Desc&, size_t, uint64_t value) {
+  csr.regs[SLOT_VXSAT] = value & 0b1;
+  csr.regs[SLOT_VXRM] = (value >> 1) & 0b11;
+}
+
+uint64_t Csr::read_counter_csr(const Csr& csr, const Desc&, size_t addr) {
+  return csr.read_counter(addr & (NUM_COUNTERS - 1));
+}
+
+void Csr::write_counter_csr(Csr& csr, const Desc&, size_t addr, uint64_t value) {
+  csr.write_counter(addr & (NUM_COUNTERS - 1), value);
+}
+
+void Csr::write_inhibit_csr(Csr& csr, const Desc&, size_t, uint64_t value) {
+  csr.write_inhibit(value);
+}
+
+// 切换事件时保持计数器当前的值不变
+void Csr::write_event(Csr& csr, const Desc& d, size_t addr, uint64_t value) {
+  size_t index = addr - MHPMEVENT3 + 3;
+  uint64_t current = csr.read_counter(index);
+  csr.regs[d.slot] = value;
+  csr.write_counter(index, current);
+}
+
+uint64_t Csr::access(uint32_t inst, Mode mode, Op op, uint64_t operand, bool write) {
+  size_t addr = inst >> 20;
+  // CSR 编号的 [9:8] 位是能访问它的最低特权级，[11:10] 位为 0b11 表示只读
+  if (!is_implemented(addr) || ((addr >> 8) & 0b11) > mode || (write && (addr >> 10) == 0b11)) {
+    throw Exception(ExceptionType::IllegalInstruction, inst);
+  }
+  // 低特权级读计数器需要 mcounteren（S、U 模式）和 scounteren（U 模式）中对应的位
+  if (addr >= CYCLE && addr < CYCLE + NUM_COUNTERS && mode != Machine) {
+    uint64_t bit = 1ULL << (addr - CYCLE);
+    if (!(regs[SLOT_MCOUNTEREN] & bit) || (mode == User && !(regs[SLOT_SCOUNTEREN] & bit))) {
+      throw Exception(ExceptionType::IllegalInstruction, inst);
+    }
+  }
+
+  const Desc& d = table.descs[table.index[addr]];
+  uint64_t old = d.read(*this, d, addr);
+  if (write) {
+    uint64_t value = op == Op::Write ? operand : op == Op::Set ? old | operand : old & ~operand;
+    d.write(*this, d, addr, (old & ~d.mask) | (value & d.mask));
+  }
+  return old;
+}
 
 // 打印所有的 CSR 寄存器
 void Csr::dump_csrs() const {
@@ -25,35 +244,124 @@ void Csr::dump_csrs() const {
             << "  scause = " << std::setw(18) << load(SCAUSE) << "\n";
 }
 
+// 打印性能计数器
+void Csr::dump_counters(std::ostream& os) const {
+  const char* names[NUM_HPM_EVENTS] = {"none", "loads", "stores", "taken branches", "traps"};
+  os << std::setw(80) << std::setfill('-') << "performance counters" << std::setfill(' ') << "\n";
+  os << std::dec << std::setw(16) << "cycle" << " = " << read_counter(0) << "\n";
+  os << std::setw(16) << "instret" << " = " << read_counter(2) << "\n";
+  for (size_t i = HPM_EVENT_LOAD; i < NUM_HPM_EVENTS; ++i) {
+    os << std::setw(16) << names[i] << " = " << events[i] << "\n";
+  }
+}
+
+uint64_t Csr::host_time() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - boot_time).count() /
+         (1'000'000'000 / TIMEBASE_FREQ);
+}
+
+uint64_t Csr::raw_counter(size_t index) const {
+  switch (index) {
+    case 0:
+    case 2:
+      // 没有流水线模型，每条指令记为一个周期
+      return instret;
+    case 1:
+      return input_log != nullptr ? input_log->time(instret, host_time()) : host_time();
+    default: {
+      uint64_t event = regs[SLOT_MHPMEVENT3 + index - 3];
+      return event < NUM_HPM_EVENTS ? events[event] : 0;
+    }
+  }
+}
+
+uint64_t Csr::read_counter(size_t index) const {
+  if ((regs[SLOT_MCOUNTINHIBIT] >> index) & 1) {
+    return counter_frozen[index];
+  }
+  return raw_counter(index) - counter_offsets[index];
+}
+
+void Csr::write_counter(size_t index, uint64_t value) {
+  if ((regs[SLOT_MCOUNTINHIBIT] >> index) & 1) {
+    counter_frozen[index] = value;
+  } else {
+    counter_offsets[index] = raw_counter(index) - value;
+  }
+}
+
+// 被禁止的计数器冻结当前值，重新使能时从冻结值继续计数。time 不受 mcountinhibit 控制
+void Csr::write_inhibit(uint64_t value) {
+  value &= ~0b10ULL;
+  for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+    uint64_t old_bit = (regs[SLOT_MCOUNTINHIBIT] >> i) & 1;
+    uint64_t new_bit = (value >> i) & 1;
+    if (old_bit == 0 && new_bit == 1) {
+      counter_frozen[i] = read_counter(i);
+    } else if (old_bit == 1 && new_bit == 0) {
+      counter_offsets[i] = raw_counter(i) - counter_frozen[i];
+    }
+  }
+  regs[SLOT_MCOUNTINHIBIT] = value;
+}
+
+void Csr::set_interrupt_line(uint64_t mask, bool level) {
+  uint64_t mip = level ? regs[SLOT_MIP] | mask : regs[SLOT_MIP] & ~mask;
+  if (mip != regs[SLOT_MIP]) {
+    regs[SLOT_MIP] = mip;
+    update_interrupts();
+  }
+}
+
+// 没有委托的中断交给 M 模式：低于 M 模式时总是响应，M 模式下由 mstatus.MIE 控制。
+// 委托的中断交给 S 模式：M 模式下不响应，U 模式下总是响应，S 模式下由 mstatus.SIE 控制
+uint64_t Csr::enabled_interrupts(Mode mode) const {
+  uint64_t pending = regs[SLOT_MIP] & regs[SLOT_MIE];
+  uint64_t deleg = regs[SLOT_MIDELEG];
+  uint64_t status = regs[SLOT_MSTATUS];
+  uint64_t enabled = 0;
+  if (mode < Machine || (status & MASK_MIE)) {
+    enabled |= pending & ~deleg;
+  }
+  if (mode == User || (mode == Supervisor && (status & MASK_SIE))) {
+    enabled |= pending & deleg;
+  }
+  return enabled;
+}
+
+void Csr::update_interrupts() {
+  deliverable = 0;
+  for (Mode mode : {User, Supervisor, Machine}) {
+    if (enabled_interrupts(mode) != 0) {
+      deliverable |= 1 << mode;
+    }
+  }
+}
+
+// 交给 M 模式的中断优先于交给 S 模式的，同一级中按外部、软件、定时器的顺序
+std::optional<uint64_t> Csr::pending_interrupt(Mode mode) const {
+  uint64_t enabled = enabled_interrupts(mode);
+  uint64_t deleg = regs[SLOT_MIDELEG];
+  for (uint64_t candidates : {enabled & ~deleg, enabled & deleg}) {
+    for (uint64_t code : {11, 3, 7, 9, 1, 5}) {
+      if ((candidates >> code) & 1) {
+        return code;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
 // 从 CSR 寄存器指定的位置中加载值
 uint64_t Csr::load(size_t addr) const {
-  switch (addr) {
-    case SIE:
-      return csrs[MIE] & csrs[MIDELEG];
-    case SIP:
-      return csrs[MIP] & csrs[MIDELEG];
-    case SSTATUS:
-      return csrs[MSTATUS] & MASK_SSTATUS;
-    default:
-      return csrs[addr];
-  }
+  const Desc& d = describe(addr);
+  return d.read(*this, d, addr);
 }
 
 // 将 value 存放到 CSR 寄存器指定的位置中
 void Csr::store(size_t addr, uint64_t value) {
-  switch (addr) {
-    case SIE:
-      csrs[MIE] = (csrs[MIE] & ~csrs[MIDELEG]) | (value & csrs[MIDELEG]);
-    break;
-    case SIP:
-      csrs[MIP] = (csrs[MIE] & ~csrs[MIDELEG]) | (value & csrs[MIDELEG]);
-    break;
-    case SSTATUS:
-      csrs[MSTATUS] = (csrs[MSTATUS] & ~MASK_SSTATUS) | (value & MASK_SSTATUS);
-    break;
-    default:
-      csrs[addr] = value;
-  }
+  const Desc& d = describe(addr);
+  d.write(*this, d, addr, value);
 }
 
 // 这个函数的目的是检查 MEDELEG 寄存器中的某一位是否被设置。
@@ -62,7 +370,7 @@ void Csr::store(size_t addr, uint64_t value) {
 // 对应的中断就被委托给了 S-mode。这个函数就是用来检查这种委
 // 托状态的。
 bool Csr::is_medelegated(uint64_t val) const {
-  return (csrs[MEDELEG] >> val & 1) == 1;
+  return (regs[SLOT_MEDELEG] >> val & 1) == 1;
 }
 
 // 这个函数的目的是检查 MIDELEG 寄存器中的某一位是否被设置。
@@ -71,7 +379,30 @@ bool Csr::is_medelegated(uint64_t val) const {
 // 那么对应的中断就被委托给了 S-mode。这个函数就是用来检查这种
 // 委托状态的。
 bool Csr::is_midelegated(uint64_t cause) const {
-  return (csrs[MIDELEG] >> cause & 1) == 1;
+  return (regs[SLOT_MIDELEG] >> cause & 1) == 1;
+}
+
+// time 以相对于 boot_time 的原始计数保存，恢复时平移 boot_time，使 time 从快照时的值继续增长。
+// 保存不是客户机的读取，直接取宿主机时间，录制时不产生事件，回放时也不消耗事件
+void Csr::save(std::ostream& os) const {
+  write_pod(os, regs.data(), regs.size());
+  write_pod(os, instret);
+  write_pod(os, events.data(), events.size());
+  write_pod(os, counter_offsets.data(), counter_offsets.size());
+  write_pod(os, counter_frozen.data(), counter_frozen.size());
+  write_pod(os, host_time());
 }
 
-}
\ No newline at end of file
+void Csr::restore(std::istream& is) {
+  read_pod(is, regs.data(), regs.size());
+  read_pod(is, instret);
+  read_pod(is, events.data(), events.size());
+  read_pod(is, counter_offsets.data(), counter_offsets.size());
+  read_pod(is, counter_frozen.data(), counter_frozen.size());
+  uint64_t time;
+  read_pod(is, time);
+  boot_time = std::chrono::steady_clock::now() - std::chrono::nanoseconds(time * (1'000'000'000 / TIMEBASE_FREQ));
+  update_interrupts();
+}
+
+}
@@ -6,21 +6,126 @@
 #include <iostream>
 #include <iomanip>
 #include <array>
+#include <chrono>
+#include <optional>
 #include "param.h"
 
 namespace cemu {
 
+class InputLog;
+
+// 控制和状态寄存器。只为实现了的 CSR 分配存储（见 CsrSlot），CSR 编号到存储位置和读写函数的映射
+// 是编译期生成的表，CSR 指令访问时查一次表，再经过一次间接调用完成读写。
+//
+// load / store 供模拟器内部使用（陷入处理、xRET、向量指令、调试器和快照等），不做权限检查，
+// 未实现的 CSR 读为 0、写入被忽略。CSR 指令通过 access 访问，它会检查特权级、只读位和计数器使能，
+// 并只写入 WARL 掩码允许的位。
 class Csr {
 public:
   Csr();  // 构造函数
   void dump_csrs() const;  // 打印所有的CSR
+  void dump_counters(std::ostream& os) const;  // 打印性能计数器
   uint64_t load(size_t addr) const;  // 加载指定地址的CSR
   void store(size_t addr, uint64_t value);  // 存储值到指定地址的CSR
+
+  // CSR 指令的三种写法：csrrw、csrrs、csrrc（及其立即数形式）
+  enum class Op { Write, Set, Clear };
+
+  // 执行一条 CSR 指令：返回 CSR 的旧值。write 为 false 时只读不写（csrrs / csrrc 的源操作数为 x0 或立即数 0），
+  // 否则按 op 把 operand 写入 CSR。CSR 未实现、mode 下无权访问、写只读 CSR 或计数器未使能时
+  // 抛出非法指令异常，异常值为 inst
+  uint64_t access(uint32_t inst, Mode mode, Op op, uint64_t operand, bool write);
+
+  // addr 是否是实现了的 CSR
+  static bool is_implemented(size_t addr);
+
+  // 中断。mip、mie、mideleg 和 mstatus 的 MIE / SIE 位改变时（CSR 写入、陷入和 xRET 都经过它们）
+  // 重新计算每个特权级下是否有可以响应的中断，执行引擎在块边界只需检查一个字节。
+  // 特权级的切换不需要重新计算：缓存中每个特权级各占一位
+
+  // 设备的中断线：把 mip 中 mask 对应的位置为 level，可以设置软件不能写的 MSIP、MTIP、MEIP
+  void set_interrupt_line(uint64_t mask, bool level);
+
+  // 在特权级 mode 下是否有可以响应的中断
+  [[nodiscard]] bool interrupt_deliverable(Mode mode) const {
+    return (deliverable >> mode) & 1;
+  }
+
+  // 在特权级 mode 下应当响应的中断号，按 MEI、MSI、MTI、SEI、SSI、STI 的优先级选择；没有时返回 std::nullopt
+  std::optional<uint64_t> pending_interrupt(Mode mode) const;
+
   bool is_medelegated(uint64_t cause) const;  // 检查是否有机器异常委托
   bool is_midelegated(uint64_t cause) const;  // 检查是否有机器中断委托
+  void save(std::ostream& os) const;  // 保存所有 CSR 和计数器状态，用于快照
+  void restore(std::istream& is);  // 从快照恢复
+
+  // 由执行引擎按块累加的原始计数。计数器 CSR 的值由它们和偏移量推算得到，
+  // 因此执行指令时不需要逐条更新 CSR。
+  uint64_t instret = 0;  // 退休的指令数
+  std::array<uint64_t, NUM_HPM_EVENTS> events{};  // 各类事件的次数，以 HPM_EVENT_* 为下标
+
+  // 非空时 time 的读取经过输入日志录制或回放
+  InputLog* input_log = nullptr;
 
 private:
-  std::array<uint64_t, NUM_CSRS> csrs;  // 存储CSR的数组
+  // 一个 CSR 的描述：读写函数、CSR 指令可写的位和存储位置
+  struct Desc {
+    uint64_t (*read)(const Csr&, const Desc&, size_t addr);
+    void (*write)(Csr&, const Desc&, size_t addr, uint64_t value);
+    uint64_t mask;   // CSR 指令可写的位（WARL），其余位保持原值
+    uint64_t value;  // 只读常量 CSR 的值
+    uint8_t slot;    // 在 regs 中的下标，视图和计数器不使用
+  };
+
+  // 有独立存储的 CSR。sstatus、sie、sip、vcsr 是其他 CSR 的视图，计数器由 instret 和 events 推算，都不占位置
+  enum CsrSlot : uint8_t {
+    SLOT_VSTART, SLOT_VXSAT, SLOT_VXRM, SLOT_VL, SLOT_VTYPE,
+    SLOT_STVEC, SLOT_SCOUNTEREN, SLOT_SSCRATCH, SLOT_SEPC, SLOT_SCAUSE, SLOT_STVAL, SLOT_SATP,
+    SLOT_MSTATUS, SLOT_MEDELEG, SLOT_MIDELEG, SLOT_MIE, SLOT_MTVEC, SLOT_MCOUNTEREN, SLOT_MCOUNTINHIBIT,
+    SLOT_MSCRATCH, SLOT_MEPC, SLOT_MCAUSE, SLOT_MTVAL, SLOT_MIP,
+    SLOT_MHPMEVENT3,  // 至 mhpmevent31
+    NUM_CSR_SLOTS = SLOT_MHPMEVENT3 + NUM_COUNTERS - 3,
+  };
+
+  struct Table;
+  static const Table table;
+  static const Desc& describe(size_t addr);
+
+  // 各类 CSR 的读写函数
+  static uint64_t read_slot(const Csr& csr, const Desc& d, size_t addr);
+  static void write_slot(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_const(const Csr& csr, const Desc& d, size_t addr);
+  static void write_ignored(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static void write_interrupt_slot(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static void write_mstatus(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_sstatus(const Csr& csr, const Desc& d, size_t addr);
+  static void write_sstatus(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_sie(const Csr& csr, const Desc& d, size_t addr);
+  static void write_sie(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_sip(const Csr& csr, const Desc& d, size_t addr);
+  static void write_sip(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static void write_satp(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_vcsr(const Csr& csr, const Desc& d, size_t addr);
+  static void write_vcsr(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static uint64_t read_counter_csr(const Csr& csr, const Desc& d, size_t addr);
+  static void write_counter_csr(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static void write_inhibit_csr(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+  static void write_event(Csr& csr, const Desc& d, size_t addr, uint64_t value);
+
+  void update_interrupts();  // 重新计算 deliverable
+  uint64_t enabled_interrupts(Mode mode) const;  // 在 mode 下挂起且可以响应的中断
+
+  uint64_t host_time() const;  // 自 boot_time 起的宿主机时间，以 time CSR 的计数为单位，不经过 input_log
+  uint64_t raw_counter(size_t index) const;  // 计数器 index 对应的原始计数
+  uint64_t read_counter(size_t index) const;  // 读计数器 index（0 = cycle, 1 = time, 2 = instret, 3 ~ 31 = hpmcounter）
+  void write_counter(size_t index, uint64_t value);  // 写计数器 index
+  void write_inhibit(uint64_t value);  // 写 mcountinhibit
+
+  std::array<uint64_t, NUM_CSR_SLOTS> regs{};  // 实现了的 CSR 的存储，以 CsrSlot 为下标
+  std::array<uint64_t, NUM_COUNTERS> counter_offsets{};  // 计数器值 = 原始计数 - 偏移量
+  std::array<uint64_t, NUM_COUNTERS> counter_frozen{};  // 被 mcountinhibit 禁止时保持的值
+  std::chrono::steady_clock::time_point boot_time;  // time CSR 的零点
+  uint8_t deliverable = 0;  // 第 mode 位表示在特权级 mode 下有可以响应的中断
 };
 
 }
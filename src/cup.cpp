@@ -3,25 +3,53 @@
 //
 
 // Cpu.cpp
+#include <algorithm>
 #include <iostream>
 #include <iomanip> // 用于格式化输出
+#include <limits>
 #include <optional>
 #include "cup.h"
 #include "instructions.h"
 #include "log.h"
+#include "threaded.h"
 
 namespace cemu {
 
+void Cpu::reset(const std::vector<uint8_t>& code) {
+  pc = DRAM_BASE;
+  exit_code.reset();
+  stop_requested = false;
+  regs.fill(0);
+  regs[2] = DRAM_END;
+  vregs.fill(0);
+  mode = Machine;
+  bus.reset(code);
+  csr = Csr();
+  csr.input_log = input_log;
+  blocks.flush();
+  accounting = Accounting();
+}
+
 std::optional<uint64_t> Cpu::load(uint64_t addr, uint64_t size) {
   return bus.load(addr, size);
 }
 
 bool Cpu::store(uint64_t addr, uint64_t size, uint64_t value) {
-  return bus.store(addr, size, value);
+  bool ok = bus.store(addr, size, value);
+  blocks.invalidate(addr, size / 8);
+  if (htif != nullptr && addr == htif->tohost) [[unlikely]] {
+    htif->write_tohost(*this);
+  }
+  return ok;
 }
 
 std::optional<uint32_t> Cpu::fetch() {
-  auto inst = bus.load(pc, 32);
+  std::optional<uint64_t> inst;
+  try {
+    inst = bus.load(pc, 32);
+  } catch (const Exception&) {
+    // 总线报告的是读访存错误，取指时应为取指错误，与 BlockCache::build 一致
+  }
   if (inst.has_value()) {
     LOG(INFO, "Instruction fetched: ", std::hex, inst.value(), std::dec);
     return inst.value();
@@ -38,6 +66,131 @@ std::optional<uint64_t>  Cpu::execute(uint32_t inst) {
   throw Exception(ExceptionType::IllegalInstruction, pc);
 }
 
+uint64_t Cpu::run(uint64_t max_insts) {
+  stopped = false;
+  resume_pc = pc;
+  if (sampler == nullptr && input_log == nullptr) {
+    return run_blocks(max_insts);
+  }
+  // 把执行切成到下一个采样点或输入事件为止的若干段，采样和输入交付只发生在段之间
+  uint64_t done = 0;
+  while (done < max_insts) {
+    uint64_t n = max_insts - done;
+    if (sampler != nullptr) {
+      n = std::min(n, sampler->remaining(csr.instret));
+    }
+    if (input_log != nullptr) {
+      n = std::min(n, input_log->remaining(csr.instret));
+    }
+    done += run_blocks(n);
+    if (sampler != nullptr && sampler->remaining(csr.instret) == 0) {
+      sampler->sample(*this);
+    }
+    if (input_log != nullptr && input_log->remaining(csr.instret) == 0) {
+      input_log->poll(*this);
+    }
+    if (stopped) {
+      break;
+    }
+  }
+  return done;
+}
+
+uint64_t Cpu::run_blocks(uint64_t max_insts) {
+  uint64_t start = csr.instret;
+  while (csr.instret - start < max_insts) {
+    if (blocks.sync()) {
+      // 上一个块中的写指令命中了观察点
+      stopped = true;
+      break;
+    }
+    // 中断只在块边界响应。能改变中断状态的 CSR 写入和 xRET 都单独成块，陷入也发生在块边界，因此这里是精确的
+    if (csr.interrupt_deliverable(mode)) [[unlikely]] {
+      take_interrupt();
+      continue;
+    }
+    Block* found;
+    try {
+      found = &blocks.lookup(bus, pc);
+    } catch (const Exception& e) {
+      // 块的第一条指令取指失败，与执行中的异常一样交给 handle_exception
+      handle_exception(e);
+      if (e.isFatal()) {
+        throw;
+      }
+      continue;
+    }
+    Block& block = *found;
+    // 从断点处继续运行时先执行断点处的块，之后再遇到断点才停止
+    if (block.breakpoint) [[unlikely]] {
+      if (block.pc != resume_pc) {
+        stopped = true;
+        break;
+      }
+      resume_pc = std::numeric_limits<uint64_t>::max();
+    }
+    run_block(block, std::min<uint64_t>(block.insts.size(), max_insts - (csr.instret - start)));
+    if (stop_requested) [[unlikely]] {
+      stop_requested = false;
+      stopped = true;
+      break;
+    }
+  }
+  return csr.instret - start;
+}
+
+void Cpu::run_block(Block& block, uint64_t n) {
+  uint64_t i = 0;
+  try {
+    if (threaded && n == block.insts.size()) {
+      run_threaded(*this, block, i);
+      i = n;
+    }
+    for (; i < n; ++i) {
+      const DecodedInst& d = block.insts[i];
+      auto next = d.fn(*this, d.inst);
+      if (!next.has_value()) {
+        throw Exception(ExceptionType::IllegalInstruction, d.inst);
+      }
+      pc = next.value();
+    }
+  } catch (const Exception& e) {
+    // 出错的指令不退休，pc 仍指向它
+    retire(block, i);
+    handle_exception(e);
+    if (e.isFatal()) {
+      throw;
+    }
+    return;
+  }
+  retire(block, n);
+  if (n == block.insts.size() && block.ends_in_branch && pc != block.fallthrough()) {
+    ++csr.events[HPM_EVENT_TAKEN_BRANCH];
+  }
+}
+
+void Cpu::retire(Block& block, uint64_t n) {
+  csr.instret += n;
+  if (n == block.insts.size()) {
+    ++block.exec_count;
+    csr.events[HPM_EVENT_LOAD] += block.loads;
+    csr.events[HPM_EVENT_STORE] += block.stores;
+    return;
+  }
+  if (block.partial_counts.empty()) {
+    block.partial_counts.resize(block.insts.size(), 0);
+  }
+  ++block.partial_counts[n];
+  // 块没有执行完（异常或指令数用尽），逐条统计已退休的部分
+  for (uint64_t i = 0; i < n; ++i) {
+    if (is_load_inst(block.insts[i].inst)) {
+      ++csr.events[HPM_EVENT_LOAD];
+    } else if (is_store_inst(block.insts[i].inst)) {
+      ++csr.events[HPM_EVENT_STORE];
+    }
+  }
+}
+
 void Cpu::dump_registers() {
   LOG(INFO, "Dumping register state:");
 
@@ -98,14 +251,30 @@ std::optional<uint64_t> Cpu::getRegValueByName(const std::string& name) {
 }
 
 void Cpu::handle_exception(const Exception& e) {
-  uint64_t pc = this->pc;   // 保存当前 PC 寄存器的值
-  Mode mode = this->mode;   // 保存当前模式
   uint64_t cause = static_cast<uint64_t>(e.getType()); // 获取异常原因
-
+  ++csr.events[HPM_EVENT_TRAP];
+  if (trap_hook) {
+    trap_hook(e);
+  }
   // 是否在 S 模式下陷入
-  bool trap_in_s_mode = mode <= Supervisor && csr.is_medelegated(cause);
-  uint64_t STATUS, TVEC, CAUSE, TVAL, EPC, MASK_PIE, pie_i, MASK_IE, ie_i, MASK_PP, pp_i;
+  enter_trap(cause, e.getValue(), mode <= Supervisor && csr.is_medelegated(cause));
+}
 
+bool Cpu::take_interrupt() {
+  auto code = csr.pending_interrupt(mode);
+  if (!code.has_value()) {
+    return false;
+  }
+  ++csr.events[HPM_EVENT_TRAP];
+  // pending_interrupt 只在 S 或 U 模式下返回委托的中断
+  enter_trap(INTERRUPT_BIT | code.value(), 0, csr.is_midelegated(code.value()));
+  return true;
+}
+
+void Cpu::enter_trap(uint64_t cause, uint64_t tval, bool trap_in_s_mode) {
+  uint64_t pc = this->pc;   // 保存当前 PC 寄存器的值
+  Mode mode = this->mode;   // 保存当前模式
+  uint64_t STATUS, TVEC, CAUSE, TVAL, EPC, MASK_PIE, pie_i, MASK_IE, ie_i, MASK_PP, pp_i;
   // 根据是否在 S 模式下陷入，设置不同的寄存器
   if (trap_in_s_mode) {
     this->mode = Supervisor;
@@ -138,7 +307,12 @@ void Cpu::handle_exception(const Exception& e) {
   // 将程序计数器（PC）设置为异常向量表（TVEC）寄存器的值。
   // 这是因为在 RISC-V 架构中，当发生异常时，CPU 会跳转到
   // TVEC 寄存器指定的地址开始执行异常处理程序。
-  this->pc = csr.load(TVEC) & ~0b11;
+  // 向量模式（MODE = 1）下中断跳转到 BASE + 4 * 中断号
+  uint64_t tvec = csr.load(TVEC);
+  this->pc = tvec & ~0b11;
+  if ((cause & INTERRUPT_BIT) && (tvec & 0b1)) {
+    this->pc += 4 * (cause & ~INTERRUPT_BIT);
+  }
 
   // 将当前的 PC 寄存器的值保存到异常程序计数器（EPC）寄存器中。
   // 这是为了在异常处理程序执行完毕后，可以通过 EPC 寄存器恢复
@@ -148,7 +322,7 @@ void Cpu::handle_exception(const Exception& e) {
   //  这两行代码将异常的原因和值保存到 CAUSE 和 TVAL 寄存器中。
   //  这是为了在异常处理程序中可以获取到这些信息，以便进行相应的处理
   csr.store(CAUSE, cause);
-  csr.store(TVAL, e.getValue());
+  csr.store(TVAL, tval);
 
   //  读取当前的状态寄存器（STATUS）的值。
   uint64_t status = csr.load(STATUS);
@@ -163,6 +337,8 @@ void Cpu::handle_exception(const Exception& e) {
   // 将状态寄存器（STATUS）的值保存回 CSR 中。
   csr.store(STATUS, status);
 
+  accounting.trap(cause, this->mode, csr.instret);
+
 }
 
 }
\ No newline at end of file
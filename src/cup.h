@@ -7,13 +7,20 @@
 
 #include <array>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "accounting.h"
+#include "block.h"
 #include "bus.h"
 #include "csr.h"
 #include "exception.h"
+#include "htif.h"
+#include "replay.h"
+#include "sampler.h"
+#include "usermode.h"
 
 namespace cemu {
 
@@ -26,12 +33,42 @@ public:
   // RISC-V 有 32 个寄存器
   std::array<uint64_t, 32> regs{};
 
+  // 32 个向量寄存器，连续存放，寄存器组（LMUL > 1）即相邻的若干个寄存器
+  alignas(32) std::array<uint8_t, 32 * VLEN_BYTES> vregs{};
+
   Bus bus;
   Mode mode;
 
   // 控制和状态寄存器。RISC-V ISA为最多4096个CSR预留了一个12位的编码空间（csr[11:0]）。
   Csr csr;
 
+  // 预解码的基本块缓存，由 run() 使用
+  BlockCache blocks;
+
+  // 按特权级和陷入原因的执行时间统计
+  Accounting accounting;
+
+  // 非空时 run() 每退休 sampler 指定数量的指令采样一次调用栈
+  Sampler* sampler = nullptr;
+
+  // 非空时录制或回放外部输入，见 attach_input_log
+  InputLog* input_log = nullptr;
+
+  // 非空时处理客户机通过 tohost 和半主机调用发出的请求
+  Htif* htif = nullptr;
+
+  // 非空时 U 模式的 ecall 由 usermode 直接在宿主机上完成，见 UserMode
+  UserMode* usermode = nullptr;
+
+  // 整块执行时使用直接线索化解释器（见 threaded.h）；为 false 时逐条调用块中的执行函数
+  bool threaded = true;
+
+  // 每次陷入时（在 handle_exception 更新完状态之后）调用
+  std::function<void(const Exception&)> trap_hook;
+
+  // 客户机请求退出时的返回值，见 exit()
+  std::optional<uint64_t> exit_code;
+
   Cpu(const std::vector<uint8_t>& code)
       : pc(DRAM_BASE),
         bus(code),
@@ -42,6 +79,9 @@ public:
       mode = Machine;
   }
 
+  // 把机器恢复到用 code 刚构造时的状态，复用已分配的 DRAM，用于连续运行多个程序
+  void reset(const std::vector<uint8_t>& code);
+
   std::optional<uint64_t> load(uint64_t addr, uint64_t size);
 
   bool store(uint64_t addr, uint64_t size, uint64_t value);
@@ -52,8 +92,35 @@ public:
     return pc + 4;
   }
 
+  // 第 i 个向量寄存器的起始地址
+  inline uint8_t* vreg(size_t i) {
+    return vregs.data() + i * VLEN_BYTES;
+  }
+
   std::optional<uint64_t> execute(uint32_t inst);
 
+  // 以基本块为单位执行至多 max_insts 条指令，返回实际退休的指令数。
+  // 非致命异常在内部交给 handle_exception 处理；致命异常处理后继续向外抛出。
+  // 到达断点（见 BlockCache::add_breakpoint）、命中观察点或调用 request_stop() 后在块边界提前返回。
+  uint64_t run(uint64_t max_insts);
+
+  // 让 run() 在当前块执行完后返回，可以在指令或回调中调用
+  void request_stop() {
+    stop_requested = true;
+  }
+
+  // 客户机退出：记录返回值并停止执行
+  void exit(uint64_t code) {
+    exit_code = code;
+    request_stop();
+  }
+
+  // 录制或回放外部输入：串口字节由 run() 在确定的 instret 处交付，time CSR 的读取也经过日志
+  void attach_input_log(InputLog* log) {
+    input_log = log;
+    csr.input_log = log;
+  }
+
   void dump_registers();
 
   void dump_pc() const;
@@ -62,7 +129,32 @@ public:
 
   void handle_exception(const Exception& e);
 
+  // 若当前特权级下有可以响应的中断，按优先级陷入其中一个并返回 true。run() 在块边界调用；
+  // 是否有中断由 Csr 缓存，mode 改变时不需要通知（见 Csr::interrupt_deliverable）。中断不经过 trap_hook
+  bool take_interrupt();
+
+  // 上一次 run() 是否因为断点、观察点或 request_stop() 提前返回
+  [[nodiscard]] bool stopped_early() const {
+    return stopped;
+  }
+
 private:
+  bool stop_requested = false;
+  bool stopped = false;
+  uint64_t resume_pc = 0;  // run() 开始时的 pc，在这里的断点不会使本次运行立即停止
+
+  // 不考虑采样，以基本块为单位执行至多 max_insts 条指令
+  uint64_t run_blocks(uint64_t max_insts);
+
+  // 执行块的前 n 条指令
+  void run_block(Block& block, uint64_t n);
+
+  // 陷入 M 模式或 S 模式（trap_in_s_mode）：保存 pc、原因和特权级，跳转到 xtvec
+  void enter_trap(uint64_t cause, uint64_t tval, bool trap_in_s_mode);
+
+  // 记录块的前 n 条指令已经退休，更新 instret、事件计数和块的执行计数
+  void retire(Block& block, uint64_t n);
+
   // 在类外初始化静态成员
   const std::array<std::string, 32> RVABI = {
     "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
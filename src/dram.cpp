@@ -1,5 +1,10 @@
 // Dram.cpp
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
 #include "dram.h"
 #include "param.h"
 #include "log.h"
@@ -7,10 +12,104 @@
 
 namespace cemu {
 
-Dram::Dram(const std::vector<uint8_t>& code) {
-  dram.resize(DRAM_SIZE, 0); // Initialize DRAM with 0s
-  // Copy code into dram
-  std::copy(code.begin(), code.end(), dram.begin());
+namespace {
+
+uint8_t* map_anonymous(void* addr, int flags) {
+  void* p = mmap(addr, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  if (p == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  return static_cast<uint8_t*>(p);
+}
+
+}  // namespace
+
+Dram::Dram() : dram(map_anonymous(nullptr, 0)), dirty(DRAM_SIZE >> PAGE_SHIFT, 0) {}
+
+Dram::Dram(const std::vector<uint8_t>& code) : Dram() {
+  // 匿名映射的内容已经是 0，只需拷贝代码
+  load_code(code);
+}
+
+Dram::~Dram() {
+  if (dram != nullptr) {
+    munmap(dram, DRAM_SIZE);
+  }
+}
+
+Dram::Dram(Dram&& other) noexcept : dram(std::exchange(other.dram, nullptr)), dirty(std::move(other.dirty)) {}
+
+Dram& Dram::operator=(Dram&& other) noexcept {
+  if (this != &other) {
+    if (dram != nullptr) {
+      munmap(dram, DRAM_SIZE);
+    }
+    dram = std::exchange(other.dram, nullptr);
+    dirty = std::move(other.dirty);
+  }
+  return *this;
+}
+
+void Dram::load_code(const std::vector<uint8_t>& code) {
+  size_t len = std::min(code.size(), DRAM_SIZE);
+  std::copy(code.begin(), code.begin() + len, dram);
+  if (len != 0) {
+    mark_dirty(DRAM_BASE, len);
+  }
+}
+
+void Dram::reset(const std::vector<uint8_t>& code) {
+  size_t used = std::count_if(dirty.begin(), dirty.end(), [](uint8_t flags) { return flags & USED_PAGE; });
+  // 用过的页较多时，重新映射比逐页清零更快
+  if (used > dirty.size() / 8) {
+    clear();
+  } else {
+    for (size_t i = 0; i < dirty.size(); ++i) {
+      if (dirty[i] & USED_PAGE) {
+        std::memset(dram + (i << PAGE_SHIFT), 0, PAGE_SIZE);
+      }
+    }
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+  load_code(code);
+}
+
+std::vector<uint32_t> Dram::dirty_pages() const {
+  std::vector<uint32_t> pages;
+  for (size_t i = 0; i < dirty.size(); ++i) {
+    if (dirty[i] & DIRTY_PAGE) {
+      pages.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  return pages;
+}
+
+void Dram::clear_dirty() {
+  for (uint8_t& flags : dirty) {
+    flags &= ~DIRTY_PAGE;
+  }
+}
+
+void Dram::clear() {
+  // 在原地址上重新映射匿名内存，旧的页（包括映射进来的文件页）全部丢弃
+  map_anonymous(dram, MAP_FIXED);
+  for (uint8_t& flags : dirty) {
+    flags &= ~USED_PAGE;
+  }
+}
+
+bool Dram::map_file(int fd, uint64_t offset, uint64_t index, uint64_t len) {
+  if (index + len > DRAM_SIZE) {
+    return false;
+  }
+  void* p = mmap(dram + index, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, static_cast<off_t>(offset));
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  for (uint64_t page = index >> PAGE_SHIFT; page < (index + len) >> PAGE_SHIFT; ++page) {
+    dirty[page] |= USED_PAGE;
+  }
+  return true;
 }
 
 std::optional<uint64_t> Dram::load(uint64_t addr, uint64_t size) {
@@ -19,7 +118,7 @@ std::optional<uint64_t> Dram::load(uint64_t addr, uint64_t size) {
   }
   uint64_t nbytes = size / 8;
   std::size_t index = (addr - DRAM_BASE);
-  if (index + nbytes > dram.size()) {
+  if (index + nbytes > DRAM_SIZE) {
     throw Exception(ExceptionType::LoadAccessFault, addr);
   }
 
@@ -39,16 +138,33 @@ bool Dram::store(uint64_t addr, uint64_t size, uint64_t value) {
 
   uint64_t nbytes = size / 8;
   std::size_t index = (addr - DRAM_BASE);
-  if (index + nbytes > dram.size()) {
+  if (index + nbytes > DRAM_SIZE) {
     throw Exception(ExceptionType::StoreAMOAccessFault, addr);
   }
 
   for (uint64_t i = 0; i < nbytes; ++i) {
     dram[index + i] = (value >> (i * 8)) & 0xFF;
   }
+  dirty[index >> PAGE_SHIFT] = DIRTY_PAGE | USED_PAGE;
+  dirty[(index + nbytes - 1) >> PAGE_SHIFT] = DIRTY_PAGE | USED_PAGE;
 
   LOG(INFO, "DRAM store successful. Value: ", value, " at address ", std::hex, addr, " with size ", size, " bytes.");
   return true;
 }
 
+uint8_t* Dram::host_ptr(uint64_t addr, uint64_t len) {
+  std::size_t index = (addr - DRAM_BASE);
+  // len 来自客户机时可能很大，不能用 index + len 比较，否则会回绕
+  if (addr < DRAM_BASE || index > DRAM_SIZE || len > DRAM_SIZE - index) {
+    return nullptr;
+  }
+  // 调用者可能通过指针写入而不标记脏页，reset 时这些页也要清零
+  if (len != 0) {
+    for (uint64_t page = index >> PAGE_SHIFT; page <= (index + len - 1) >> PAGE_SHIFT; ++page) {
+      dirty[page] |= USED_PAGE;
+    }
+  }
+  return dram + index;
+}
+
 }
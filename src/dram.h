@@ -4,17 +4,67 @@
 #include <vector>
 #include <cstdint>
 #include <optional>
+#include "param.h"
 
 namespace cemu {
+// DRAM 用匿名 mmap 分配：未访问的页不占用宿主机内存，并且可以把快照文件按写时复制的方式直接映射进来
 class Dram {
 public:
   Dram();
   Dram(const std::vector<uint8_t>& code);
+  ~Dram();
+
+  Dram(Dram&& other) noexcept;
+  Dram& operator=(Dram&& other) noexcept;
+  Dram(const Dram&) = delete;
+  Dram& operator=(const Dram&) = delete;
 
   std::optional<uint64_t> load(uint64_t addr, uint64_t size);
   bool store(uint64_t addr, uint64_t size, uint64_t value);
 
+  // 返回 [addr, addr + len) 对应的宿主机内存，越界时返回 nullptr，供批量访问（如向量访存）直接拷贝。
+  // 通过它写入时需要调用 mark_dirty
+  uint8_t* host_ptr(uint64_t addr, uint64_t len);
+
+  // 脏页跟踪：记录自上次 clear_dirty 以来被写过的页，用于增量检查点
+  static constexpr uint64_t PAGE_SHIFT = 12;
+  static constexpr uint64_t PAGE_SIZE = 1 << PAGE_SHIFT;
+
+  // 把 [addr, addr + len) 所在的页标记为脏，addr 必须在 DRAM 范围内
+  inline void mark_dirty(uint64_t addr, uint64_t len) {
+    if (len == 0) {
+      return;
+    }
+    uint64_t index = addr - DRAM_BASE;
+    for (uint64_t page = index >> PAGE_SHIFT; page <= (index + len - 1) >> PAGE_SHIFT; ++page) {
+      dirty[page] = DIRTY_PAGE | USED_PAGE;
+    }
+  }
+
+  // 按页号升序返回所有脏页
+  [[nodiscard]] std::vector<uint32_t> dirty_pages() const;
+
+  void clear_dirty();
+
+  // 丢弃所有内容，恢复为全零
+  void clear();
+
+  // 清空后放入新的代码，复用已分配的地址空间。只用过少量页时只把这些页清零，
+  // 不重新映射整个 DRAM，之后访问它们也不会再缺页，适合反复运行很短的程序（如模糊测试）
+  void reset(const std::vector<uint8_t>& code);
+
+  // 把文件 fd 中 [offset, offset + len) 以写时复制的方式映射到 DRAM 偏移 index 处。
+  // offset、index 和 len 都必须按宿主机页对齐，失败时返回 false
+  bool map_file(int fd, uint64_t offset, uint64_t index, uint64_t len);
+
 private:
-  std::vector<uint8_t> dram;
+  void load_code(const std::vector<uint8_t>& code);
+
+  // dirty 中每页的标记
+  static constexpr uint8_t DIRTY_PAGE = 1;  // 自上次 clear_dirty 以来写过
+  static constexpr uint8_t USED_PAGE = 2;   // 自上次清空以来可能不为零（写过、映射过文件或交出过宿主机指针）
+
+  uint8_t* dram = nullptr;  // DRAM_SIZE 字节
+  std::vector<uint8_t> dirty;  // 每页一个字节，比位图少一次移位和读改写，存储路径上更快
 };
 }
@@ -0,0 +1,323 @@
+//
+// Created by Jie Wei on 2024/5/9.
+//
+
+#include "elf.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "cup.h"
+
+namespace cemu {
+
+namespace {
+
+// ELF64 文件头、节头和符号表项，字段布局与规范一致
+struct Elf64Header {
+  uint8_t ident[16];
+  uint16_t type;
+  uint16_t machine;
+  uint32_t version;
+  uint64_t entry;
+  uint64_t phoff;
+  uint64_t shoff;
+  uint32_t flags;
+  uint16_t ehsize;
+  uint16_t phentsize;
+  uint16_t phnum;
+  uint16_t shentsize;
+  uint16_t shnum;
+  uint16_t shstrndx;
+};
+
+struct Elf64ProgramHeader {
+  uint32_t type;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t vaddr;
+  uint64_t paddr;
+  uint64_t filesz;
+  uint64_t memsz;
+  uint64_t align;
+};
+
+struct Elf64SectionHeader {
+  uint32_t name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t addr;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint32_t info;
+  uint64_t addralign;
+  uint64_t entsize;
+};
+
+struct Elf64Symbol {
+  uint32_t name;
+  uint8_t info;
+  uint8_t other;
+  uint16_t shndx;
+  uint64_t value;
+  uint64_t size;
+};
+
+constexpr uint16_t ET_DYN = 3;
+constexpr uint16_t EM_RISCV = 243;
+constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint8_t STT_OBJECT = 1;
+constexpr uint8_t STT_FUNC = 2;
+constexpr uint8_t STT_NOTYPE = 0;
+
+// 从 elf[offset] 读出一个 T，越界时返回 false
+template <typename T>
+bool read(std::span<const uint8_t> elf, uint64_t offset, T& out) {
+  if (offset > elf.size() || elf.size() - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&out, elf.data() + offset, sizeof(T));
+  return true;
+}
+
+bool is_elf64_le(const Elf64Header& header) {
+  return std::memcmp(header.ident, "\x7f" "ELF", 4) == 0 && header.ident[4] == 2 && header.ident[5] == 1;
+}
+
+// 只读映射整个文件，解析时只有访问到的页才会读入
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      return;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      data = static_cast<const uint8_t*>(p);
+      size = st.st_size;
+    }
+  }
+
+  ~MappedFile() {
+    if (data != nullptr) {
+      munmap(const_cast<uint8_t*>(data), size);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] std::span<const uint8_t> bytes() const {
+    return {data, size};
+  }
+
+  int fd = -1;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+// 把段中 [begin, end)（相对段起始的偏移）从文件拷贝到 DRAM
+void copy_range(Dram& dram, const MappedFile& file, const Segment& seg, uint64_t begin, uint64_t end) {
+  if (begin >= end) {
+    return;
+  }
+  std::memcpy(dram.host_ptr(seg.paddr + begin, end - begin), file.data + seg.offset + begin, end - begin);
+}
+
+// 放置一个段的文件内容：与宿主机页对齐的整页直接映射，其余部分拷贝
+void place_segment(Dram& dram, const MappedFile& file, const Segment& seg) {
+  constexpr uint64_t mask = Dram::PAGE_SIZE - 1;
+  uint64_t index = seg.paddr - DRAM_BASE;
+  // 文件偏移和 DRAM 偏移在页内的位置相同时才能映射
+  if (((index ^ seg.offset) & mask) == 0) {
+    uint64_t first = std::min(((index + mask) & ~mask) - index, seg.filesz);  // 第一个整页相对段起始的偏移
+    uint64_t last = ((index + seg.filesz) & ~mask) - index;                   // 最后一个整页之后
+    if (last > first && dram.map_file(file.fd, seg.offset + first, index + first, last - first)) {
+      copy_range(dram, file, seg, 0, first);
+      copy_range(dram, file, seg, last, seg.filesz);
+      return;
+    }
+  }
+  copy_range(dram, file, seg, 0, seg.filesz);
+}
+
+}  // namespace
+
+std::optional<SymbolTable> SymbolTable::parse(std::span<const uint8_t> elf) {
+  Elf64Header header;
+  if (!read(elf, 0, header) || !is_elf64_le(header)) {
+    return std::nullopt;
+  }
+
+  SymbolTable table;
+  for (uint16_t i = 0; i < header.shnum; ++i) {
+    Elf64SectionHeader section;
+    if (!read(elf, header.shoff + i * sizeof(Elf64SectionHeader), section)) {
+      return std::nullopt;
+    }
+    if (section.type != SHT_SYMTAB) {
+      continue;
+    }
+
+    // 符号名存放在 link 指向的字符串表中
+    Elf64SectionHeader strtab;
+    if (!read(elf, header.shoff + section.link * sizeof(Elf64SectionHeader), strtab)) {
+      return std::nullopt;
+    }
+    for (uint64_t off = 0; off + sizeof(Elf64Symbol) <= section.size; off += sizeof(Elf64Symbol)) {
+      Elf64Symbol sym;
+      if (!read(elf, section.offset + off, sym)) {
+        return std::nullopt;
+      }
+      uint8_t type = sym.info & 0xf;
+      if (sym.shndx == 0 || sym.name == 0 || (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)) {
+        continue;
+      }
+      uint64_t name_off = strtab.offset + sym.name;
+      if (name_off >= elf.size()) {
+        continue;
+      }
+      const char* begin = reinterpret_cast<const char*>(elf.data() + name_off);
+      std::string name(begin, strnlen(begin, elf.size() - name_off));
+      // 跳过编译器生成的局部标号，如 .L0
+      if (name.empty() || name[0] == '.' || name[0] == '$') {
+        continue;
+      }
+      table.symbols.push_back({std::move(name), sym.value, sym.size});
+    }
+  }
+
+  std::sort(table.symbols.begin(), table.symbols.end(),
+            [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+  return table;
+}
+
+std::optional<SymbolTable> SymbolTable::load(const std::string& path) {
+  MappedFile file(path);
+  if (file.data == nullptr) {
+    return std::nullopt;
+  }
+  return parse(file.bytes());
+}
+
+const Symbol* SymbolTable::find(uint64_t addr) const {
+  // 第一个起始地址大于 addr 的符号的前一个
+  auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                             [](uint64_t a, const Symbol& s) { return a < s.addr; });
+  if (it == symbols.begin()) {
+    return nullptr;
+  }
+  const Symbol& sym = *std::prev(it);
+  if (sym.size != 0 && addr >= sym.addr + sym.size) {
+    return nullptr;
+  }
+  return &sym;
+}
+
+void SymbolTable::rebase(uint64_t bias) {
+  for (Symbol& sym : symbols) {
+    sym.addr += bias;
+  }
+}
+
+const Symbol* SymbolTable::lookup(std::string_view name) const {
+  auto it = std::find_if(symbols.begin(), symbols.end(), [name](const Symbol& s) { return s.name == name; });
+  return it != symbols.end() ? &*it : nullptr;
+}
+
+std::string SymbolTable::symbolize(uint64_t addr) const {
+  const Symbol* sym = find(addr);
+  if (sym == nullptr) {
+    return "";
+  }
+  if (addr == sym->addr) {
+    return sym->name;
+  }
+  std::ostringstream os;
+  os << sym->name << "+0x" << std::hex << addr - sym->addr;
+  return os.str();
+}
+
+bool is_elf(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[4] = {};
+  return file.read(magic, sizeof(magic)) && std::memcmp(magic, "\x7f" "ELF", 4) == 0;
+}
+
+ElfImage load_elf(Cpu& cpu, const std::string& path) {
+  MappedFile file(path);
+  if (file.data == nullptr) {
+    throw std::runtime_error("Cannot open ELF file: " + path);
+  }
+  Elf64Header header;
+  if (!read(file.bytes(), 0, header) || !is_elf64_le(header) || header.machine != EM_RISCV) {
+    throw std::runtime_error("Not a RISC-V ELF64 file: " + path);
+  }
+
+  std::vector<Elf64ProgramHeader> loads;
+  for (uint16_t i = 0; i < header.phnum; ++i) {
+    Elf64ProgramHeader ph;
+    if (!read(file.bytes(), header.phoff + i * sizeof(Elf64ProgramHeader), ph)) {
+      throw std::runtime_error("Truncated program header in: " + path);
+    }
+    if (ph.type == PT_LOAD && ph.memsz != 0) {
+      loads.push_back(ph);
+    }
+  }
+
+  // 位置无关的可执行文件（ET_DYN）整体平移，使最低的段从 DRAM_BASE 开始
+  ElfImage image;
+  if (header.type == ET_DYN && !loads.empty()) {
+    uint64_t lowest = std::min_element(loads.begin(), loads.end(), [](const auto& a, const auto& b) {
+      return a.paddr < b.paddr;
+    })->paddr;
+    image.bias = DRAM_BASE - (lowest & ~(Dram::PAGE_SIZE - 1));
+  }
+  image.entry = header.entry + image.bias;
+  image.phnum = header.phnum;
+  for (const Elf64ProgramHeader& ph : loads) {
+    uint64_t paddr = ph.paddr + image.bias;
+    if (ph.filesz > ph.memsz || ph.offset > file.size || file.size - ph.offset < ph.filesz ||
+        paddr < DRAM_BASE || paddr - DRAM_BASE > DRAM_SIZE || DRAM_SIZE - (paddr - DRAM_BASE) < ph.memsz) {
+      throw std::runtime_error("Segment does not fit in DRAM: " + path);
+    }
+    image.segments.push_back({paddr, ph.offset, ph.filesz, ph.memsz, ph.flags});
+    image.end = std::max(image.end, paddr + ph.memsz);
+    // 程序头表被加载时，记下它在客户机中的地址（用户态程序通过 AT_PHDR 找到它）
+    if (header.phoff >= ph.offset && header.phoff - ph.offset < ph.filesz) {
+      image.phdr = paddr + (header.phoff - ph.offset);
+    }
+  }
+
+  Dram& dram = cpu.bus.memory();
+  dram.clear();
+  for (const Segment& seg : image.segments) {
+    place_segment(dram, file, seg);
+    dram.mark_dirty(seg.paddr, seg.filesz);
+  }
+  cpu.blocks.flush();
+  cpu.pc = image.entry;
+
+  if (auto symbols = SymbolTable::parse(file.bytes())) {
+    image.symbols = std::move(*symbols);
+    image.symbols.rebase(image.bias);
+  }
+  return image;
+}
+
+}
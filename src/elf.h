@@ -0,0 +1,87 @@
+//
+// Created by Jie Wei on 2024/5/9.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cemu {
+
+class Cpu;
+
+// ELF 符号表中的一个函数或对象符号
+struct Symbol {
+  std::string name;
+  uint64_t addr;
+  uint64_t size;
+};
+
+// 从 ELF64 (RISC-V, 小端) 文件的 .symtab 中读出的符号，按地址排序，用于把 pc 翻译成函数名
+class SymbolTable {
+ public:
+  // 解析内存中的 ELF 文件，不是 ELF64 小端文件时返回 std::nullopt，没有符号表时返回空表
+  static std::optional<SymbolTable> parse(std::span<const uint8_t> elf);
+
+  static std::optional<SymbolTable> parse(const std::vector<uint8_t>& elf) {
+    return parse(std::span<const uint8_t>(elf));
+  }
+
+  // 读取并解析文件
+  static std::optional<SymbolTable> load(const std::string& path);
+
+  // 包含 addr 的符号；size 为 0 的符号视为延伸到下一个符号
+  [[nodiscard]] const Symbol* find(uint64_t addr) const;
+
+  // 按名字查找符号，找不到时返回 nullptr
+  [[nodiscard]] const Symbol* lookup(std::string_view name) const;
+
+  // "name+0x10" 形式的地址描述，找不到符号时返回空串
+  [[nodiscard]] std::string symbolize(uint64_t addr) const;
+
+  // 所有符号的地址加上 bias，用于平移加载的位置无关程序
+  void rebase(uint64_t bias);
+
+  [[nodiscard]] size_t size() const {
+    return symbols.size();
+  }
+
+ private:
+  std::vector<Symbol> symbols;
+};
+
+// ELF 文件中的一个 PT_LOAD 段
+struct Segment {
+  uint64_t paddr;   // 加载到的物理地址
+  uint64_t offset;  // 在文件中的偏移
+  uint64_t filesz;  // 文件中的字节数
+  uint64_t memsz;   // 内存中的字节数，超出 filesz 的部分（BSS）为 0
+  uint32_t flags;   // PF_X / PF_W / PF_R
+};
+
+struct ElfImage {
+  uint64_t entry;
+  std::vector<Segment> segments;
+  SymbolTable symbols;
+  uint64_t bias = 0;   // 位置无关程序的加载偏移，段地址、入口和符号都已加上
+  uint64_t phdr = 0;   // 程序头表在客户机中的地址，没有被加载时为 0
+  uint16_t phnum = 0;
+  uint64_t end = 0;    // 最高的段的结束地址
+};
+
+// 文件是否以 ELF 魔数开头
+bool is_elf(const std::string& path);
+
+// 把 ELF64 RISC-V 可执行文件加载到 cpu 中，替换 DRAM 中原有的内容，并把 pc 设为 e_entry。
+// 位置无关的可执行文件（ET_DYN）被平移到 DRAM_BASE 处。
+// PT_LOAD 段按物理地址放置：页对齐的整页部分以写时复制的方式直接映射文件，不拷贝也不读入，
+// 只有段首尾不足一页的部分才拷贝；BSS 依赖 DRAM 的匿名映射，第一次访问时才由宿主机清零。
+// 因此加载时间与文件大小无关。文件不合法或段不在 DRAM 中时抛出 std::runtime_error
+ElfImage load_elf(Cpu& cpu, const std::string& path);
+
+}
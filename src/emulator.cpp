@@ -0,0 +1,129 @@
+//
+// Created by Jie Wei on 2024/5/16.
+//
+
+#include "emulator.h"
+#include <cstring>
+#include "elf.h"
+
+namespace cemu {
+
+Emulator::Emulator(const EmulatorConfig& config) : cpu(std::vector<uint8_t>()) {
+  if (!config.elf.empty()) {
+    ElfImage image = load_elf(cpu, config.elf);
+    htif.locate(image.symbols);
+    if (config.user_mode) {
+      usermode.setup(cpu, image, config.args, config.env);
+    }
+  } else {
+    write_memory(config.load_addr, config.image.data(), config.image.size());
+    cpu.pc = config.entry;
+  }
+  cpu.bus.memory().clear_dirty();
+  htif.semihosting = config.semihosting;
+  if (htif.tohost != 0 || htif.semihosting) {
+    cpu.htif = &htif;
+  }
+  if (config.uart_stdin) {
+    cpu.bus.uart->start_input();
+  }
+}
+
+void Emulator::on_trap(std::function<bool(const Exception&)> callback) {
+  trap_callback = std::move(callback);
+  if (!trap_callback) {
+    cpu.trap_hook = nullptr;
+    return;
+  }
+  cpu.trap_hook = [this](const Exception& e) {
+    if (trap_callback(e)) {
+      trap_stop = true;
+      cpu.request_stop();
+    }
+  };
+}
+
+RunResult Emulator::run_for(uint64_t n) {
+  uint64_t start = cpu.csr.instret;
+  trap_stop = false;
+  try {
+    cpu.run(n);
+  } catch (const Exception& e) {
+    return finish({StopReason::FatalTrap, cpu.csr.instret - start, e});
+  }
+
+  RunResult result{StopReason::InstructionLimit, cpu.csr.instret - start};
+  if (cpu.stopped_early()) {
+    if (cpu.exit_code.has_value()) {
+      result.reason = StopReason::Exited;
+    } else if (trap_stop) {
+      result.reason = StopReason::Stopped;
+    } else if (cpu.blocks.watch_hit.has_value()) {
+      result.reason = StopReason::Watchpoint;
+      result.watch_addr = cpu.blocks.watch_hit;
+      cpu.blocks.watch_hit.reset();
+    } else {
+      result.reason = StopReason::Breakpoint;
+    }
+  }
+  return finish(result);
+}
+
+RunResult Emulator::run_until(uint64_t addr, uint64_t max_insts) {
+  // 临时断点，已经存在的断点保持不变
+  bool temporary = !cpu.blocks.is_breakpoint(addr);
+  if (temporary) {
+    cpu.blocks.add_breakpoint(addr);
+  }
+  RunResult result = run_for(max_insts);
+  if (temporary) {
+    cpu.blocks.remove_breakpoint(addr);
+  }
+  return result;
+}
+
+RunResult Emulator::finish(RunResult result) {
+  if (stop_callback) {
+    stop_callback(result);
+  }
+  return result;
+}
+
+bool Emulator::read_memory(uint64_t addr, void* data, uint64_t len) {
+  if (const uint8_t* src = cpu.bus.dram_ptr(addr, len)) {
+    std::memcpy(data, src, len);
+    return true;
+  }
+  auto* dst = static_cast<uint8_t*>(data);
+  try {
+    for (uint64_t i = 0; i < len; ++i) {
+      dst[i] = static_cast<uint8_t>(cpu.bus.load(addr + i, 8).value());
+    }
+  } catch (const Exception&) {
+    return false;
+  }
+  return true;
+}
+
+bool Emulator::write_memory(uint64_t addr, const void* data, uint64_t len) {
+  if (len == 0) {
+    return true;
+  }
+  if (uint8_t* dst = cpu.bus.dram_ptr(addr, len)) {
+    std::memcpy(dst, data, len);
+    cpu.bus.memory().mark_dirty(addr, len);
+    cpu.blocks.host_written(addr, len);
+    return true;
+  }
+  const auto* src = static_cast<const uint8_t*>(data);
+  try {
+    for (uint64_t i = 0; i < len; ++i) {
+      cpu.store(addr + i, 8, src[i]);
+    }
+  } catch (const Exception&) {
+    return false;
+  }
+  return true;
+}
+
+}
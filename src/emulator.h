@@ -0,0 +1,160 @@
+//
+// Created by Jie Wei on 2024/5/16.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+#include "cup.h"
+
+namespace cemu {
+
+// 创建机器的参数
+struct EmulatorConfig {
+  std::string elf;             // 非空时加载该 ELF 文件，忽略 image、load_addr 和 entry
+  std::vector<uint8_t> image;  // 加载到 load_addr 处的程序
+  uint64_t load_addr = DRAM_BASE;
+  uint64_t entry = DRAM_BASE;  // 第一条指令的地址
+  bool uart_stdin = false;     // 是否把标准输入接到串口
+  bool semihosting = false;    // 是否处理半主机调用
+
+  // 用户态模拟：在 U 模式下直接运行 elf 指定的 Linux 用户程序，系统调用由宿主机完成，见 UserMode
+  bool user_mode = false;
+  std::vector<std::string> args;  // 客户机的 argv，包括程序名
+  std::vector<std::string> env;
+};
+
+// 一次运行停止的原因
+enum class StopReason {
+  InstructionLimit,  // 执行完了要求的指令数
+  Breakpoint,        // 到达 run_until 的目标地址或断点
+  Watchpoint,        // 写了观察点监视的内存，见 RunResult::watch_addr
+  Stopped,           // 陷入回调要求停止
+  Exited,            // 客户机退出，见 Cpu::exit
+  FatalTrap,         // 致命异常
+};
+
+struct RunResult {
+  StopReason reason = StopReason::InstructionLimit;
+  uint64_t insts = 0;                    // 本次运行退休的指令数
+  std::optional<Exception> trap{};       // reason 为 FatalTrap 时的异常
+  std::optional<uint64_t> watch_addr{};  // reason 为 Watchpoint 时写入的地址
+};
+
+// 供其他程序嵌入使用的模拟器接口。内部使用基本块执行引擎，按块而不是按指令调用，
+// 所以 run_for / run_until 的开销与直接调用 Cpu::run 相同。
+class Emulator {
+ public:
+  explicit Emulator(const EmulatorConfig& config);
+
+  // cpu 中保存了指向 htif 的指针和捕获 this 的陷入回调，不能复制或移动
+  Emulator(const Emulator&) = delete;
+  Emulator& operator=(const Emulator&) = delete;
+  Emulator(Emulator&&) = delete;
+  Emulator& operator=(Emulator&&) = delete;
+
+  // 执行至多 n 条指令
+  RunResult run_for(uint64_t n);
+
+  // 执行到 pc 等于 addr（之前至少执行一条指令），或者执行了 max_insts 条指令
+  RunResult run_until(uint64_t addr, uint64_t max_insts = std::numeric_limits<uint64_t>::max());
+
+  // 单步执行 n 条指令，等同于 run_for(n)
+  RunResult step(uint64_t n = 1) {
+    return run_for(n);
+  }
+
+  // 每次陷入时调用，返回 true 表示在当前块结束后停止运行
+  void on_trap(std::function<bool(const Exception&)> callback);
+
+  // 每次运行停止时调用
+  void on_stop(std::function<void(const RunResult&)> callback) {
+    stop_callback = std::move(callback);
+  }
+
+  void add_breakpoint(uint64_t addr) {
+    cpu.blocks.add_breakpoint(addr);
+  }
+
+  void remove_breakpoint(uint64_t addr) {
+    cpu.blocks.remove_breakpoint(addr);
+  }
+
+  // 写观察点：客户机写入 [addr, addr + len) 后停止
+  void add_watchpoint(uint64_t addr, uint64_t len) {
+    cpu.blocks.add_watchpoint(addr, len);
+  }
+
+  void remove_watchpoint(uint64_t addr, uint64_t len) {
+    cpu.blocks.remove_watchpoint(addr, len);
+  }
+
+  [[nodiscard]] uint64_t pc() const {
+    return cpu.pc;
+  }
+
+  void set_pc(uint64_t pc) {
+    cpu.pc = pc;
+  }
+
+  [[nodiscard]] uint64_t reg(size_t i) const {
+    return cpu.regs[i];
+  }
+
+  void set_reg(size_t i, uint64_t value) {
+    if (i != 0) {
+      cpu.regs[i] = value;
+    }
+  }
+
+  [[nodiscard]] const std::array<uint64_t, 32>& regs() const {
+    return cpu.regs;
+  }
+
+  void set_regs(const std::array<uint64_t, 32>& values) {
+    cpu.regs = values;
+    cpu.regs[0] = 0;
+  }
+
+  // 批量读写客户机物理内存。完全落在 DRAM 中时直接拷贝，否则逐字节经过总线（可以访问外设）。
+  // 访问出错时返回 false
+  bool read_memory(uint64_t addr, void* data, uint64_t len);
+  bool write_memory(uint64_t addr, const void* data, uint64_t len);
+
+  [[nodiscard]] std::optional<uint64_t> exit_code() const {
+    return cpu.exit_code;
+  }
+
+  // 客户机通过 HTIF 和半主机调用访问的宿主机接口，可以修改输出的去向。
+  // ELF 中有 tohost 符号时自动启用 HTIF
+  Htif& host() {
+    return htif;
+  }
+
+  UserMode& user() {
+    return usermode;
+  }
+
+  // 直接访问底层的 Cpu，用于接口没有覆盖的功能
+  Cpu& raw() {
+    return cpu;
+  }
+
+ private:
+  RunResult finish(RunResult result);
+
+  Cpu cpu;
+  Htif htif;
+  UserMode usermode;
+  std::function<bool(const Exception&)> trap_callback;
+  std::function<void(const RunResult&)> stop_callback;
+  bool trap_stop = false;
+};
+
+}
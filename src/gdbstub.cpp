@@ -0,0 +1,502 @@
+//
+// Created by Jie Wei on 2024/5/19.
+//
+
+#include "gdbstub.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "cli.h"
+#include "cup.h"
+#include "log.h"
+
+namespace cemu {
+
+namespace {
+
+// GDB 的 RISC-V 寄存器编号：x0-x31，pc，f0-f31，之后从 65 开始是 CSR
+constexpr uint64_t REG_PC = 32;
+constexpr uint64_t REG_CSR_BASE = 65;
+
+// 只描述整数寄存器和 pc，GDB 不会再请求浮点寄存器
+constexpr const char* TARGET_XML =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<architecture>riscv:rv64</architecture>"
+    "<feature name=\"org.gnu.gdb.riscv.cpu\">"
+    "<reg name=\"zero\" bitsize=\"64\" type=\"int\" regnum=\"0\"/>"
+    "<reg name=\"ra\" bitsize=\"64\" type=\"code_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"gp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"tp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"t0\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"fp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"s1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a0\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a1\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"a7\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s2\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s7\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s8\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s9\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s10\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"s11\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t3\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t4\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t5\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"t6\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"pc\" bitsize=\"64\" type=\"code_ptr\"/>"
+    "</feature>"
+    "</target>";
+
+constexpr char HEX[] = "0123456789abcdef";
+
+// 按小端字节序输出 nbytes 字节
+std::string to_hex(uint64_t value, size_t nbytes) {
+  std::string s;
+  for (size_t i = 0; i < nbytes; ++i) {
+    uint8_t b = (value >> (i * 8)) & 0xff;
+    s.push_back(HEX[b >> 4]);
+    s.push_back(HEX[b & 0xf]);
+  }
+  return s;
+}
+
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// 解析按小端字节序排列的十六进制字节
+uint64_t from_hex_le(std::string_view s) {
+  uint64_t value = 0;
+  for (size_t i = 0; i + 1 < s.size() && i < 16; i += 2) {
+    uint64_t b = (hex_digit(s[i]) << 4) | hex_digit(s[i + 1]);
+    value |= b << (i * 4);
+  }
+  return value;
+}
+
+// 解析普通的十六进制数（如地址和长度），pos 移动到数字之后
+uint64_t parse_hex(std::string_view s, size_t& pos) {
+  uint64_t value = 0;
+  while (pos < s.size() && hex_digit(s[pos]) >= 0) {
+    value = (value << 4) | hex_digit(s[pos]);
+    ++pos;
+  }
+  return value;
+}
+
+// 异常对应的信号：访存错误为 SIGSEGV，非法指令为 SIGILL，其余为 SIGTRAP
+const char* signal_reply(const Exception& e) {
+  switch (e.getType()) {
+    case ExceptionType::IllegalInstruction:
+      return "S04";
+    case ExceptionType::InstructionAccessFault:
+    case ExceptionType::LoadAccessFault:
+    case ExceptionType::StoreAMOAccessFault:
+      return "S0b";
+    default:
+      return "S05";
+  }
+}
+
+}  // namespace
+
+GdbStub::~GdbStub() {
+  if (conn >= 0) {
+    close(conn);
+  }
+}
+
+void GdbStub::listen(const std::string& address) {
+  int server;
+  auto colon = address.rfind(':');
+  if (colon != std::string::npos) {
+    std::string host = address.substr(0, colon);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    uint16_t port;
+    if (!parse_number(std::string_view(address).substr(colon + 1), port) ||
+        inet_pton(AF_INET, host.empty() ? "127.0.0.1" : host.c_str(), &addr.sin_addr) != 1) {
+      throw std::runtime_error("Invalid gdb address: " + address);
+    }
+    addr.sin_port = htons(port);
+    server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      throw std::runtime_error("Cannot bind gdb socket: " + address);
+    }
+  } else {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (address.size() >= sizeof(addr.sun_path)) {
+      throw std::runtime_error("Socket path too long: " + address);
+    }
+    std::strcpy(addr.sun_path, address.c_str());
+    unlink(address.c_str());
+    server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      throw std::runtime_error("Cannot bind gdb socket: " + address);
+    }
+  }
+
+  LOG(INFO, "Waiting for gdb on ", address);
+  if (::listen(server, 1) != 0) {
+    close(server);
+    throw std::runtime_error("Cannot listen on gdb socket: " + address);
+  }
+  conn = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+  close(server);
+  if (conn < 0) {
+    throw std::runtime_error("Cannot accept gdb connection: " + address);
+  }
+  // 包都很小，关闭 Nagle 算法以减少单步时的延迟（Unix 套接字会忽略这个选项）
+  int one = 1;
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+void GdbStub::serve() {
+  std::string packet;
+  while (receive(packet)) {
+    if (!handle(packet)) {
+      break;
+    }
+  }
+}
+
+bool GdbStub::receive(std::string& packet) {
+  // 包的格式为 $<内容>#<两位校验和>，之前可能有 + 和 - 应答，中断为单独的 0x03
+  char c;
+  do {
+    if (read(conn, &c, 1) != 1) {
+      return false;
+    }
+  } while (c != '$');
+
+  packet.clear();
+  uint8_t sum = 0;
+  while (true) {
+    if (read(conn, &c, 1) != 1) {
+      return false;
+    }
+    if (c == '#') {
+      break;
+    }
+    sum += static_cast<uint8_t>(c);
+    packet.push_back(c);
+  }
+  char checksum[2];
+  if (read(conn, checksum, 2) != 2) {
+    return false;
+  }
+  if (!no_ack) {
+    bool ok = ((hex_digit(checksum[0]) << 4) | hex_digit(checksum[1])) == sum;
+    if (write(conn, ok ? "+" : "-", 1) != 1) {
+      return false;
+    }
+    if (!ok) {
+      return receive(packet);
+    }
+  }
+  return true;
+}
+
+void GdbStub::send(std::string_view payload) {
+  uint8_t sum = 0;
+  for (char c : payload) {
+    sum += static_cast<uint8_t>(c);
+  }
+  std::string out = "$";
+  out.append(payload);
+  out.push_back('#');
+  out.push_back(HEX[sum >> 4]);
+  out.push_back(HEX[sum & 0xf]);
+  for (size_t done = 0; done < out.size();) {
+    ssize_t n = write(conn, out.data() + done, out.size() - done);
+    if (n <= 0) {
+      return;
+    }
+    done += n;
+  }
+}
+
+bool GdbStub::interrupted() {
+  pollfd pfd{conn, POLLIN, 0};
+  if (poll(&pfd, 1, 0) <= 0) {
+    return false;
+  }
+  char c;
+  return recv(conn, &c, 1, MSG_PEEK) == 1 && c == '\x03' && read(conn, &c, 1) == 1;
+}
+
+bool GdbStub::handle(const std::string& packet) {
+  std::string_view p = packet;
+  size_t pos = 1;
+  if (p.empty()) {
+    send("");
+    return true;
+  }
+
+  switch (p[0]) {
+    case '?':
+      send("S05");
+      return true;
+    case 'g': {
+      std::string regs;
+      for (uint64_t i = 0; i <= REG_PC; ++i) {
+        regs += read_register(i);
+      }
+      send(regs);
+      return true;
+    }
+    case 'G':
+      for (uint64_t i = 0; i <= REG_PC && 1 + i * 16 + 16 <= p.size(); ++i) {
+        write_register(i, from_hex_le(p.substr(1 + i * 16, 16)));
+      }
+      send("OK");
+      return true;
+    case 'p': {
+      std::string value = read_register(parse_hex(p, pos));
+      send(value.empty() ? "E01" : value);
+      return true;
+    }
+    case 'P': {
+      uint64_t n = parse_hex(p, pos);
+      bool ok = pos < p.size() && p[pos] == '=' && write_register(n, from_hex_le(p.substr(pos + 1)));
+      send(ok ? "OK" : "E01");
+      return true;
+    }
+    case 'm': {
+      uint64_t addr = parse_hex(p, pos);
+      ++pos;
+      uint64_t len = parse_hex(p, pos);
+      std::string data = read_memory(addr, len);
+      send(data.empty() && len != 0 ? "E14" : data);
+      return true;
+    }
+    case 'M': {
+      uint64_t addr = parse_hex(p, pos);
+      ++pos;
+      parse_hex(p, pos);
+      bool ok = pos < p.size() && p[pos] == ':' && write_memory(addr, p.substr(pos + 1));
+      send(ok ? "OK" : "E14");
+      return true;
+    }
+    case 'c':
+    case 's':
+      if (pos < p.size()) {
+        cpu.pc = parse_hex(p, pos);
+      }
+      send(resume(p[0] == 's'));
+      return true;
+    case 'Z':
+    case 'z': {
+      // Z<type>,<addr>,<kind>：0 软件断点，1 硬件断点，2 写观察点；读观察点不支持
+      uint64_t type = parse_hex(p, pos);
+      ++pos;
+      uint64_t addr = parse_hex(p, pos);
+      ++pos;
+      uint64_t kind = parse_hex(p, pos);
+      bool insert = p[0] == 'Z';
+      if (type == 0 || type == 1) {
+        insert ? cpu.blocks.add_breakpoint(addr) : cpu.blocks.remove_breakpoint(addr);
+      } else if (type == 2) {
+        insert ? cpu.blocks.add_watchpoint(addr, kind) : cpu.blocks.remove_watchpoint(addr, kind);
+      } else {
+        send("");
+        return true;
+      }
+      send("OK");
+      return true;
+    }
+    case 'H':
+      send("OK");
+      return true;
+    case 'D':
+      send("OK");
+      return false;
+    case 'k':
+      return false;
+    default:
+      break;
+  }
+
+  if (p.starts_with("qSupported")) {
+    send("PacketSize=4000;qXfer:features:read+;QStartNoAckMode+");
+  } else if (p == "QStartNoAckMode") {
+    send("OK");
+    no_ack = true;
+  } else if (p.starts_with("qXfer:features:read:target.xml:")) {
+    pos = std::string_view("qXfer:features:read:target.xml:").size();
+    uint64_t offset = parse_hex(p, pos);
+    ++pos;
+    uint64_t len = parse_hex(p, pos);
+    std::string_view xml = TARGET_XML;
+    if (offset >= xml.size()) {
+      send("l");
+    } else {
+      std::string_view chunk = xml.substr(offset, len);
+      send((offset + chunk.size() >= xml.size() ? "l" : "m") + std::string(chunk));
+    }
+  } else if (p == "qAttached") {
+    send("1");
+  } else if (p == "qC") {
+    send("QC1");
+  } else if (p == "qfThreadInfo") {
+    send("m1");
+  } else if (p == "qsThreadInfo") {
+    send("l");
+  } else {
+    send("");
+  }
+  return true;
+}
+
+std::string GdbStub::resume(bool step) {
+  try {
+    if (step) {
+      cpu.run(1);
+    } else {
+      while (true) {
+        cpu.run(RUN_SLICE);
+        if (cpu.stopped_early() || cpu.exit_code.has_value()) {
+          break;
+        }
+        if (interrupted()) {
+          return "S02";
+        }
+      }
+    }
+  } catch (const Exception& e) {
+    return signal_reply(e);
+  }
+
+  if (cpu.exit_code.has_value()) {
+    return "W" + to_hex(*cpu.exit_code & 0xff, 1);
+  }
+  if (cpu.blocks.watch_hit.has_value()) {
+    uint64_t addr = *cpu.blocks.watch_hit;
+    cpu.blocks.watch_hit.reset();
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "T05watch:%llx;", static_cast<unsigned long long>(addr));
+    return buf;
+  }
+  return "S05";
+}
+
+std::string GdbStub::read_register(uint64_t n) {
+  if (n < REG_PC) {
+    return to_hex(cpu.regs[n], 8);
+  }
+  if (n == REG_PC) {
+    return to_hex(cpu.pc, 8);
+  }
+  if (n >= REG_CSR_BASE && n < REG_CSR_BASE + NUM_CSRS) {
+    return to_hex(cpu.csr.load(n - REG_CSR_BASE), 8);
+  }
+  return "";
+}
+
+bool GdbStub::write_register(uint64_t n, uint64_t value) {
+  if (n < REG_PC) {
+    if (n != 0) {
+      cpu.regs[n] = value;
+    }
+    return true;
+  }
+  if (n == REG_PC) {
+    cpu.pc = value;
+    return true;
+  }
+  if (n >= REG_CSR_BASE && n < REG_CSR_BASE + NUM_CSRS) {
+    cpu.csr.store(n - REG_CSR_BASE, value);
+    return true;
+  }
+  return false;
+}
+
+std::string GdbStub::read_memory(uint64_t addr, uint64_t len) {
+  std::string out;
+  if (const uint8_t* p = cpu.bus.dram_ptr(addr, len)) {
+    out.reserve(len * 2);
+    for (uint64_t i = 0; i < len; ++i) {
+      out.push_back(HEX[p[i] >> 4]);
+      out.push_back(HEX[p[i] & 0xf]);
+    }
+    return out;
+  }
+  // 不在 DRAM 中时逐字节经过总线，可以读外设寄存器
+  try {
+    for (uint64_t i = 0; i < len; ++i) {
+      auto value = cpu.bus.load(addr + i, 8);
+      if (!value.has_value()) {
+        return "";
+      }
+      out += to_hex(*value, 1);
+    }
+  } catch (const Exception&) {
+    return "";
+  }
+  return out;
+}
+
+bool GdbStub::write_memory(uint64_t addr, std::string_view hex) {
+  uint64_t len = hex.size() / 2;
+  std::vector<uint8_t> data(len);
+  for (uint64_t i = 0; i < len; ++i) {
+    data[i] = (hex_digit(hex[i * 2]) << 4) | hex_digit(hex[i * 2 + 1]);
+  }
+  if (len == 0) {
+    return true;
+  }
+  if (uint8_t* dst = cpu.bus.dram_ptr(addr, len)) {
+    // 调试器写入（如改写代码）使缓存的块失效，但不触发观察点
+    std::memcpy(dst, data.data(), len);
+    cpu.bus.memory().mark_dirty(addr, len);
+    cpu.blocks.host_written(addr, len);
+    return true;
+  }
+  try {
+    for (uint64_t i = 0; i < len; ++i) {
+      if (!cpu.bus.store(addr + i, 8, data[i])) {
+        return false;
+      }
+    }
+  } catch (const Exception&) {
+    return false;
+  }
+  return true;
+}
+
+}
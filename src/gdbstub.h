@@ -0,0 +1,65 @@
+//
+// Created by Jie Wei on 2024/5/19.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace cemu {
+
+class Cpu;
+
+// GDB 远程串行协议（RSP）服务端。支持读写通用寄存器、pc 和 CSR（寄存器号 65 + CSR 编号）、
+// 读写内存、单步、继续执行（可用 Ctrl-C 中断）、软件/硬件断点和写观察点。
+//
+// 断点和观察点由 BlockCache 实现：断点使块在断点前结束并在块边界检查，观察点复用代码页的写检查，
+// 因此没有设置它们时执行引擎没有额外开销，设置后也只重建受影响的块。
+class GdbStub {
+ public:
+  explicit GdbStub(Cpu& cpu) : cpu(cpu) {}
+  ~GdbStub();
+
+  GdbStub(const GdbStub&) = delete;
+  GdbStub& operator=(const GdbStub&) = delete;
+
+  // 在 address 上等待调试器连接。"host:port" 或 ":port" 为 TCP（默认 127.0.0.1），否则为 Unix 套接字路径。
+  // 失败时抛出 std::runtime_error
+  void listen(const std::string& address);
+
+  // 使用已经连接好的套接字，用于测试
+  void attach(int fd) {
+    conn = fd;
+  }
+
+  // 处理调试器的请求，直到调试器断开、detach 或 kill
+  void serve();
+
+  // 继续执行时每次最多执行的指令数，两次之间检查调试器是否发来了中断
+  static constexpr uint64_t RUN_SLICE = 1 << 20;
+
+ private:
+  // 收到一个完整的包时返回它的内容，连接断开时返回 false
+  bool receive(std::string& packet);
+  void send(std::string_view payload);
+
+  // 处理一个包，返回 false 表示结束会话
+  bool handle(const std::string& packet);
+
+  // 执行并返回停止时的应答
+  std::string resume(bool step);
+
+  std::string read_register(uint64_t n);
+  bool write_register(uint64_t n, uint64_t value);
+  std::string read_memory(uint64_t addr, uint64_t len);
+  bool write_memory(uint64_t addr, std::string_view hex);
+  bool interrupted();
+
+  Cpu& cpu;
+  int conn = -1;
+  bool no_ack = false;
+};
+
+}
@@ -0,0 +1,265 @@
+//
+// Created by Jie Wei on 2024/5/17.
+//
+
+#include "htif.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include "cup.h"
+#include "elf.h"
+#include "log.h"
+
+namespace cemu {
+
+namespace {
+
+// HTIF 代理的系统调用号，与 riscv-pk 一致
+constexpr uint64_t HTIF_SYS_WRITE = 64;
+constexpr uint64_t HTIF_SYS_EXIT = 93;
+
+// 半主机操作号
+constexpr uint64_t SYS_OPEN = 0x01;
+constexpr uint64_t SYS_CLOSE = 0x02;
+constexpr uint64_t SYS_WRITEC = 0x03;
+constexpr uint64_t SYS_WRITE0 = 0x04;
+constexpr uint64_t SYS_WRITE = 0x05;
+constexpr uint64_t SYS_READ = 0x06;
+constexpr uint64_t SYS_ERRNO = 0x13;
+constexpr uint64_t SYS_EXIT = 0x18;
+constexpr uint64_t SYS_EXIT_EXTENDED = 0x20;
+
+constexpr uint64_t ADP_STOPPED_APPLICATION_EXIT = 0x20026;
+
+// 半主机调用序列中 ebreak 前后的两条指令
+constexpr uint32_t SEMIHOST_PRE = 0x01f01013;   // slli x0, x0, 0x1f
+constexpr uint32_t SEMIHOST_POST = 0x40705013;  // srai x0, x0, 7
+
+constexpr uint64_t ENOSYS_RESULT = static_cast<uint64_t>(-38);
+constexpr uint64_t EFAULT_RESULT = static_cast<uint64_t>(-14);
+
+// 客户机内存中的第 i 个双字，越界时返回 std::nullopt
+std::optional<uint64_t> load64(Cpu& cpu, uint64_t addr, uint64_t i) {
+  const uint8_t* p = cpu.bus.dram_ptr(addr + i * 8, 8);
+  if (p == nullptr) {
+    return std::nullopt;
+  }
+  uint64_t value;
+  std::memcpy(&value, p, 8);
+  return value;
+}
+
+// 半主机 SYS_OPEN 的打开方式，顺序与 fopen 的模式串 r, rb, r+, r+b, w, wb, w+, w+b, a, ab, a+, a+b 一致
+int open_flags(uint64_t mode) {
+  static constexpr int flags[] = {O_RDONLY, O_RDWR, O_WRONLY | O_CREAT | O_TRUNC, O_RDWR | O_CREAT | O_TRUNC,
+                                  O_WRONLY | O_CREAT | O_APPEND, O_RDWR | O_CREAT | O_APPEND};
+  return flags[(mode / 2) % 6];
+}
+
+}  // namespace
+
+bool Htif::locate(const SymbolTable& symbols) {
+  const Symbol* to = symbols.lookup("tohost");
+  const Symbol* from = symbols.lookup("fromhost");
+  tohost = to != nullptr ? to->addr : 0;
+  fromhost = from != nullptr ? from->addr : 0;
+  return tohost != 0;
+}
+
+void Htif::write_tohost(Cpu& cpu) {
+  auto value = load64(cpu, tohost, 0);
+  if (!value.has_value() || *value == 0) {
+    return;
+  }
+  uint64_t device = *value >> 56;
+  uint64_t command = (*value >> 48) & 0xff;
+  uint64_t payload = *value & ((1ULL << 48) - 1);
+  uint64_t response = 0;
+
+  if (device == 0 && command == 0) {
+    if (payload & 1) {
+      cpu.exit(payload >> 1);
+    } else {
+      cpu.bus.store(payload, 64, syscall(cpu, payload));
+      response = 1;
+    }
+  } else if (device == 1 && command == 1) {
+    out->put(static_cast<char>(payload & 0xff));
+    out->flush();
+    response = (device << 56) | (command << 48);
+  } else {
+    LOG(WARNING, "Unknown HTIF command: 0x", std::hex, *value, std::dec);
+  }
+
+  cpu.bus.store(tohost, 64, 0);
+  if (response != 0 && fromhost != 0) {
+    cpu.bus.store(fromhost, 64, response);
+  }
+}
+
+uint64_t Htif::syscall(Cpu& cpu, uint64_t buf) {
+  uint64_t args[4];
+  for (uint64_t i = 0; i < 4; ++i) {
+    auto arg = load64(cpu, buf, i);
+    if (!arg.has_value()) {
+      return EFAULT_RESULT;
+    }
+    args[i] = *arg;
+  }
+  switch (args[0]) {
+    case HTIF_SYS_WRITE:
+      return static_cast<uint64_t>(write(cpu, args[1], args[2], args[3]));
+    case HTIF_SYS_EXIT:
+      cpu.exit(args[1]);
+      return 0;
+    default:
+      LOG(WARNING, "Unsupported HTIF syscall: ", args[0]);
+      return ENOSYS_RESULT;
+  }
+}
+
+int64_t Htif::write(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len) {
+  const uint8_t* p = cpu.bus.dram_ptr(buf, len);
+  if (p == nullptr && len != 0) {
+    last_errno = EFAULT;
+    return -EFAULT;
+  }
+  if (fd == 1 || fd == 2) {
+    std::ostream& os = fd == 1 ? *out : *err;
+    os.write(reinterpret_cast<const char*>(p), static_cast<std::streamsize>(len));
+    os.flush();
+    return static_cast<int64_t>(len);
+  }
+  if (!open_files.contains(fd)) {
+    last_errno = EBADF;
+    return -EBADF;
+  }
+  ssize_t n = ::write(static_cast<int>(fd), p, len);
+  last_errno = n < 0 ? errno : 0;
+  return n < 0 ? -last_errno : n;
+}
+
+void Htif::close_files() {
+  for (uint64_t fd : open_files) {
+    close(static_cast<int>(fd));
+  }
+  open_files.clear();
+}
+
+bool Htif::semihost(Cpu& cpu) {
+  if (!semihosting) {
+    return false;
+  }
+  const uint8_t* pre = cpu.bus.dram_ptr(cpu.pc - 4, 12);
+  if (pre == nullptr) {
+    return false;
+  }
+  uint32_t before, after;
+  std::memcpy(&before, pre, 4);
+  std::memcpy(&after, pre + 8, 4);
+  if (before != SEMIHOST_PRE || after != SEMIHOST_POST) {
+    return false;
+  }
+  cpu.regs[10] = semihost_call(cpu, cpu.regs[10], cpu.regs[11]);
+  return true;
+}
+
+uint64_t Htif::semihost_call(Cpu& cpu, uint64_t op, uint64_t arg) {
+  // 大多数操作的参数是 arg 指向的参数块
+  auto param = [&](uint64_t i) { return load64(cpu, arg, i).value_or(0); };
+  constexpr uint64_t FAIL = static_cast<uint64_t>(-1);
+
+  switch (op) {
+    case SYS_OPEN: {
+      uint64_t name_len = param(2);
+      const uint8_t* name = cpu.bus.dram_ptr(param(0), name_len);
+      if (name == nullptr) {
+        return FAIL;
+      }
+      std::string path(reinterpret_cast<const char*>(name), name_len);
+      uint64_t mode = param(1);
+      // ":tt" 表示控制台：读方式为标准输入，写方式为标准输出，追加方式为标准错误
+      if (path == ":tt") {
+        return mode < 4 ? 0 : mode < 8 ? 1 : 2;
+      }
+      int fd = open(path.c_str(), open_flags(mode) | O_CLOEXEC, 0644);
+      last_errno = fd < 0 ? errno : 0;
+      if (fd < 0) {
+        return FAIL;
+      }
+      open_files.insert(fd);
+      return static_cast<uint64_t>(fd);
+    }
+    case SYS_CLOSE: {
+      uint64_t fd = param(0);
+      if (fd <= 2) {
+        return 0;
+      }
+      if (open_files.erase(fd) == 0) {
+        last_errno = EBADF;
+        return FAIL;
+      }
+      int r = close(static_cast<int>(fd));
+      last_errno = r < 0 ? errno : 0;
+      return r < 0 ? FAIL : 0;
+    }
+    case SYS_WRITEC: {
+      const uint8_t* c = cpu.bus.dram_ptr(arg, 1);
+      if (c != nullptr) {
+        out->put(static_cast<char>(*c));
+        out->flush();
+      }
+      return 0;
+    }
+    case SYS_WRITE0: {
+      for (const uint8_t* c = cpu.bus.dram_ptr(arg, 1); c != nullptr && *c != 0;
+           c = cpu.bus.dram_ptr(++arg, 1)) {
+        out->put(static_cast<char>(*c));
+      }
+      out->flush();
+      return 0;
+    }
+    case SYS_WRITE: {
+      // 返回没有写出的字节数
+      uint64_t len = param(2);
+      int64_t n = write(cpu, param(0), param(1), len);
+      return n < 0 ? len : len - n;
+    }
+    case SYS_READ: {
+      uint64_t fd = param(0);
+      uint64_t len = param(2);
+      uint8_t* buf = cpu.bus.dram_ptr(param(1), len);
+      if (buf == nullptr && len != 0) {
+        return len;
+      }
+      if (fd != 0 && !open_files.contains(fd)) {
+        last_errno = EBADF;
+        return len;
+      }
+      ssize_t n = read(static_cast<int>(fd), buf, len);
+      last_errno = n < 0 ? errno : 0;
+      if (n <= 0) {
+        return len;
+      }
+      cpu.bus.memory().mark_dirty(param(1), n);
+      cpu.blocks.invalidate(param(1), n);
+      return len - n;
+    }
+    case SYS_ERRNO:
+      return static_cast<uint64_t>(last_errno);
+    case SYS_EXIT:
+    case SYS_EXIT_EXTENDED: {
+      // RV64 上参数是 {原因, 返回值} 参数块
+      uint64_t reason = param(0);
+      cpu.exit(reason == ADP_STOPPED_APPLICATION_EXIT || op == SYS_EXIT_EXTENDED ? param(1) : 1);
+      return 0;
+    }
+    default:
+      LOG(WARNING, "Unsupported semihosting call: 0x", std::hex, op, std::dec);
+      return FAIL;
+  }
+}
+
+}
@@ -0,0 +1,71 @@
+//
+// Created by Jie Wei on 2024/5/17.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <set>
+
+namespace cemu {
+
+class Cpu;
+class SymbolTable;
+
+// 客户机与宿主机之间的两种通信方式，测试程序用它们输出结果并以指定的返回值立即退出：
+//
+// HTIF：客户机向 tohost 写入一个 64 位命令。最低位为 1 表示退出，返回值为 value >> 1；
+// 设备 1 命令 1 输出一个字符；设备 0 命令 0 时 value 是一个 8 个双字的缓冲区地址，
+// 缓冲区中依次是系统调用号和参数，支持 write(64) 和 exit(93)，返回值写回缓冲区第一项。
+// 处理完后 tohost 清零，并向 fromhost 写入应答。
+//
+// 半主机（semihosting）：slli x0, x0, 0x1f; ebreak; srai x0, x0, 7 三条指令组成一次调用，
+// a0 为操作号，a1 为参数或参数块地址，结果写回 a0。支持控制台和宿主机文件的读写以及退出。
+//
+// 客户机只能读写标准输入输出和自己通过 SYS_OPEN 打开的文件，其他文件描述符（例如宿主机上的快照、
+// 日志文件）返回 EBADF。
+class Htif {
+ public:
+  Htif() = default;
+  ~Htif() {
+    close_files();
+  }
+
+  // 持有客户机打开的宿主机文件
+  Htif(const Htif&) = delete;
+  Htif& operator=(const Htif&) = delete;
+
+  // tohost 为 0 时不处理 HTIF 命令
+  uint64_t tohost = 0;
+  uint64_t fromhost = 0;
+
+  // 是否处理半主机调用
+  bool semihosting = false;
+
+  // 客户机标准输出和标准错误的去向
+  std::ostream* out = &std::cout;
+  std::ostream* err = &std::cerr;
+
+  // 从 ELF 符号表中找到 tohost 和 fromhost 的地址，找到 tohost 时返回 true
+  bool locate(const SymbolTable& symbols);
+
+  // 客户机写 tohost 后由 Cpu::store 调用
+  void write_tohost(Cpu& cpu);
+
+  // 由 EBREAK 调用，pc 处是半主机调用序列时执行并返回 true
+  bool semihost(Cpu& cpu);
+
+  // 关闭客户机通过 SYS_OPEN 打开但还没有关闭的文件，在连续运行多个程序时使用
+  void close_files();
+
+ private:
+  uint64_t syscall(Cpu& cpu, uint64_t buf);
+  uint64_t semihost_call(Cpu& cpu, uint64_t op, uint64_t arg);
+  // 把客户机缓冲区写入 fd，返回写出的字节数，失败时返回 -errno
+  int64_t write(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len);
+  int last_errno = 0;
+  std::set<uint64_t> open_files;  // 客户机通过 SYS_OPEN 打开的宿主机文件描述符
+};
+
+}
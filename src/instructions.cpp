@@ -1,11 +1,14 @@
 
+#include <algorithm>
 #include <bitset>
+#include <cstring>
 #include <functional>  // for std::hash
 #include <iostream>
 #include <optional>
 #include <unordered_map>
 #include "log.h"
 #include "instructions.h"
+#include "vector.h"
 
 namespace std {
 template <>
@@ -284,7 +287,7 @@ std::optional<uint64_t> executeSlti(Cpu& cpu, uint32_t inst) {
   auto immediate = static_cast<int64_t>(static_cast<int32_t>(inst & 0xfff00000) >> 20);
 
   LOG(INFO, "SLTI: x", rd, " = (x", rs1, " < ", immediate, ") ? 1 : 0");
-  cpu.regs[rd] = (cpu.regs[rs1] < static_cast<uint64_t>(immediate)) ? 1 : 0;
+  cpu.regs[rd] = (static_cast<int64_t>(cpu.regs[rs1]) < immediate) ? 1 : 0;
   return cpu.update_pc();
 }
 
@@ -293,7 +296,8 @@ std::optional<uint64_t> executeSltiu(Cpu& cpu, uint32_t inst) {
   auto immediate = static_cast<int64_t>(static_cast<int32_t>(inst & 0xfff00000) >> 20);
 
   LOG(INFO, "SLTIU: x", rd, " = (x", rs1, " < ", immediate, ") ? 1 : 0");
-  cpu.regs[rd] = (cpu.regs[rs1] < static_cast<unsigned int>(immediate)) ? 1 : 0;
+  // 立即数先符号扩展，再按无符号数比较
+  cpu.regs[rd] = (cpu.regs[rs1] < static_cast<uint64_t>(immediate)) ? 1 : 0;
   return cpu.update_pc();
 }
 
@@ -334,8 +338,9 @@ std::optional<uint64_t> executeSrai(Cpu& cpu, uint32_t inst) {
 std::optional<uint64_t> executeSll(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
+  // RV64 只使用 rs2 的低 6 位作为移位量
   LOG(INFO, "SLL: x", rd, " = x", rs1, " << x", rs2);
-  cpu.regs[rd] = cpu.regs[rs1] << cpu.regs[rs2];
+  cpu.regs[rd] = cpu.regs[rs1] << (cpu.regs[rs2] & 0x3f);
   return cpu.update_pc();
 }
 
@@ -348,6 +353,14 @@ std::optional<uint64_t> executeSlt(Cpu& cpu, uint32_t inst) {
   return cpu.update_pc();
 }
 
+std::optional<uint64_t> executeSltu(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SLTU: x", rd, " = (x", rs1, " < x", rs2, ") ? 1 : 0 (unsigned)");
+  cpu.regs[rd] = (cpu.regs[rs1] < cpu.regs[rs2]) ? 1 : 0;
+  return cpu.update_pc();
+}
+
 std::optional<uint64_t> executeXor(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
@@ -360,7 +373,7 @@ std::optional<uint64_t> executeSrl(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
   LOG(INFO, "SRL: x", rd, " = x", rs1, " >> x", rs2);
-  cpu.regs[rd] = cpu.regs[rs1] >> cpu.regs[rs2];
+  cpu.regs[rd] = cpu.regs[rs1] >> (cpu.regs[rs2] & 0x3f);
   return cpu.update_pc();
 }
 
@@ -368,7 +381,7 @@ std::optional<uint64_t> executeSra(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
   LOG(INFO, "SRA: x", rd, " = x", rs1, " >> x", rs2, " (arithmetic right shift)");
-  cpu.regs[rd] = static_cast<uint64_t>(static_cast<int64_t>(cpu.regs[rs1]) >> cpu.regs[rs2]);
+  cpu.regs[rd] = static_cast<uint64_t>(static_cast<int64_t>(cpu.regs[rs1]) >> (cpu.regs[rs2] & 0x3f));
   return cpu.update_pc();
 }
 
@@ -392,7 +405,83 @@ std::optional<uint64_t> executeAddw(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
   LOG(INFO, "ADDW: x", rd, " = x", rs1, " + x", rs2);
-  int64_t result = static_cast<int32_t>(cpu.regs[rs1]) + static_cast<int32_t>(cpu.regs[rs2]);
+  // 按 32 位回绕相加，再把结果符号扩展
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1] + cpu.regs[rs2]));
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeSubw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SUBW: x", rd, " = x", rs1, " - x", rs2);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1] - cpu.regs[rs2]));
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+// 32 位移位只使用 rs2 的低 5 位，结果符号扩展
+std::optional<uint64_t> executeSllw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SLLW: x", rd, " = x", rs1, " << x", rs2);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1]) << (cpu.regs[rs2] & 0x1f));
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeSrlw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SRLW: x", rd, " = x", rs1, " >> x", rs2);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1]) >> (cpu.regs[rs2] & 0x1f));
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeSraw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SRAW: x", rd, " = x", rs1, " >> x", rs2, " (arithmetic right shift)");
+  int64_t result = static_cast<int32_t>(cpu.regs[rs1]) >> (cpu.regs[rs2] & 0x1f);
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeAddiw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+  auto immediate = static_cast<int64_t>(static_cast<int32_t>(inst & 0xfff00000) >> 20);
+
+  LOG(INFO, "ADDIW: x", rd, " = x", rs1, " + ", immediate);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1] + immediate));
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+// 32 位立即数移位的移位量只有 5 位，shamt[5] 不为零的编码是非法的，解码表不接受
+std::optional<uint64_t> executeSlliw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SLLIW: x", rd, " = x", rs1, " << ", rs2);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1]) << rs2);
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeSrliw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SRLIW: x", rd, " = x", rs1, " >> ", rs2);
+  int64_t result = static_cast<int32_t>(static_cast<uint32_t>(cpu.regs[rs1]) >> rs2);
+  cpu.regs[rd] = static_cast<uint64_t>(result);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeSraiw(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+
+  LOG(INFO, "SRAIW: x", rd, " = x", rs1, " >> ", rs2, " (arithmetic right shift)");
+  int64_t result = static_cast<int32_t>(cpu.regs[rs1]) >> rs2;
   cpu.regs[rd] = static_cast<uint64_t>(result);
   return cpu.update_pc();
 }
@@ -420,9 +509,17 @@ std::optional<uint64_t> executeAdd(Cpu& cpu, uint32_t inst) {
   return cpu.update_pc();
 }
 
+std::optional<uint64_t> executeSub(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+  LOG(INFO, "SUB: x" , rd , " = x" , rs1 , " - x" , rs2);
+  cpu.regs[rd] = cpu.regs[rs1] - cpu.regs[rs2];
+  return cpu.update_pc();
+}
+
 std::optional<uint64_t> executeLui(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto immediate = static_cast<uint64_t>(inst & 0xfffff000);  // Extract the upper 20 bits
+  // 高 20 位，RV64 中符号扩展到 64 位
+  auto immediate = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(inst & 0xfffff000)));
   LOG(INFO, "LUI: x", rd , " = ", immediate);
   cpu.regs[rd] = immediate;
   return cpu.update_pc();
@@ -437,12 +534,17 @@ std::optional<uint64_t> executeAUIPC(Cpu& cpu, uint32_t inst) {
   return cpu.update_pc();
 }
 
+// J 型指令的立即数 imm[20|10:1|11|19:12] = inst[31|30:21|20|19:12]，符号扩展到 64 位
+int64_t jumpImmediate(uint32_t inst) {
+  return static_cast<int64_t>(static_cast<int32_t>(inst & 0x80000000) >> 11) |
+         (inst & 0xff000) |
+         ((inst >> 9) & 0x800) |
+         ((inst >> 20) & 0x7fe);
+}
+
 std::optional<uint64_t> executeJAL(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto imm = ((inst & 0x80000000) ? 0xfff00000 : 0) |
-             ((inst >> 20) & 0x7fe) |
-             ((inst >> 9) & 0x800) |
-             ((inst >> 12) & 0xff);
+  int64_t imm = jumpImmediate(inst);
 
   LOG(INFO, "JAL: x", rd, " = pc + 4; pc = pc + ", imm);
   cpu.regs[rd] = cpu.pc + 4;
@@ -461,123 +563,62 @@ std::optional<uint64_t> executeJALR(Cpu& cpu, uint32_t inst) {
   return new_pc;
 }
 
+// B 型指令的立即数 imm[12|10:5|4:1|11] = inst[31|30:25|11:8|7]，符号扩展到 64 位
+int64_t branchImmediate(uint32_t inst) {
+  return static_cast<int64_t>(static_cast<int32_t>(inst & 0x80000000) >> 19) |
+         ((inst & 0x80) << 4) |
+         ((inst >> 20) & 0x7e0) |
+         ((inst >> 7) & 0x1e);
+}
+
 std::optional<uint64_t> executeBEQ(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  int64_t imm = static_cast<int64_t>((((inst & 0x80000000) ? 0xFFF00000 : 0) |
-                                   ((inst & 0x80) << 4) |
-                                   ((inst >> 20) & 0x7E0) |
-                                   ((inst >> 7) & 0x1E)) << 1) >> 1;  // Sign-extend
+  int64_t imm = branchImmediate(inst);
 
   if (cpu.regs[rs1] == cpu.regs[rs2]) {
     LOG(INFO, "BEQ: pc = pc + ", imm);
     return cpu.pc + imm;
   }
-  return std::nullopt;
+  return cpu.update_pc();
 }
 
+// CSR 指令都经过 Csr::access：它检查访问权限并按 WARL 掩码写入，返回 CSR 的旧值。
+// 先读出 rs1 再写 rd，rd 与 rs1 相同时 CSR 得到的是 rs1 的旧值
 std::optional<uint64_t> executeCSR_RW(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the value from the rs1 register into the CSR register
-  cpu.csr.store(csr_addr, cpu.regs[rs1]);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Update the program counter
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Write, cpu.regs[rs1], true);
   return cpu.update_pc();
 }
 
+// rs1 为 x0 时只读不写，因此可以用来读只读 CSR
 std::optional<uint64_t> executeCSR_RS(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Perform bitwise OR operation between the CSR register value and the rs1 register value
-  // and store the result back into the CSR register
-  cpu.csr.store(csr_addr, t | cpu.regs[rs1]);
-
-  // Update the program counter
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Set, cpu.regs[rs1], rs1 != 0);
   return cpu.update_pc();
 }
 
 std::optional<uint64_t> executeCSR_RC(Cpu& cpu, uint32_t inst) {
   auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Perform bitwise AND operation between the CSR register value and the bitwise NOT of the rs1 register value
-  // and store the result back into the CSR register
-  cpu.csr.store(csr_addr, t & ~cpu.regs[rs1]);
-
-  // Update the program counter
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Clear, cpu.regs[rs1], rs1 != 0);
   return cpu.update_pc();
 }
 
+// 立即数形式：rs1 字段是 5 位零扩展的立即数 zimm
 std::optional<uint64_t> executeCSR_RWI(Cpu& cpu, uint32_t inst) {
-  auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Set the CSR register value to the immediate value
-  cpu.csr.store(csr_addr, rs1);
-
-  // Update the program counter
+  auto [rd, zimm, rs2] = unpackInstruction(inst);
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Write, zimm, true);
   return cpu.update_pc();
 }
 
 std::optional<uint64_t> executeCSR_RSI(Cpu& cpu, uint32_t inst) {
-  auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Perform bitwise OR operation between the CSR register value and the immediate value
-  // and store the result back into the CSR register
-  cpu.csr.store(csr_addr, t | (1 << rs1));
-
-  // Update the program counter
+  auto [rd, zimm, rs2] = unpackInstruction(inst);
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Set, zimm, zimm != 0);
   return cpu.update_pc();
 }
 
 std::optional<uint64_t> executeCSR_RCI(Cpu& cpu, uint32_t inst) {
-  auto [rd, rs1, rs2] = unpackInstruction(inst);
-  auto csr_addr = (inst & 0xfff00000) >> 20;
-
-  // Load the value from the CSR register
-  uint64_t t = cpu.csr.load(csr_addr);
-
-  // Store the original CSR value into the rd register
-  cpu.regs[rd] = t;
-
-  // Perform bitwise AND operation between the CSR register value and the bitwise NOT of the immediate value
-  // and store the result back into the CSR register
-  cpu.csr.store(csr_addr, t & ~rs1);
-
-  // Update the program counter
+  auto [rd, zimm, rs2] = unpackInstruction(inst);
+  cpu.regs[rd] = cpu.csr.access(inst, cpu.mode, Csr::Op::Clear, zimm, zimm != 0);
   return cpu.update_pc();
 }
 
@@ -590,6 +631,33 @@ std::optional<uint64_t> executeSFENCE_VMA(Cpu& cpu, uint32_t inst) {
   return cpu.update_pc();
 }
 
+std::optional<uint64_t> executeECALL_EBREAK(Cpu& cpu, uint32_t inst) {
+  if ((inst >> 20) == 0) {
+    // 用户态模拟时系统调用在宿主机上完成，不进入陷入处理
+    if (cpu.mode == User && cpu.usermode != nullptr) {
+      cpu.usermode->syscall(cpu);
+      return cpu.update_pc();
+    }
+    // ECALL：按当前特权级产生环境调用异常，epc 指向 ECALL 本身
+    switch (cpu.mode) {
+      case User:
+        throw Exception(ExceptionType::EnvironmentCallFromUMode, 0);
+      case Supervisor:
+        throw Exception(ExceptionType::EnvironmentCallFromSMode, 0);
+      default:
+        throw Exception(ExceptionType::EnvironmentCallFromMMode, 0);
+    }
+  }
+  if ((inst >> 20) == 1) {
+    // EBREAK：半主机调用在宿主机上直接完成，之后的 srai x0, x0, 7 照常作为空操作执行
+    if (cpu.htif != nullptr && cpu.htif->semihost(cpu)) {
+      return cpu.update_pc();
+    }
+    throw Exception(ExceptionType::Breakpoint, cpu.pc);
+  }
+  return std::nullopt;
+}
+
 std::optional<uint64_t> executeSRET(Cpu& cpu, uint32_t inst) {
   // 从 CSR 寄存器加载 sstatus 的值
   uint64_t sstatus = cpu.csr.load(SSTATUS);
@@ -615,6 +683,8 @@ std::optional<uint64_t> executeSRET(Cpu& cpu, uint32_t inst) {
   // 将程序计数器（PC）设置为 sepc 寄存器的值
   // 当 IALIGN=32 时，sepc[1] 位在读取时被屏蔽，使其看起来像是 0。这种屏蔽也发生在 SRET 指令的隐式读取中
   uint64_t new_pc = cpu.csr.load(SEPC) & ~0b11;
+  // xRET 本身算在返回前的特权级中
+  cpu.accounting.trap_return(cpu.mode, cpu.csr.instret + 1);
 
   // 返回新的程序计数器（PC）的值
   return new_pc;
@@ -650,6 +720,8 @@ std::optional<uint64_t> executeMRET(Cpu& cpu, uint32_t inst) {
   // Set the program counter (PC) to the value of the mepc register
   // When IALIGN=32, the mepc[1] bit is masked when read, making it look like 0. This masking also occurs in the implicit read of the MRET instruction
   uint64_t new_pc = cpu.csr.load(MEPC) & ~0b11;
+  // xRET 本身算在返回前的特权级中
+  cpu.accounting.trap_return(cpu.mode, cpu.csr.instret + 1);
 
   // Return the new value of the program counter (PC)
   return new_pc;
@@ -657,17 +729,14 @@ std::optional<uint64_t> executeMRET(Cpu& cpu, uint32_t inst) {
 
 std::optional<uint64_t> executeBNE(Cpu& cpu, uint32_t inst) {
     auto [rd, rs1, rs2] = unpackInstruction(inst);
-    auto imm = static_cast<int64_t>((((inst & 0x80000000) ? 0xFFF00000 : 0) |
-                                     ((inst & 0x80) << 4) |
-                                     ((inst >> 20) & 0x7E0) |
-                                     ((inst >> 7) & 0x1E)) << 1) >> 1;  // Sign-extend
+    int64_t imm = branchImmediate(inst);
 
     if (cpu.regs[rs1] != cpu.regs[rs2]) {
         LOG(INFO, "BNE: pc = pc + ", imm);
         return cpu.pc + imm;
     }
 
-    return std::nullopt;
+    return cpu.update_pc();
 }
 
 /**
@@ -679,17 +748,14 @@ std::optional<uint64_t> executeBNE(Cpu& cpu, uint32_t inst) {
  * @param cpu The current state of the CPU, including registers and other relevant data.
  * @param inst The 32-bit binary representation of the instruction to execute.
  *
- * @return If the branch is taken, returns the new program counter value. If the branch is not taken, returns std::nullopt.
+ * @return If the branch is taken, returns the branch target. Otherwise returns the address of the next instruction.
  */
 std::optional<uint64_t> executeBLT(Cpu& cpu, uint32_t inst) {
   // Unpack the instruction into its constituent parts
   auto [rd, rs1, rs2] = unpackInstruction(inst);
 
   // Calculate the branch offset, taking into account that it's a signed value
-  int64_t imm = static_cast<int64_t>((static_cast<int64_t>(inst) & 0x80000000 ? 0xFFFFF000LL : 0) |
-                ((static_cast<uint64_t>(inst) & 0x80) << 4) |
-                ((inst >> 20) & 0x7E0) |
-                ((inst >> 7) & 0x1E));
+  int64_t imm = branchImmediate(inst);
 
   // If the value in rs1 is less than the value in rs2, branch to the calculated offset
   if (static_cast<int64_t>(cpu.regs[rs1]) < static_cast<int64_t>(cpu.regs[rs2])) {
@@ -697,150 +763,668 @@ std::optional<uint64_t> executeBLT(Cpu& cpu, uint32_t inst) {
     return cpu.pc + imm;
   }
 
-  // If the branch is not taken, return std::nullopt
-  return std::nullopt;
+  // If the branch is not taken, fall through to the next instruction
+  return cpu.update_pc();
 }
 
 
 std::optional<uint64_t> executeBGE(Cpu& cpu, uint32_t inst) {
     auto [rd, rs1, rs2] = unpackInstruction(inst);
-    auto imm = static_cast<int64_t>((((inst & 0x80000000) ? 0xFFF00000 : 0) |
-                                     ((inst & 0x80) << 4) |
-                                     ((inst >> 20) & 0x7E0) |
-                                     ((inst >> 7) & 0x1E)) << 1) >> 1;  // Sign-extend
+    int64_t imm = branchImmediate(inst);
 
     if (static_cast<int64_t>(cpu.regs[rs1]) >= static_cast<int64_t>(cpu.regs[rs2])) {
         LOG(INFO, "BGE: pc = pc + ", imm);
         return cpu.pc + imm;
     }
 
-    return std::nullopt;
+    return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeBLTU(Cpu& cpu, uint32_t inst) {
+    auto [rd, rs1, rs2] = unpackInstruction(inst);
+    int64_t imm = branchImmediate(inst);
+
+    if (cpu.regs[rs1] < cpu.regs[rs2]) {
+        LOG(INFO, "BLTU: pc = pc + ", imm);
+        return cpu.pc + imm;
+    }
+
+    return cpu.update_pc();
 }
 
 std::optional<uint64_t> executeBGEU(Cpu& cpu, uint32_t inst) {
     auto [rd, rs1, rs2] = unpackInstruction(inst);
-    auto imm = static_cast<int64_t>((((inst & 0x80000000) ? 0xFFF00000 : 0) |
-                                     ((inst & 0x80) << 4) |
-                                     ((inst >> 20) & 0x7E0) |
-                                     ((inst >> 7) & 0x1E)) << 1) >> 1;  // Sign-extend
+    int64_t imm = branchImmediate(inst);
 
     if (cpu.regs[rs1] >= cpu.regs[rs2]) {
         LOG(INFO, "BGEU: pc = pc + ", imm);
         return cpu.pc + imm;
     }
 
-    return std::nullopt;
+    return cpu.update_pc();
 }
 
-using ExecuteFunction = std::function<std::optional<uint64_t>(Cpu&, uint32_t)>;
+// ---------------------------------------------------------------------------
+// 向量扩展（RVV 1.0 的子集）：vsetvl{i}、单位步长/跨步访存、整数加减乘与逻辑运算、归约。
+// 元素运算由 vector.cpp 中按宿主机 SIMD 能力选择的内核完成。
 
-std::optional<uint64_t> InstructionExecutor::execute(Cpu& cpu, uint32_t inst) {
-  uint32_t opcode = inst & 0x0000007f;
-  uint32_t funct3  = (inst & 0x00007000) >> 12;
-  uint32_t funct7 = (inst & 0xfe000000) >> 25;
+// vtype 解码结果
+struct VectorType {
+  uint64_t sew;    // 元素位宽
+  uint64_t vlmax;  // 最大元素个数
+  uint64_t lmul;   // 寄存器组包含的寄存器个数（分数 LMUL 记为 1）
+};
 
-  // x0 is hardwired zero
-  cpu.regs[0] = 0;
-  LOG(INFO, "Instruction: 0x", std::hex, inst, std::dec);
-  LOG(INFO, "Executing instruction with opcode: 0x", std::hex, opcode, std::dec);
+std::optional<VectorType> decodeVtype(uint64_t vtype) {
+  uint64_t vlmul = vtype & 0x7;
+  uint64_t vsew = (vtype >> 3) & 0x7;
+  // vill 或保留位被设置，或 vsew / vlmul 取保留编码
+  if ((vtype >> 8) != 0 || vsew > 3 || vlmul == 4) {
+    return std::nullopt;
+  }
+  uint64_t sew = 8 << vsew;
+  if (vlmul < 4) {
+    return VectorType{sew, (VLEN / sew) << vlmul, 1ULL << vlmul};
+  }
+  // 分数 LMUL：1/8、1/4、1/2
+  uint64_t vlmax = (VLEN / sew) >> (8 - vlmul);
+  if (vlmax == 0) {
+    return std::nullopt;
+  }
+  return VectorType{sew, vlmax, 1};
+}
 
-  std::unordered_map<uint32_t, ExecuteFunction> opcodeTable = {
-    {0x17, executeAUIPC},
-    {0x37, executeLui},
-    {0x67, executeJALR},
-    {0x6f, executeJAL},
-  };
+// 当前的 vl。vsetvl 保证 vl 不超过 VLMAX，但恢复快照等直接写 CSR 的路径不经过它，
+// 使用前再按 VLMAX 截断一次，保证访问不越过寄存器组
+uint64_t vectorLength(Cpu& cpu, const VectorType& vt) {
+  return std::min(cpu.csr.load(VL), vt.vlmax);
+}
 
-  // Look up the corresponding execute function in the opcodeTable
-  auto executeFunc = opcodeTable.find(opcode);
+// 寄存器组必须按组大小对齐且不越过 v31
+bool isValidGroup(uint32_t reg, uint64_t lmul) {
+  return reg % lmul == 0 && reg + lmul <= 32;
+}
 
-  // If found, call the execute function with the given instruction
-  if (executeFunc != opcodeTable.end()) {
-    auto result = executeFunc->second(cpu, inst);
-    if (result.has_value()) {
-      LOG(INFO, "Instruction executed successfully. New PC: 0x", std::hex, result.value(), std::dec);
+std::optional<uint64_t> executeVsetvl(Cpu& cpu, uint32_t inst) {
+  auto [rd, rs1, rs2] = unpackInstruction(inst);
+  uint64_t vtype;
+  uint64_t avl;
+  if ((inst >> 30) == 0b11) {
+    // vsetivli：AVL 为 rs1 字段中的 5 位立即数
+    vtype = (inst >> 20) & 0x3ff;
+    avl = rs1;
+  } else {
+    // vsetvli 的 vtype 为 11 位立即数，vsetvl 的 vtype 来自 rs2
+    vtype = (inst >> 31) == 0 ? (inst >> 20) & 0x7ff : cpu.regs[rs2];
+    if (rs1 != 0) {
+      avl = cpu.regs[rs1];
+    } else if (rd != 0) {
+      avl = UINT64_MAX;
     } else {
-      throw Exception(ExceptionType::IllegalInstruction, inst);
+      avl = cpu.csr.load(VL);  // 保持 vl 不变，只修改 vtype
     }
-    return result;
-  }
-
-  LOG(INFO, "funct3: 0x", std::hex, funct3, std::dec);
-
-  std::unordered_map<std::tuple<uint32_t, uint32_t>, ExecuteFunction> instructionMap = {
-    {std::make_tuple(0x03, 0x0), executeLb},
-    {std::make_tuple(0x03, 0x1), executeLh},
-    {std::make_tuple(0x03, 0x2), executeLw},
-    {std::make_tuple(0x03, 0x3), executeLd},
-    {std::make_tuple(0x03, 0x4), executeLbu},
-    {std::make_tuple(0x03, 0x5), executeLhu},
-    {std::make_tuple(0x03, 0x6), executeLwu},
-    {std::make_tuple(0x0f, 0x0), executeFence},
-    {std::make_tuple(0x13, 0x0), executeAddi},
-    {std::make_tuple(0x13, 0x1), executeSlli},
-    {std::make_tuple(0x13, 0x2), executeSlti},
-    {std::make_tuple(0x13, 0x3), executeSltiu},
-    {std::make_tuple(0x13, 0x4), executeXori},
-    {std::make_tuple(0x13, 0x6), executeOri},
-    {std::make_tuple(0x13, 0x7), executeAndi},
-    {std::make_tuple(0x19, 0x7), executeSb},
-    {std::make_tuple(0x23, 0x0), executeStoreByte},
-    {std::make_tuple(0x23, 0x3), executeStoreDouble},
-    {std::make_tuple(0x63, 0x1), executeBEQ},
-    {std::make_tuple(0x73, 0x1), executeCSR_RW},
-    {std::make_tuple(0x73, 0x2), executeCSR_RS},
-    {std::make_tuple(0x73, 0x3), executeCSR_RC},
-    {std::make_tuple(0x73, 0x5), executeCSR_RWI},
-    {std::make_tuple(0x73, 0x6), executeCSR_RSI},
-    {std::make_tuple(0x73, 0x7), executeCSR_RCI},
-  };
+  }
+
+  auto vt = decodeVtype(vtype);
+  uint64_t vl = vt.has_value() ? std::min(avl, vt->vlmax) : 0;
+  LOG(INFO, "VSETVL: vtype = ", std::hex, vtype, ", vl = ", std::dec, vl);
+  cpu.csr.store(VTYPE, vt.has_value() ? vtype : MASK_VILL);
+  cpu.csr.store(VL, vl);
+  cpu.csr.store(VSTART, 0);
+  cpu.regs[rd] = vl;
+  return cpu.update_pc();
+}
+
+// 访存指令 width 字段 -> 元素位宽，标量浮点访存的编码不在此处理
+uint64_t vectorMemEew(uint32_t width) {
+  switch (width) {
+    case 0x0:
+      return 8;
+    case 0x5:
+      return 16;
+    case 0x6:
+      return 32;
+    default:
+      return 64;
+  }
+}
+
+std::optional<uint64_t> executeVLoad(Cpu& cpu, uint32_t inst) {
+  auto [vd, rs1, rs2] = unpackInstruction(inst);
+  uint32_t mop = (inst >> 26) & 0x3;
+  bool masked = ((inst >> 25) & 1) == 0;
+  uint32_t nf = inst >> 29;
+  auto vt = decodeVtype(cpu.csr.load(VTYPE));
+  // 只支持单位步长（lumop = 0）与跨步访存，不支持分段访存和索引访存
+  if (!vt.has_value() || nf != 0 || (mop != 0b00 && mop != 0b10) || (mop == 0b00 && rs2 != 0)) {
+    return std::nullopt;
+  }
+  uint64_t eew = vectorMemEew((inst >> 12) & 0x7);
+  uint64_t nbytes = eew / 8;
+  uint64_t emul = std::max<uint64_t>(1, eew * vt->lmul / vt->sew);
+  if (!isValidGroup(vd, emul) || (masked && vd == 0)) {
+    return std::nullopt;
+  }
+
+  uint64_t vl = vectorLength(cpu, *vt);
+  uint64_t vstart = cpu.csr.load(VSTART);
+  uint64_t base = cpu.regs[rs1];
+  uint64_t stride = mop == 0b10 ? cpu.regs[rs2] : nbytes;
+  uint8_t* dst = cpu.vreg(vd);
+  LOG(INFO, "VLE", eew, ": v", vd, " = MEM[x", rs1, "], stride = ", stride, ", vl = ", vl);
+
+  // 单位步长且整段都在 DRAM 中时直接整块拷贝
+  if (!masked && stride == nbytes && vstart == 0) {
+    if (uint8_t* src = cpu.bus.dram_ptr(base, vl * nbytes)) {
+      std::memcpy(dst, src, vl * nbytes);
+      cpu.csr.store(VSTART, 0);
+      return cpu.update_pc();
+    }
+  }
+  // 从 vstart 开始逐个元素访问。某个元素出错时把它的下标记入 vstart，处理程序返回后从这里继续
+  const uint8_t* mask = cpu.vreg(0);
+  uint64_t i = vstart;
+  try {
+    for (; i < vl; ++i) {
+      if (masked && ((mask[i / 8] >> (i % 8)) & 1) == 0) {
+        continue;
+      }
+      uint64_t value = cpu.load(base + i * stride, eew).value();
+      std::memcpy(dst + i * nbytes, &value, nbytes);
+    }
+  } catch (const Exception&) {
+    cpu.csr.store(VSTART, i);
+    throw;
+  }
+  cpu.csr.store(VSTART, 0);
+  return cpu.update_pc();
+}
+
+std::optional<uint64_t> executeVStore(Cpu& cpu, uint32_t inst) {
+  auto [vs3, rs1, rs2] = unpackInstruction(inst);
+  uint32_t mop = (inst >> 26) & 0x3;
+  bool masked = ((inst >> 25) & 1) == 0;
+  uint32_t nf = inst >> 29;
+  auto vt = decodeVtype(cpu.csr.load(VTYPE));
+  if (!vt.has_value() || nf != 0 || (mop != 0b00 && mop != 0b10) || (mop == 0b00 && rs2 != 0)) {
+    return std::nullopt;
+  }
+  uint64_t eew = vectorMemEew((inst >> 12) & 0x7);
+  uint64_t nbytes = eew / 8;
+  uint64_t emul = std::max<uint64_t>(1, eew * vt->lmul / vt->sew);
+  if (!isValidGroup(vs3, emul)) {
+    return std::nullopt;
+  }
+
+  uint64_t vl = vectorLength(cpu, *vt);
+  uint64_t vstart = cpu.csr.load(VSTART);
+  uint64_t base = cpu.regs[rs1];
+  uint64_t stride = mop == 0b10 ? cpu.regs[rs2] : nbytes;
+  const uint8_t* src = cpu.vreg(vs3);
+  LOG(INFO, "VSE", eew, ": MEM[x", rs1, "] = v", vs3, ", stride = ", stride, ", vl = ", vl);
+
+  if (!masked && stride == nbytes && vstart == 0) {
+    if (uint8_t* dst = cpu.bus.dram_ptr(base, vl * nbytes)) {
+      std::memcpy(dst, src, vl * nbytes);
+      cpu.bus.memory().mark_dirty(base, vl * nbytes);
+      cpu.blocks.invalidate(base, vl * nbytes);
+      cpu.csr.store(VSTART, 0);
+      return cpu.update_pc();
+    }
+  }
+  const uint8_t* mask = cpu.vreg(0);
+  uint64_t i = vstart;
+  try {
+    for (; i < vl; ++i) {
+      if (masked && ((mask[i / 8] >> (i % 8)) & 1) == 0) {
+        continue;
+      }
+      uint64_t value = 0;
+      std::memcpy(&value, src + i * nbytes, nbytes);
+      cpu.store(base + i * stride, eew, value);
+    }
+  } catch (const Exception&) {
+    cpu.csr.store(VSTART, i);
+    throw;
+  }
+  cpu.csr.store(VSTART, 0);
+  return cpu.update_pc();
+}
+
+// 把运算结果写回 vd：未使用掩码时由内核直接写入，使用掩码时先算到临时缓冲区再按 v0 合并
+template <typename F>
+void writeVectorResult(Cpu& cpu, uint32_t vd, bool masked, uint64_t sew, uint64_t vl, F&& compute) {
+  if (!masked) {
+    compute(cpu.vreg(vd));
+    return;
+  }
+  alignas(32) std::array<uint8_t, 8 * VLEN_BYTES> tmp;
+  compute(tmp.data());
+  vector_merge(sew, cpu.vreg(vd), tmp.data(), cpu.vreg(0), vl);
+}
 
-  auto it = instructionMap.find({opcode, funct3});
-  if (it != instructionMap.end()) {
-    auto result = it->second(cpu, inst);
-    if (result.has_value()) {
-      LOG(INFO, "Instruction executed successfully. New PC: 0x", std::hex, result.value(), std::dec);
+// OPIVV / OPIVI / OPIVX：整数加减、最值、逻辑运算与 vmv.v.* / vmerge
+std::optional<uint64_t> executeVOpI(Cpu& cpu, uint32_t inst) {
+  auto [vd, rs1, vs2] = unpackInstruction(inst);
+  uint32_t funct3 = (inst >> 12) & 0x7;
+  uint32_t funct6 = inst >> 26;
+  bool masked = ((inst >> 25) & 1) == 0;
+  auto vt = decodeVtype(cpu.csr.load(VTYPE));
+  // 运算指令不会在中途陷入，规范允许 vstart 非零时报非法指令异常
+  if (!vt.has_value() || !isValidGroup(vd, vt->lmul) || (masked && vd == 0) || cpu.csr.load(VSTART) != 0) {
+    return std::nullopt;
+  }
+  uint64_t sew = vt->sew;
+  uint64_t vl = vectorLength(cpu, *vt);
+
+  // 第二个操作数：OPIVV 为向量寄存器，OPIVX 为标量寄存器，OPIVI 为符号扩展的 5 位立即数
+  alignas(32) std::array<uint8_t, 8 * VLEN_BYTES> splat;
+  const uint8_t* src1;
+  if (funct3 == 0x0) {
+    if (!isValidGroup(rs1, vt->lmul)) {
+      return std::nullopt;
+    }
+    src1 = cpu.vreg(rs1);
+  } else {
+    uint64_t scalar = funct3 == 0x4 ? cpu.regs[rs1]
+                                    : static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(rs1 << 27) >> 27));
+    vector_splat(sew, splat.data(), scalar, vl);
+    src1 = splat.data();
+  }
+
+  // vmv.v.* 与 vmerge.v*m
+  if (funct6 == 0x17) {
+    if (masked) {
+      if (!isValidGroup(vs2, vt->lmul)) {
+        return std::nullopt;
+      }
+      // vd[i] = v0.mask[i] ? src1[i] : vs2[i]。vd 可能与 vs1 重叠，先在临时缓冲区中合并
+      alignas(32) std::array<uint8_t, 8 * VLEN_BYTES> tmp;
+      std::memcpy(tmp.data(), cpu.vreg(vs2), vl * sew / 8);
+      vector_merge(sew, tmp.data(), src1, cpu.vreg(0), vl);
+      std::memcpy(cpu.vreg(vd), tmp.data(), vl * sew / 8);
     } else {
-      throw Exception(ExceptionType::IllegalInstruction, inst);
+      std::memmove(cpu.vreg(vd), src1, vl * sew / 8);
     }
-    return result;
-  }
-
-  LOG(INFO, "funct7: 0x", std::hex, funct7, std::dec);
-
-  std::unordered_map<std::tuple<uint32_t, uint32_t, uint32_t>, ExecuteFunction> instruction2Map = {
-    {std::make_tuple(0x13, 0x5, 0x00), executeSrli},
-    {std::make_tuple(0x13, 0x5, 0x20), executeSrai},
-    {std::make_tuple(0x33, 0x0, 0x00), executeAdd},
-    {std::make_tuple(0x33, 0x1, 0x00), executeSll},
-    {std::make_tuple(0x33, 0x2, 0x00), executeSlt},
-    {std::make_tuple(0x33, 0x4, 0x00), executeXor},
-    {std::make_tuple(0x33, 0x5, 0x00), executeSrl},
-    {std::make_tuple(0x33, 0x5, 0x20), executeSra},
-    {std::make_tuple(0x33, 0x6, 0x00), executeOr},
-    {std::make_tuple(0x33, 0x7, 0x00), executeAnd},
-    {std::make_tuple(0x3b, 0x0, 0x00), executeAddw},
-    {std::make_tuple(0x73, 0x0, 0x9), executeSFENCE_VMA},
-    {std::make_tuple(0x73, 0x0, 0x8), executeSRET},
-    {std::make_tuple(0x73, 0x0, 0x18), executeMRET},
-  };
+    LOG(INFO, "VMV/VMERGE: v", vd, ", vl = ", vl);
+    cpu.csr.store(VSTART, 0);
+    return cpu.update_pc();
+  }
+
+  if (!isValidGroup(vs2, vt->lmul)) {
+    return std::nullopt;
+  }
+  const uint8_t* src2 = cpu.vreg(vs2);
+  VectorOp op;
+  switch (funct6) {
+    case 0x00:
+      op = VectorOp::Add;
+      break;
+    case 0x02:
+      if (funct3 == 0x3) {
+        return std::nullopt;  // 没有 vsub.vi
+      }
+      op = VectorOp::Sub;
+      break;
+    case 0x03:
+      if (funct3 == 0x0) {
+        return std::nullopt;  // 没有 vrsub.vv
+      }
+      // vrsub：vd = src1 - vs2
+      op = VectorOp::Sub;
+      std::swap(src1, src2);
+      break;
+    case 0x04:
+      op = VectorOp::Minu;
+      break;
+    case 0x05:
+      op = VectorOp::Min;
+      break;
+    case 0x06:
+      op = VectorOp::Maxu;
+      break;
+    case 0x07:
+      op = VectorOp::Max;
+      break;
+    case 0x09:
+      op = VectorOp::And;
+      break;
+    case 0x0a:
+      op = VectorOp::Or;
+      break;
+    case 0x0b:
+      op = VectorOp::Xor;
+      break;
+    default:
+      return std::nullopt;
+  }
+  if ((op == VectorOp::Minu || op == VectorOp::Min || op == VectorOp::Maxu || op == VectorOp::Max) &&
+      funct3 == 0x3) {
+    return std::nullopt;  // 最值运算没有立即数形式
+  }
+
+  LOG(INFO, "VOPI: v", vd, " = v", vs2, " op ", funct3 == 0x0 ? "v" : "x", rs1, ", funct6 = 0x", std::hex, funct6,
+      std::dec, ", vl = ", vl);
+  writeVectorResult(cpu, vd, masked, sew, vl,
+                    [&](uint8_t* dst) { vector_binary(op, sew, dst, src2, src1, vl); });
+  cpu.csr.store(VSTART, 0);
+  return cpu.update_pc();
+}
+
+// OPMVV / OPMVX：整数乘法、归约、vmv.x.s 与 vmv.s.x
+std::optional<uint64_t> executeVOpM(Cpu& cpu, uint32_t inst) {
+  auto [vd, rs1, vs2] = unpackInstruction(inst);
+  uint32_t funct3 = (inst >> 12) & 0x7;
+  uint32_t funct6 = inst >> 26;
+  bool masked = ((inst >> 25) & 1) == 0;
+  auto vt = decodeVtype(cpu.csr.load(VTYPE));
+  if (!vt.has_value() || cpu.csr.load(VSTART) != 0) {
+    return std::nullopt;
+  }
+  uint64_t sew = vt->sew;
+  uint64_t nbytes = sew / 8;
+  uint64_t vl = vectorLength(cpu, *vt);
+
+  // vmv.x.s：x[rd] = sext(vs2[0])，vmv.s.x：vd[0] = x[rs1]
+  if (funct6 == 0x10) {
+    if (funct3 == 0x2 && rs1 == 0 && !masked) {
+      int64_t value = 0;
+      std::memcpy(&value, cpu.vreg(vs2), nbytes);
+      uint64_t shift = 64 - sew;
+      cpu.regs[vd] = static_cast<uint64_t>((value << shift) >> shift);
+      LOG(INFO, "VMV.X.S: x", vd, " = v", vs2, "[0]");
+      return cpu.update_pc();
+    }
+    if (funct3 == 0x6 && vs2 == 0 && !masked) {
+      if (vl > 0) {
+        std::memcpy(cpu.vreg(vd), &cpu.regs[rs1], nbytes);
+      }
+      LOG(INFO, "VMV.S.X: v", vd, "[0] = x", rs1);
+      cpu.csr.store(VSTART, 0);
+      return cpu.update_pc();
+    }
+    return std::nullopt;
+  }
 
-  auto it1 = instruction2Map.find({opcode, funct3, funct7});
-  LOG(INFO, "Executing srli or srai funct7: 0x" , std::hex, funct7 , std::dec);
-  if (it1 != instruction2Map.end()) {
-    auto result = it1->second(cpu, inst);
-    if (result.has_value()) {
-      LOG(INFO, "Instruction executed successfully. New PC: 0x", std::hex, result.value(), std::dec);
+  // 归约：vd[0] = op(vs1[0], vs2[0..vl-1])
+  if (funct3 == 0x2 && funct6 <= 0x07) {
+    if (!isValidGroup(vs2, vt->lmul) || masked) {
+      return std::nullopt;
+    }
+    if (vl == 0) {
+      cpu.csr.store(VSTART, 0);
+      return cpu.update_pc();
+    }
+    uint64_t init = 0;
+    std::memcpy(&init, cpu.vreg(rs1), nbytes);
+    uint64_t result = vector_reduce(static_cast<VectorRedOp>(funct6), sew, cpu.vreg(vs2), init, vl);
+    std::memcpy(cpu.vreg(vd), &result, nbytes);
+    LOG(INFO, "VRED: v", vd, "[0] = reduce(v", rs1, "[0], v", vs2, "), funct6 = 0x", std::hex, funct6, std::dec);
+    cpu.csr.store(VSTART, 0);
+    return cpu.update_pc();
+  }
+
+  // vmul.vv / vmul.vx
+  if (funct6 == 0x25) {
+    if (!isValidGroup(vd, vt->lmul) || !isValidGroup(vs2, vt->lmul) || (masked && vd == 0)) {
+      return std::nullopt;
+    }
+    alignas(32) std::array<uint8_t, 8 * VLEN_BYTES> splat;
+    const uint8_t* src1;
+    if (funct3 == 0x2) {
+      if (!isValidGroup(rs1, vt->lmul)) {
+        return std::nullopt;
+      }
+      src1 = cpu.vreg(rs1);
     } else {
-      throw Exception(ExceptionType::IllegalInstruction, inst);
+      vector_splat(sew, splat.data(), cpu.regs[rs1], vl);
+      src1 = splat.data();
     }
-    return result;
-  } else {
+    const uint8_t* src2 = cpu.vreg(vs2);
+    LOG(INFO, "VMUL: v", vd, " = v", vs2, " * ", funct3 == 0x2 ? "v" : "x", rs1, ", vl = ", vl);
+    writeVectorResult(cpu, vd, masked, sew, vl,
+                      [&](uint8_t* dst) { vector_binary(VectorOp::Mul, sew, dst, src2, src1, vl); });
+    cpu.csr.store(VSTART, 0);
+    return cpu.update_pc();
+  }
+
+  return std::nullopt;
+}
+
+// 非法或尚未实现的指令。块缓存把它放在解码失败的位置，真正执行到时才抛出异常
+std::optional<uint64_t> executeIllegal(Cpu&, uint32_t inst) {
+  throw Exception(ExceptionType::IllegalInstruction, inst);
+}
+
+// ---------------------------------------------------------------- 按操作数特化的执行函数
+// 由 InstructionExecutor::specialize 在预解码时选择，保证 x0 始终为零
+
+// 目的寄存器为 x0、没有副作用的整数运算（nop 和各种 HINT）
+std::optional<uint64_t> executeNop(Cpu& cpu, uint32_t) {
+  return cpu.update_pc();
+}
+
+// 目的寄存器为 x0 但有副作用的指令（访存、跳转、CSR 访问等）：照常执行，再把被写入的 x0 恢复为零
+template <ExecuteFunction fn>
+std::optional<uint64_t> executeDiscardRd(Cpu& cpu, uint32_t inst) {
+  auto next = fn(cpu, inst);
+  cpu.regs[0] = 0;
+  return next;
+}
+
+// addi rd, x0, imm（li）
+std::optional<uint64_t> executeLi(Cpu& cpu, uint32_t inst) {
+  cpu.regs[(inst >> 7) & 0x1f] = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(inst) >> 20));
+  return cpu.update_pc();
+}
+
+// addi rd, rs1, 0（mv）
+std::optional<uint64_t> executeMv(Cpu& cpu, uint32_t inst) {
+  cpu.regs[(inst >> 7) & 0x1f] = cpu.regs[(inst >> 15) & 0x1f];
+  return cpu.update_pc();
+}
+
+#define DISCARD_RD(fn) {fn, executeDiscardRd<fn>}
+
+// 写整数寄存器 rd 且有副作用的执行函数，rd 为 x0 时换成 executeDiscardRd 的特化
+const std::unordered_map<ExecuteFunction, ExecuteFunction> discardRdTable = {
+    DISCARD_RD(executeLb),
+    DISCARD_RD(executeLh),
+    DISCARD_RD(executeLw),
+    DISCARD_RD(executeLd),
+    DISCARD_RD(executeLbu),
+    DISCARD_RD(executeLhu),
+    DISCARD_RD(executeLwu),
+    DISCARD_RD(executeJAL),
+    DISCARD_RD(executeJALR),
+    DISCARD_RD(executeCSR_RW),
+    DISCARD_RD(executeCSR_RS),
+    DISCARD_RD(executeCSR_RC),
+    DISCARD_RD(executeCSR_RWI),
+    DISCARD_RD(executeCSR_RSI),
+    DISCARD_RD(executeCSR_RCI),
+    DISCARD_RD(executeVsetvl),
+    DISCARD_RD(executeVOpM),  // vmv.x.s
+};
+
+// 解码表项：执行函数及其名字，名字用于性能分析报告
+struct Handler {
+  ExecuteFunction fn;
+  const char* name;
+};
+
+#define HANDLER(fn) Handler{fn, #fn}
+
+// 解码表只构造一次：先按 opcode 查找，再按 (opcode, funct3)，最后按 (opcode, funct3, funct7)
+const std::unordered_map<uint32_t, Handler> opcodeTable = {
+    {0x17, HANDLER(executeAUIPC)},
+    {0x37, HANDLER(executeLui)},
+    {0x67, HANDLER(executeJALR)},
+    {0x6f, HANDLER(executeJAL)},
+};
+
+const std::unordered_map<std::tuple<uint32_t, uint32_t>, Handler> instructionMap = {
+    {std::make_tuple(0x03, 0x0), HANDLER(executeLb)},
+    {std::make_tuple(0x03, 0x1), HANDLER(executeLh)},
+    {std::make_tuple(0x03, 0x2), HANDLER(executeLw)},
+    {std::make_tuple(0x03, 0x3), HANDLER(executeLd)},
+    {std::make_tuple(0x03, 0x4), HANDLER(executeLbu)},
+    {std::make_tuple(0x03, 0x5), HANDLER(executeLhu)},
+    {std::make_tuple(0x03, 0x6), HANDLER(executeLwu)},
+    {std::make_tuple(0x07, 0x0), HANDLER(executeVLoad)},
+    {std::make_tuple(0x07, 0x5), HANDLER(executeVLoad)},
+    {std::make_tuple(0x07, 0x6), HANDLER(executeVLoad)},
+    {std::make_tuple(0x07, 0x7), HANDLER(executeVLoad)},
+    {std::make_tuple(0x0f, 0x0), HANDLER(executeFence)},
+    {std::make_tuple(0x0f, 0x1), HANDLER(executeFence)},  // fence.i：写代码时块缓存已经失效
+    {std::make_tuple(0x13, 0x0), HANDLER(executeAddi)},
+    {std::make_tuple(0x13, 0x1), HANDLER(executeSlli)},
+    {std::make_tuple(0x13, 0x2), HANDLER(executeSlti)},
+    {std::make_tuple(0x13, 0x3), HANDLER(executeSltiu)},
+    {std::make_tuple(0x13, 0x4), HANDLER(executeXori)},
+    {std::make_tuple(0x13, 0x6), HANDLER(executeOri)},
+    {std::make_tuple(0x13, 0x7), HANDLER(executeAndi)},
+    {std::make_tuple(0x19, 0x7), HANDLER(executeSb)},
+    {std::make_tuple(0x1b, 0x0), HANDLER(executeAddiw)},
+    {std::make_tuple(0x23, 0x0), HANDLER(executeStoreByte)},
+    {std::make_tuple(0x23, 0x1), HANDLER(executeStoreHalf)},
+    {std::make_tuple(0x23, 0x2), HANDLER(executeStoreWord)},
+    {std::make_tuple(0x23, 0x3), HANDLER(executeStoreDouble)},
+    {std::make_tuple(0x27, 0x0), HANDLER(executeVStore)},
+    {std::make_tuple(0x27, 0x5), HANDLER(executeVStore)},
+    {std::make_tuple(0x27, 0x6), HANDLER(executeVStore)},
+    {std::make_tuple(0x27, 0x7), HANDLER(executeVStore)},
+    {std::make_tuple(0x57, 0x0), HANDLER(executeVOpI)},
+    {std::make_tuple(0x57, 0x2), HANDLER(executeVOpM)},
+    {std::make_tuple(0x57, 0x3), HANDLER(executeVOpI)},
+    {std::make_tuple(0x57, 0x4), HANDLER(executeVOpI)},
+    {std::make_tuple(0x57, 0x6), HANDLER(executeVOpM)},
+    {std::make_tuple(0x57, 0x7), HANDLER(executeVsetvl)},
+    {std::make_tuple(0x63, 0x0), HANDLER(executeBEQ)},
+    {std::make_tuple(0x63, 0x1), HANDLER(executeBNE)},
+    {std::make_tuple(0x63, 0x4), HANDLER(executeBLT)},
+    {std::make_tuple(0x63, 0x5), HANDLER(executeBGE)},
+    {std::make_tuple(0x63, 0x6), HANDLER(executeBLTU)},
+    {std::make_tuple(0x63, 0x7), HANDLER(executeBGEU)},
+    {std::make_tuple(0x73, 0x1), HANDLER(executeCSR_RW)},
+    {std::make_tuple(0x73, 0x2), HANDLER(executeCSR_RS)},
+    {std::make_tuple(0x73, 0x3), HANDLER(executeCSR_RC)},
+    {std::make_tuple(0x73, 0x5), HANDLER(executeCSR_RWI)},
+    {std::make_tuple(0x73, 0x6), HANDLER(executeCSR_RSI)},
+    {std::make_tuple(0x73, 0x7), HANDLER(executeCSR_RCI)},
+};
+
+const std::unordered_map<std::tuple<uint32_t, uint32_t, uint32_t>, Handler> instruction2Map = {
+    // RV64 的移位量有 6 位，最高位落在 funct7 的最低位
+    {std::make_tuple(0x13, 0x5, 0x00), HANDLER(executeSrli)},
+    {std::make_tuple(0x13, 0x5, 0x01), HANDLER(executeSrli)},
+    {std::make_tuple(0x13, 0x5, 0x20), HANDLER(executeSrai)},
+    {std::make_tuple(0x13, 0x5, 0x21), HANDLER(executeSrai)},
+    {std::make_tuple(0x1b, 0x1, 0x00), HANDLER(executeSlliw)},
+    {std::make_tuple(0x1b, 0x5, 0x00), HANDLER(executeSrliw)},
+    {std::make_tuple(0x1b, 0x5, 0x20), HANDLER(executeSraiw)},
+    {std::make_tuple(0x33, 0x0, 0x00), HANDLER(executeAdd)},
+    {std::make_tuple(0x33, 0x0, 0x20), HANDLER(executeSub)},
+    {std::make_tuple(0x33, 0x1, 0x00), HANDLER(executeSll)},
+    {std::make_tuple(0x33, 0x2, 0x00), HANDLER(executeSlt)},
+    {std::make_tuple(0x33, 0x3, 0x00), HANDLER(executeSltu)},
+    {std::make_tuple(0x33, 0x4, 0x00), HANDLER(executeXor)},
+    {std::make_tuple(0x33, 0x5, 0x00), HANDLER(executeSrl)},
+    {std::make_tuple(0x33, 0x5, 0x20), HANDLER(executeSra)},
+    {std::make_tuple(0x33, 0x6, 0x00), HANDLER(executeOr)},
+    {std::make_tuple(0x33, 0x7, 0x00), HANDLER(executeAnd)},
+    {std::make_tuple(0x3b, 0x0, 0x00), HANDLER(executeAddw)},
+    {std::make_tuple(0x3b, 0x0, 0x20), HANDLER(executeSubw)},
+    {std::make_tuple(0x3b, 0x1, 0x00), HANDLER(executeSllw)},
+    {std::make_tuple(0x3b, 0x5, 0x00), HANDLER(executeSrlw)},
+    {std::make_tuple(0x3b, 0x5, 0x20), HANDLER(executeSraw)},
+    {std::make_tuple(0x73, 0x0, 0x0), HANDLER(executeECALL_EBREAK)},
+    {std::make_tuple(0x73, 0x0, 0x9), HANDLER(executeSFENCE_VMA)},
+    {std::make_tuple(0x73, 0x0, 0x8), HANDLER(executeSRET)},
+    {std::make_tuple(0x73, 0x0, 0x18), HANDLER(executeMRET)},
+};
+
+ExecuteFunction InstructionExecutor::decode(uint32_t inst) {
+  uint32_t opcode = inst & 0x0000007f;
+  uint32_t funct3  = (inst & 0x00007000) >> 12;
+  uint32_t funct7 = (inst & 0xfe000000) >> 25;
+
+  if (auto it = opcodeTable.find(opcode); it != opcodeTable.end()) {
+    return it->second.fn;
+  }
+  if (auto it = instructionMap.find({opcode, funct3}); it != instructionMap.end()) {
+    return it->second.fn;
+  }
+  if (auto it = instruction2Map.find({opcode, funct3, funct7}); it != instruction2Map.end()) {
+    return it->second.fn;
+  }
+  return nullptr;
+}
+
+const char* InstructionExecutor::name(ExecuteFunction fn) {
+  // 反查表在第一次使用时由三张解码表生成
+  static const std::unordered_map<ExecuteFunction, const char*> names = [] {
+    std::unordered_map<ExecuteFunction, const char*> m = {{executeIllegal, "executeIllegal"}};
+    for (const auto& [key, handler] : opcodeTable) {
+      m.emplace(handler.fn, handler.name);
+    }
+    for (const auto& [key, handler] : instructionMap) {
+      m.emplace(handler.fn, handler.name);
+    }
+    for (const auto& [key, handler] : instruction2Map) {
+      m.emplace(handler.fn, handler.name);
+    }
+    return m;
+  }();
+  auto it = names.find(fn);
+  return it != names.end() ? it->second : "unknown";
+}
+
+ExecuteFunction InstructionExecutor::specialize(ExecuteFunction fn, uint32_t inst) {
+  uint32_t opcode = inst & 0x7f;
+  uint32_t rd = (inst >> 7) & 0x1f;
+  if (fn == executeIllegal) {
+    return fn;
+  }
+  if (rd == 0) {
+    // OP-IMM、OP-IMM-32、OP、OP-32、LUI、AUIPC：结果被丢弃，也没有其他作用
+    if (opcode == 0x13 || opcode == 0x1b || opcode == 0x33 || opcode == 0x3b || opcode == 0x37 || opcode == 0x17) {
+      return executeNop;
+    }
+    auto it = discardRdTable.find(fn);
+    return it != discardRdTable.end() ? it->second : fn;
+  }
+  if (fn == executeAddi) {
+    if (((inst >> 15) & 0x1f) == 0) {
+      return executeLi;
+    }
+    if ((inst >> 20) == 0) {
+      return executeMv;
+    }
+  }
+  return fn;
+}
+
+std::optional<uint64_t> InstructionExecutor::execute(Cpu& cpu, uint32_t inst) {
+  LOG(INFO, "Instruction: 0x", std::hex, inst, std::dec);
+  LOG(INFO, "Executing instruction with opcode: 0x", std::hex, (inst & 0x7f), std::dec);
+
+  ExecuteFunction executeFunc = decode(inst);
+  if (executeFunc == nullptr) {
     LOG(ERROR, "Unsupported instruction: 0x", std::hex, inst,
-      ", opcode: 0x", opcode, ", funct3: 0x", funct3,
-      ", funct7: 0x", std::hex, funct7, std::dec);
+      ", opcode: 0x", (inst & 0x7f), ", funct3: 0x", ((inst >> 12) & 0x7),
+      ", funct7: 0x", std::hex, (inst >> 25), std::dec);
+    throw Exception(ExceptionType::IllegalInstruction, inst);
+  }
+
+  // 特化后的执行函数不会写 x0，执行前不必清零
+  auto result = specialize(executeFunc, inst)(cpu, inst);
+  if (result.has_value()) {
+    LOG(INFO, "Instruction executed successfully. New PC: 0x", std::hex, result.value(), std::dec);
+  } else {
     throw Exception(ExceptionType::IllegalInstruction, inst);
   }
+  return result;
 }
 
-}
\ No newline at end of file
+}
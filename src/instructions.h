@@ -13,6 +13,24 @@ namespace cemu {
 class InstructionExecutor {
 public:
   static std::optional<uint64_t> execute(Cpu& cpu, uint32_t inst);
+
+  // 解码出指令对应的执行函数，未实现的指令返回 nullptr
+  static ExecuteFunction decode(uint32_t inst);
+
+  // 按操作数为 decode 得到的执行函数选择特化的版本：rd 为 x0 的整数运算换成 nop，有副作用的换成
+  // 执行后恢复 x0 的版本，addi 的 li、mv 形式换成更短的执行函数。特化后的执行函数从不把 x0 写成非零值，
+  // 调用者不必在每条指令前清零 x0
+  static ExecuteFunction specialize(ExecuteFunction fn, uint32_t inst);
+
+  // 执行函数的名字，如 "executeLd"
+  static const char* name(ExecuteFunction fn);
 };
 
+// 执行到非法指令时抛出 IllegalInstruction
+std::optional<uint64_t> executeIllegal(Cpu& cpu, uint32_t inst);
+
+// B 型和 J 型指令的立即数，符号扩展到 64 位
+int64_t branchImmediate(uint32_t inst);
+int64_t jumpImmediate(uint32_t inst);
+
 }
@@ -0,0 +1,211 @@
+//
+// Created by Jie Wei on 2024/5/21.
+//
+
+#include "lockstep.h"
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include "clone.h"
+#include "instructions.h"
+
+namespace cemu {
+
+void reference_step(Cpu& cpu) {
+  // 每条指令之前都检查中断，然后执行处理程序的第一条指令
+  if (cpu.csr.interrupt_deliverable(cpu.mode)) {
+    cpu.take_interrupt();
+  }
+  try {
+    uint32_t inst = cpu.fetch().value();
+    // 每条指令都重新解码，不经过块缓存
+    ExecuteFunction fn = InstructionExecutor::decode(inst);
+    if (fn == nullptr) {
+      throw Exception(ExceptionType::IllegalInstruction, inst);
+    }
+    auto next_pc = fn(cpu, inst);
+    // 参考解释器使用未特化的执行函数，它们会写 x0，因此每条指令后都清零，比较时 x0 也必须一致
+    cpu.regs[0] = 0;
+    if (!next_pc.has_value()) {
+      throw Exception(ExceptionType::IllegalInstruction, inst);
+    }
+    uint64_t next = next_pc.value();
+    bool taken = (inst & 0x7f) == 0x63 && next != cpu.pc + 4;
+    cpu.pc = next;
+    ++cpu.csr.instret;
+    if (is_load_inst(inst)) {
+      ++cpu.csr.events[HPM_EVENT_LOAD];
+    } else if (is_store_inst(inst)) {
+      ++cpu.csr.events[HPM_EVENT_STORE];
+    } else if (taken) {
+      ++cpu.csr.events[HPM_EVENT_TAKEN_BRANCH];
+    }
+  } catch (const Exception& e) {
+    // 出错的指令不退休，pc 仍指向它
+    cpu.handle_exception(e);
+    if (e.isFatal()) {
+      throw;
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const Divergence& d) {
+  return os << d.what << " differs after the block at 0x" << std::hex << d.block_pc << ": expected 0x" << d.expected
+            << ", got 0x" << d.actual << std::dec << " (instret " << d.instret << ")";
+}
+
+Lockstep::Lockstep(Cpu& cpu) : clone(MachineImage(cpu).clone()), fast(cpu), ref(*clone) {
+  init();
+}
+
+Lockstep::Lockstep(Cpu& cpu, Cpu& reference) : fast(cpu), ref(reference) {
+  init();
+}
+
+Lockstep::~Lockstep() {
+  if (ref.htif == &ref_htif) {
+    ref.htif = nullptr;
+  }
+}
+
+void Lockstep::init() {
+  if (fast.usermode != nullptr) {
+    throw std::runtime_error("Lockstep does not support user-mode emulation.");
+  }
+  if (fast.htif != nullptr) {
+    // 只复制配置，客户机打开的文件仍然属于 fast 的 Htif
+    ref_htif.tohost = fast.htif->tohost;
+    ref_htif.fromhost = fast.htif->fromhost;
+    ref_htif.semihosting = fast.htif->semihosting;
+    ref_htif.out = &ref_output;
+    ref_htif.err = &ref_output;
+    ref.htif = &ref_htif;
+  }
+  ref.exit_code = fast.exit_code;
+  // 此时两边的内存相同，之后只需比较写过的页
+  fast.bus.memory().clear_dirty();
+  ref.bus.memory().clear_dirty();
+}
+
+std::optional<Divergence> Lockstep::run(uint64_t max_insts) {
+  uint64_t done = 0;
+  while (done < max_insts && !fast.exit_code.has_value()) {
+    uint64_t block_pc = fast.pc;
+    uint64_t n = 1;
+    try {
+      n = fast.blocks.lookup(fast.bus, block_pc).insts.size();
+    } catch (const Exception&) {
+      // 取不到指令，由 run() 报告异常
+    }
+
+    // 快速引擎执行一个块（块中发生陷入时会继续执行陷入处理程序，总数不超过块的长度）
+    uint64_t fast_start = fast.csr.instret;
+    std::exception_ptr fast_error;
+    try {
+      fast.run(std::min(n, max_insts - done));
+    } catch (const Exception&) {
+      fast_error = std::current_exception();
+    }
+    uint64_t retired = fast.csr.instret - fast_start;
+
+    // 参考解释器退休同样数量的指令。快速引擎遇到致命异常时，参考解释器也应在下一条指令处遇到
+    uint64_t ref_start = ref.csr.instret;
+    bool ref_error = false;
+    try {
+      while (ref.csr.instret - ref_start < retired) {
+        reference_step(ref);
+      }
+      while (fast_error && ref.csr.instret - ref_start == retired) {
+        reference_step(ref);
+      }
+    } catch (const Exception&) {
+      ref_error = true;
+    }
+    done += retired;
+
+    if (auto d = compare(block_pc)) {
+      return d;
+    }
+    if (static_cast<bool>(fast_error) != ref_error) {
+      return Divergence{"fatal trap", ref_error, static_cast<bool>(fast_error), block_pc, fast.csr.instret};
+    }
+    if (fast_error) {
+      std::rethrow_exception(fast_error);
+    }
+    if (retired == 0 && fast.stopped_early()) {
+      break;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Divergence> Lockstep::compare(uint64_t block_pc) {
+  auto diverge = [&](std::string what, uint64_t expected, uint64_t actual) {
+    return Divergence{std::move(what), expected, actual, block_pc, fast.csr.instret};
+  };
+
+  if (ref.pc != fast.pc) {
+    return diverge("pc", ref.pc, fast.pc);
+  }
+  if (ref.mode != fast.mode) {
+    return diverge("mode", ref.mode, fast.mode);
+  }
+  if (ref.exit_code != fast.exit_code) {
+    return diverge("exit", ref.exit_code.value_or(0), fast.exit_code.value_or(0));
+  }
+  for (size_t i = 0; i < ref.regs.size(); ++i) {
+    if (ref.regs[i] != fast.regs[i]) {
+      return diverge("x" + std::to_string(i), ref.regs[i], fast.regs[i]);
+    }
+  }
+  if (ref.vregs != fast.vregs) {
+    for (size_t i = 0; i < 32; ++i) {
+      for (size_t off = 0; off < VLEN_BYTES; off += 8) {
+        uint64_t expected, actual;
+        std::memcpy(&expected, ref.vreg(i) + off, 8);
+        std::memcpy(&actual, fast.vreg(i) + off, 8);
+        if (expected != actual) {
+          return diverge("v" + std::to_string(i), expected, actual);
+        }
+      }
+    }
+  }
+  for (size_t addr = 0; addr < NUM_CSRS; ++addr) {
+    if (Csr::is_implemented(addr) && addr != TIME && ref.csr.load(addr) != fast.csr.load(addr)) {
+      std::ostringstream name;
+      name << "csr 0x" << std::hex << addr;
+      return diverge(name.str(), ref.csr.load(addr), fast.csr.load(addr));
+    }
+  }
+
+  // 只比较任一边写过的页
+  Dram& ref_dram = ref.bus.memory();
+  Dram& fast_dram = fast.bus.memory();
+  std::vector<uint32_t> pages = ref_dram.dirty_pages();
+  for (uint32_t page : fast_dram.dirty_pages()) {
+    pages.push_back(page);
+  }
+  for (uint32_t page : pages) {
+    uint64_t addr = DRAM_BASE + (static_cast<uint64_t>(page) << Dram::PAGE_SHIFT);
+    const uint8_t* expected = ref.bus.dram_ptr(addr, Dram::PAGE_SIZE);
+    const uint8_t* actual = fast.bus.dram_ptr(addr, Dram::PAGE_SIZE);
+    if (std::memcmp(expected, actual, Dram::PAGE_SIZE) == 0) {
+      continue;
+    }
+    for (uint64_t off = 0; off < Dram::PAGE_SIZE; off += 8) {
+      uint64_t e, a;
+      std::memcpy(&e, expected + off, 8);
+      std::memcpy(&a, actual + off, 8);
+      if (e != a) {
+        std::ostringstream name;
+        name << "mem 0x" << std::hex << addr + off;
+        return diverge(name.str(), e, a);
+      }
+    }
+  }
+  ref_dram.clear_dirty();
+  fast_dram.clear_dirty();
+  return std::nullopt;
+}
+
+}
@@ -0,0 +1,75 @@
+//
+// Created by Jie Wei on 2024/5/21.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include "cup.h"
+
+namespace cemu {
+
+// 参考解释器：不经过块缓存，逐条取指、解码并执行一条指令，按指令更新 instret 和事件计数。
+// 执行前先响应可以响应的中断。
+// 非致命异常交给 handle_exception 处理；致命异常处理后继续向外抛出
+void reference_step(Cpu& cpu);
+
+// 两个执行引擎第一次出现的不一致
+struct Divergence {
+  std::string what;    // 不一致的状态：pc、mode、exit、x5、v3、csr 0x300 或 mem 0x80001000
+  uint64_t expected;   // 参考解释器中的值
+  uint64_t actual;     // 快速引擎中的值
+  uint64_t block_pc;   // 执行的块的起始地址
+  uint64_t instret;    // 执行完这个块后退休的指令数
+};
+
+std::ostream& operator<<(std::ostream& os, const Divergence& d);
+
+// 锁步差分检查：快速引擎（块缓存上的 Cpu::run）和参考解释器从同一状态出发，每次让快速引擎执行一个块，
+// 参考解释器逐条执行同样数量的指令，然后比较 pc、特权级、通用寄存器、向量寄存器、CSR 和这期间写过的内存。
+//
+// 参考机器默认是构造时对 cpu 的克隆，带有自己的 Htif，它的控制台输出被丢弃。写过的内存通过脏页找到，
+// 因此锁步运行期间 cpu 的脏页记录会被清除，不能同时写增量检查点。
+// time CSR 取决于宿主机时间，不参与比较；读 time 的程序可能因此在寄存器上出现不一致。
+// 不支持用户态模拟（系统调用会在宿主机上执行两次）
+class Lockstep {
+ public:
+  // 以 cpu 当前的状态为起点，cpu 作为快速引擎。失败时抛出 std::runtime_error
+  explicit Lockstep(Cpu& cpu);
+
+  // 由调用者提供与 cpu 状态相同的参考机器（例如用同样的代码 reset 过），省去克隆的开销
+  Lockstep(Cpu& cpu, Cpu& reference);
+
+  ~Lockstep();
+
+  Lockstep(const Lockstep&) = delete;
+  Lockstep& operator=(const Lockstep&) = delete;
+
+  // 锁步执行至多 max_insts 条指令，返回第一处不一致；客户机退出或指令数用尽时返回 std::nullopt。
+  // 两边同时遇到致命异常时，比较完状态后把快速引擎的异常继续向外抛出
+  std::optional<Divergence> run(uint64_t max_insts);
+
+  // 参考解释器所在的机器
+  Cpu& reference() {
+    return ref;
+  }
+
+ private:
+  // 两个构造函数共同的准备工作
+  void init();
+
+  // 比较两台机器的状态，block_pc 只用于报告
+  std::optional<Divergence> compare(uint64_t block_pc);
+
+  std::optional<Cpu> clone;  // 没有提供参考机器时，对 cpu 的克隆
+  Cpu& fast;
+  Cpu& ref;
+  Htif ref_htif;
+  std::ostringstream ref_output;  // 参考机器的控制台输出
+};
+
+}
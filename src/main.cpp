@@ -1,46 +1,301 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cstdint>
 #include <fstream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include "batch.h"
+#include "cli.h"
 #include "cup.h"
+#include "elf.h"
 #include "log.h"
 #include "exception.h"
+#include "gdbstub.h"
+#include "lockstep.h"
+#include "profiler.h"
+#include "replay.h"
+#include "sampler.h"
+#include "snapshot.h"
+
+namespace {
+
+void print_usage() {
+  LOG(cemu::ERROR, "Usage:\n- ./program_name [--stats] [--modes] [--profile [--symbols <elf>] [--top N]] "
+                   "[--sample N [--folded <file>]] [--max-insts N] [--snapshot <file>] "
+                   "[--checkpoint <prefix> N] [--record <log> | --replay <log>] [--gdb <host:port | socket> | --lockstep] "
+                   "(<filename> | --restore <file>...)\n"
+                   "- ./program_name [--stats] [--modes] [--profile ...] [--max-insts N] --user <elf> [args...]\n"
+                   "- ./program_name --batch <manifest> [--jobs N] [--json <file>]");
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    LOG(cemu::ERROR, "Usage:\n- ./program_name <filename>");
-    return 0;
+  const char* filename = nullptr;
+  bool dump_stats = false;  // 退出时打印性能计数器
+  bool profile = false;     // 退出时打印指令剖析报告
+  bool dump_modes = false;  // 退出时打印各特权级和陷入原因的统计
+  bool semihosting = false;  // 处理半主机调用
+  bool user_mode = false;    // 用户态模拟，程序文件之后的参数都传给客户机
+  std::vector<std::string> guest_args;
+  const char* symbols_file = nullptr;
+  size_t top_n = 20;
+  uint64_t sample_interval = 0;  // 非 0 时每退休这么多条指令采样一次调用栈
+  const char* folded_file = nullptr;
+  std::vector<const char*> restore_files;  // 依次恢复完整快照和之后的增量快照，此时可以不给程序文件
+  const char* snapshot_file = nullptr;  // 运行结束后把机器状态保存到快照
+  uint64_t max_insts = std::numeric_limits<uint64_t>::max();
+  const char* batch_file = nullptr;  // 批量运行清单中的所有程序
+  size_t jobs = std::thread::hardware_concurrency();
+  const char* json_file = nullptr;
+  const char* record_file = nullptr;  // 录制外部输入
+  const char* replay_file = nullptr;  // 回放录制的外部输入，不读标准输入
+  const char* checkpoint_prefix = nullptr;  // 周期性地写检查点 <prefix>.0（完整）、<prefix>.1（增量）...
+  uint64_t checkpoint_interval = 0;
+  const char* gdb_address = nullptr;  // 不直接运行，等待 gdb 连接到这个地址（host:port 或 Unix 套接字路径）
+  bool lockstep = false;  // 与参考解释器锁步运行，报告第一处不一致
+  bool diverged = false;
+  bool valid = true;  // 数值参数都能解析
+  for (int i = 1; i < argc && valid; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--stats") {
+      dump_stats = true;
+    } else if (arg == "--modes") {
+      dump_modes = true;
+    } else if (arg == "--semihosting") {
+      semihosting = true;
+    } else if (arg == "--user") {
+      user_mode = true;
+    } else if (arg == "--profile") {
+      profile = true;
+    } else if (arg == "--symbols" && i + 1 < argc) {
+      symbols_file = argv[++i];
+    } else if (arg == "--sample" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], sample_interval);
+    } else if (arg == "--folded" && i + 1 < argc) {
+      folded_file = argv[++i];
+    } else if (arg == "--restore" && i + 1 < argc) {
+      restore_files.push_back(argv[++i]);
+    } else if (arg == "--snapshot" && i + 1 < argc) {
+      snapshot_file = argv[++i];
+    } else if (arg == "--checkpoint" && i + 2 < argc) {
+      checkpoint_prefix = argv[++i];
+      valid = cemu::parse_number(argv[++i], checkpoint_interval);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batch_file = argv[++i];
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], jobs);
+    } else if (arg == "--json" && i + 1 < argc) {
+      json_file = argv[++i];
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_file = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay_file = argv[++i];
+    } else if (arg == "--gdb" && i + 1 < argc) {
+      gdb_address = argv[++i];
+    } else if (arg == "--lockstep") {
+      lockstep = true;
+    } else if (arg == "--max-insts" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], max_insts);
+    } else if (arg == "--top" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], top_n);
+    } else if (filename == nullptr) {
+      filename = argv[i];
+      if (user_mode) {
+        guest_args.assign(argv + i, argv + argc);
+        break;
+      }
+    } else {
+      filename = nullptr;
+      break;
+    }
   }
-
-  std::ifstream file(argv[1], std::ios::binary);
-  if (!file) {
-    LOG(cemu::ERROR, "Cannot open file: ", argv[1]);
+  if (!valid) {
+    print_usage();
     return 1;
   }
+  if (batch_file != nullptr) {
+    try {
+      auto results = cemu::run_batch(cemu::load_manifest(batch_file), jobs);
+      if (json_file != nullptr) {
+        std::ofstream out(json_file);
+        cemu::write_json(out, results);
+      } else {
+        cemu::write_json(std::cout, results);
+      }
+      return std::all_of(results.begin(), results.end(), cemu::batch_succeeded) ? 0 : 1;
+    } catch (const std::runtime_error& e) {
+      LOG(cemu::ERROR, e.what());
+      return 1;
+    }
+  }
+
+  if (filename == nullptr && restore_files.empty()) {
+    print_usage();
+    return 0;
+  }
 
-  std::vector<uint8_t> code(std::istreambuf_iterator<char>(file), {});
+  std::vector<uint8_t> code;
+  bool elf = filename != nullptr && cemu::is_elf(filename);
+  if (filename != nullptr && !elf) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+      LOG(cemu::ERROR, "Cannot open file: ", filename);
+      return 1;
+    }
+    code.assign(std::istreambuf_iterator<char>(file), {});
+  }
   cemu::Cpu cpu(code); // 假设Cpu类的构造函数接受指令代码的vector
+  std::optional<cemu::SymbolTable> symbols;
+  cemu::Htif htif;
+  cemu::UserMode usermode;
+  if (user_mode && !elf) {
+    LOG(cemu::ERROR, "User mode needs an ELF executable: ", filename);
+    return 1;
+  }
+  if (elf) {
+    try {
+      cemu::ElfImage image = cemu::load_elf(cpu, filename);
+      if (user_mode) {
+        std::vector<std::string> env;
+        for (char** e = environ; *e != nullptr; ++e) {
+          env.emplace_back(*e);
+        }
+        usermode.setup(cpu, image, guest_args, env);
+      }
+      symbols = std::move(image.symbols);
+    } catch (const std::runtime_error& e) {
+      if (user_mode) {
+        LOG(cemu::ERROR, e.what(), " (user mode only runs static-pie executables)");
+      } else {
+        LOG(cemu::ERROR, e.what());
+      }
+      return 1;
+    }
+    htif.locate(*symbols);
+  }
+  htif.semihosting = semihosting;
+  if (htif.tohost != 0 || htif.semihosting) {
+    cpu.htif = &htif;
+  }
 
-  while (true) {
+  for (const char* restore_file : restore_files) {
     try {
-      auto inst = cpu.fetch();
-      if (!inst.has_value()) {
-        LOG(cemu::INFO, "End of program reached.");
-        break;
+      cemu::restore_snapshot(cpu, restore_file);
+    } catch (const std::runtime_error& e) {
+      LOG(cemu::ERROR, e.what());
+      return 1;
+    }
+  }
+  std::optional<cemu::InputLog> input_log;
+  try {
+    if (record_file != nullptr) {
+      input_log.emplace(cemu::InputLog::Mode::Record, record_file);
+    } else if (replay_file != nullptr) {
+      input_log.emplace(cemu::InputLog::Mode::Replay, replay_file);
+    }
+  } catch (const std::runtime_error& e) {
+    LOG(cemu::ERROR, e.what());
+    return 1;
+  }
+  if (input_log) {
+    cpu.attach_input_log(&*input_log);
+  }
+  // 用户态模拟时客户机直接读标准输入
+  if (replay_file == nullptr && !user_mode) {
+    cpu.bus.uart->start_input(record_file != nullptr);
+  }
+
+  if (symbols_file != nullptr) {
+    symbols = cemu::SymbolTable::load(symbols_file);
+    if (!symbols) {
+      LOG(cemu::WARNING, "Cannot read symbols from: ", symbols_file);
+    }
+  }
+  cemu::Profiler profiler;
+  if (profile) {
+    cpu.blocks.profiler = &profiler;
+  }
+  std::optional<cemu::Sampler> sampler;
+  if (sample_interval != 0) {
+    sampler.emplace(sample_interval);
+    cpu.sampler = &*sampler;
+  }
+
+  try {
+    if (gdb_address != nullptr) {
+      cemu::GdbStub stub(cpu);
+      stub.listen(gdb_address);
+      stub.serve();
+    } else if (lockstep) {
+      cemu::Lockstep checker(cpu);
+      if (auto d = checker.run(max_insts)) {
+        LOG(cemu::WARNING, "Lockstep divergence: ", *d);
+        diverged = true;
       }
-      auto new_pc = cpu.execute(inst.value());
-      cpu.pc = new_pc.value();
-    } catch (const cemu::Exception& e) {
-      cpu.handle_exception(e);
-      if (e.isFatal()) {
-        LOG(cemu::INFO, "Fatal error: ", e.what());
-        break;
+    } else if (checkpoint_interval == 0) {
+      cpu.run(max_insts);
+    } else {
+      // 每执行 checkpoint_interval 条指令写一个检查点，第一个是完整快照，之后只写脏页
+      for (uint64_t done = 0, n = 0; done < max_insts; ++n) {
+        done += cpu.run(std::min(checkpoint_interval, max_insts - done));
+        if (cpu.exit_code.has_value()) {
+          break;
+        }
+        std::string path = std::string(checkpoint_prefix) + "." + std::to_string(n);
+        if (n == 0) {
+          cemu::save_snapshot(cpu, path);
+        } else {
+          cemu::save_incremental_snapshot(cpu, path);
+        }
       }
     }
+  } catch (const cemu::Exception& e) {
+    LOG(cemu::INFO, "Fatal error: ", e.what());
+  } catch (const std::runtime_error& e) {
+    LOG(cemu::ERROR, e.what());
   }
 
-  cpu.dump_registers(); // 打印寄存器状态
-  cpu.dump_pc();        // 打印PC寄存器状态
+  if (snapshot_file != nullptr) {
+    try {
+      cemu::save_snapshot(cpu, snapshot_file);
+    } catch (const std::runtime_error& e) {
+      LOG(cemu::ERROR, e.what());
+    }
+  }
 
-  return 0;
-}
\ No newline at end of file
+  // 用户态模拟时标准输出属于客户机程序
+  if (!user_mode) {
+    cpu.dump_registers(); // 打印寄存器状态
+    cpu.dump_pc();        // 打印PC寄存器状态
+  }
+  if (dump_stats) {
+    cpu.csr.dump_counters(std::cout);
+  }
+  if (dump_modes) {
+    cpu.accounting.report(std::cout, cpu.csr.instret);
+  }
+  if (profile) {
+    profiler.collect(cpu.blocks);
+    profiler.report(std::cout, symbols ? &*symbols : nullptr, top_n);
+  }
+  if (sampler) {
+    if (folded_file != nullptr) {
+      std::ofstream out(folded_file);
+      sampler->write_folded(out, symbols ? &*symbols : nullptr);
+    } else {
+      sampler->write_folded(std::cout, symbols ? &*symbols : nullptr);
+    }
+  }
+
+  if (diverged) {
+    return 1;
+  }
+  // 客户机通过 HTIF 或半主机调用退出时，把它的返回值作为进程的退出码
+  return static_cast<int>(cpu.exit_code.value_or(0));
+}
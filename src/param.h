@@ -7,8 +7,12 @@ namespace cemu {
 // 使用 std::size_t 替代 uint64_t 来表示内存大小，更好地表达意图和增加可移植性
 constexpr std::size_t DRAM_BASE = 0x8000'0000;
 
-// 定义DRAM的大小，128MB
+// 定义DRAM的大小，128MB。构建时可以用 -DCEMU_DRAM_SIZE=<字节数> 改变，如模糊测试使用很小的 DRAM
+#ifdef CEMU_DRAM_SIZE
+constexpr std::size_t DRAM_SIZE = CEMU_DRAM_SIZE;
+#else
 constexpr std::size_t DRAM_SIZE = 1024 * 1024 * 128;
+#endif
 
 // 定义DRAM的结束地址
 constexpr std::size_t DRAM_END = DRAM_SIZE + DRAM_BASE - 1;
@@ -16,8 +20,12 @@ constexpr std::size_t DRAM_END = DRAM_SIZE + DRAM_BASE - 1;
 constexpr size_t NUM_CSRS = 4096;  // 定义CSR的数量为4096
 
 // 机器级别的CSR
+constexpr size_t MVENDORID = 0xf11;  // 厂商 ID
+constexpr size_t MARCHID = 0xf12;  // 微架构 ID
+constexpr size_t MIMPID = 0xf13;  // 实现版本
 constexpr size_t MHARTID = 0xf14;  // 硬件线程ID
 constexpr size_t MSTATUS = 0x300;  // 机器状态寄存器
+constexpr size_t MISA = 0x301;  // 指令集和扩展
 constexpr size_t MEDELEG = 0x302;  // 机器异常委托寄存器
 constexpr size_t MIDELEG = 0x303;  // 机器中断委托寄存器
 constexpr size_t MIE = 0x304;  // 机器中断使能寄存器
@@ -28,11 +36,17 @@ constexpr size_t MEPC = 0x341;  // 机器异常程序计数器
 constexpr size_t MCAUSE = 0x342;  // 机器陷阱原因
 constexpr size_t MTVAL = 0x343;  // 机器错误地址或指令
 constexpr size_t MIP = 0x344;  // 机器中断挂起
+constexpr size_t MCOUNTINHIBIT = 0x320;  // 机器计数器禁止
+constexpr size_t MHPMEVENT3 = 0x323;  // 性能监控事件选择器 3，至 MHPMEVENT31 (0x33f)
+constexpr size_t MCYCLE = 0xb00;  // 机器周期计数器
+constexpr size_t MINSTRET = 0xb02;  // 机器退休指令计数器
+constexpr size_t MHPMCOUNTER3 = 0xb03;  // 性能监控计数器 3，至 MHPMCOUNTER31 (0xb1f)
 
 // 监管级别的CSR
 constexpr size_t SSTATUS = 0x100;  // 监管状态寄存器
 constexpr size_t SIE = 0x104;  // 监管中断使能寄存器
 constexpr size_t STVEC = 0x105;  // 监管陷阱处理程序基地址
+constexpr size_t SCOUNTEREN = 0x106;  // 监管计数器使能
 constexpr size_t SSCRATCH = 0x140;  // 监管陷阱处理程序的临时寄存器
 constexpr size_t SEPC = 0x141;  // 监管异常程序计数器
 constexpr size_t SCAUSE = 0x142;  // 监管陷阱原因
@@ -40,6 +54,48 @@ constexpr size_t STVAL = 0x143;  // 监管错误地址或指令
 constexpr size_t SIP = 0x144;  // 监管中断挂起
 constexpr size_t SATP = 0x180;  // 监管地址转换和保护
 
+// 用户级的只读计数器（Zicntr / Zihpm）
+constexpr size_t CYCLE = 0xc00;  // 周期计数器
+constexpr size_t TIME = 0xc01;  // 实时时钟
+constexpr size_t INSTRET = 0xc02;  // 退休指令计数器
+constexpr size_t HPMCOUNTER3 = 0xc03;  // 性能监控计数器 3，至 HPMCOUNTER31 (0xc1f)
+
+// 计数器个数：cycle、time、instret 和 hpmcounter3 ~ hpmcounter31
+constexpr size_t NUM_COUNTERS = 32;
+
+// time CSR 的时钟频率（10 MHz，与 QEMU virt 平台一致）
+constexpr uint64_t TIMEBASE_FREQ = 10'000'000;
+
+// mhpmevent 可选择的事件
+constexpr uint64_t HPM_EVENT_NONE = 0;  // 不计数
+constexpr uint64_t HPM_EVENT_LOAD = 1;  // 访存读指令
+constexpr uint64_t HPM_EVENT_STORE = 2;  // 访存写指令
+constexpr uint64_t HPM_EVENT_TAKEN_BRANCH = 3;  // 发生跳转的条件分支
+constexpr uint64_t HPM_EVENT_TRAP = 4;  // 陷入（异常和中断）
+constexpr size_t NUM_HPM_EVENTS = 5;
+
+// 向量扩展的CSR
+constexpr size_t VSTART = 0x008;  // 向量起始元素下标
+constexpr size_t VXSAT = 0x009;  // 定点饱和标志
+constexpr size_t VXRM = 0x00a;  // 定点舍入模式
+constexpr size_t VCSR = 0x00f;  // 向量控制和状态寄存器
+constexpr size_t VL = 0xc20;  // 向量长度
+constexpr size_t VTYPE = 0xc21;  // 向量数据类型
+constexpr size_t VLENB = 0xc22;  // 向量寄存器字节数（只读）
+
+// 向量寄存器的位宽，取 256 位以便与宿主机 AVX2 寄存器的宽度一致
+constexpr size_t VLEN = 256;
+
+// 向量寄存器的字节数
+constexpr size_t VLEN_BYTES = VLEN / 8;
+
+// vtype 中的非法位 vill
+constexpr uint64_t MASK_VILL = 1ULL << 63;
+
+// misa 的值：MXL = 2（64 位），扩展 I、S、U、V
+constexpr uint64_t MISA_VALUE = (2ULL << 62) | (1 << ('I' - 'A')) | (1 << ('S' - 'A')) | (1 << ('U' - 'A')) |
+                                (1 << ('V' - 'A'));
+
 // mstatus 和 sstatus 字段掩码
 constexpr uint64_t MASK_SIE = 1 << 1;  // 监管中断使能掩码
 constexpr uint64_t MASK_MIE = 1 << 3;  // 机器中断使能掩码
@@ -73,6 +129,9 @@ constexpr uint64_t MASK_MTIP = 1 << 7;  // 机器定时器中断挂起掩码
 constexpr uint64_t MASK_SEIP = 1 << 9;  // 监管外部中断挂起掩码
 constexpr uint64_t MASK_MEIP = 1 << 11;  // 机器外部中断挂起掩码
 
+// mcause / scause 的最高位为 1 表示中断，低位是中断号（即 MIP 中对应的位号）
+constexpr uint64_t INTERRUPT_BIT = 1ULL << 63;
+
 // 使用 uint64_t 定义 Mode 类型
 using Mode = uint64_t;
 
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include "exception.h"
 #include "plic.h"
+#include "snapshot.h"
 #include "param.h"
 
 namespace cemu {
@@ -50,5 +51,18 @@ void Plic::store(uint64_t addr, uint64_t size, uint64_t value) {
   }
 }
 
+void Plic::save(std::ostream& os) const {
+  write_pod(os, pending);
+  write_pod(os, senable);
+  write_pod(os, spriority);
+  write_pod(os, sclaim);
 }
 
+void Plic::restore(std::istream& is) {
+  read_pod(is, pending);
+  read_pod(is, senable);
+  read_pod(is, spriority);
+  read_pod(is, sclaim);
+}
+
+}
@@ -4,6 +4,8 @@
 
 #pragma once
 #include <cstdint>
+#include <istream>
+#include <ostream>
 #include "exception.h"
 
 namespace cemu {
@@ -18,6 +20,10 @@ class Plic {
   uint64_t load(uint64_t addr, uint64_t size);
   void store(uint64_t addr, uint64_t size, uint64_t value);
 
+  // 保存和恢复寄存器状态，用于快照
+  void save(std::ostream& os) const;
+  void restore(std::istream& is);
+
  private:
   uint64_t pending;     // 对应PLIC的挂起寄存器
   uint64_t senable;     // 对应PLIC的使能寄存器
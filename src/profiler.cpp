@@ -0,0 +1,120 @@
+//
+// Created by Jie Wei on 2024/5/9.
+//
+
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include "elf.h"
+#include "instructions.h"
+#include "threaded.h"
+
+namespace cemu {
+
+void Profiler::collect(const Block& block) {
+  BlockStats& stats = block_stats[block.pc];
+  stats.count += block.exec_count;
+  for (uint64_t count : block.partial_counts) {
+    stats.count += count;
+  }
+  // 只有整块执行时才使用融合的处理程序
+  for (size_t k = 0; k < fusions.size(); ++k) {
+    fusions[k] += block.fusions[k] * block.exec_count;
+  }
+  for (size_t i = 0; i < block.insts.size(); ++i) {
+    uint64_t count = block.inst_count(i);
+    if (count == 0) {
+      break;
+    }
+    // 按解码得到的执行函数统计，不区分特化的版本
+    ExecuteFunction fn = InstructionExecutor::decode(block.insts[i].inst);
+    handlers[fn != nullptr ? fn : executeIllegal] += count;
+    pcs[block.pc + i * 4] += count;
+    stats.insts += count;
+    total_insts += count;
+  }
+}
+
+void Profiler::collect(BlockCache& cache) {
+  cache.for_each([this](const Block& block) { collect(block); });
+  cache.reset_counts();
+}
+
+uint64_t Profiler::pc_count(uint64_t pc) const {
+  auto it = pcs.find(pc);
+  return it != pcs.end() ? it->second : 0;
+}
+
+uint64_t Profiler::handler_count(ExecuteFunction fn) const {
+  auto it = handlers.find(fn);
+  return it != handlers.end() ? it->second : 0;
+}
+
+namespace {
+
+// 按计数从大到小取前 n 项，计数相同时按键排序，保证输出稳定
+template <typename K>
+std::vector<std::pair<K, uint64_t>> top(std::vector<std::pair<K, uint64_t>> items, size_t n) {
+  std::sort(items.begin(), items.end(), [](const auto& a, const auto& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  if (items.size() > n) {
+    items.resize(n);
+  }
+  return items;
+}
+
+double percent(uint64_t count, uint64_t total) {
+  return total == 0 ? 0.0 : 100.0 * static_cast<double>(count) / static_cast<double>(total);
+}
+
+}  // namespace
+
+void Profiler::report(std::ostream& os, const SymbolTable* symbols, size_t top_n) const {
+  auto describe = [symbols](uint64_t pc) {
+    return symbols != nullptr ? symbols->symbolize(pc) : std::string();
+  };
+  std::ios_base::fmtflags flags = os.flags();
+  char fill = os.fill();
+  os << std::fixed << std::setprecision(2) << std::setfill(' ');
+
+  os << "Profile: " << total_insts << " instructions retired\n";
+
+  os << "\nInstruction mix:\n";
+  std::vector<std::pair<std::string, uint64_t>> mix;
+  for (const auto& [fn, count] : handlers) {
+    mix.emplace_back(InstructionExecutor::name(fn), count);
+  }
+  for (const auto& [name, count] : top(std::move(mix), handlers.size())) {
+    os << "  " << std::left << std::setw(20) << name << std::right << std::setw(16) << count << std::setw(8)
+       << percent(count, total_insts) << "%\n";
+  }
+
+  os << "\nFused pairs (share of retired instructions):\n";
+  for (size_t k = 0; k < fusions.size(); ++k) {
+    os << "  " << std::left << std::setw(20) << fusion_name(static_cast<Fusion>(k)) << std::right << std::setw(16)
+       << fusions[k] << std::setw(8) << percent(2 * fusions[k], total_insts) << "%\n";
+  }
+
+  os << "\nHot PCs:\n";
+  for (const auto& [pc, count] : top(std::vector<std::pair<uint64_t, uint64_t>>(pcs.begin(), pcs.end()), top_n)) {
+    os << "  0x" << std::hex << std::setw(16) << std::setfill('0') << pc << std::dec << std::setfill(' ')
+       << std::setw(16) << count << std::setw(8) << percent(count, total_insts) << "%  " << describe(pc) << '\n';
+  }
+
+  os << "\nHot blocks:\n";
+  std::vector<std::pair<uint64_t, uint64_t>> blocks;
+  for (const auto& [pc, stats] : block_stats) {
+    blocks.emplace_back(pc, stats.insts);
+  }
+  for (const auto& [pc, insts] : top(std::move(blocks), top_n)) {
+    os << "  0x" << std::hex << std::setw(16) << std::setfill('0') << pc << std::dec << std::setfill(' ')
+       << std::setw(16) << insts << std::setw(8) << percent(insts, total_insts) << "%  entered "
+       << block_stats.at(pc).count << "x  " << describe(pc) << '\n';
+  }
+  os.flags(flags);
+  os.fill(fill);
+}
+
+}
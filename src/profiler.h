@@ -0,0 +1,59 @@
+//
+// Created by Jie Wei on 2024/5/9.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include "block.h"
+
+namespace cemu {
+
+class SymbolTable;
+
+// 客户机指令剖析。执行时只在 Block 中累加计数，剖析器在块被丢弃前或程序结束时把计数汇总起来，
+// 得到每个执行函数（如 executeLd）、每个 pc 和每个基本块的执行次数，以及线索化解释器中各种融合指令对的命中次数。
+class Profiler {
+ public:
+  // 汇总一个块的执行计数
+  void collect(const Block& block);
+
+  // 汇总缓存中所有块的执行计数，并清零这些块的计数，可重复调用
+  void collect(BlockCache& cache);
+
+  // 写出报告：指令构成、最热的 top_n 个 pc 和 top_n 个基本块。symbols 非空时附上函数名
+  void report(std::ostream& os, const SymbolTable* symbols, size_t top_n) const;
+
+  [[nodiscard]] uint64_t total() const {
+    return total_insts;
+  }
+
+  // pc 处指令的执行次数
+  [[nodiscard]] uint64_t pc_count(uint64_t pc) const;
+
+  // 某个执行函数的执行次数
+  [[nodiscard]] uint64_t handler_count(ExecuteFunction fn) const;
+
+  // 某种融合指令对的执行次数（每次执行两条指令）
+  [[nodiscard]] uint64_t fusion_count(Fusion kind) const {
+    return fusions[static_cast<size_t>(kind)];
+  }
+
+ private:
+  struct BlockStats {
+    uint64_t count = 0;  // 进入块的次数
+    uint64_t insts = 0;  // 块内退休的指令总数
+  };
+
+  uint64_t total_insts = 0;
+  std::unordered_map<ExecuteFunction, uint64_t> handlers;
+  std::unordered_map<uint64_t, uint64_t> pcs;
+  std::map<uint64_t, BlockStats> block_stats;
+  std::array<uint64_t, static_cast<size_t>(Fusion::Count)> fusions{};
+};
+
+}
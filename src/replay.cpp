@@ -0,0 +1,224 @@
+//
+// Created by Jie Wei on 2024/5/14.
+//
+
+#include "replay.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+#include "cup.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr char MAGIC[8] = {'C', 'E', 'M', 'U', 'R', 'E', 'C', '1'};
+
+// 把 value 编码到 p，返回写入的字节数
+size_t put_varint(char* p, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    p[n++] = static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  p[n++] = static_cast<char>(value);
+  return n;
+}
+
+// 写出 [p, p + len)，忽略错误：调用者没有办法再处理它们。只使用异步信号安全的函数
+void write_all(int fd, const char* p, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n <= 0) {
+      return;
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+// 正在录制的日志，供退出和信号处理函数使用
+std::atomic<InputLog*> recording = nullptr;
+
+bool read_varint(std::istream& is, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = is.get();
+    if (c == EOF) {
+      return false;
+    }
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+InputLog::InputLog(Mode mode, const std::string& path) : log_mode(mode) {
+  if (mode == Mode::Record) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot create input log: " + path);
+    }
+    write_all(fd, MAGIC, sizeof(MAGIC));
+    static std::once_flag handlers;
+    std::call_once(handlers, [] {
+      std::atexit(flush_at_exit);
+      struct sigaction sa {};
+      sa.sa_handler = flush_on_signal;
+      sa.sa_flags = SA_RESETHAND;
+      sigemptyset(&sa.sa_mask);
+      for (int sig : {SIGINT, SIGTERM, SIGHUP}) {
+        sigaction(sig, &sa, nullptr);
+      }
+    });
+    recording = this;
+    return;
+  }
+
+  file.open(path, std::ios::in | std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  if (!file || !file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("Not an input log: " + path);
+  }
+  read_next();
+}
+
+InputLog::~InputLog() {
+  if (log_mode == Mode::Record) {
+    InputLog* self = this;
+    recording.compare_exchange_strong(self, nullptr);
+    flush();
+    close(fd);
+  }
+}
+
+void InputLog::flush() {
+  if (log_mode != Mode::Record || buffered == 0) {
+    return;
+  }
+  flushing = true;
+  write_all(fd, buffer.data(), buffered);
+  buffered = 0;
+  flushing = false;
+}
+
+void InputLog::flush_at_exit() {
+  if (InputLog* log = recording.load()) {
+    log->flush();
+  }
+}
+
+void InputLog::flush_on_signal(int sig) {
+  // 被打断的 flush() 已经在写缓冲区，这里再写会重复
+  InputLog* log = recording.load();
+  if (log != nullptr && !log->flushing) {
+    write_all(log->fd, log->buffer.data(), log->buffered);
+  }
+  // SA_RESETHAND 已恢复默认处理，重新发送信号以原本的方式终止进程
+  raise(sig);
+}
+
+uint64_t InputLog::remaining(uint64_t instret) const {
+  if (log_mode == Mode::Record) {
+    return next_poll > instret ? next_poll - instret : 0;
+  }
+  if (!has_next) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  // 时间事件由第 next.instret 条指令（单独成块的 CSR 读取）消费，需要执行完它才能看到后面的事件
+  if (next.type == TIME) {
+    return next.instret >= instret ? next.instret - instret + 1 : 1;
+  }
+  return next.instret > instret ? next.instret - instret : 0;
+}
+
+void InputLog::poll(Cpu& cpu) {
+  Uart& uart = *cpu.bus.uart;
+  uint64_t instret = cpu.csr.instret;
+  if (log_mode == Mode::Record) {
+    next_poll = instret + POLL_INTERVAL;
+    // 接收寄存器空闲时才交付下一个字节，与直接从标准输入读取时的行为一致
+    while (auto byte = uart.take_input()) {
+      write(UART, instret, *byte);
+    }
+    // 每个轮询周期最多写一次文件，进程被杀死时最多丢失一个周期的事件
+    flush();
+    return;
+  }
+  while (has_next && next.type == UART && next.instret == instret) {
+    uart.deliver(static_cast<uint8_t>(next.value));
+    read_next();
+  }
+}
+
+uint64_t InputLog::time(uint64_t instret, uint64_t host_time) {
+  if (log_mode == Mode::Record) {
+    write(TIME, instret, host_time);
+    return host_time;
+  }
+  if (!has_next || next.type != TIME) {
+    throw std::runtime_error("Replay diverged: unexpected time read at instret " + std::to_string(instret));
+  }
+  uint64_t value = next.value;
+  read_next();
+  return value;
+}
+
+void InputLog::write(EventType type, uint64_t instret, uint64_t value) {
+  if (BUFFER_SIZE - buffered < MAX_EVENT_SIZE) {
+    flush();
+  }
+  char* p = buffer.data() + buffered;
+  size_t n = 0;
+  p[n++] = static_cast<char>(type);
+  n += put_varint(p + n, instret - last_instret);
+  last_instret = instret;
+  if (type == UART) {
+    p[n++] = static_cast<char>(value);
+  } else {
+    // 时间单调递增，差值通常很小
+    int64_t delta = static_cast<int64_t>(value - last_time);
+    n += put_varint(p + n, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    last_time = value;
+  }
+  // 事件完整写入后才计入，信号处理函数不会写出半个事件
+  buffered += n;
+}
+
+void InputLog::read_next() {
+  int type = file.get();
+  uint64_t delta;
+  if (type == EOF || !read_varint(file, delta)) {
+    has_next = false;
+    return;
+  }
+  if (type != UART && type != TIME) {
+    throw std::runtime_error("Corrupted input log: unknown event type " + std::to_string(type));
+  }
+  next.type = static_cast<EventType>(type);
+  next.instret = last_instret += delta;
+  if (next.type == UART) {
+    int c = file.get();
+    has_next = c != EOF;
+    next.value = static_cast<uint8_t>(c);
+    return;
+  }
+  uint64_t zigzag;
+  if (!read_varint(file, zigzag)) {
+    has_next = false;
+    return;
+  }
+  has_next = true;
+  int64_t d = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+  next.value = last_time += static_cast<uint64_t>(d);
+}
+
+}
@@ -0,0 +1,98 @@
+//
+// Created by Jie Wei on 2024/5/14.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+
+namespace cemu {
+
+class Cpu;
+
+// 外部输入的录制与回放。客户机能观察到的非确定性输入只有两类：串口收到的字节和 time CSR 读到的
+// 宿主机时间。录制时串口字节先进入队列，由执行引擎在块边界交给 Uart，并记下此时的 instret；
+// 回放时不读标准输入，而是在同一 instret 处交付同一字节，time 读取返回录制的值。
+//
+// 日志格式：magic 之后是一串事件，每个事件为 类型(1 字节) + instret 增量(varint) + 负载，
+// 串口事件的负载是 1 字节，时间事件的负载是与上一个时间值之差的 zigzag varint。
+//
+// 录制的事件先写入内存缓冲区，在 poll()、析构和缓冲区写满时写入文件；进程正常退出（atexit）
+// 或被 SIGINT/SIGTERM/SIGHUP 终止时也会写出已缓冲的事件。
+class InputLog {
+ public:
+  enum class Mode { Record, Replay };
+
+  // 打开日志文件，失败时抛出 std::runtime_error
+  InputLog(Mode mode, const std::string& path);
+  ~InputLog();
+
+  InputLog(const InputLog&) = delete;
+  InputLog& operator=(const InputLog&) = delete;
+
+  [[nodiscard]] Mode mode() const {
+    return log_mode;
+  }
+
+  // 距离下一次需要执行引擎介入还可以执行的指令数：录制时是下一次轮询串口的时刻，
+  // 回放时是下一个事件发生的时刻
+  [[nodiscard]] uint64_t remaining(uint64_t instret) const;
+
+  // 由执行引擎在 remaining() 用尽时调用：录制时把排队的串口字节交给 Uart 并记录，
+  // 回放时交付到期的串口字节
+  void poll(Cpu& cpu);
+
+  // 读取 time 时调用，host_time 为宿主机时间。录制时记录并返回 host_time，回放时返回录制的值
+  uint64_t time(uint64_t instret, uint64_t host_time);
+
+  // 录制时把缓冲的事件写入文件
+  void flush();
+
+  // 录制时每隔这么多条指令检查一次串口输入队列
+  static constexpr uint64_t POLL_INTERVAL = 4096;
+
+ private:
+  enum EventType : uint8_t { UART = 1, TIME = 2 };
+
+  struct Event {
+    EventType type;
+    uint64_t instret;
+    uint64_t value;
+  };
+
+  void write(EventType type, uint64_t instret, uint64_t value);
+  void read_next();
+
+  // 录制缓冲区大小，以及一个事件编码后的最大长度：类型 + 两个 varint
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+  static constexpr size_t MAX_EVENT_SIZE = 1 + 2 * 10;
+
+  // 进程退出和收到终止信号时写出当前录制日志的缓冲区
+  static void flush_at_exit();
+  static void flush_on_signal(int sig);
+
+  Mode log_mode;
+  std::fstream file;  // 回放时读取
+
+  // 录制时直接写文件描述符，信号处理函数里也能安全地写出缓冲区。
+  // buffered 只在一个事件完整写入 buffer 后才增加，flushing 表示 flush() 正在写文件
+  int fd = -1;
+  std::array<char, BUFFER_SIZE> buffer{};
+  std::atomic<size_t> buffered = 0;
+  std::atomic<bool> flushing = false;
+
+  uint64_t last_instret = 0;
+  uint64_t last_time = 0;
+  uint64_t next_poll = 0;  // 录制时下一次检查串口输入队列的 instret
+
+  // 回放时预读的下一个事件，has_next 为 false 表示日志已结束
+  Event next{};
+  bool has_next = false;
+};
+
+}
@@ -0,0 +1,72 @@
+//
+// Created by Jie Wei on 2024/5/10.
+//
+
+#include "sampler.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+#include "cup.h"
+#include "elf.h"
+
+namespace cemu {
+
+Sampler::Sampler(uint64_t interval, size_t max_depth)
+    : interval(interval == 0 ? 1 : interval), max_depth(max_depth), next(this->interval) {}
+
+void Sampler::sample(Cpu& cpu) {
+  next = cpu.csr.instret + interval;
+  ++total;
+
+  frames.clear();
+  frames.push_back(cpu.pc);
+
+  // 按 RISC-V 的帧布局回溯：fp - 8 处保存返回地址，fp - 16 处保存上一帧的 fp。
+  // 直接读宿主机内存，不经过 Cpu::load，避免产生访存副作用；帧指针不合法时停止回溯
+  uint64_t fp = cpu.regs[8];
+  while (frames.size() < max_depth && fp != 0 && fp % 8 == 0) {
+    const uint8_t* frame = cpu.bus.dram_ptr(fp - 16, 16);
+    if (frame == nullptr) {
+      break;
+    }
+    uint64_t ra, prev_fp;
+    std::memcpy(&prev_fp, frame, 8);
+    std::memcpy(&ra, frame + 8, 8);
+    if (ra == 0) {
+      break;
+    }
+    // 返回地址指向调用指令的下一条，减 4 使其落在调用者的函数内
+    frames.push_back(ra - 4);
+    // 栈向低地址增长，上一帧必须在更高的地址处，否则说明帧链已损坏
+    if (prev_fp <= fp) {
+      break;
+    }
+    fp = prev_fp;
+  }
+  ++folded[frames];
+}
+
+void Sampler::write_folded(std::ostream& os, const SymbolTable* symbols) const {
+  // 同一函数内不同 pc 的样本在符号化后合并为一行
+  std::map<std::string, uint64_t> lines;
+  for (const auto& [stack, count] : folded) {
+    std::ostringstream line;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+      if (it != stack.rbegin()) {
+        line << ';';
+      }
+      const Symbol* sym = symbols != nullptr ? symbols->find(*it) : nullptr;
+      if (sym != nullptr) {
+        line << sym->name;
+      } else {
+        line << "0x" << std::hex << *it << std::dec;
+      }
+    }
+    lines[line.str()] += count;
+  }
+  for (const auto& [line, count] : lines) {
+    os << line << ' ' << count << '\n';
+  }
+}
+
+}
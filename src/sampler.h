@@ -0,0 +1,53 @@
+//
+// Created by Jie Wei on 2024/5/10.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace cemu {
+
+class Cpu;
+class SymbolTable;
+
+// 采样剖析器。每退休 interval 条指令由 Cpu::run 调用一次 sample()，记录 pc 并沿帧指针（s0）
+// 回溯客户机调用栈，按调用栈聚合后输出 flamegraph 工具使用的 folded 格式。
+// Cpu::sampler 为空时 run() 不做任何额外工作。
+class Sampler {
+ public:
+  explicit Sampler(uint64_t interval, size_t max_depth = 64);
+
+  // 距离下一次采样还要退休的指令数
+  [[nodiscard]] uint64_t remaining(uint64_t instret) const {
+    return next > instret ? next - instret : 0;
+  }
+
+  // 采样一次，并安排下一次采样
+  void sample(Cpu& cpu);
+
+  // 写出 folded 格式：每行 "外层;...;内层 次数"。symbols 非空时用函数名代替地址
+  void write_folded(std::ostream& os, const SymbolTable* symbols) const;
+
+  [[nodiscard]] uint64_t samples() const {
+    return total;
+  }
+
+  // 聚合后的调用栈，最内层的帧在最前
+  [[nodiscard]] const std::map<std::vector<uint64_t>, uint64_t>& stacks() const {
+    return folded;
+  }
+
+ private:
+  uint64_t interval;
+  size_t max_depth;
+  uint64_t next;
+  uint64_t total = 0;
+  std::vector<uint64_t> frames;  // 复用的回溯缓冲区
+  std::map<std::vector<uint64_t>, uint64_t> folded;
+};
+
+}
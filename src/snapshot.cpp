@@ -0,0 +1,230 @@
+//
+// Created by Jie Wei on 2024/5/12.
+//
+
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "cup.h"
+
+namespace cemu {
+
+namespace {
+
+// 文件格式：
+//   magic, version, kind         kind 为 FULL 或 INCREMENTAL
+//   state_size, state            Cpu、CSR 和外设的状态
+//   page_count, page[page_count] 非零页的页号
+//   填充到 SNAPSHOT_PAGE_SIZE 对齐
+//   page_count 个页的内容，依次排列
+constexpr char MAGIC[8] = {'C', 'E', 'M', 'U', 'S', 'N', 'A', 'P'};
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t FULL = 0;
+constexpr uint32_t INCREMENTAL = 1;
+constexpr uint64_t NUM_PAGES = DRAM_SIZE / SNAPSHOT_PAGE_SIZE;
+
+bool is_zero_page(const uint8_t* page) {
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(page);
+  for (size_t i = 0; i < SNAPSHOT_PAGE_SIZE / 8; ++i) {
+    if (words[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t align_up(uint64_t value) {
+  return (value + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE * SNAPSHOT_PAGE_SIZE;
+}
+
+// 读取 fd 中 [offset, offset + len) 到 buf
+void pread_all(int fd, void* buf, uint64_t len, uint64_t offset) {
+  auto* p = static_cast<uint8_t*>(buf);
+  while (len > 0) {
+    ssize_t n = pread(fd, p, len, static_cast<off_t>(offset));
+    if (n <= 0) {
+      throw std::runtime_error("Snapshot is truncated.");
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+void save(Cpu& cpu, const std::string& path, uint32_t kind) {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) {
+    throw std::runtime_error("Cannot create snapshot: " + path);
+  }
+
+  std::ostringstream state;
+  save_machine_state(cpu, state);
+  std::string blob = state.str();
+
+  // 完整快照跳过全零页；增量快照必须写出所有脏页，包括被清零的页
+  const uint8_t* dram = cpu.bus.dram_ptr(DRAM_BASE, DRAM_SIZE);
+  std::vector<uint32_t> pages;
+  if (kind == FULL) {
+    for (uint64_t i = 0; i < NUM_PAGES; ++i) {
+      if (!is_zero_page(dram + i * SNAPSHOT_PAGE_SIZE)) {
+        pages.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  } else {
+    pages = cpu.bus.memory().dirty_pages();
+  }
+
+  os.write(MAGIC, sizeof(MAGIC));
+  write_pod(os, VERSION);
+  write_pod(os, kind);
+  write_pod(os, static_cast<uint64_t>(blob.size()));
+  os.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+  write_pod(os, static_cast<uint64_t>(pages.size()));
+  write_pod(os, pages.data(), pages.size());
+
+  uint64_t header = static_cast<uint64_t>(os.tellp());
+  std::vector<char> padding(align_up(header) - header, 0);
+  os.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+  for (uint32_t page : pages) {
+    os.write(reinterpret_cast<const char*>(dram + page * SNAPSHOT_PAGE_SIZE), SNAPSHOT_PAGE_SIZE);
+  }
+  if (!os.flush()) {
+    throw std::runtime_error("Cannot write snapshot: " + path);
+  }
+  cpu.bus.memory().clear_dirty();
+}
+
+}  // namespace
+
+void save_machine_state(Cpu& cpu, std::ostream& os) {
+  write_pod(os, cpu.pc);
+  write_pod(os, cpu.mode);
+  write_pod(os, cpu.regs.data(), cpu.regs.size());
+  write_pod(os, cpu.vregs.data(), cpu.vregs.size());
+  cpu.csr.save(os);
+  cpu.bus.clint.save(os);
+  cpu.bus.plic.save(os);
+  cpu.bus.uart->save(os);
+}
+
+void restore_machine_state(Cpu& cpu, std::istream& is) {
+  read_pod(is, cpu.pc);
+  read_pod(is, cpu.mode);
+  read_pod(is, cpu.regs.data(), cpu.regs.size());
+  read_pod(is, cpu.vregs.data(), cpu.vregs.size());
+  cpu.csr.restore(is);
+  cpu.bus.clint.restore(is);
+  cpu.bus.plic.restore(is);
+  cpu.bus.uart->restore(is);
+}
+
+void save_snapshot(Cpu& cpu, const std::string& path) {
+  save(cpu, path, FULL);
+}
+
+void save_incremental_snapshot(Cpu& cpu, const std::string& path) {
+  save(cpu, path, INCREMENTAL);
+}
+
+void restore_snapshot(Cpu& cpu, const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open snapshot: " + path);
+  }
+  // 映射建立后即使关闭 fd 也保持有效
+  struct Closer {
+    int fd;
+    ~Closer() { close(fd); }
+  } closer{fd};
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version, kind;
+  uint64_t state_size;
+  uint64_t offset = 0;
+  pread_all(fd, magic, sizeof(magic), offset);
+  pread_all(fd, &version, sizeof(version), offset += sizeof(magic));
+  pread_all(fd, &kind, sizeof(kind), offset += sizeof(version));
+  pread_all(fd, &state_size, sizeof(state_size), offset += sizeof(kind));
+  if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION || kind > INCREMENTAL) {
+    throw std::runtime_error("Not a snapshot: " + path);
+  }
+  // 先按文件大小检查长度，损坏的文件不会导致巨大的分配
+  struct stat st {};
+  offset += sizeof(state_size);
+  if (fstat(fd, &st) != 0 || state_size > static_cast<uint64_t>(st.st_size) - std::min<uint64_t>(offset, st.st_size)) {
+    throw std::runtime_error("Corrupted snapshot: " + path);
+  }
+  std::string blob(state_size, '\0');
+  pread_all(fd, blob.data(), state_size, offset);
+
+  uint64_t page_count;
+  pread_all(fd, &page_count, sizeof(page_count), offset += state_size);
+  if (page_count > NUM_PAGES) {
+    throw std::runtime_error("Corrupted snapshot: " + path);
+  }
+  std::vector<uint32_t> pages(page_count);
+  pread_all(fd, pages.data(), page_count * sizeof(uint32_t), offset += sizeof(page_count));
+  uint64_t data = align_up(offset + page_count * sizeof(uint32_t));
+
+  // 修改 cpu 之前先检查完整个文件：页号必须严格递增且在 DRAM 内，页数据不能超出文件末尾，
+  // 否则映射截断文件的页会在访问时触发 SIGBUS
+  for (uint64_t i = 0; i < page_count; ++i) {
+    if (pages[i] >= NUM_PAGES || (i > 0 && pages[i] <= pages[i - 1])) {
+      throw std::runtime_error("Corrupted snapshot: " + path);
+    }
+  }
+  if (data > static_cast<uint64_t>(st.st_size) ||
+      page_count > (static_cast<uint64_t>(st.st_size) - data) / SNAPSHOT_PAGE_SIZE) {
+    throw std::runtime_error("Corrupted snapshot: " + path);
+  }
+
+  // 状态块的内容只有解析时才能检查。解析失败时回滚到原来的状态，保证出错时 cpu 不被修改
+  std::ostringstream backup;
+  save_machine_state(cpu, backup);
+  try {
+    std::istringstream state(blob);
+    restore_machine_state(cpu, state);
+    if (state.peek() != std::char_traits<char>::eof()) {
+      throw std::runtime_error("Corrupted snapshot: " + path);
+    }
+  } catch (...) {
+    std::istringstream old(backup.str());
+    restore_machine_state(cpu, old);
+    throw;
+  }
+
+  // 连续的页合并为一次映射；宿主机页大小与快照页不一致时退回到逐页读取
+  Dram& dram = cpu.bus.memory();
+  if (kind == FULL) {
+    dram.clear();
+  }
+  bool can_map = sysconf(_SC_PAGESIZE) == static_cast<long>(SNAPSHOT_PAGE_SIZE);
+  for (uint64_t i = 0; i < page_count;) {
+    uint64_t j = i + 1;
+    while (j < page_count && pages[j] == pages[j - 1] + 1) {
+      ++j;
+    }
+    uint64_t index = pages[i] * SNAPSHOT_PAGE_SIZE;
+    uint64_t len = (j - i) * SNAPSHOT_PAGE_SIZE;
+    uint64_t file_offset = data + i * SNAPSHOT_PAGE_SIZE;
+    if (!can_map || !dram.map_file(fd, file_offset, index, len)) {
+      pread_all(fd, dram.host_ptr(DRAM_BASE + index, len), len, file_offset);
+    }
+    i = j;
+  }
+
+  // 此时 DRAM 与快照链一致，之后的增量快照以此为基准
+  dram.clear_dirty();
+
+  // 旧的预解码块和未完成的陷入记录都不再有效
+  cpu.blocks.flush();
+  cpu.accounting = Accounting(cpu.mode, cpu.csr.instret);
+}
+
+}
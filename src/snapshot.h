@@ -0,0 +1,62 @@
+//
+// Created by Jie Wei on 2024/5/12.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace cemu {
+
+class Cpu;
+
+// 以宿主机字节序写入/读出平凡可拷贝的值，快照只在同一类宿主机上使用
+template <typename T>
+void write_pod(std::ostream& os, const T* data, size_t count) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  os.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+template <typename T>
+void write_pod(std::ostream& os, const T& value) {
+  write_pod(os, &value, 1);
+}
+
+template <typename T>
+void read_pod(std::istream& is, T* data, size_t count) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (!is.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(sizeof(T) * count))) {
+    throw std::runtime_error("Snapshot is truncated.");
+  }
+}
+
+template <typename T>
+void read_pod(std::istream& is, T& value) {
+  read_pod(is, &value, 1);
+}
+
+// 保存和恢复除 DRAM 以外的机器状态：pc、特权级、寄存器、CSR 和外设
+void save_machine_state(Cpu& cpu, std::ostream& os);
+void restore_machine_state(Cpu& cpu, std::istream& is);
+
+// 快照中 DRAM 按页稀疏保存，只写入非零页
+constexpr uint64_t SNAPSHOT_PAGE_SIZE = 4096;
+
+// 把整台机器（寄存器、CSR、DRAM 和外设）的状态写入文件，并清空 DRAM 的脏页记录。
+// 失败时抛出 std::runtime_error
+void save_snapshot(Cpu& cpu, const std::string& path);
+
+// 增量快照：与完整快照格式相同，但只包含上次保存快照以来写过的 DRAM 页，开销与工作集成正比。
+// 恢复时先恢复完整快照，再依次应用之后的各个增量快照
+void save_incremental_snapshot(Cpu& cpu, const std::string& path);
+
+// 从文件恢复整台机器的状态。完整快照的 DRAM 页以写时复制的方式直接映射快照文件，不需要逐页拷贝；
+// 增量快照在当前状态上覆盖其中的页。失败时抛出 std::runtime_error，此时 cpu 的状态不确定
+void restore_snapshot(Cpu& cpu, const std::string& path);
+
+}
@@ -0,0 +1,459 @@
+//
+// Created by Jie Wei on 2024/5/22.
+//
+
+#include "threaded.h"
+#include <iterator>
+#include <vector>
+#include "cup.h"
+#include "instructions.h"
+
+#if defined(__GNUC__)
+#define CEMU_COMPUTED_GOTO 1
+#endif
+
+namespace cemu {
+
+namespace {
+
+// 有专门处理程序的指令，与 instructions.cpp 中的解码表一一对应
+enum Op : uint8_t {
+  OP_NOP,  // 目的寄存器为 x0 的整数运算
+  OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_SRAI, OP_ORI, OP_ANDI,
+  OP_ADD, OP_SLL, OP_SLT, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND, OP_ADDW,
+  OP_LUI, OP_AUIPC,
+  OP_CONST, OP_MV,  // addi rd, x0, imm 和 addi rd, rs1, 0
+  OP_LB, OP_LH, OP_LW, OP_LD, OP_LBU, OP_LHU, OP_LWU,
+  OP_SB, OP_SD,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+  OP_JAL, OP_JALR,
+  OP_J, OP_JR,  // rd 为 x0 的 jal、jalr
+  // 融合的指令对，见 fuse()
+  OP_LI,  // lui/auipc + addi
+  OP_AUIPC_JALR, OP_AUIPC_JR, OP_AUIPC_LD, OP_ZEXT,
+  OP_SLT_BEQZ, OP_SLT_BNEZ, OP_SLTI_BEQZ, OP_SLTI_BNEZ, OP_SLTIU_BEQZ, OP_SLTIU_BNEZ,
+  OP_CALL,  // 调用执行函数
+  OP_EXIT,  // 块末尾的哨兵
+  NUM_OPS,
+};
+
+int64_t i_immediate(uint32_t inst) {
+  return static_cast<int32_t>(inst) >> 20;
+}
+
+int64_t s_immediate(uint32_t inst) {
+  return static_cast<int64_t>(static_cast<int32_t>(inst & 0xfe000000) >> 20) | ((inst >> 7) & 0x1f);
+}
+
+// 选择指令的处理程序并预先解码立即数，pc 是指令的地址。
+// 解码表中没有的指令（fn 为 executeIllegal）以及其他扩展的指令都调用执行函数
+Op translate(const DecodedInst& d, uint64_t pc, ThreadedInst& t) {
+  uint32_t inst = d.inst;
+  uint32_t opcode = inst & 0x7f;
+  uint32_t funct3 = (inst >> 12) & 0x7;
+  uint32_t funct7 = inst >> 25;
+  t.fn = d.fn;
+  t.inst = inst;
+  t.rd = (inst >> 7) & 0x1f;
+  t.rs1 = (inst >> 15) & 0x1f;
+  t.rs2 = (inst >> 20) & 0x1f;
+  t.imm = i_immediate(inst);
+  if (d.fn == executeIllegal) {
+    return OP_CALL;
+  }
+
+  // 处理程序按操作数特化，都不写 x0：没有副作用的整数运算写 x0 时什么也不做，
+  // rd 为 x0 的跳转不写返回地址，rd 为 x0 的访存调用特化的执行函数（见 InstructionExecutor::specialize）
+  auto alu = [&t](Op op) { return t.rd == 0 ? OP_NOP : op; };
+  switch (opcode) {
+    case 0x13: {
+      static constexpr Op ops[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_ORI, OP_ANDI};
+      if (funct3 == 0x1 || funct3 == 0x5) {
+        t.imm &= 0x3f;
+      }
+      if (funct3 == 0x0 && t.rs1 == 0) {
+        return alu(OP_CONST);
+      }
+      if (funct3 == 0x0 && t.imm == 0) {
+        return alu(OP_MV);
+      }
+      // funct7 的最低位是移位量的最高位
+      return alu(funct3 == 0x5 && (funct7 >> 1) == 0x10 ? OP_SRAI : ops[funct3]);
+    }
+    case 0x33: {
+      // 只有 funct7 为 0 的基本运算和 sra 有专门的操作，sub、M 扩展等其余编码都交给执行函数
+      static constexpr Op ops[8] = {OP_ADD, OP_SLL, OP_SLT, OP_CALL, OP_XOR, OP_SRL, OP_OR, OP_AND};
+      if (funct7 == 0x00) {
+        return alu(ops[funct3]);
+      }
+      return funct3 == 0x5 && funct7 == 0x20 ? alu(OP_SRA) : OP_CALL;
+    }
+    case 0x3b:
+      return funct3 == 0x0 && funct7 == 0x00 ? alu(OP_ADDW) : OP_CALL;
+    case 0x37:
+      t.imm = static_cast<int32_t>(inst & 0xfffff000);
+      return alu(OP_LUI);
+    case 0x17:
+      t.imm = static_cast<int64_t>(pc + static_cast<int32_t>(inst & 0xfffff000));
+      return alu(OP_AUIPC);
+    case 0x03: {
+      static constexpr Op ops[8] = {OP_LB, OP_LH, OP_LW, OP_LD, OP_LBU, OP_LHU, OP_LWU, OP_CALL};
+      return t.rd == 0 ? OP_CALL : ops[funct3];
+    }
+    case 0x23:
+      t.imm = s_immediate(inst);
+      return funct3 == 0x0 ? OP_SB : funct3 == 0x3 ? OP_SD : OP_CALL;
+    case 0x63: {
+      static constexpr Op ops[8] = {OP_BEQ, OP_BNE, OP_CALL, OP_CALL, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU};
+      t.imm = static_cast<int64_t>(pc + branchImmediate(inst));
+      return ops[funct3];
+    }
+    case 0x6f:
+      t.imm = static_cast<int64_t>(pc + jumpImmediate(inst));
+      return t.rd == 0 ? OP_J : OP_JAL;
+    case 0x67:
+      return t.rd == 0 ? OP_JR : OP_JALR;
+    default:
+      return OP_CALL;
+  }
+}
+
+// 把相邻的常见指令对换成一次分派完成的融合处理程序：第一条指令的表项换成融合的处理程序，
+// 第二条的表项只由它读取（块总是从第一条指令进入），两者的操作数在这里预先合并。
+// 第二条指令必须使用第一条的结果（rs1 为第一条的 rd），每条指令最多属于一个融合对。
+// 第一条指令的 rd 不是 x0，否则 translate 已经把它换成了 OP_NOP
+void fuse(Block& block, std::vector<Op>& ops) {
+  for (size_t i = 0; i + 1 < block.insts.size(); ++i) {
+    ThreadedInst& a = block.threaded[i];
+    ThreadedInst& b = block.threaded[i + 1];
+    if (b.rs1 != a.rd) {
+      continue;
+    }
+    Op first = ops[i];
+    Op second = ops[i + 1];
+    bool beqz = second == OP_BEQ && b.rs2 == 0;
+    bool bnez = second == OP_BNE && b.rs2 == 0;
+    Op fused = OP_CALL;
+    Fusion kind{};
+    if ((first == OP_LUI || first == OP_AUIPC) && second == OP_ADDI && b.rd == a.rd) {
+      // 结果是常数
+      a.imm = static_cast<int64_t>(static_cast<uint64_t>(a.imm) + static_cast<uint64_t>(b.imm));
+      fused = OP_LI;
+      kind = first == OP_LUI ? Fusion::LuiAddi : Fusion::AuipcAddi;
+    } else if (first == OP_AUIPC && (second == OP_JALR || second == OP_JR)) {
+      b.imm = static_cast<int64_t>((static_cast<uint64_t>(a.imm) + static_cast<uint64_t>(b.imm)) & ~1ULL);
+      fused = second == OP_JALR ? OP_AUIPC_JALR : OP_AUIPC_JR;
+      kind = Fusion::AuipcJalr;
+    } else if (first == OP_AUIPC && second == OP_LD) {
+      b.imm = static_cast<int64_t>(static_cast<uint64_t>(a.imm) + static_cast<uint64_t>(b.imm));
+      fused = OP_AUIPC_LD;
+      kind = Fusion::AuipcLd;
+    } else if (first == OP_SLLI && second == OP_SRLI && b.rd == a.rd && b.imm == a.imm) {
+      a.imm = static_cast<int64_t>(~0ULL >> a.imm);
+      fused = OP_ZEXT;
+      kind = Fusion::SlliSrli;
+    } else if (beqz || bnez) {
+      kind = Fusion::CompareBranch;
+      if (first == OP_SLT) {
+        fused = beqz ? OP_SLT_BEQZ : OP_SLT_BNEZ;
+      } else if (first == OP_SLTI) {
+        fused = beqz ? OP_SLTI_BEQZ : OP_SLTI_BNEZ;
+      } else if (first == OP_SLTIU) {
+        fused = beqz ? OP_SLTIU_BEQZ : OP_SLTIU_BNEZ;
+      }
+    }
+    if (fused != OP_CALL) {
+      ops[i] = fused;
+      ++block.fusions[static_cast<size_t>(kind)];
+      ++i;
+    }
+  }
+}
+
+// 访存失败时总线抛出异常，这里不会得到空值
+inline uint64_t load(Cpu& cpu, uint64_t addr, uint64_t size) {
+  return cpu.load(addr, size).value();
+}
+
+}  // namespace
+
+void run_threaded(Cpu& cpu, Block& block, uint64_t& done) {
+#ifdef CEMU_COMPUTED_GOTO
+  static const void* const handlers[] = {
+      &&nop,
+      &&addi, &&slli, &&slti, &&sltiu, &&xori, &&srli, &&srai, &&ori, &&andi,
+      &&add, &&sll, &&slt, &&xor_, &&srl, &&sra, &&or_, &&and_, &&addw,
+      &&lui, &&auipc,
+      &&lui, &&mv,
+      &&lb, &&lh, &&lw, &&ld, &&lbu, &&lhu, &&lwu,
+      &&sb, &&sd,
+      &&beq, &&bne, &&blt, &&bge, &&bltu, &&bgeu,
+      &&jal, &&jalr,
+      &&j, &&jr,
+      &&li,
+      &&auipc_jalr, &&auipc_jr, &&auipc_ld, &&zext,
+      &&slt_beqz, &&slt_bnez, &&slti_beqz, &&slti_bnez, &&sltiu_beqz, &&sltiu_bnez,
+      &&call,
+      &&exit,
+  };
+  static_assert(std::size(handlers) == NUM_OPS);
+
+  if (block.threaded.empty()) [[unlikely]] {
+    std::vector<Op> ops(block.insts.size() + 1, OP_EXIT);
+    block.threaded.resize(block.insts.size() + 1);
+    for (size_t i = 0; i < block.insts.size(); ++i) {
+      ops[i] = translate(block.insts[i], block.pc + i * 4, block.threaded[i]);
+    }
+    fuse(block, ops);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      block.threaded[i].handler = handlers[ops[i]];
+    }
+  }
+
+  uint64_t* x = cpu.regs.data();
+  const ThreadedInst* const base = block.threaded.data();
+  const ThreadedInst* ip = base;
+  // 控制流只在块的最后一条指令处改变，它的下一条指令就是 fallthrough
+  const uint64_t fallthrough = block.fallthrough();
+  uint64_t next_pc = fallthrough;
+
+#define DISPATCH() goto *(++ip)->handler
+#define RD x[ip->rd]
+#define RS1 x[ip->rs1]
+#define RS2 x[ip->rs2]
+#define SRS1 static_cast<int64_t>(x[ip->rs1])
+#define SRS2 static_cast<int64_t>(x[ip->rs2])
+
+  try {
+    goto *ip->handler;
+
+  nop:
+    DISPATCH();
+
+  addi:
+    RD = RS1 + ip->imm;
+    DISPATCH();
+  slli:
+    RD = RS1 << ip->imm;
+    DISPATCH();
+  slti:
+    RD = SRS1 < ip->imm;
+    DISPATCH();
+  sltiu:
+    RD = RS1 < static_cast<uint64_t>(ip->imm);
+    DISPATCH();
+  xori:
+    RD = RS1 ^ ip->imm;
+    DISPATCH();
+  srli:
+    RD = RS1 >> ip->imm;
+    DISPATCH();
+  srai:
+    RD = static_cast<uint64_t>(SRS1 >> ip->imm);
+    DISPATCH();
+  ori:
+    RD = RS1 | ip->imm;
+    DISPATCH();
+  andi:
+    RD = RS1 & ip->imm;
+    DISPATCH();
+
+  add:
+    RD = RS1 + RS2;
+    DISPATCH();
+  sll:
+    RD = RS1 << (RS2 & 0x3f);
+    DISPATCH();
+  slt:
+    RD = SRS1 < SRS2;
+    DISPATCH();
+  xor_:
+    RD = RS1 ^ RS2;
+    DISPATCH();
+  srl:
+    RD = RS1 >> (RS2 & 0x3f);
+    DISPATCH();
+  sra:
+    RD = static_cast<uint64_t>(SRS1 >> (RS2 & 0x3f));
+    DISPATCH();
+  or_:
+    RD = RS1 | RS2;
+    DISPATCH();
+  and_:
+    RD = RS1 & RS2;
+    DISPATCH();
+  addw:
+    RD = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(static_cast<uint32_t>(RS1 + RS2))));
+    DISPATCH();
+
+  lui:
+  auipc:
+    RD = static_cast<uint64_t>(ip->imm);
+    DISPATCH();
+  mv:
+    RD = RS1;
+    DISPATCH();
+
+    // 访存出错时总线抛出异常，ip 仍指向出错的指令
+  lb:
+    RD = static_cast<uint64_t>(static_cast<int8_t>(load(cpu, RS1 + ip->imm, 8)));
+    DISPATCH();
+  lh:
+    RD = static_cast<uint64_t>(static_cast<int16_t>(load(cpu, RS1 + ip->imm, 16)));
+    DISPATCH();
+  lw:
+    RD = static_cast<uint64_t>(static_cast<int32_t>(load(cpu, RS1 + ip->imm, 32)));
+    DISPATCH();
+  ld:
+    RD = load(cpu, RS1 + ip->imm, 64);
+    DISPATCH();
+  lbu:
+    RD = load(cpu, RS1 + ip->imm, 8) & 0xff;
+    DISPATCH();
+  lhu:
+    RD = load(cpu, RS1 + ip->imm, 16) & 0xffff;
+    DISPATCH();
+  lwu:
+    RD = load(cpu, RS1 + ip->imm, 32) & 0xffffffff;
+    DISPATCH();
+
+  sb:
+    cpu.store(RS1 + ip->imm, 8, RS2);
+    DISPATCH();
+  sd:
+    cpu.store(RS1 + ip->imm, 64, RS2);
+    DISPATCH();
+
+    // 分支和跳转总是块的最后一条指令
+  beq:
+    next_pc = RS1 == RS2 ? ip->imm : fallthrough;
+    goto exit;
+  bne:
+    next_pc = RS1 != RS2 ? ip->imm : fallthrough;
+    goto exit;
+  blt:
+    next_pc = SRS1 < SRS2 ? ip->imm : fallthrough;
+    goto exit;
+  bge:
+    next_pc = SRS1 >= SRS2 ? ip->imm : fallthrough;
+    goto exit;
+  bltu:
+    next_pc = RS1 < RS2 ? ip->imm : fallthrough;
+    goto exit;
+  bgeu:
+    next_pc = RS1 >= RS2 ? ip->imm : fallthrough;
+    goto exit;
+  jal:
+    next_pc = ip->imm;
+    RD = fallthrough;
+    goto exit;
+  jalr:
+    // 先算目标地址，rd 与 rs1 相同时用的是旧值
+    next_pc = (RS1 + ip->imm) & ~1ULL;
+    RD = fallthrough;
+    goto exit;
+  j:
+    next_pc = ip->imm;
+    goto exit;
+  jr:
+    next_pc = (RS1 + ip->imm) & ~1ULL;
+    goto exit;
+
+    // 融合的指令对，ip->imm 和 ip[1].imm 由 fuse() 预先算好。第二条指令可能出错时先让 ip 指向它
+  li:
+    RD = static_cast<uint64_t>(ip->imm);
+    ++ip;
+    DISPATCH();
+  auipc_jalr:
+    RD = static_cast<uint64_t>(ip->imm);
+    ++ip;
+    next_pc = ip->imm;
+    RD = fallthrough;
+    goto exit;
+  auipc_jr:
+    RD = static_cast<uint64_t>(ip->imm);
+    next_pc = ip[1].imm;
+    goto exit;
+  auipc_ld:
+    RD = static_cast<uint64_t>(ip->imm);
+    ++ip;
+    RD = load(cpu, ip->imm, 64);
+    DISPATCH();
+  zext:
+    RD = RS1 & ip->imm;
+    ++ip;
+    DISPATCH();
+  slt_beqz:
+    RD = SRS1 < SRS2;
+    next_pc = RD == 0 ? ip[1].imm : fallthrough;
+    goto exit;
+  slt_bnez:
+    RD = SRS1 < SRS2;
+    next_pc = RD != 0 ? ip[1].imm : fallthrough;
+    goto exit;
+  slti_beqz:
+    RD = SRS1 < ip->imm;
+    next_pc = RD == 0 ? ip[1].imm : fallthrough;
+    goto exit;
+  slti_bnez:
+    RD = SRS1 < ip->imm;
+    next_pc = RD != 0 ? ip[1].imm : fallthrough;
+    goto exit;
+  sltiu_beqz:
+    RD = RS1 < static_cast<uint64_t>(ip->imm);
+    next_pc = RD == 0 ? ip[1].imm : fallthrough;
+    goto exit;
+  sltiu_bnez:
+    RD = RS1 < static_cast<uint64_t>(ip->imm);
+    next_pc = RD != 0 ? ip[1].imm : fallthrough;
+    goto exit;
+
+  call: {
+    uint64_t pc = block.pc + (ip - base) * 4;
+    cpu.pc = pc;
+    auto next = ip->fn(cpu, ip->inst);
+    if (!next.has_value()) {
+      throw Exception(ExceptionType::IllegalInstruction, ip->inst);
+    }
+    // 改变控制流的指令（SYSTEM 指令等）总是块的最后一条
+    if (next.value() != pc + 4) {
+      next_pc = next.value();
+      goto exit;
+    }
+    DISPATCH();
+  }
+
+  exit:;
+  } catch (const Exception&) {
+    done = ip - base;
+    cpu.pc = block.pc + done * 4;
+    throw;
+  }
+  cpu.pc = next_pc;
+
+#undef DISPATCH
+#undef RD
+#undef RS1
+#undef RS2
+#undef SRS1
+#undef SRS2
+#else
+  for (done = 0; done < block.insts.size(); ++done) {
+    const DecodedInst& d = block.insts[done];
+    auto next = d.fn(cpu, d.inst);
+    if (!next.has_value()) {
+      throw Exception(ExceptionType::IllegalInstruction, d.inst);
+    }
+    cpu.pc = next.value();
+  }
+#endif
+}
+
+const char* fusion_name(Fusion kind) {
+  static constexpr const char* names[] = {
+      "lui+addi", "auipc+addi", "auipc+jalr", "auipc+ld", "slli+srli", "compare+branch",
+  };
+  return names[static_cast<size_t>(kind)];
+}
+
+}
@@ -0,0 +1,30 @@
+//
+// Created by Jie Wei on 2024/5/22.
+//
+
+#pragma once
+
+#include <cstdint>
+#include "block.h"
+
+namespace cemu {
+
+class Cpu;
+
+// 直接线索化（direct threading）解释器。块第一次由它执行时，每条预解码指令被翻译成一个 ThreadedInst，
+// 其中带有处理程序标签的地址；之后每个处理程序执行完直接跳到下一条指令的处理程序（GCC 的计算 goto），
+// 不经过函数调用、std::optional 返回值和循环上的同一个间接跳转。寄存器数组的地址和块内的位置保存在局部变量中，
+// pc 只在块结束、调用执行函数和出错时写回 Cpu。
+//
+// 常用的 RV64I 整数、访存、分支和跳转指令有专门的处理程序，语义与对应的执行函数相同；
+// 其余指令（CSR、SYSTEM、向量等）调用 DecodedInst::fn。编译器不支持标签地址时整块逐条调用执行函数。
+// 编译器生成的代码中常见的相邻指令对（见 Fusion）融合成一个处理程序，一次分派执行两条指令，
+// 每个块中融合的个数记录在 Block::fusions 中，由 Profiler 汇总。
+
+// 执行整个块。正常返回时 cpu.pc 是下一个块的地址；抛出异常时 cpu.pc 指向出错的指令，done 是已执行完的指令数
+void run_threaded(Cpu& cpu, Block& block, uint64_t& done);
+
+// 融合指令对的名字，如 "lui+addi"
+const char* fusion_name(Fusion kind);
+
+}
@@ -3,14 +3,22 @@
 #include "uart.h"
 #include <iostream>
 #include "log.h"
+#include "snapshot.h"
 
 namespace cemu {
 
 Uart::Uart() : uart(UART_SIZE), interrupt(false) {
   uart[UART_LSR] |= MASK_UART_LSR_TX;
-  std::thread([this]() {
+}
+
+void Uart::start_input(bool deferred) {
+  std::thread([this, deferred]() {
     char byte;
     while (std::cin >> byte) {
+      if (deferred) {
+        queue_input(static_cast<uint8_t>(byte));
+        continue;
+      }
       std::unique_lock<std::mutex> lock(mtx);
       while ((uart[UART_LSR] & MASK_UART_LSR_RX) == 1) {
         cv.wait(lock);
@@ -22,6 +30,31 @@ Uart::Uart() : uart(UART_SIZE), interrupt(false) {
   }).detach();
 }
 
+void Uart::queue_input(uint8_t byte) {
+  std::lock_guard<std::mutex> lock(mtx);
+  pending.push_back(byte);
+}
+
+std::optional<uint8_t> Uart::take_input() {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (pending.empty() || (uart[UART_LSR] & MASK_UART_LSR_RX) != 0) {
+    return std::nullopt;
+  }
+  uint8_t byte = pending.front();
+  pending.pop_front();
+  uart[UART_RHR] = byte;
+  interrupt.store(true);
+  uart[UART_LSR] |= MASK_UART_LSR_RX;
+  return byte;
+}
+
+void Uart::deliver(uint8_t byte) {
+  std::lock_guard<std::mutex> lock(mtx);
+  uart[UART_RHR] = byte;
+  interrupt.store(true);
+  uart[UART_LSR] |= MASK_UART_LSR_RX;
+}
+
 bool Uart::is_interrupting() {
   return interrupt.exchange(false);
 }
@@ -55,4 +88,19 @@ void Uart::store(uint64_t addr, uint64_t size, uint64_t value) {
   }
 }
 
-}
\ No newline at end of file
+void Uart::save(std::ostream& os) {
+  std::lock_guard<std::mutex> lock(mtx);
+  write_pod(os, uart.data(), uart.size());
+  write_pod(os, interrupt.load());
+}
+
+void Uart::restore(std::istream& is) {
+  std::lock_guard<std::mutex> lock(mtx);
+  read_pod(is, uart.data(), uart.size());
+  bool pending;
+  read_pod(is, pending);
+  interrupt.store(pending);
+  cv.notify_one();
+}
+
+}
@@ -3,9 +3,13 @@
 #pragma once
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <optional>
+#include <istream>
+#include <ostream>
 #include <thread>
-#include "bus.h"
+#include <vector>
 #include "exception.h"
 #include "param.h"
 
@@ -14,14 +18,35 @@ namespace cemu {
 class Uart {
  public:
   Uart();
+
+  // 启动后台线程，从标准输入读取字符作为串口输入。只应调用一次，且 Uart 的地址此后不能改变。
+  // deferred 为 true 时字节只进入队列，由 take_input() 在确定的时刻交给客户机（用于录制）
+  void start_input(bool deferred = false);
+
+  // 把一个字节放入输入队列
+  void queue_input(uint8_t byte);
+
+  // 接收寄存器空闲时，把队列中的下一个字节放入接收寄存器并返回它
+  std::optional<uint8_t> take_input();
+
+  // 把一个字节放入接收寄存器，不检查寄存器是否空闲（用于回放）
+  void deliver(uint8_t byte);
+
   bool is_interrupting();
   uint64_t load(uint64_t addr, uint64_t size);
   void store(uint64_t addr, uint64_t size, uint64_t value);
 
+  // 保存和恢复寄存器状态，用于快照
+  void save(std::ostream& os);
+  void restore(std::istream& is);
+
   std::vector<uint8_t> uart;
   std::condition_variable cv;
   std::atomic<bool> interrupt;
   std::mutex mtx;
+
+ private:
+  std::deque<uint8_t> pending;  // deferred 模式下已读入、尚未交付的字节，受 mtx 保护
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,533 @@
+//
+// Created by Jie Wei on 2024/5/18.
+//
+
+#include "usermode.h"
+#include <fcntl.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include "cup.h"
+#include "elf.h"
+#include "log.h"
+
+namespace cemu {
+
+namespace {
+
+// RISC-V Linux 的系统调用号（asm-generic/unistd.h）
+constexpr uint64_t SYS_GETCWD = 17;
+constexpr uint64_t SYS_DUP = 23;
+constexpr uint64_t SYS_FCNTL = 25;
+constexpr uint64_t SYS_IOCTL = 29;
+constexpr uint64_t SYS_UNLINKAT = 35;
+constexpr uint64_t SYS_FACCESSAT = 48;
+constexpr uint64_t SYS_OPENAT = 56;
+constexpr uint64_t SYS_CLOSE = 57;
+constexpr uint64_t SYS_LSEEK = 62;
+constexpr uint64_t SYS_READ = 63;
+constexpr uint64_t SYS_WRITE = 64;
+constexpr uint64_t SYS_READV = 65;
+constexpr uint64_t SYS_WRITEV = 66;
+constexpr uint64_t SYS_READLINKAT = 78;
+constexpr uint64_t SYS_NEWFSTATAT = 79;
+constexpr uint64_t SYS_FSTAT = 80;
+constexpr uint64_t SYS_EXIT = 93;
+constexpr uint64_t SYS_EXIT_GROUP = 94;
+constexpr uint64_t SYS_SET_TID_ADDRESS = 96;
+constexpr uint64_t SYS_FUTEX = 98;
+constexpr uint64_t SYS_SET_ROBUST_LIST = 99;
+constexpr uint64_t SYS_CLOCK_GETTIME = 113;
+constexpr uint64_t SYS_RT_SIGACTION = 134;
+constexpr uint64_t SYS_RT_SIGPROCMASK = 135;
+constexpr uint64_t SYS_UNAME = 160;
+constexpr uint64_t SYS_GETTIMEOFDAY = 169;
+constexpr uint64_t SYS_GETPID = 172;
+constexpr uint64_t SYS_GETPPID = 173;
+constexpr uint64_t SYS_GETUID = 174;
+constexpr uint64_t SYS_GETEUID = 175;
+constexpr uint64_t SYS_GETGID = 176;
+constexpr uint64_t SYS_GETEGID = 177;
+constexpr uint64_t SYS_GETTID = 178;
+constexpr uint64_t SYS_BRK = 214;
+constexpr uint64_t SYS_MUNMAP = 215;
+constexpr uint64_t SYS_MMAP = 222;
+constexpr uint64_t SYS_MPROTECT = 226;
+constexpr uint64_t SYS_MADVISE = 233;
+constexpr uint64_t SYS_PRLIMIT64 = 261;
+constexpr uint64_t SYS_GETRANDOM = 278;
+
+constexpr uint64_t GUEST_MAP_FIXED = 0x10;
+constexpr uint64_t GUEST_MAP_ANONYMOUS = 0x20;
+constexpr uint64_t GUEST_RLIMIT_STACK = 3;
+
+// 辅助向量的类型
+constexpr uint64_t AT_NULL = 0;
+constexpr uint64_t AT_PHDR = 3;
+constexpr uint64_t AT_PHENT = 4;
+constexpr uint64_t AT_PHNUM = 5;
+constexpr uint64_t AT_PAGESZ = 6;
+constexpr uint64_t AT_BASE = 7;
+constexpr uint64_t AT_ENTRY = 9;
+constexpr uint64_t AT_UID = 11;
+constexpr uint64_t AT_EUID = 12;
+constexpr uint64_t AT_GID = 13;
+constexpr uint64_t AT_EGID = 14;
+constexpr uint64_t AT_CLKTCK = 17;
+constexpr uint64_t AT_SECURE = 23;
+constexpr uint64_t AT_RANDOM = 25;
+
+constexpr uint64_t PAGE_MASK = Dram::PAGE_SIZE - 1;
+
+// 客户机看到的 struct stat（asm-generic/stat.h），与 x86-64 宿主机的布局不同
+struct GuestStat {
+  uint64_t dev;
+  uint64_t ino;
+  uint32_t mode;
+  uint32_t nlink;
+  uint32_t uid;
+  uint32_t gid;
+  uint64_t rdev;
+  uint64_t pad1;
+  int64_t size;
+  int32_t blksize;
+  int32_t pad2;
+  int64_t blocks;
+  int64_t atime;
+  uint64_t atime_nsec;
+  int64_t mtime;
+  uint64_t mtime_nsec;
+  int64_t ctime;
+  uint64_t ctime_nsec;
+  uint32_t unused[2];
+};
+static_assert(sizeof(GuestStat) == 128);
+
+uint64_t error(int err) {
+  return static_cast<uint64_t>(-static_cast<int64_t>(err));
+}
+
+// 宿主机调用的返回值：失败时返回 -errno
+uint64_t result(int64_t ret) {
+  return ret < 0 ? error(errno) : static_cast<uint64_t>(ret);
+}
+
+uint64_t align_up(uint64_t value) {
+  return (value + PAGE_MASK) & ~PAGE_MASK;
+}
+
+// 客户机地址 [addr, addr + len) 对应的宿主机指针，不在 DRAM 中时返回 nullptr
+uint8_t* guest(Cpu& cpu, uint64_t addr, uint64_t len) {
+  return cpu.bus.dram_ptr(addr, len);
+}
+
+// 宿主机直接写了客户机内存之后调用
+void written(Cpu& cpu, uint64_t addr, uint64_t len) {
+  cpu.bus.memory().mark_dirty(addr, len);
+  cpu.blocks.invalidate(addr, len);
+}
+
+// 客户机中以 0 结尾的字符串，最长 PATH_MAX
+std::optional<std::string> guest_string(Cpu& cpu, uint64_t addr) {
+  std::string s;
+  for (uint64_t i = 0; i < 4096; ++i) {
+    const uint8_t* c = guest(cpu, addr + i, 1);
+    if (c == nullptr) {
+      return std::nullopt;
+    }
+    if (*c == 0) {
+      return s;
+    }
+    s.push_back(static_cast<char>(*c));
+  }
+  return std::nullopt;
+}
+
+template <typename T>
+bool put(Cpu& cpu, uint64_t addr, const T& value) {
+  uint8_t* p = guest(cpu, addr, sizeof(T));
+  if (p == nullptr) {
+    return false;
+  }
+  std::memcpy(p, &value, sizeof(T));
+  written(cpu, addr, sizeof(T));
+  return true;
+}
+
+}  // namespace
+
+void UserMode::setup(Cpu& cpu, const ElfImage& image, const std::vector<std::string>& args,
+                     const std::vector<std::string>& env) {
+  const uint64_t top = DRAM_BASE + DRAM_SIZE;
+  brk_start = brk_end = brk_max = align_up(image.end);
+  mmap_top = mmap_bottom = mmap_low = top - STACK_SIZE;
+
+  // 栈顶依次放字符串和 AT_RANDOM 的 16 字节，下面是 argc、argv、envp 和辅助向量
+  uint64_t sp = top;
+  // 参数和环境变量太多、栈放不下时启动失败，而不是写到栈以外
+  auto stack = [&](uint64_t addr, uint64_t len) {
+    uint8_t* p = addr >= top - STACK_SIZE ? guest(cpu, addr, len) : nullptr;
+    if (p == nullptr) {
+      throw std::runtime_error("Arguments and environment do not fit in the guest stack");
+    }
+    return p;
+  };
+  auto push = [&](const void* data, uint64_t len) {
+    sp -= len;
+    std::memcpy(stack(sp, len), data, len);
+    return sp;
+  };
+  std::vector<uint64_t> arg_ptrs, env_ptrs;
+  for (const auto& arg : args) {
+    arg_ptrs.push_back(push(arg.c_str(), arg.size() + 1));
+  }
+  for (const auto& var : env) {
+    env_ptrs.push_back(push(var.c_str(), var.size() + 1));
+  }
+  std::random_device rd;
+  uint32_t random[4] = {rd(), rd(), rd(), rd()};
+  uint64_t random_ptr = push(random, sizeof(random));
+
+  std::vector<uint64_t> words = {arg_ptrs.size()};
+  words.insert(words.end(), arg_ptrs.begin(), arg_ptrs.end());
+  words.push_back(0);
+  words.insert(words.end(), env_ptrs.begin(), env_ptrs.end());
+  words.push_back(0);
+  uint64_t auxv[][2] = {
+      {AT_PHDR, image.phdr},   {AT_PHENT, 56},           {AT_PHNUM, image.phnum},
+      {AT_PAGESZ, Dram::PAGE_SIZE}, {AT_BASE, 0},        {AT_ENTRY, image.entry},
+      {AT_UID, getuid()},      {AT_EUID, geteuid()},     {AT_GID, getgid()},
+      {AT_EGID, getegid()},    {AT_CLKTCK, 100},         {AT_SECURE, 0},
+      {AT_RANDOM, random_ptr}, {AT_NULL, 0},
+  };
+  for (const auto& [type, value] : auxv) {
+    words.push_back(type);
+    words.push_back(value);
+  }
+  // 入口处 sp 按 16 字节对齐，指向 argc
+  sp = (sp - words.size() * 8) & ~uint64_t{15};
+  std::memcpy(stack(sp, words.size() * 8), words.data(), words.size() * 8);
+  written(cpu, sp, top - sp);
+
+  cpu.regs.fill(0);
+  cpu.regs[2] = sp;
+  cpu.pc = image.entry;
+  cpu.mode = User;
+  // Linux 允许用户程序读 cycle、time 和 instret（rdcycle 等伪指令）
+  cpu.csr.store(MCOUNTEREN, 0b111);
+  cpu.csr.store(SCOUNTEREN, 0b111);
+  cpu.accounting.trap_return(User, cpu.csr.instret);
+  cpu.usermode = this;
+}
+
+void UserMode::syscall(Cpu& cpu) {
+  uint64_t number = cpu.regs[17];
+  const uint64_t* args = &cpu.regs[10];
+  uint64_t ret = do_syscall(cpu, number, args);
+  cpu.regs[10] = ret;
+}
+
+uint64_t UserMode::do_syscall(Cpu& cpu, uint64_t number, const uint64_t* args) {
+  auto fd = static_cast<int>(args[0]);
+  switch (number) {
+    case SYS_READ:
+      return do_read(cpu, args[0], args[1], args[2]);
+    case SYS_WRITE:
+      return do_write(cpu, args[0], args[1], args[2]);
+    case SYS_READV:
+    case SYS_WRITEV: {
+      // struct iovec { void* base; size_t len; }
+      uint64_t total = 0;
+      for (uint64_t i = 0; i < args[2]; ++i) {
+        const uint8_t* iov = guest(cpu, args[1] + i * 16, 16);
+        if (iov == nullptr) {
+          return error(EFAULT);
+        }
+        uint64_t base, len;
+        std::memcpy(&base, iov, 8);
+        std::memcpy(&len, iov + 8, 8);
+        uint64_t n = number == SYS_READV ? do_read(cpu, args[0], base, len) : do_write(cpu, args[0], base, len);
+        if (static_cast<int64_t>(n) < 0) {
+          return total != 0 ? total : n;
+        }
+        total += n;
+        if (n < len) {
+          break;
+        }
+      }
+      return total;
+    }
+    case SYS_OPENAT: {
+      auto path = guest_string(cpu, args[1]);
+      if (!path) {
+        return error(EFAULT);
+      }
+      // O_* 标志取 asm-generic 的值，与 x86-64 宿主机相同
+      return result(openat(fd, path->c_str(), static_cast<int>(args[2]), static_cast<mode_t>(args[3])));
+    }
+    case SYS_CLOSE:
+      // 不关闭模拟器自己的标准输入输出
+      return fd <= 2 ? 0 : result(close(fd));
+    case SYS_LSEEK:
+      return result(lseek(fd, static_cast<off_t>(args[1]), static_cast<int>(args[2])));
+    case SYS_DUP:
+      return result(dup(fd));
+    case SYS_FCNTL:
+      // 只支持整数参数的命令：F_DUPFD、F_GETFD、F_SETFD、F_GETFL、F_SETFL
+      if (args[1] > F_SETFL) {
+        return error(EINVAL);
+      }
+      return result(fcntl(fd, static_cast<int>(args[1]), static_cast<int>(args[2])));
+    case SYS_IOCTL:
+      // 没有终端，isatty 返回假，libc 对标准输出使用全缓冲
+      return error(ENOTTY);
+    case SYS_UNLINKAT:
+    case SYS_FACCESSAT:
+    case SYS_READLINKAT: {
+      auto path = guest_string(cpu, args[1]);
+      if (!path) {
+        return error(EFAULT);
+      }
+      if (number == SYS_UNLINKAT) {
+        return result(unlinkat(fd, path->c_str(), static_cast<int>(args[2])));
+      }
+      if (number == SYS_FACCESSAT) {
+        return result(faccessat(fd, path->c_str(), static_cast<int>(args[2]), 0));
+      }
+      char* buf = reinterpret_cast<char*>(guest(cpu, args[2], args[3]));
+      if (buf == nullptr) {
+        return error(EFAULT);
+      }
+      uint64_t ret = result(readlinkat(fd, path->c_str(), buf, args[3]));
+      if (static_cast<int64_t>(ret) > 0) {
+        written(cpu, args[2], ret);
+      }
+      return ret;
+    }
+    case SYS_NEWFSTATAT:
+      return do_stat(cpu, fd, args[1], args[2], args[3]);
+    case SYS_FSTAT:
+      return do_stat(cpu, fd, 0, args[1], 0);
+    case SYS_GETCWD: {
+      char* buf = reinterpret_cast<char*>(guest(cpu, args[0], args[1]));
+      if (buf == nullptr) {
+        return error(EFAULT);
+      }
+      if (getcwd(buf, args[1]) == nullptr) {
+        return error(errno);
+      }
+      uint64_t len = std::strlen(buf) + 1;
+      written(cpu, args[0], len);
+      return len;
+    }
+    case SYS_EXIT:
+    case SYS_EXIT_GROUP:
+      cpu.exit(args[0] & 0xff);
+      return 0;
+    case SYS_SET_TID_ADDRESS:
+    case SYS_GETPID:
+    case SYS_GETTID:
+      // 只有一个线程，进程号固定为 1，保证运行结果可重现
+      return 1;
+    case SYS_GETPPID:
+      return 0;
+    case SYS_GETUID:
+      return getuid();
+    case SYS_GETEUID:
+      return geteuid();
+    case SYS_GETGID:
+      return getgid();
+    case SYS_GETEGID:
+      return getegid();
+    case SYS_FUTEX:
+    case SYS_SET_ROBUST_LIST:
+    case SYS_RT_SIGACTION:
+    case SYS_RT_SIGPROCMASK:
+    case SYS_MPROTECT:
+    case SYS_MADVISE:
+      // 单线程、没有信号和页保护，这些调用都不需要做任何事
+      return 0;
+    case SYS_CLOCK_GETTIME: {
+      timespec ts{};
+      if (clock_gettime(static_cast<clockid_t>(args[0]), &ts) != 0) {
+        return error(errno);
+      }
+      int64_t value[2] = {ts.tv_sec, ts.tv_nsec};
+      return put(cpu, args[1], value) ? 0 : error(EFAULT);
+    }
+    case SYS_GETTIMEOFDAY: {
+      timeval tv{};
+      gettimeofday(&tv, nullptr);
+      int64_t value[2] = {tv.tv_sec, tv.tv_usec};
+      return args[0] == 0 || put(cpu, args[0], value) ? 0 : error(EFAULT);
+    }
+    case SYS_UNAME: {
+      char uts[6][65] = {"Linux", "cemu", "5.15.0", "#1", "riscv64", ""};
+      return put(cpu, args[0], uts) ? 0 : error(EFAULT);
+    }
+    case SYS_PRLIMIT64: {
+      if (args[3] == 0) {
+        return 0;
+      }
+      uint64_t limit[2] = {~0ULL, ~0ULL};
+      if (args[1] == GUEST_RLIMIT_STACK) {
+        limit[0] = limit[1] = STACK_SIZE;
+      }
+      return put(cpu, args[3], limit) ? 0 : error(EFAULT);
+    }
+    case SYS_GETRANDOM: {
+      uint8_t* buf = guest(cpu, args[0], args[1]);
+      if (buf == nullptr) {
+        return error(EFAULT);
+      }
+      uint64_t ret = result(getrandom(buf, args[1], 0));
+      if (static_cast<int64_t>(ret) > 0) {
+        written(cpu, args[0], ret);
+      }
+      return ret;
+    }
+    case SYS_BRK:
+      return do_brk(cpu, args[0]);
+    case SYS_MMAP:
+      // 没有页保护，忽略 prot
+      return do_mmap(cpu, args[0], args[1], args[3], args[4], args[5]);
+    case SYS_MUNMAP:
+      return do_munmap(args[0], args[1]);
+    default:
+      LOG(WARNING, "Unsupported syscall: ", number);
+      return error(ENOSYS);
+  }
+}
+
+uint64_t UserMode::do_write(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len) {
+  const uint8_t* p = guest(cpu, buf, len);
+  if (p == nullptr) {
+    return error(EFAULT);
+  }
+  if (fd == 1 || fd == 2) {
+    std::ostream& os = fd == 1 ? *out : *err;
+    os.write(reinterpret_cast<const char*>(p), static_cast<std::streamsize>(len));
+    os.flush();
+    return len;
+  }
+  return result(::write(static_cast<int>(fd), p, len));
+}
+
+uint64_t UserMode::do_read(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len) {
+  uint8_t* p = guest(cpu, buf, len);
+  if (p == nullptr) {
+    return error(EFAULT);
+  }
+  uint64_t ret = result(::read(static_cast<int>(fd), p, len));
+  if (static_cast<int64_t>(ret) > 0) {
+    written(cpu, buf, ret);
+  }
+  return ret;
+}
+
+uint64_t UserMode::do_stat(Cpu& cpu, int fd, uint64_t path, uint64_t buf, uint64_t flags) {
+  struct stat st {};
+  if (path == 0) {
+    if (fstat(fd, &st) != 0) {
+      return error(errno);
+    }
+  } else {
+    auto name = guest_string(cpu, path);
+    if (!name) {
+      return error(EFAULT);
+    }
+    if (fstatat(fd, name->c_str(), &st, static_cast<int>(flags)) != 0) {
+      return error(errno);
+    }
+  }
+  GuestStat gs{};
+  gs.dev = st.st_dev;
+  gs.ino = st.st_ino;
+  gs.mode = st.st_mode;
+  gs.nlink = static_cast<uint32_t>(st.st_nlink);
+  gs.uid = st.st_uid;
+  gs.gid = st.st_gid;
+  gs.rdev = st.st_rdev;
+  gs.size = st.st_size;
+  gs.blksize = static_cast<int32_t>(st.st_blksize);
+  gs.blocks = st.st_blocks;
+  gs.atime = st.st_atim.tv_sec;
+  gs.atime_nsec = st.st_atim.tv_nsec;
+  gs.mtime = st.st_mtim.tv_sec;
+  gs.mtime_nsec = st.st_mtim.tv_nsec;
+  gs.ctime = st.st_ctim.tv_sec;
+  gs.ctime_nsec = st.st_ctim.tv_nsec;
+  return put(cpu, buf, gs) ? 0 : error(EFAULT);
+}
+
+uint64_t UserMode::do_brk(Cpu& cpu, uint64_t addr) {
+  if (addr < brk_start || addr > mmap_bottom) {
+    return brk_end;
+  }
+  // 只有曾经用过又被释放的部分需要清零，从未用过的页仍然是匿名映射的零页
+  uint64_t dirty_end = std::min(addr, brk_max);
+  if (dirty_end > brk_end) {
+    std::memset(guest(cpu, brk_end, dirty_end - brk_end), 0, dirty_end - brk_end);
+    written(cpu, brk_end, dirty_end - brk_end);
+  }
+  brk_end = addr;
+  brk_max = std::max(brk_max, addr);
+  return brk_end;
+}
+
+uint64_t UserMode::do_mmap(Cpu& cpu, uint64_t addr, uint64_t len, uint64_t flags, uint64_t fd, uint64_t off) {
+  len = align_up(len);
+  if (len == 0) {
+    return error(EINVAL);
+  }
+  uint64_t region;
+  if (flags & GUEST_MAP_FIXED) {
+    if (guest(cpu, addr, len) == nullptr) {
+      return error(ENOMEM);
+    }
+    region = addr;
+    std::memset(guest(cpu, region, len), 0, len);
+    written(cpu, region, len);
+  } else {
+    if (mmap_bottom - brk_end < len) {
+      return error(ENOMEM);
+    }
+    region = mmap_bottom - len;
+    mmap_bottom = region;
+    // 低于 mmap_low 的部分从未用过，仍然是零页
+    if (region + len > mmap_low) {
+      uint64_t begin = std::max(region, mmap_low);
+      std::memset(guest(cpu, begin, region + len - begin), 0, region + len - begin);
+      written(cpu, begin, region + len - begin);
+    }
+    mmap_low = std::min(mmap_low, region);
+  }
+
+  if (!(flags & GUEST_MAP_ANONYMOUS)) {
+    // 私有文件映射：读入文件内容，超出文件末尾的部分保持为 0
+    ssize_t n = pread(static_cast<int>(fd), guest(cpu, region, len), len, static_cast<off_t>(off));
+    if (n < 0) {
+      return error(errno);
+    }
+    written(cpu, region, static_cast<uint64_t>(n));
+  }
+  return region;
+}
+
+uint64_t UserMode::do_munmap(uint64_t addr, uint64_t len) {
+  // 只回收最低处的映射，其余的区域留到程序退出
+  if (addr == mmap_bottom) {
+    mmap_bottom = std::min(mmap_top, addr + align_up(len));
+  }
+  return 0;
+}
+
+}
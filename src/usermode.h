@@ -0,0 +1,65 @@
+//
+// Created by Jie Wei on 2024/5/18.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace cemu {
+
+class Cpu;
+struct ElfImage;
+
+// 用户态模拟：不启动内核，直接在 U 模式下运行 Linux 用户程序。U 模式的 ecall 在进入
+// handle_exception 之前被拦截，按 RISC-V Linux 的系统调用号翻译成宿主机的系统调用，
+// 客户机指针（没有 MMU，即 DRAM 中的物理地址）在调用前翻译成宿主机指针。
+//
+// 因为客户机地址就是 DRAM 地址，只支持能放进 DRAM 的程序：静态链接的位置无关可执行文件
+// （-static-pie，由 load_elf 整体平移到 DRAM_BASE），或者链接地址本身就在 DRAM 中的程序。
+// 按默认地址（0x10000）链接的普通静态可执行文件会被 load_elf 以段不在 DRAM 中为由拒绝。
+//
+// 内存布局：程序段之后是 brk 堆，向上增长；DRAM 顶部是栈，栈下面是 mmap 区域，向下增长。
+// mmap 只支持匿名映射和私有文件映射（读入内容），munmap 只回收最近一次映射的区域。
+class UserMode {
+ public:
+  // 栈的大小，mmap 区域从栈底向下分配
+  static constexpr uint64_t STACK_SIZE = 8 << 20;
+
+  // 把已经由 load_elf 加载的程序设置为在 U 模式下从入口开始运行：在栈上放好 argc、argv、
+  // envp 和辅助向量，并接管 cpu 的 U 模式 ecall
+  void setup(Cpu& cpu, const ElfImage& image, const std::vector<std::string>& args,
+             const std::vector<std::string>& env);
+
+  // 执行 a7 指定的系统调用，结果写入 a0
+  void syscall(Cpu& cpu);
+
+  // 客户机标准输出和标准错误的去向，其他文件描述符直接使用宿主机的
+  std::ostream* out = &std::cout;
+  std::ostream* err = &std::cerr;
+
+  [[nodiscard]] uint64_t brk() const {
+    return brk_end;
+  }
+
+ private:
+  uint64_t do_syscall(Cpu& cpu, uint64_t number, const uint64_t* args);
+  uint64_t do_brk(Cpu& cpu, uint64_t addr);
+  uint64_t do_mmap(Cpu& cpu, uint64_t addr, uint64_t len, uint64_t flags, uint64_t fd, uint64_t off);
+  uint64_t do_munmap(uint64_t addr, uint64_t len);
+  uint64_t do_write(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len);
+  uint64_t do_read(Cpu& cpu, uint64_t fd, uint64_t buf, uint64_t len);
+  uint64_t do_stat(Cpu& cpu, int fd, uint64_t path, uint64_t buf, uint64_t flags);
+
+  uint64_t brk_start = 0;
+  uint64_t brk_end = 0;
+  uint64_t brk_max = 0;      // brk 曾经到过的最高地址，之上的页从未被写过
+  uint64_t mmap_bottom = 0;  // mmap 区域的最低地址，下一次映射在它下面
+  uint64_t mmap_low = 0;     // mmap 曾经用到的最低地址
+  uint64_t mmap_top = 0;
+};
+
+}
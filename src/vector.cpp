@@ -0,0 +1,256 @@
+//
+// Created by Jie Wei on 2024/5/6.
+//
+
+#include "vector.h"
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+// 运算符模板总是内联进带 target 属性的内核中，不存在跨 ABI 的调用，关闭相应的告警
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace cemu {
+
+namespace {
+
+// 每个运算同时作用于 GCC 向量类型和标量类型，强制内联以便在带 target 属性的内核中展开为对应的 SIMD 指令
+struct OpAdd {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a + b; }
+};
+struct OpSub {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a - b; }
+};
+struct OpAnd {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a & b; }
+};
+struct OpOr {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a | b; }
+};
+struct OpXor {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a ^ b; }
+};
+struct OpMul {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a * b; }
+};
+struct OpMin {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a < b ? a : b; }
+};
+struct OpMax {
+  template <typename V> [[gnu::always_inline]] V operator()(const V& a, const V& b) const { return a > b ? a : b; }
+};
+
+using BinaryKernel = void (*)(uint8_t*, const uint8_t*, const uint8_t*, size_t);
+using ReduceKernel = uint64_t (*)(const uint8_t*, uint64_t, size_t);
+
+// 以 W 字节为一组处理元素，剩余不足一组的元素逐个处理
+template <size_t W, typename T, typename Op>
+[[gnu::always_inline]] inline void binary_loop(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, size_t nbytes) {
+  typedef T V __attribute__((vector_size(W)));
+  size_t i = 0;
+  for (; i + W <= nbytes; i += W) {
+    V a, b;
+    std::memcpy(&a, vs2 + i, W);
+    std::memcpy(&b, vs1 + i, W);
+    V r = Op{}(a, b);
+    std::memcpy(vd + i, &r, W);
+  }
+  for (; i < nbytes; i += sizeof(T)) {
+    T a, b;
+    std::memcpy(&a, vs2 + i, sizeof(T));
+    std::memcpy(&b, vs1 + i, sizeof(T));
+    T r = static_cast<T>(Op{}(a, b));
+    std::memcpy(vd + i, &r, sizeof(T));
+  }
+}
+
+// 先在 W 字节宽的累加器中按列归约，再对累加器的各个通道和剩余元素做标量归约
+template <size_t W, typename T, typename Op>
+[[gnu::always_inline]] inline uint64_t reduce_loop(const uint8_t* vs2, uint64_t init, size_t nbytes) {
+  typedef T V __attribute__((vector_size(W)));
+  T r = static_cast<T>(init);
+  size_t i = 0;
+  if (nbytes >= W) {
+    V acc;
+    std::memcpy(&acc, vs2, W);
+    for (i = W; i + W <= nbytes; i += W) {
+      V a;
+      std::memcpy(&a, vs2 + i, W);
+      acc = Op{}(acc, a);
+    }
+    for (size_t j = 0; j < W / sizeof(T); ++j) {
+      r = static_cast<T>(Op{}(r, static_cast<T>(acc[j])));
+    }
+  }
+  for (; i < nbytes; i += sizeof(T)) {
+    T a;
+    std::memcpy(&a, vs2 + i, sizeof(T));
+    r = static_cast<T>(Op{}(r, a));
+  }
+  return static_cast<std::make_unsigned_t<T>>(r);
+}
+
+// 三种实现共用同一份循环，仅向量宽度和编译目标不同
+struct ScalarIsa {
+  static constexpr const char* name = "scalar";
+  template <typename T, typename Op>
+  static void binary(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, size_t n) {
+    binary_loop<sizeof(T), T, Op>(vd, vs2, vs1, n);
+  }
+  template <typename T, typename Op>
+  static uint64_t reduce(const uint8_t* vs2, uint64_t init, size_t n) {
+    return reduce_loop<sizeof(T), T, Op>(vs2, init, n);
+  }
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+struct Sse42Isa {
+  static constexpr const char* name = "sse4.2";
+  template <typename T, typename Op>
+  [[gnu::target("sse4.2")]] static void binary(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, size_t n) {
+    binary_loop<16, T, Op>(vd, vs2, vs1, n);
+  }
+  template <typename T, typename Op>
+  [[gnu::target("sse4.2")]] static uint64_t reduce(const uint8_t* vs2, uint64_t init, size_t n) {
+    return reduce_loop<16, T, Op>(vs2, init, n);
+  }
+};
+
+struct Avx2Isa {
+  static constexpr const char* name = "avx2";
+  template <typename T, typename Op>
+  [[gnu::target("avx2")]] static void binary(uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, size_t n) {
+    binary_loop<32, T, Op>(vd, vs2, vs1, n);
+  }
+  template <typename T, typename Op>
+  [[gnu::target("avx2")]] static uint64_t reduce(const uint8_t* vs2, uint64_t init, size_t n) {
+    return reduce_loop<32, T, Op>(vs2, init, n);
+  }
+};
+#endif
+
+// 按 SEW = 8/16/32/64 索引的内核
+struct KernelTable {
+  const char* name;
+  std::array<std::array<BinaryKernel, 4>, static_cast<size_t>(VectorOp::Count)> binary;
+  std::array<std::array<ReduceKernel, 4>, static_cast<size_t>(VectorRedOp::Count)> reduce;
+};
+
+template <typename Isa, typename Op, bool Signed>
+constexpr std::array<BinaryKernel, 4> binary_row() {
+  if constexpr (Signed) {
+    return {Isa::template binary<int8_t, Op>, Isa::template binary<int16_t, Op>,
+            Isa::template binary<int32_t, Op>, Isa::template binary<int64_t, Op>};
+  } else {
+    return {Isa::template binary<uint8_t, Op>, Isa::template binary<uint16_t, Op>,
+            Isa::template binary<uint32_t, Op>, Isa::template binary<uint64_t, Op>};
+  }
+}
+
+template <typename Isa, typename Op, bool Signed>
+constexpr std::array<ReduceKernel, 4> reduce_row() {
+  if constexpr (Signed) {
+    return {Isa::template reduce<int8_t, Op>, Isa::template reduce<int16_t, Op>,
+            Isa::template reduce<int32_t, Op>, Isa::template reduce<int64_t, Op>};
+  } else {
+    return {Isa::template reduce<uint8_t, Op>, Isa::template reduce<uint16_t, Op>,
+            Isa::template reduce<uint32_t, Op>, Isa::template reduce<uint64_t, Op>};
+  }
+}
+
+// 表项顺序与 VectorOp / VectorRedOp 的声明顺序一致
+template <typename Isa>
+constexpr KernelTable make_table() {
+  return {
+    Isa::name,
+    {
+      binary_row<Isa, OpAdd, false>(),
+      binary_row<Isa, OpSub, false>(),
+      binary_row<Isa, OpAnd, false>(),
+      binary_row<Isa, OpOr, false>(),
+      binary_row<Isa, OpXor, false>(),
+      binary_row<Isa, OpMin, false>(),
+      binary_row<Isa, OpMin, true>(),
+      binary_row<Isa, OpMax, false>(),
+      binary_row<Isa, OpMax, true>(),
+      binary_row<Isa, OpMul, false>(),
+    },
+    {
+      reduce_row<Isa, OpAdd, false>(),
+      reduce_row<Isa, OpAnd, false>(),
+      reduce_row<Isa, OpOr, false>(),
+      reduce_row<Isa, OpXor, false>(),
+      reduce_row<Isa, OpMin, false>(),
+      reduce_row<Isa, OpMin, true>(),
+      reduce_row<Isa, OpMax, false>(),
+      reduce_row<Isa, OpMax, true>(),
+    },
+  };
+}
+
+// 运行时根据宿主机 CPU 特性选择内核，只在第一次使用时检测一次
+const KernelTable& kernels() {
+  static const KernelTable table = [] {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return make_table<Avx2Isa>();
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+      return make_table<Sse42Isa>();
+    }
+#endif
+    return make_table<ScalarIsa>();
+  }();
+  return table;
+}
+
+// SEW(位) -> 内核表的列下标
+size_t sew_index(uint64_t sew) {
+  switch (sew) {
+    case 8:
+      return 0;
+    case 16:
+      return 1;
+    case 32:
+      return 2;
+    default:
+      return 3;
+  }
+}
+
+}  // namespace
+
+void vector_binary(VectorOp op, uint64_t sew, uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, uint64_t vl) {
+  kernels().binary[static_cast<size_t>(op)][sew_index(sew)](vd, vs2, vs1, vl * (sew / 8));
+}
+
+uint64_t vector_reduce(VectorRedOp op, uint64_t sew, const uint8_t* vs2, uint64_t init, uint64_t vl) {
+  return kernels().reduce[static_cast<size_t>(op)][sew_index(sew)](vs2, init, vl * (sew / 8));
+}
+
+void vector_splat(uint64_t sew, uint8_t* vd, uint64_t value, uint64_t vl) {
+  uint64_t nbytes = sew / 8;
+  if (nbytes == 1) {
+    std::memset(vd, static_cast<int>(value & 0xff), vl);
+    return;
+  }
+  for (uint64_t i = 0; i < vl; ++i) {
+    std::memcpy(vd + i * nbytes, &value, nbytes);
+  }
+}
+
+void vector_merge(uint64_t sew, uint8_t* vd, const uint8_t* src, const uint8_t* mask, uint64_t vl) {
+  uint64_t nbytes = sew / 8;
+  for (uint64_t i = 0; i < vl; ++i) {
+    if ((mask[i / 8] >> (i % 8)) & 1) {
+      std::memcpy(vd + i * nbytes, src + i * nbytes, nbytes);
+    }
+  }
+}
+
+const char* vector_isa() {
+  return kernels().name;
+}
+
+}
@@ -0,0 +1,34 @@
+//
+// Created by Jie Wei on 2024/5/6.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cemu {
+
+// 向量整数运算。Rsub 在取指解码时交换操作数后按 Sub 执行，因此不单独列出。
+enum class VectorOp { Add, Sub, And, Or, Xor, Minu, Min, Maxu, Max, Mul, Count };
+
+// 向量归约运算 vd[0] = op(vs1[0], vs2[0..vl-1])
+enum class VectorRedOp { Sum, And, Or, Xor, Minu, Min, Maxu, Max, Count };
+
+// 对 vl 个宽度为 sew 位的元素执行 vd[i] = vs2[i] op vs1[i]。
+// 内核在第一次调用时根据宿主机 CPU 特性（AVX2 / SSE4.2 / 标量）选定。
+void vector_binary(VectorOp op, uint64_t sew, uint8_t* vd, const uint8_t* vs2, const uint8_t* vs1, uint64_t vl);
+
+// 返回 op(init, vs2[0], ..., vs2[vl-1])，结果保留低 sew 位
+uint64_t vector_reduce(VectorRedOp op, uint64_t sew, const uint8_t* vs2, uint64_t init, uint64_t vl);
+
+// 将标量 value 的低 sew 位复制到 vd 的前 vl 个元素
+void vector_splat(uint64_t sew, uint8_t* vd, uint64_t value, uint64_t vl);
+
+// 按 v0 中的掩码位合并：mask[i] 为 1 时 vd[i] = src[i]，否则保持 vd[i] 不变
+void vector_merge(uint64_t sew, uint8_t* vd, const uint8_t* src, const uint8_t* mask, uint64_t vl);
+
+// 当前使用的宿主机 SIMD 指令集名称
+const char* vector_isa();
+
+}
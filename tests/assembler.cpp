@@ -0,0 +1,589 @@
+//
+// Created by Jie Wei on 2024/5/20.
+//
+
+#include "assembler.h"
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "../src/param.h"
+
+namespace cemu {
+
+namespace {
+
+// 一条语句：助记符和逗号分隔的操作数
+struct Statement {
+  size_t line;
+  std::string mnemonic;
+  std::vector<std::string> operands;
+  uint64_t addr = 0;
+};
+
+[[noreturn]] void fail(size_t line, const std::string& message) {
+  throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+std::optional<int64_t> parse_int(std::string_view s) {
+  s = trim(s);
+  bool negative = false;
+  if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+    negative = s[0] == '-';
+    s.remove_prefix(1);
+  }
+  int base = 10;
+  if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    base = 16;
+    s.remove_prefix(2);
+  } else if (s.size() > 2 && s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+    base = 2;
+    s.remove_prefix(2);
+  }
+  uint64_t value = 0;
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value, base);
+  if (s.empty() || ec != std::errc() || end != s.data() + s.size()) {
+    return std::nullopt;
+  }
+  return negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+}
+
+std::optional<uint32_t> parse_reg(std::string_view s) {
+  static const std::unordered_map<std::string_view, uint32_t> abi = {
+      {"zero", 0}, {"ra", 1},  {"sp", 2},   {"gp", 3},   {"tp", 4},  {"t0", 5},  {"t1", 6},  {"t2", 7},
+      {"s0", 8},   {"fp", 8},  {"s1", 9},   {"a0", 10},  {"a1", 11}, {"a2", 12}, {"a3", 13}, {"a4", 14},
+      {"a5", 15},  {"a6", 16}, {"a7", 17},  {"s2", 18},  {"s3", 19}, {"s4", 20}, {"s5", 21}, {"s6", 22},
+      {"s7", 23},  {"s8", 24}, {"s9", 25},  {"s10", 26}, {"s11", 27}, {"t3", 28}, {"t4", 29}, {"t5", 30},
+      {"t6", 31},
+  };
+  s = trim(s);
+  if (auto it = abi.find(s); it != abi.end()) {
+    return it->second;
+  }
+  if (s.size() >= 2 && s[0] == 'x') {
+    auto n = parse_int(s.substr(1));
+    if (n && *n >= 0 && *n < 32) {
+      return static_cast<uint32_t>(*n);
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint32_t> parse_csr(std::string_view s) {
+  static const std::unordered_map<std::string_view, uint32_t> names = {
+      {"mhartid", MHARTID},   {"mstatus", MSTATUS},       {"medeleg", MEDELEG},   {"mideleg", MIDELEG},
+      {"mie", MIE},           {"mtvec", MTVEC},           {"mcounteren", MCOUNTEREN},
+      {"mscratch", MSCRATCH}, {"mepc", MEPC},             {"mcause", MCAUSE},     {"mtval", MTVAL},
+      {"mip", MIP},           {"mcountinhibit", MCOUNTINHIBIT},
+      {"mcycle", MCYCLE},     {"minstret", MINSTRET},     {"sstatus", SSTATUS},   {"sie", SIE},
+      {"stvec", STVEC},       {"scounteren", SCOUNTEREN}, {"sscratch", SSCRATCH}, {"sepc", SEPC},
+      {"scause", SCAUSE},     {"stval", STVAL},           {"sip", SIP},           {"satp", SATP},
+      {"cycle", CYCLE},       {"time", TIME},             {"instret", INSTRET},   {"vstart", VSTART},
+      {"vxsat", VXSAT},       {"vxrm", VXRM},             {"vcsr", VCSR},         {"vl", VL},
+      {"vtype", VTYPE},       {"vlenb", VLENB},
+  };
+  s = trim(s);
+  if (auto it = names.find(s); it != names.end()) {
+    return it->second;
+  }
+  auto n = parse_int(s);
+  if (n && *n >= 0 && *n < static_cast<int64_t>(NUM_CSRS)) {
+    return static_cast<uint32_t>(*n);
+  }
+  return std::nullopt;
+}
+
+bool fits_signed(int64_t value, int bits) {
+  return value >= -(int64_t{1} << (bits - 1)) && value < (int64_t{1} << (bits - 1));
+}
+
+int64_t sign_extend(uint64_t value, int bits) {
+  return static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+}
+
+uint32_t rtype(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t itype(int64_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return (static_cast<uint32_t>(imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t stype(int64_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  uint32_t u = static_cast<uint32_t>(imm);
+  return (((u >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1f) << 7) | 0x23;
+}
+
+uint32_t btype(int64_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  uint32_t u = static_cast<uint32_t>(imm);
+  return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         (((u >> 1) & 0xf) << 8) | (((u >> 11) & 1) << 7) | 0x63;
+}
+
+uint32_t utype(int64_t imm, uint32_t rd, uint32_t opcode) {
+  return (static_cast<uint32_t>(imm & 0xfffff) << 12) | (rd << 7) | opcode;
+}
+
+uint32_t jtype(int64_t imm, uint32_t rd) {
+  uint32_t u = static_cast<uint32_t>(imm);
+  return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3ff) << 21) | (((u >> 11) & 1) << 20) | (((u >> 12) & 0xff) << 12) |
+         (rd << 7) | 0x6f;
+}
+
+// li 展开后的指令序列，与 GNU as / LLVM 的展开方式相同：先装入高位再移位加上低 12 位
+void expand_li(std::vector<uint32_t>& out, uint32_t rd, int64_t value) {
+  if (fits_signed(value, 32)) {
+    int64_t lo12 = sign_extend(value, 12);
+    int64_t hi20 = ((value + 0x800) >> 12) & 0xfffff;
+    if (hi20 != 0) {
+      out.push_back(utype(hi20, rd, 0x37));
+    }
+    if (lo12 != 0 || hi20 == 0) {
+      out.push_back(hi20 != 0 ? itype(lo12, rd, 0x0, rd, 0x1b) : itype(lo12, 0, 0x0, rd, 0x13));
+    }
+    return;
+  }
+  int64_t lo12 = sign_extend(value, 12);
+  int64_t hi52 = (value + 0x800) >> 12;
+  int shift = std::countr_zero(static_cast<uint64_t>(hi52)) + 12;
+  hi52 = sign_extend(static_cast<uint64_t>(hi52) >> (shift - 12), 64 - shift);
+  expand_li(out, rd, hi52);
+  out.push_back(itype(shift, rd, 0x1, rd, 0x13));
+  if (lo12 != 0) {
+    out.push_back(itype(lo12, rd, 0x0, rd, 0x13));
+  }
+}
+
+// 寄存器-寄存器运算：funct7, funct3, opcode
+struct ROp {
+  uint32_t funct7, funct3, opcode;
+};
+
+const std::unordered_map<std::string_view, ROp> R_OPS = {
+    {"add", {0x00, 0x0, 0x33}},  {"sub", {0x20, 0x0, 0x33}},   {"sll", {0x00, 0x1, 0x33}},
+    {"slt", {0x00, 0x2, 0x33}},  {"sltu", {0x00, 0x3, 0x33}},  {"xor", {0x00, 0x4, 0x33}},
+    {"srl", {0x00, 0x5, 0x33}},  {"sra", {0x20, 0x5, 0x33}},   {"or", {0x00, 0x6, 0x33}},
+    {"and", {0x00, 0x7, 0x33}},  {"addw", {0x00, 0x0, 0x3b}},  {"subw", {0x20, 0x0, 0x3b}},
+    {"sllw", {0x00, 0x1, 0x3b}}, {"srlw", {0x00, 0x5, 0x3b}},  {"sraw", {0x20, 0x5, 0x3b}},
+    {"mul", {0x01, 0x0, 0x33}},  {"mulh", {0x01, 0x1, 0x33}},  {"mulhsu", {0x01, 0x2, 0x33}},
+    {"mulhu", {0x01, 0x3, 0x33}}, {"div", {0x01, 0x4, 0x33}},  {"divu", {0x01, 0x5, 0x33}},
+    {"rem", {0x01, 0x6, 0x33}},  {"remu", {0x01, 0x7, 0x33}},  {"mulw", {0x01, 0x0, 0x3b}},
+    {"divw", {0x01, 0x4, 0x3b}}, {"divuw", {0x01, 0x5, 0x3b}}, {"remw", {0x01, 0x6, 0x3b}},
+    {"remuw", {0x01, 0x7, 0x3b}},
+};
+
+// 立即数运算：funct3, opcode；移位指令的高位 funct6 另外给出
+struct IOp {
+  uint32_t funct3, opcode, shift_funct = 0;
+  int shamt_bits = 0;  // 非 0 表示移位指令
+};
+
+const std::unordered_map<std::string_view, IOp> I_OPS = {
+    {"addi", {0x0, 0x13}},         {"slti", {0x2, 0x13}},         {"sltiu", {0x3, 0x13}},
+    {"xori", {0x4, 0x13}},         {"ori", {0x6, 0x13}},          {"andi", {0x7, 0x13}},
+    {"addiw", {0x0, 0x1b}},        {"slli", {0x1, 0x13, 0x00, 6}}, {"srli", {0x5, 0x13, 0x00, 6}},
+    {"srai", {0x5, 0x13, 0x10, 6}}, {"slliw", {0x1, 0x1b, 0x00, 5}}, {"srliw", {0x5, 0x1b, 0x00, 5}},
+    {"sraiw", {0x5, 0x1b, 0x20, 5}},
+};
+
+const std::unordered_map<std::string_view, uint32_t> LOAD_OPS = {
+    {"lb", 0x0}, {"lh", 0x1}, {"lw", 0x2}, {"ld", 0x3}, {"lbu", 0x4}, {"lhu", 0x5}, {"lwu", 0x6},
+};
+
+const std::unordered_map<std::string_view, uint32_t> STORE_OPS = {
+    {"sb", 0x0}, {"sh", 0x1}, {"sw", 0x2}, {"sd", 0x3},
+};
+
+const std::unordered_map<std::string_view, uint32_t> BRANCH_OPS = {
+    {"beq", 0x0}, {"bne", 0x1}, {"blt", 0x4}, {"bge", 0x5}, {"bltu", 0x6}, {"bgeu", 0x7},
+};
+
+const std::unordered_map<std::string_view, uint32_t> CSR_OPS = {
+    {"csrrw", 0x1}, {"csrrs", 0x2}, {"csrrc", 0x3}, {"csrrwi", 0x5}, {"csrrsi", 0x6}, {"csrrci", 0x7},
+};
+
+// 没有操作数的指令
+const std::unordered_map<std::string_view, uint32_t> FIXED_OPS = {
+    {"ecall", 0x00000073},   {"ebreak", 0x00100073}, {"mret", 0x30200073}, {"sret", 0x10200073},
+    {"wfi", 0x10500073},     {"fence", 0x0ff0000f},  {"fence.i", 0x0000100f},
+    {"nop", 0x00000013},
+};
+
+class Assembler {
+ public:
+  std::vector<uint8_t> run(std::string_view source) {
+    parse(source);
+    // 第一遍确定每条语句的地址和标签，第二遍编码
+    uint64_t addr = 0;
+    for (Statement& s : statements) {
+      if (s.mnemonic.empty()) {
+        labels[s.operands[0]] = addr;
+        continue;
+      }
+      s.addr = addr;
+      addr += size_of(s);
+    }
+    for (const Statement& s : statements) {
+      if (!s.mnemonic.empty()) {
+        emit(s);
+      }
+    }
+    return std::move(code);
+  }
+
+ private:
+  void parse(std::string_view source) {
+    size_t line = 0;
+    while (!source.empty()) {
+      ++line;
+      size_t eol = source.find('\n');
+      std::string_view text = source.substr(0, eol);
+      source = eol == std::string_view::npos ? std::string_view() : source.substr(eol + 1);
+
+      // 去掉注释，再按分号拆分语句
+      if (size_t c = std::min(text.find('#'), text.find("//")); c != std::string_view::npos) {
+        text = text.substr(0, c);
+      }
+      while (!text.empty()) {
+        size_t semi = text.find(';');
+        parse_statement(line, trim(text.substr(0, semi)));
+        text = semi == std::string_view::npos ? std::string_view() : text.substr(semi + 1);
+      }
+    }
+  }
+
+  void parse_statement(size_t line, std::string_view text) {
+    // 行首可以有任意多个标签，标签用空助记符的语句表示
+    while (true) {
+      size_t colon = text.find(':');
+      size_t space = text.find_first_of(" \t");
+      if (colon == std::string_view::npos || (space != std::string_view::npos && space < colon)) {
+        break;
+      }
+      statements.push_back({line, "", {std::string(trim(text.substr(0, colon)))}});
+      text = trim(text.substr(colon + 1));
+    }
+    if (text.empty()) {
+      return;
+    }
+
+    Statement s;
+    s.line = line;
+    size_t space = text.find_first_of(" \t");
+    s.mnemonic = std::string(text.substr(0, space));
+    std::string_view rest = space == std::string_view::npos ? std::string_view() : trim(text.substr(space));
+    while (!rest.empty()) {
+      size_t comma = rest.find(',');
+      s.operands.emplace_back(trim(rest.substr(0, comma)));
+      rest = comma == std::string_view::npos ? std::string_view() : trim(rest.substr(comma + 1));
+    }
+    // 不影响代码的伪操作（.global、.text 等）
+    if (s.mnemonic[0] == '.' && s.mnemonic != ".word" && s.mnemonic != ".dword" && s.mnemonic != ".zero" &&
+        s.mnemonic != ".align") {
+      return;
+    }
+    statements.push_back(std::move(s));
+  }
+
+  uint64_t size_of(const Statement& s) {
+    const std::string& m = s.mnemonic;
+    if (m == ".word") {
+      return 4 * s.operands.size();
+    }
+    if (m == ".dword") {
+      return 8 * s.operands.size();
+    }
+    if (m == ".zero") {
+      int64_t n = imm(s, 0);
+      if (n < 0) {
+        fail(s.line, "invalid size: " + operand(s, 0));
+      }
+      return n;
+    }
+    if (m == ".align") {
+      // 与 RISC-V 的 GNU as 一样，参数是 2 的幂次；s.addr 在计算大小之前已经确定
+      uint64_t align = uint64_t{1} << imm(s, 0);
+      return (align - s.addr % align) % align;
+    }
+    if (m == "li") {
+      std::vector<uint32_t> insts;
+      expand_li(insts, reg(s, 0), imm(s, 1));
+      return insts.size() * 4;
+    }
+    if (m == "la") {
+      return 8;
+    }
+    return 4;
+  }
+
+  const std::string& operand(const Statement& s, size_t i) {
+    if (i >= s.operands.size()) {
+      fail(s.line, "missing operand for " + s.mnemonic);
+    }
+    return s.operands[i];
+  }
+
+  void expect_operands(const Statement& s, size_t n) {
+    if (s.operands.size() != n) {
+      fail(s.line, s.mnemonic + " expects " + std::to_string(n) + " operands");
+    }
+  }
+
+  uint32_t reg(const Statement& s, size_t i) {
+    auto r = parse_reg(operand(s, i));
+    if (!r) {
+      fail(s.line, "invalid register: " + operand(s, i));
+    }
+    return *r;
+  }
+
+  int64_t imm(const Statement& s, size_t i) {
+    auto v = parse_int(operand(s, i));
+    if (!v) {
+      fail(s.line, "invalid immediate: " + operand(s, i));
+    }
+    return *v;
+  }
+
+  int64_t imm_bits(const Statement& s, size_t i, int bits) {
+    int64_t v = imm(s, i);
+    if (!fits_signed(v, bits)) {
+      fail(s.line, "immediate out of range: " + operand(s, i));
+    }
+    return v;
+  }
+
+  // 跳转目标：标签或相对程序开头的地址，返回相对当前指令的偏移
+  int64_t target(const Statement& s, size_t i, int bits) {
+    const std::string& t = operand(s, i);
+    int64_t addr;
+    if (auto it = labels.find(t); it != labels.end()) {
+      addr = static_cast<int64_t>(it->second);
+    } else if (auto v = parse_int(t)) {
+      addr = *v;
+    } else {
+      fail(s.line, "undefined label: " + t);
+    }
+    int64_t offset = addr - static_cast<int64_t>(s.addr);
+    if (!fits_signed(offset, bits) || offset % 2 != 0) {
+      fail(s.line, "branch target out of range: " + t);
+    }
+    return offset;
+  }
+
+  // off(reg) 形式的访存操作数
+  std::pair<int64_t, uint32_t> mem(const Statement& s, size_t i) {
+    const std::string& text = operand(s, i);
+    size_t open = text.find('(');
+    size_t close = text.find(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+      fail(s.line, "invalid memory operand: " + text);
+    }
+    std::string_view off = trim(std::string_view(text).substr(0, open));
+    auto base = parse_reg(std::string_view(text).substr(open + 1, close - open - 1));
+    auto v = off.empty() ? std::optional<int64_t>(0) : parse_int(off);
+    if (!base || !v || !fits_signed(*v, 12)) {
+      fail(s.line, "invalid memory operand: " + text);
+    }
+    return {*v, *base};
+  }
+
+  uint32_t csr(const Statement& s, size_t i) {
+    auto c = parse_csr(operand(s, i));
+    if (!c) {
+      fail(s.line, "invalid CSR: " + operand(s, i));
+    }
+    return *c;
+  }
+
+  void put32(uint32_t inst) {
+    for (int i = 0; i < 4; ++i) {
+      code.push_back(static_cast<uint8_t>(inst >> (i * 8)));
+    }
+  }
+
+  void emit(const Statement& s) {
+    const std::string& m = s.mnemonic;
+    if (auto it = R_OPS.find(m); it != R_OPS.end()) {
+      expect_operands(s, 3);
+      put32(rtype(it->second.funct7, reg(s, 2), reg(s, 1), it->second.funct3, reg(s, 0), it->second.opcode));
+    } else if (auto it = I_OPS.find(m); it != I_OPS.end()) {
+      expect_operands(s, 3);
+      const IOp& op = it->second;
+      if (op.shamt_bits != 0) {
+        int64_t shamt = imm(s, 2);
+        if (shamt < 0 || shamt >= (1 << op.shamt_bits)) {
+          fail(s.line, "shift amount out of range: " + operand(s, 2));
+        }
+        int64_t field = op.shamt_bits == 6 ? (op.shift_funct << 6) | shamt : (op.shift_funct << 5) | shamt;
+        put32(itype(field, reg(s, 1), op.funct3, reg(s, 0), op.opcode));
+      } else {
+        put32(itype(imm_bits(s, 2, 12), reg(s, 1), op.funct3, reg(s, 0), op.opcode));
+      }
+    } else if (auto it = LOAD_OPS.find(m); it != LOAD_OPS.end()) {
+      expect_operands(s, 2);
+      auto [off, base] = mem(s, 1);
+      put32(itype(off, base, it->second, reg(s, 0), 0x03));
+    } else if (auto it = STORE_OPS.find(m); it != STORE_OPS.end()) {
+      expect_operands(s, 2);
+      auto [off, base] = mem(s, 1);
+      put32(stype(off, reg(s, 0), base, it->second));
+    } else if (auto it = BRANCH_OPS.find(m); it != BRANCH_OPS.end()) {
+      expect_operands(s, 3);
+      put32(btype(target(s, 2, 13), reg(s, 1), reg(s, 0), it->second));
+    } else if (auto it = CSR_OPS.find(m); it != CSR_OPS.end()) {
+      expect_operands(s, 3);
+      uint32_t src = it->second >= 0x5 ? static_cast<uint32_t>(imm(s, 2)) & 0x1f : reg(s, 2);
+      put32(itype(csr(s, 1), src, it->second, reg(s, 0), 0x73));
+    } else if (auto it = FIXED_OPS.find(m); it != FIXED_OPS.end()) {
+      put32(it->second);
+    } else {
+      emit_other(s);
+    }
+  }
+
+  void emit_other(const Statement& s) {
+    const std::string& m = s.mnemonic;
+    if (m == "lui" || m == "auipc") {
+      expect_operands(s, 2);
+      int64_t v = imm(s, 1);
+      if (v < -(1 << 19) || v >= (1 << 20)) {
+        fail(s.line, "immediate out of range: " + operand(s, 1));
+      }
+      put32(utype(v, reg(s, 0), m == "lui" ? 0x37 : 0x17));
+    } else if (m == "jal") {
+      if (s.operands.size() == 1) {
+        put32(jtype(target(s, 0, 21), 1));
+      } else {
+        expect_operands(s, 2);
+        put32(jtype(target(s, 1, 21), reg(s, 0)));
+      }
+    } else if (m == "jalr") {
+      // jalr rs1 / jalr rd, off(rs1) / jalr rd, rs1, off
+      if (s.operands.size() == 1) {
+        put32(itype(0, reg(s, 0), 0x0, 1, 0x67));
+      } else if (s.operands.size() == 2) {
+        auto [off, base] = mem(s, 1);
+        put32(itype(off, base, 0x0, reg(s, 0), 0x67));
+      } else {
+        expect_operands(s, 3);
+        put32(itype(imm_bits(s, 2, 12), reg(s, 1), 0x0, reg(s, 0), 0x67));
+      }
+    } else if (m == "sfence.vma") {
+      uint32_t rs1 = s.operands.size() > 0 ? reg(s, 0) : 0;
+      uint32_t rs2 = s.operands.size() > 1 ? reg(s, 1) : 0;
+      put32(rtype(0x09, rs2, rs1, 0x0, 0, 0x73));
+    } else if (m == "li") {
+      expect_operands(s, 2);
+      std::vector<uint32_t> insts;
+      expand_li(insts, reg(s, 0), imm(s, 1));
+      for (uint32_t inst : insts) {
+        put32(inst);
+      }
+    } else if (m == "la") {
+      // auipc + addi，只支持 ±2 GiB 内的标签
+      expect_operands(s, 2);
+      auto it = labels.find(operand(s, 1));
+      if (it == labels.end()) {
+        fail(s.line, "undefined label: " + operand(s, 1));
+      }
+      int64_t offset = static_cast<int64_t>(it->second) - static_cast<int64_t>(s.addr);
+      uint32_t rd = reg(s, 0);
+      put32(utype((offset + 0x800) >> 12, rd, 0x17));
+      put32(itype(sign_extend(offset, 12), rd, 0x0, rd, 0x13));
+    } else if (m == "mv") {
+      expect_operands(s, 2);
+      put32(itype(0, reg(s, 1), 0x0, reg(s, 0), 0x13));
+    } else if (m == "not") {
+      expect_operands(s, 2);
+      put32(itype(-1, reg(s, 1), 0x4, reg(s, 0), 0x13));
+    } else if (m == "neg" || m == "negw") {
+      expect_operands(s, 2);
+      put32(rtype(0x20, reg(s, 1), 0, 0x0, reg(s, 0), m == "neg" ? 0x33 : 0x3b));
+    } else if (m == "sext.w") {
+      expect_operands(s, 2);
+      put32(itype(0, reg(s, 1), 0x0, reg(s, 0), 0x1b));
+    } else if (m == "seqz") {
+      expect_operands(s, 2);
+      put32(itype(1, reg(s, 1), 0x3, reg(s, 0), 0x13));
+    } else if (m == "snez") {
+      expect_operands(s, 2);
+      put32(rtype(0x00, reg(s, 1), 0, 0x3, reg(s, 0), 0x33));
+    } else if (m == "j") {
+      expect_operands(s, 1);
+      put32(jtype(target(s, 0, 21), 0));
+    } else if (m == "call") {
+      expect_operands(s, 1);
+      put32(jtype(target(s, 0, 21), 1));
+    } else if (m == "jr") {
+      expect_operands(s, 1);
+      put32(itype(0, reg(s, 0), 0x0, 0, 0x67));
+    } else if (m == "ret") {
+      put32(itype(0, 1, 0x0, 0, 0x67));
+    } else if (m == "beqz" || m == "bnez" || m == "bltz" || m == "bgez") {
+      expect_operands(s, 2);
+      uint32_t funct3 = m == "beqz" ? 0x0 : m == "bnez" ? 0x1 : m == "bltz" ? 0x4 : 0x5;
+      put32(btype(target(s, 1, 13), 0, reg(s, 0), funct3));
+    } else if (m == "blez" || m == "bgtz") {
+      // blez rs, L = bge zero, rs, L；bgtz rs, L = blt zero, rs, L
+      expect_operands(s, 2);
+      put32(btype(target(s, 1, 13), reg(s, 0), 0, m == "blez" ? 0x5 : 0x4));
+    } else if (m == "bgt" || m == "ble" || m == "bgtu" || m == "bleu") {
+      // 交换操作数
+      expect_operands(s, 3);
+      uint32_t funct3 = m == "bgt" ? 0x4 : m == "ble" ? 0x5 : m == "bgtu" ? 0x6 : 0x7;
+      put32(btype(target(s, 2, 13), reg(s, 0), reg(s, 1), funct3));
+    } else if (m == "csrr") {
+      expect_operands(s, 2);
+      put32(itype(csr(s, 1), 0, 0x2, reg(s, 0), 0x73));
+    } else if (m == "csrw" || m == "csrs" || m == "csrc") {
+      expect_operands(s, 2);
+      uint32_t funct3 = m == "csrw" ? 0x1 : m == "csrs" ? 0x2 : 0x3;
+      put32(itype(csr(s, 0), reg(s, 1), funct3, 0, 0x73));
+    } else if (m == "csrwi" || m == "csrsi" || m == "csrci") {
+      expect_operands(s, 2);
+      uint32_t funct3 = m == "csrwi" ? 0x5 : m == "csrsi" ? 0x6 : 0x7;
+      put32(itype(csr(s, 0), static_cast<uint32_t>(imm(s, 1)) & 0x1f, funct3, 0, 0x73));
+    } else if (m == ".word") {
+      for (size_t i = 0; i < s.operands.size(); ++i) {
+        put32(static_cast<uint32_t>(imm(s, i)));
+      }
+    } else if (m == ".dword") {
+      for (size_t i = 0; i < s.operands.size(); ++i) {
+        uint64_t v = static_cast<uint64_t>(imm(s, i));
+        put32(static_cast<uint32_t>(v));
+        put32(static_cast<uint32_t>(v >> 32));
+      }
+    } else if (m == ".zero" || m == ".align") {
+      code.resize(code.size() + size_of(s), 0);
+    } else {
+      fail(s.line, "unknown instruction: " + m);
+    }
+  }
+
+  std::vector<Statement> statements;
+  std::unordered_map<std::string, uint64_t> labels;
+  std::vector<uint8_t> code;
+};
+
+}  // namespace
+
+std::vector<uint8_t> assemble(std::string_view source) {
+  return Assembler().run(source);
+}
+
+}
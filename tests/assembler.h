@@ -0,0 +1,23 @@
+//
+// Created by Jie Wei on 2024/5/20.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace cemu {
+
+// 测试用的 RV64 汇编器：在进程内把汇编源码翻译成机器码，不依赖交叉编译工具链。
+//
+// 支持 RV64I、M、Zicsr、Zifencei 和特权指令，寄存器可以用 x0-x31 或 ABI 名字，CSR 可以用名字或编号，
+// 以及标签、常用伪指令（li、la、mv、j、ret、beqz 等）和 .word / .dword / .zero / .align 伪操作。
+// 注释以 # 或 // 开始，分号和换行都可以分隔语句，其余以 . 开头的伪操作被忽略。
+//
+// 代码的链接地址为 0（与 -Ttext=0x0 相同），所以跳转和分支的数字目标是相对程序开头的地址。
+// 语法错误时抛出 std::runtime_error，消息中带有行号
+std::vector<uint8_t> assemble(std::string_view source);
+
+}
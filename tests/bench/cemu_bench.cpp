@@ -0,0 +1,290 @@
+// cemu_bench.cpp：执行引擎的微基准（单条指令、DRAM、总线、CSR、陷入）和宏基准（客户机内核的 MIPS）
+//
+// 用法：./cemu_bench [--benchmark_filter=<regex>] [--benchmark_out=<file> --benchmark_out_format=json]
+// 设置环境变量 CEMU_BENCH_ELF=<elf> 时，额外测量这个客户机程序（如交叉编译的 Dhrystone、CoreMark）的 MIPS
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "../../src/cup.h"
+#include "../../src/emulator.h"
+#include "../../src/instructions.h"
+
+namespace {
+
+using cemu::Cpu;
+using cemu::DRAM_BASE;
+
+// 指令编码，与单元测试中的写法一致
+uint32_t rtype(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t itype(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+  return (static_cast<uint32_t>(imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t stype(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  uint32_t u = static_cast<uint32_t>(imm);
+  return (((u >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1f) << 7) | 0x23;
+}
+
+uint32_t btype(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+  uint32_t u = static_cast<uint32_t>(imm);
+  return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         (((u >> 1) & 0xf) << 8) | (((u >> 11) & 1) << 7) | 0x63;
+}
+
+uint32_t addi(uint32_t rd, uint32_t rs1, int32_t imm) {
+  return itype(imm, rs1, 0x0, rd, 0x13);
+}
+
+std::vector<uint8_t> assemble(const std::vector<uint32_t>& insts) {
+  std::vector<uint8_t> code(insts.size() * 4);
+  std::memcpy(code.data(), insts.data(), code.size());
+  return code;
+}
+
+constexpr uint64_t DATA = DRAM_BASE + 0x10000;
+
+// ---------------------------------------------------------------- 微基准
+
+// 每类指令一条代表：经过解码和执行的完整路径
+void BM_Execute(benchmark::State& state, uint32_t inst) {
+  Cpu cpu(std::vector<uint8_t>{});
+  cpu.regs[10] = DATA;
+  cpu.regs[11] = 3;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cemu::InstructionExecutor::execute(cpu, inst));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_Execute, addi, addi(5, 5, 1));
+BENCHMARK_CAPTURE(BM_Execute, add, rtype(0x00, 11, 5, 0x0, 5, 0x33));
+BENCHMARK_CAPTURE(BM_Execute, srai, itype(0x400 | 3, 5, 0x5, 6, 0x13));
+BENCHMARK_CAPTURE(BM_Execute, lui, 0x12345000u | (5 << 7) | 0x37);
+BENCHMARK_CAPTURE(BM_Execute, ld, itype(0, 10, 0x3, 6, 0x03));
+BENCHMARK_CAPTURE(BM_Execute, sd, stype(0, 11, 10, 0x3));
+BENCHMARK_CAPTURE(BM_Execute, beq, btype(-8, 0, 0, 0x0));
+BENCHMARK_CAPTURE(BM_Execute, csrrs, itype(static_cast<int32_t>(cemu::MSCRATCH), 0, 0x2, 6, 0x73));
+
+// 参数为访问宽度（位）
+void BM_DramLoad(benchmark::State& state) {
+  cemu::Dram dram;
+  uint64_t size = state.range(0);
+  uint64_t addr = DATA;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dram.load(addr, size));
+    addr = DATA + ((addr + 8) & 0xfff);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DramLoad)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+
+void BM_DramStore(benchmark::State& state) {
+  cemu::Dram dram;
+  uint64_t size = state.range(0);
+  uint64_t addr = DATA;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dram.store(addr, size, addr));
+    addr = DATA + ((addr + 8) & 0xfff);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DramStore)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+
+// 总线按地址分派到各个设备
+void BM_BusLoad(benchmark::State& state, uint64_t addr, uint64_t size) {
+  cemu::Bus bus(std::vector<uint8_t>{});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bus.load(addr, size));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_BusLoad, dram, DATA, 64);
+BENCHMARK_CAPTURE(BM_BusLoad, clint, cemu::CLINT_MTIME, 64);
+BENCHMARK_CAPTURE(BM_BusLoad, plic, cemu::PLIC_PENDING, 32);
+
+void BM_CsrLoad(benchmark::State& state, uint64_t addr) {
+  cemu::Csr csr;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(csr.load(addr));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_CsrLoad, mscratch, cemu::MSCRATCH);
+BENCHMARK_CAPTURE(BM_CsrLoad, sstatus, cemu::SSTATUS);
+BENCHMARK_CAPTURE(BM_CsrLoad, minstret, cemu::MINSTRET);
+
+void BM_CsrStore(benchmark::State& state, uint64_t addr) {
+  cemu::Csr csr;
+  uint64_t value = 0;
+  for (auto _ : state) {
+    csr.store(addr, ++value);
+  }
+  benchmark::DoNotOptimize(csr.load(addr));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_CsrStore, mscratch, cemu::MSCRATCH);
+BENCHMARK_CAPTURE(BM_CsrStore, sstatus, cemu::SSTATUS);
+
+// CSR 指令的路径：权限检查、查表、读旧值并按 WARL 掩码写入
+void BM_CsrAccess(benchmark::State& state, uint64_t addr) {
+  cemu::Csr csr;
+  auto inst = static_cast<uint32_t>(addr << 20 | 0x1073);
+  uint64_t value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(csr.access(inst, cemu::Machine, cemu::Csr::Op::Write, ++value, true));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_CsrAccess, mscratch, cemu::MSCRATCH);
+BENCHMARK_CAPTURE(BM_CsrAccess, mstatus, cemu::MSTATUS);
+BENCHMARK_CAPTURE(BM_CsrAccess, minstret, cemu::MINSTRET);
+
+// 一次完整的陷入：保存现场、切换特权级、更新统计
+void BM_TrapDelivery(benchmark::State& state) {
+  Cpu cpu(std::vector<uint8_t>{});
+  cpu.csr.store(cemu::MTVEC, DATA);
+  cemu::Exception e(cemu::ExceptionType::Breakpoint, DRAM_BASE);
+  for (auto _ : state) {
+    cpu.pc = DRAM_BASE;
+    cpu.handle_exception(e);
+  }
+  benchmark::DoNotOptimize(cpu.pc);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TrapDelivery);
+
+// ---------------------------------------------------------------- 宏基准
+
+// 整数运算：Dhrystone 式的算术和逻辑运算混合，外层循环不结束
+std::vector<uint32_t> integer_kernel() {
+  return {
+      addi(5, 0, 100),                      // outer: li t0, 100
+      rtype(0x00, 6, 7, 0x0, 7, 0x33),      // loop: add t2, t2, t1
+      rtype(0x00, 7, 6, 0x4, 6, 0x33),      // xor t1, t1, t2
+      itype(3, 7, 0x1, 28, 0x13),           // slli t3, t2, 3
+      itype(5, 28, 0x5, 28, 0x13),          // srli t3, t3, 5
+      rtype(0x00, 28, 6, 0x7, 29, 0x33),    // and t4, t1, t3
+      rtype(0x00, 29, 7, 0x6, 7, 0x33),     // or t2, t2, t4
+      rtype(0x00, 28, 6, 0x0, 6, 0x3b),     // addw t1, t1, t3
+      addi(5, 5, -1),                       // addi t0, t0, -1
+      btype(-32, 0, 5, 0x1),                // bne t0, zero, loop
+      btype(-40, 0, 0, 0x0),                // beq zero, zero, outer
+  };
+}
+
+// 访存：对 512 个双字求和并写回，CoreMark 中链表和矩阵部分的访存模式
+std::vector<uint32_t> memory_kernel() {
+  return {
+      addi(10, 11, 0),                      // outer: mv a0, a1
+      addi(5, 0, 512),                      // li t0, 512
+      itype(0, 10, 0x3, 6, 0x03),           // loop: ld t1, 0(a0)
+      rtype(0x00, 6, 7, 0x0, 7, 0x33),      // add t2, t2, t1
+      stype(0, 7, 10, 0x3),                 // sd t2, 0(a0)
+      addi(10, 10, 8),                      // addi a0, a0, 8
+      addi(5, 5, -1),                       // addi t0, t0, -1
+      btype(-20, 0, 5, 0x1),                // bne t0, zero, loop
+      btype(-32, 0, 0, 0x0),                // beq zero, zero, outer
+  };
+}
+
+// 按位计算 CRC32：CoreMark 的 crcu8 式内层循环，分支多、块短
+std::vector<uint32_t> crc_kernel() {
+  return {
+      addi(5, 0, 8),                        // outer: li t0, 8
+      itype(1, 6, 0x7, 28, 0x13),           // loop: andi t3, t1, 1
+      itype(1, 6, 0x5, 6, 0x13),            // srli t1, t1, 1
+      btype(8, 0, 28, 0x0),                 // beq t3, zero, skip
+      rtype(0x00, 12, 6, 0x4, 6, 0x33),     // xor t1, t1, a2
+      addi(5, 5, -1),                       // skip: addi t0, t0, -1
+      btype(-20, 0, 5, 0x1),                // bne t0, zero, loop
+      addi(6, 6, 0x5a),                     // addi t1, t1, 0x5a
+      btype(-32, 0, 0, 0x0),                // beq zero, zero, outer
+  };
+}
+
+constexpr uint64_t SLICE = 1 << 20;
+
+// 以 MIPS 报告吞吐量
+void report_mips(benchmark::State& state, uint64_t insts) {
+  state.SetItemsProcessed(static_cast<int64_t>(insts));
+  state.counters["MIPS"] = benchmark::Counter(static_cast<double>(insts) / 1e6, benchmark::Counter::kIsRate);
+}
+
+// 执行引擎：execute 逐条取指并经 InstructionExecutor::execute 解码执行（不用块缓存），
+// call 在块中逐条调用预解码的执行函数，threaded 是直接线索化解释器（见 threaded.h）
+enum class Engine { Execute, Call, Threaded };
+
+void BM_Kernel(benchmark::State& state, std::vector<uint32_t> (*kernel)(), Engine engine) {
+  Cpu cpu(assemble(kernel()));
+  cpu.regs[11] = DATA;
+  cpu.regs[12] = 0xedb88320;
+  cpu.threaded = engine == Engine::Threaded;
+  uint64_t insts = 0;
+  for (auto _ : state) {
+    if (engine != Engine::Execute) {
+      insts += cpu.run(SLICE);
+      continue;
+    }
+    for (uint64_t i = 0; i < SLICE; ++i) {
+      cpu.regs[0] = 0;
+      cpu.pc = cemu::InstructionExecutor::execute(cpu, cpu.fetch().value()).value();
+    }
+    insts += SLICE;
+  }
+  report_mips(state, insts);
+}
+BENCHMARK_CAPTURE(BM_Kernel, integer/execute, integer_kernel, Engine::Execute)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, integer/call, integer_kernel, Engine::Call)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, integer/threaded, integer_kernel, Engine::Threaded)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, memory/execute, memory_kernel, Engine::Execute)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, memory/call, memory_kernel, Engine::Call)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, memory/threaded, memory_kernel, Engine::Threaded)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, crc/execute, crc_kernel, Engine::Execute)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, crc/call, crc_kernel, Engine::Call)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Kernel, crc/threaded, crc_kernel, Engine::Threaded)->Unit(benchmark::kMillisecond);
+
+// 运行 CEMU_BENCH_ELF 指定的程序直到退出，每次迭代都从头开始
+void BM_Elf(benchmark::State& state, const char* path) {
+  uint64_t insts = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    cemu::EmulatorConfig config;
+    config.elf = path;
+    cemu::Emulator emu(config);
+    state.ResumeTiming();
+    while (true) {
+      cemu::RunResult r = emu.run_for(SLICE);
+      insts += r.insts;
+      if (r.reason != cemu::StopReason::InstructionLimit) {
+        break;
+      }
+    }
+  }
+  report_mips(state, insts);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // 执行引擎在每次访存时都会写 INFO 日志，基准中丢弃它们，报告仍然写到标准输出
+  std::ostream report(std::cout.rdbuf());
+  std::cout.rdbuf(nullptr);
+
+  if (const char* elf = std::getenv("CEMU_BENCH_ELF")) {
+    benchmark::RegisterBenchmark("BM_Elf", BM_Elf, elf)->Unit(benchmark::kMillisecond);
+  }
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::ConsoleReporter reporter;
+  reporter.SetOutputStream(&report);
+  reporter.SetErrorStream(&std::cerr);
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,56 @@
+// clone_bench.cpp：测量从一台已启动的机器每秒能克隆出多少台独立的机器
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "../../src/clone.h"
+
+namespace {
+
+// loop: addi x5, x5, 1; beq x0, x0, loop
+std::vector<uint8_t> loop_program() {
+  std::vector<uint32_t> insts = {(1 << 20) | (5 << 15) | (5 << 7) | 0x13, 0xfe000ee3};
+  std::vector<uint8_t> code(insts.size() * 4);
+  std::memcpy(code.data(), insts.data(), code.size());
+  return code;
+}
+
+template <typename F>
+double per_second(int n, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; ++i) {
+    f(i);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return n / elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+  // 模拟一台已经启动的机器：运行一段时间并写满 16 MiB 内存
+  cemu::Cpu booted(loop_program());
+  booted.run(1000);
+  for (uint64_t addr = cemu::DRAM_BASE + 0x100000; addr < cemu::DRAM_BASE + 0x1100000; addr += 4096) {
+    booted.bus.memory().host_ptr(addr, 8)[0] = 1;
+  }
+  cemu::MachineImage image(booted);
+
+  double clones = per_second(n, [&image](int i) {
+    cemu::Cpu child = image.clone();
+    child.regs[10] = i;  // 每台子机器使用不同的输入
+    child.run(100);
+  });
+  cemu::Cpu child = image.clone();
+  double resets = per_second(n, [&image, &child](int i) {
+    image.reset(child);
+    child.regs[10] = i;
+    child.run(100);
+  });
+
+  std::cout << "clone + run 100 insts: " << clones << " machines/s\n";
+  std::cout << "reset + run 100 insts: " << resets << " machines/s\n";
+  return 0;
+}
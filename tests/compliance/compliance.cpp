@@ -0,0 +1,74 @@
+// compliance.cpp：运行 riscv-tests 的 ISA 测试并输出通过矩阵，有测试失败时返回 1
+//
+// 用法：./cemu_compliance <riscv-tests/isa 构建目录> [--suites rv64ui,rv64mi,...] [--jobs N] [--max-insts N]
+//                          [--json <file>]
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include "../../src/cli.h"
+#include "../../src/compliance.h"
+
+int main(int argc, char* argv[]) {
+  const char* dir = nullptr;
+  std::vector<std::string> suites = cemu::DEFAULT_SUITES;
+  size_t jobs = std::thread::hardware_concurrency();
+  uint64_t max_insts = 10'000'000;
+  const char* json_file = nullptr;
+  bool valid = true;
+  for (int i = 1; i < argc && valid; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--suites" && i + 1 < argc) {
+      suites.clear();
+      std::istringstream is(argv[++i]);
+      for (std::string suite; std::getline(is, suite, ',');) {
+        suites.push_back(suite);
+      }
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], jobs);
+    } else if (arg == "--max-insts" && i + 1 < argc) {
+      valid = cemu::parse_number(argv[++i], max_insts);
+    } else if (arg == "--json" && i + 1 < argc) {
+      json_file = argv[++i];
+    } else {
+      dir = argv[i];
+    }
+  }
+  if (!valid || dir == nullptr) {
+    std::cerr << "Usage: " << argv[0]
+              << " <riscv-tests isa dir> [--suites rv64ui,rv64mi,...] [--jobs N] [--max-insts N] [--json <file>]\n";
+    return 2;
+  }
+
+  std::vector<cemu::ComplianceTest> tests;
+  try {
+    tests = cemu::find_compliance_tests(dir, suites);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    return 2;
+  }
+  if (tests.empty()) {
+    std::cerr << "No tests found in " << dir << "\n";
+    return 2;
+  }
+
+  // 执行引擎在每次访存时都会写 INFO 日志，运行期间丢弃标准输出上的内容
+  std::streambuf* stdout_buf = std::cout.rdbuf(nullptr);
+  auto results = cemu::run_compliance(tests, jobs, max_insts);
+  std::cout.rdbuf(stdout_buf);
+  std::cout.clear();
+
+  cemu::write_matrix(std::cout, tests, results);
+  if (json_file != nullptr) {
+    std::ofstream out(json_file);
+    cemu::write_json(out, results);
+  }
+  for (const auto& r : results) {
+    if (!cemu::compliance_passed(r)) {
+      return 1;
+    }
+  }
+  return 0;
+}
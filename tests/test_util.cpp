@@ -1,89 +1,126 @@
 #include "test_util.h"
+#include <algorithm>
+#include <cstring>
 #include "../src/log.h"
 
 namespace cemu {
-void generate_rv_assembly(const std::string& c_src) {
-  std::string command = "riscv64-unknown-elf-gcc -S" + c_src + " -o ";
-  int result = std::system(command.c_str());
 
-  if (result != 0) {
-    throw std::runtime_error("Failed to generate RV assembly. Command: " + command);
+Cpu rv_helper(const std::string& code, const std::string& testname, size_t n_clock) {
+  // 在进程内汇编，不经过磁盘和交叉编译工具链，测试之间可以并行
+  std::vector<uint8_t> binaryCode;
+  try {
+    binaryCode = assemble(code);
+  } catch (const std::runtime_error& e) {
+    ADD_FAILURE() << testname << ": " << e.what();
   }
-}
-
-void generate_rv_obj(const std::string& assembly) {
-  // 使用C++的字符串处理能力来获取不含扩展名的文件名
-  size_t dotPos = assembly.find_last_of(".");
-  std::string baseName = (dotPos == std::string::npos) ? assembly : assembly.substr(0, dotPos);
 
-  // 构建clang命令行字符串
-  std::string command = "riscv64-unknown-elf-gcc -Wl,-Ttext=0x0 -nostdlib -o " + baseName + " " + assembly;
-
-  // 执行命令
-  int result = std::system(command.c_str());
+  LOG(DEBUG, "========================================================");
 
-  // 检查命令执行结果
-  if (result != 0) {
-    std::cerr << "Failed to generate RV object from assembly: " << assembly << std::endl;
+  // 初始化CPU并执行指令，遇到致命异常时停止
+  Cpu cpu(binaryCode);
+  try {
+    cpu.run(n_clock);
+  } catch (const Exception&) {
+    LOG(DEBUG, "Stopped at 0x", std::hex, cpu.pc, std::dec, " after ", cpu.csr.instret, " instructions.");
   }
+  return cpu;
 }
 
-void generate_rv_binary(const std::string& obj) {
-  // 构建llvm-objcopy命令行字符串
-  std::string command = "riscv64-unknown-elf-objcopy -O binary " + obj + " " + obj + ".bin";
+uint32_t encode(std::string_view inst) {
+  std::vector<uint8_t> code = assemble(inst);
+  uint32_t word = 0;
+  std::memcpy(&word, code.data(), std::min<size_t>(code.size(), 4));
+  return word;
+}
 
-  // 执行命令
-  int result = std::system(command.c_str());
+std::vector<uint8_t> to_code(const std::vector<uint32_t>& insts) {
+  std::vector<uint8_t> code(insts.size() * 4);
+  std::memcpy(code.data(), insts.data(), code.size());
+  return code;
+}
 
-  // 检查命令执行结果
-  if (result != 0) {
-    std::cerr << "Failed to generate RV binary from object: " << obj << std::endl;
-  }
+std::vector<uint8_t> loop_program() {
+  return assemble(R"(
+loop:
+    addi x5, x5, 1
+    beq zero, zero, loop
+)");
 }
 
-Cpu rv_helper(const std::string& code, const std::string& testname, size_t n_clock) {
-  std::string filename = testname + ".s";
-  // 创建并写入汇编文件
-  std::ofstream file(filename);
-  if (!file.is_open()) {
-    LOG(ERROR, "Failed to create assembly file.");
-  }
-  file << code;
-  file.close();
+namespace {
+
+template <typename T>
+void put(std::vector<uint8_t>& out, uint64_t offset, const T& value) {
+  std::memcpy(out.data() + offset, &value, sizeof(T));
+}
 
-  // 生成目标文件和二进制文件
-  generate_rv_obj(filename.c_str());
-  generate_rv_binary(testname.c_str());
+}  // namespace
 
-  // 读取二进制文件内容
-  std::string binFilename = testname + ".bin";
-  std::ifstream file_bin(binFilename, std::ios::binary);
-  if (!file_bin.is_open()) {
-    LOG(ERROR, "Failed to open binary file.");
+std::vector<uint8_t> make_elf(uint64_t entry, const std::vector<TestSegment>& segments,
+                              const std::vector<TestSymbol>& symbols, uint16_t type) {
+  uint64_t size = 64 + segments.size() * 56;
+  for (const auto& seg : segments) {
+    size = std::max(size, seg.offset + seg.data.size());
   }
-  std::vector<uint8_t> binaryCode((std::istreambuf_iterator<char>(file_bin)), std::istreambuf_iterator<char>());
 
-  LOG(DEBUG, "========================================================");
+  // 0 号符号和字符串表的第一个字节为空
+  std::string strtab(1, '\0');
+  std::vector<uint8_t> symtab(24 * (symbols.size() + 1), 0);
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    uint64_t sym = 24 * (i + 1);
+    put<uint32_t>(symtab, sym, static_cast<uint32_t>(strtab.size()));
+    put<uint8_t>(symtab, sym + 4, symbols[i].info);
+    put<uint16_t>(symtab, sym + 6, 1);
+    put<uint64_t>(symtab, sym + 8, symbols[i].addr);
+    put<uint64_t>(symtab, sym + 16, symbols[i].size);
+    strtab += symbols[i].name;
+    strtab += '\0';
+  }
+  uint64_t symtab_off = (size + 7) & ~7ULL;
+  uint64_t strtab_off = symtab_off + symtab.size();
+  uint64_t shoff = (strtab_off + strtab.size() + 7) & ~7ULL;
+  std::vector<uint8_t> elf(symbols.empty() ? size : shoff + 3 * 64, 0);
 
-  // 初始化CPU并执行指令
-  Cpu cpu(binaryCode);
-  for (size_t i = 0; i < n_clock; ++i) {
-    auto inst = cpu.fetch();
-    if (inst.has_value()) {
-      auto new_pc = cpu.execute(inst.value());
-      if (new_pc.has_value()) {
-        cpu.pc = new_pc.value();
-        LOG(DEBUG, "Successfully executed instruction at clock cycle ", i + 1);
-      } else {
-        LOG(DEBUG, "Failed to execute instruction at clock cycle ", i + 1);
-        break;
-      }
-    } else {
-      LOG(DEBUG, "No more instructions to execute at clock cycle ", i + 1);
-      break;
-    }
-    LOG(DEBUG, "========================================================");
+  // 先放段的内容，文件头和程序头可以覆盖其中的一部分
+  for (const auto& seg : segments) {
+    std::memcpy(elf.data() + seg.offset, seg.data.data(), seg.data.size());
   }
-  return cpu;
+  std::memcpy(elf.data(), "\x7f" "ELF\x02\x01\x01", 7);
+  put<uint16_t>(elf, 0x10, type);
+  put<uint16_t>(elf, 0x12, 243);  // EM_RISCV
+  put<uint64_t>(elf, 0x18, entry);
+  put<uint64_t>(elf, 0x20, 64);   // e_phoff
+  put<uint16_t>(elf, 0x36, 56);   // e_phentsize
+  put<uint16_t>(elf, 0x38, static_cast<uint16_t>(segments.size()));
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const auto& seg = segments[i];
+    uint64_t ph = 64 + i * 56;
+    put<uint32_t>(elf, ph, 1);  // PT_LOAD
+    put<uint32_t>(elf, ph + 4, 7);
+    put<uint64_t>(elf, ph + 8, seg.offset);
+    put<uint64_t>(elf, ph + 16, seg.paddr);
+    put<uint64_t>(elf, ph + 24, seg.paddr);
+    put<uint64_t>(elf, ph + 32, seg.data.size());
+    put<uint64_t>(elf, ph + 40, seg.memsz);
+  }
+  if (symbols.empty()) {
+    return elf;
+  }
+
+  std::memcpy(elf.data() + symtab_off, symtab.data(), symtab.size());
+  std::memcpy(elf.data() + strtab_off, strtab.data(), strtab.size());
+  put<uint64_t>(elf, 0x28, shoff);
+  put<uint16_t>(elf, 0x3a, 64);   // e_shentsize
+  put<uint16_t>(elf, 0x3c, 3);
+  // 节 0 为空，节 1 是 .symtab（sh_link 指向节 2），节 2 是 .strtab
+  put<uint32_t>(elf, shoff + 64 + 4, 2);  // SHT_SYMTAB
+  put<uint64_t>(elf, shoff + 64 + 0x18, symtab_off);
+  put<uint64_t>(elf, shoff + 64 + 0x20, symtab.size());
+  put<uint32_t>(elf, shoff + 64 + 0x28, 2);
+  put<uint64_t>(elf, shoff + 64 + 0x38, 24);
+  put<uint32_t>(elf, shoff + 128 + 4, 3);  // SHT_STRTAB
+  put<uint64_t>(elf, shoff + 128 + 0x18, strtab_off);
+  put<uint64_t>(elf, shoff + 128 + 0x20, strtab.size());
+  return elf;
+}
 }
-}
\ No newline at end of file
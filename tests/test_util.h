@@ -2,16 +2,49 @@
 #define GENERATE_RV_H
 
 #include <gtest/gtest.h>
-#include <fstream>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "../src/cup.h"
+#include "assembler.h"
 namespace cemu {
 
-// 消除警告： warning: cannot find entry symbol _start; defaulting to 0000000000000000
+// 与交叉编译器的写法保持一致，内置汇编器会忽略 .global
 const std::string start = ".global _start \n _start:";
 
-void generate_rv_assembly(const std::string& c_src);
-void generate_rv_obj(const std::string& assembly);
-void generate_rv_binary(const std::string& obj);
+// 用内置汇编器汇编 code，从 DRAM_BASE 开始执行至多 n_clock 条指令，遇到致命异常时停止。
+// testname 只用于出错时的提示
 Cpu rv_helper(const std::string& code, const std::string& testname, size_t n_clock);
+
+// 单条指令的机器码，用于改写客户机代码、直接调用执行函数等需要指令字的地方
+uint32_t encode(std::string_view inst);
+
+// 把指令字按小端序拼成代码，只用于内置汇编器不支持的指令（如向量指令）
+std::vector<uint8_t> to_code(const std::vector<uint32_t>& insts);
+
+// 无限计数循环：loop: addi x5, x5, 1; beq x0, x0, loop
+std::vector<uint8_t> loop_program();
+
+// 测试 ELF 中的一个 PT_LOAD 段：data 位于文件偏移 offset 处，加载到 paddr，memsz 超出 data 的部分为 BSS
+struct TestSegment {
+  uint64_t paddr;
+  uint64_t offset;
+  std::vector<uint8_t> data;
+  uint64_t memsz;
+};
+
+// 测试 ELF 符号表中的一个符号，info 为 st_info，默认是 STB_GLOBAL | STT_FUNC
+struct TestSymbol {
+  std::string name;
+  uint64_t addr;
+  uint64_t size;
+  uint8_t info = 0x12;
+};
+
+// 构造 ELF64 RISC-V 小端文件：每个段一个程序头，文件头和程序头可以位于第一个段中；
+// symbols 非空时在段之后追加 .symtab 和 .strtab 节。type 为 e_type（2 = ET_EXEC，3 = ET_DYN）
+std::vector<uint8_t> make_elf(uint64_t entry, const std::vector<TestSegment>& segments,
+                              const std::vector<TestSymbol>& symbols = {}, uint16_t type = 2);
 }
 #endif  // GENERATE_RV_H
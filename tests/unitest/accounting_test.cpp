@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+// 0x00: mret 进入 U 模式；0x20: 用户代码；0x40: M 模式陷入处理程序
+std::vector<uint8_t> program() {
+  std::string source = "mret\n";
+  for (int i = 1; i < 0x50 / 4; ++i) {
+    source += i == 0x48 / 4 ? "mret\n" : "addi t1, t1, 1\n";
+  }
+  return assemble(source);
+}
+
+}  // namespace
+
+TEST(AccountingTest, ModesAndTrapHandlers) {
+  Cpu cpu(program());
+  cpu.csr.store(MEPC, DRAM_BASE + 0x20);
+  cpu.csr.store(MTVEC, DRAM_BASE + 0x40);
+
+  cpu.run(3);
+  EXPECT_EQ(cpu.mode, User);
+  cpu.handle_exception(Exception(ExceptionType::EnvironmentCallFromUMode, 0));
+  EXPECT_EQ(cpu.mode, Machine);
+  cpu.run(4);
+  EXPECT_EQ(cpu.mode, User);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 0x2c);
+
+  EXPECT_EQ(cpu.accounting.mode_stats(Machine, cpu.csr.instret).insts, 4);
+  EXPECT_EQ(cpu.accounting.mode_stats(User, cpu.csr.instret).insts, 3);
+  EXPECT_EQ(cpu.accounting.mode_stats(Supervisor, cpu.csr.instret).insts, 0);
+
+  const auto& traps = cpu.accounting.trap_stats();
+  auto cause = static_cast<uint64_t>(ExceptionType::EnvironmentCallFromUMode);
+  ASSERT_EQ(traps.count(cause), 1);
+  EXPECT_EQ(traps.at(cause).count, 1);
+  EXPECT_EQ(traps.at(cause).returns, 1);
+  EXPECT_EQ(traps.at(cause).handler_insts, 3);
+
+  std::ostringstream os;
+  cpu.accounting.report(os, cpu.csr.instret);
+  EXPECT_NE(os.str().find("avg handler 3.0 insts"), std::string::npos);
+}
+
+}  // namespace cemu
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <stdexcept>
+#include "../../src/cup.h"
+#include "../assembler.h"
+
+namespace cemu {
+
+namespace {
+
+std::vector<uint32_t> words(const std::vector<uint8_t>& code) {
+  std::vector<uint32_t> out(code.size() / 4);
+  std::memcpy(out.data(), code.data(), out.size() * 4);
+  return out;
+}
+
+}  // namespace
+
+// 编码与 riscv64-unknown-elf-as 的输出一致
+TEST(AssemblerTest, MatchesGnuEncoding) {
+  auto code = words(assemble(
+      "addi x5, x5, 1\n"
+      "sd t0, 0(a0)\n"
+      "csrrw ra, mstatus, sp\n"
+      "srai a3, a0, 2\n"
+      "jalr a0, -8(a1)\n"
+      "mret\n"
+      "li a0, 0x12345678\n"));
+  std::vector<uint32_t> expected = {0x00128293, 0x00553023, 0x300110f3, 0x40255693,
+                                    0xff858567, 0x30200073, 0x12345537, 0x6785051b};
+  EXPECT_EQ(code, expected);
+}
+
+TEST(AssemblerTest, LabelsAndBranches) {
+  auto code = words(assemble(
+      ".global _start\n"
+      "_start:\n"
+      "loop: addi x5, x5, 1   # 注释\n"
+      "  beq x0, x0, loop; j done\n"
+      "done: jal 0\n"));
+  ASSERT_EQ(code.size(), 4);
+  EXPECT_EQ(code[1], 0xfe000ee3);  // beq x0, x0, -4
+  EXPECT_EQ(code[2], 0x0040006f);  // j +4
+  EXPECT_EQ(code[3], 0xff5ff0ef);  // jal ra, -12
+}
+
+TEST(AssemblerTest, RunsInCpu) {
+  Cpu cpu(assemble(
+      "  li t0, 5\n"
+      "loop:\n"
+      "  addi a0, a0, 3\n"
+      "  addi t0, t0, -1\n"
+      "  bnez t0, loop\n"
+      "  csrrwi zero, mscratch, 7\n"));
+  cpu.run(17);
+  EXPECT_EQ(cpu.regs[10], 15);
+  EXPECT_EQ(cpu.csr.load(MSCRATCH), 7);
+}
+
+TEST(AssemblerTest, ReportsErrorsWithLine) {
+  try {
+    assemble("addi a0, a0, 1\nfrobnicate a0\n");
+    FAIL() << "expected an error";
+  } catch (const std::runtime_error& e) {
+    EXPECT_NE(std::string(e.what()).find("line 2"), std::string::npos);
+  }
+  EXPECT_THROW(assemble("addi a0, a0, 4096"), std::runtime_error);
+  EXPECT_THROW(assemble("beq a0, a1, nowhere"), std::runtime_error);
+  EXPECT_THROW(assemble("ld a0, a1"), std::runtime_error);
+}
+
+}  // namespace cemu
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "../../src/batch.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+class BatchTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    for (const auto& path : files) {
+      std::remove(path.c_str());
+    }
+  }
+
+  std::string write_program(const std::string& name, const std::vector<uint8_t>& code) {
+    std::string path = testing::TempDir() + name;
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(code.data()), code.size());
+    files.push_back(path);
+    return path;
+  }
+
+  std::vector<std::string> files;
+};
+
+}  // namespace
+
+TEST_F(BatchTest, RunsJobsInParallel) {
+  // 执行到全零的非法指令时停止，a0 为返回值
+  std::vector<BatchJob> jobs;
+  for (int i = 0; i < 8; ++i) {
+    auto code = assemble("li a0, " + std::to_string(i) + "\naddi a0, a0, 1");
+    jobs.push_back({write_program("batch_" + std::to_string(i) + ".bin", code)});
+  }
+  // 死循环程序在 max_insts 处停止
+  jobs.push_back({write_program("batch_loop.bin", loop_program()), 1000});
+  jobs.push_back({testing::TempDir() + "batch_missing.bin"});
+  // 原始二进制通过半主机调用 SYS_EXIT 以返回值 0 退出
+  jobs.push_back({write_program("batch_semihost.bin", assemble(R"(
+      li t0, 0x20026  # ADP_Stopped_ApplicationExit
+      addi sp, sp, -16
+      sd t0, 0(sp)
+      sd zero, 8(sp)
+      li a0, 0x18  # SYS_EXIT
+      mv a1, sp
+      slli zero, zero, 0x1f
+      ebreak
+      srai zero, zero, 7
+  )"))});
+
+  auto results = run_batch(jobs, 3);
+  ASSERT_EQ(results.size(), jobs.size());
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(results[i].path, jobs[i].path);
+    EXPECT_EQ(results[i].status, "exited");
+    EXPECT_EQ(results[i].a0, i + 1);
+    EXPECT_EQ(results[i].insts, 2);
+  }
+  EXPECT_EQ(results[8].status, "timeout");
+  EXPECT_EQ(results[8].insts, 1000);
+  EXPECT_EQ(results[9].status, "error");
+  EXPECT_EQ(results[10].status, "finished");
+  EXPECT_EQ(results[10].exit_code, 0);
+  EXPECT_EQ(std::count_if(results.begin(), results.end(), batch_succeeded), 1);
+
+  // 只有客户机请求退出且返回值为 0 才算成功
+  BatchResult finished;
+  finished.status = "finished";
+  finished.exit_code = 0;
+  EXPECT_TRUE(batch_succeeded(finished));
+  finished.exit_code = 1;
+  EXPECT_FALSE(batch_succeeded(finished));
+
+  std::ostringstream os;
+  write_json(os, results);
+  EXPECT_NE(os.str().find("\"status\": \"timeout\", \"message\": \"\", \"insts\": 1000"), std::string::npos);
+}
+
+TEST_F(BatchTest, LoadsManifest) {
+  std::string manifest = testing::TempDir() + "batch_manifest.txt";
+  files.push_back(manifest);
+  std::ofstream(manifest) << "# comment\na.bin\n\nb.bin 500\n";
+  auto jobs = load_manifest(manifest);
+  ASSERT_EQ(jobs.size(), 2);
+  EXPECT_EQ(jobs[0].path, "a.bin");
+  EXPECT_EQ(jobs[1].path, "b.bin");
+  EXPECT_EQ(jobs[1].max_insts, 500);
+}
+
+}  // namespace cemu
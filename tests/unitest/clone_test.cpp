@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "../../src/clone.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t DATA = DRAM_BASE + 0x10000;
+
+}  // namespace
+
+TEST(CloneTest, ChildrenAreIndependent) {
+  Cpu parent(loop_program());
+  parent.run(21);
+  parent.store(DATA, 64, 7);
+  MachineImage image(parent);
+
+  // 冻结之后对父机器的修改不影响镜像
+  parent.store(DATA, 64, 8);
+  parent.run(10);
+
+  Cpu a = image.clone();
+  Cpu b = image.clone();
+  EXPECT_EQ(a.regs[5], 11);
+  EXPECT_EQ(a.pc, DRAM_BASE + 4);
+  EXPECT_EQ(a.csr.load(MINSTRET), 21);
+  EXPECT_EQ(a.load(DATA, 64).value(), 7);
+
+  a.store(DATA, 64, 1);
+  a.run(10);
+  EXPECT_EQ(a.regs[5], 16);
+  EXPECT_EQ(b.load(DATA, 64).value(), 7);
+  EXPECT_EQ(b.regs[5], 11);
+  EXPECT_EQ(parent.load(DATA, 64).value(), 8);
+
+  // 子机器可以重置回镜像状态
+  image.reset(a);
+  EXPECT_EQ(a.load(DATA, 64).value(), 7);
+  EXPECT_EQ(a.regs[5], 11);
+  EXPECT_TRUE(a.bus.memory().dirty_pages().empty());
+}
+
+TEST(CloneTest, ConcurrentClones) {
+  Cpu parent(loop_program());
+  MachineImage image(parent);
+  std::vector<uint64_t> results(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < results.size(); ++t) {
+    threads.emplace_back([&image, &results, t] {
+      Cpu cpu = image.clone();
+      cpu.run(2 * (t + 1));
+      results[t] = cpu.regs[5];
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(results, (std::vector<uint64_t>{1, 2, 3, 4}));
+}
+
+}  // namespace cemu
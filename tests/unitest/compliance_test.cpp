@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "../../src/compliance.h"
+#include "../../src/param.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+// 构造与 riscv-tests 相同形式的 ELF：代码从 DRAM_BASE 开始，tohost 在 DRAM_BASE + 0x1000，符号表中有 tohost
+std::vector<uint8_t> make_test_elf(const std::vector<uint8_t>& code) {
+  // tohost 是 STT_OBJECT | STB_GLOBAL
+  return make_elf(DRAM_BASE, {{DRAM_BASE, 0x1000, code, 0x1008}}, {{"tohost", DRAM_BASE + 0x1000, 8, 0x11}});
+}
+
+// 向 tohost 写入 (code << 1) | 1 后停在原地
+std::vector<uint8_t> exit_program(uint64_t code) {
+  return assemble(
+      "auipc t1, 1\n"
+      "li t0, " + std::to_string((code << 1) | 1) + "\n"
+      "sd t0, 0(t1)\n"
+      "hang: beq zero, zero, hang\n");
+}
+
+class ComplianceTestFixture : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::filesystem::create_directories(dir);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(dir);
+  }
+
+  void write(const std::string& name, const std::vector<uint8_t>& data) {
+    std::ofstream(dir + "/" + name, std::ios::binary)
+        .write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  }
+
+  std::string dir = testing::TempDir() + "cemu_compliance_test";
+};
+
+}  // namespace
+
+TEST_F(ComplianceTestFixture, RunsSuitesAndReportsMatrix) {
+  write("rv64ui-p-pass", make_test_elf(exit_program(0)));
+  write("rv64ui-p-fail", make_test_elf(exit_program(3)));
+  write("rv64um-v-hang", make_test_elf(assemble("hang: beq zero, zero, hang\n")));
+  write("rv64ui-p-pass.dump", {'t', 'e', 'x', 't'});
+  write("rv64uf-p-other", make_test_elf(exit_program(0)));  // 不在所选的套件中
+  EXPECT_EQ(find_compliance_tests(dir).size(), 2);  // 默认只运行 rv64ui
+
+  auto tests = find_compliance_tests(dir, {"rv64ui", "rv64um"});
+  ASSERT_EQ(tests.size(), 3);
+  EXPECT_EQ(tests[0].name, "fail");
+  EXPECT_EQ(tests[1].name, "pass");
+  EXPECT_EQ(tests[2].suite, "rv64um");
+  EXPECT_EQ(tests[2].env, "v");
+
+  auto results = run_compliance(tests, 2, 1000);
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_FALSE(compliance_passed(results[0]));
+  EXPECT_EQ(results[0].exit_code, 3);
+  EXPECT_TRUE(compliance_passed(results[1]));
+  EXPECT_EQ(results[2].status, "timeout");
+
+  std::ostringstream os;
+  write_matrix(os, tests, results);
+  std::string matrix = os.str();
+  EXPECT_NE(matrix.find("FAIL rv64ui-p-fail: test 3 failed"), std::string::npos);
+  EXPECT_NE(matrix.find("FAIL rv64um-v-hang: no exit after 1000 instructions"), std::string::npos);
+  EXPECT_NE(matrix.find("rv64ui    1/2       -"), std::string::npos);
+  EXPECT_NE(matrix.find("rv64um    -         0/1"), std::string::npos);
+  EXPECT_NE(matrix.find("total     1/3"), std::string::npos);
+}
+
+TEST_F(ComplianceTestFixture, MissingDirectory) {
+  EXPECT_THROW(find_compliance_tests(dir + "/missing"), std::runtime_error);
+}
+
+}  // namespace cemu
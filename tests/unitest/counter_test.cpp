@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "../../src/cup.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t DATA = DRAM_BASE + 0x1000;
+
+// 10 次循环，每次一个 sd、一个 ld 和一个条件分支，最后读出计数器。mhpmevent3 统计跳转的分支
+std::vector<uint8_t> counter_program() {
+  return assemble("li s1, " + std::to_string(HPM_EVENT_TAKEN_BRANCH) + R"(
+    csrw 0x323, s1
+    li t0, 10
+loop:
+    sd t0, 0(a0)
+    ld t1, 0(a0)
+    addi t0, t0, -1
+    bnez t0, loop
+    csrr t2, minstret
+    csrr s0, cycle
+    csrr a1, 0xc03
+)");
+}
+
+}  // namespace
+
+TEST(CounterTest, InstretFromBlocks) {
+  Cpu cpu(counter_program());
+  cpu.regs[10] = DATA;
+  EXPECT_EQ(cpu.run(46), 46);
+  EXPECT_EQ(cpu.regs[7], 43);  // rdinstret 返回之前退休的指令数
+  EXPECT_EQ(cpu.regs[8], 44);
+  EXPECT_EQ(cpu.regs[11], 9);
+  EXPECT_EQ(cpu.csr.instret, 46);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_LOAD], 10);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_STORE], 10);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_TAKEN_BRANCH], 9);
+}
+
+TEST(CounterTest, RunStopsAtExactCount) {
+  Cpu cpu(counter_program());
+  cpu.regs[10] = DATA;
+  EXPECT_EQ(cpu.run(4), 4);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 4 * 4);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_STORE], 1);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_LOAD], 0);
+  EXPECT_EQ(cpu.run(42), 42);
+  EXPECT_EQ(cpu.regs[11], 9);
+}
+
+TEST(CounterTest, WritableAndInhibited) {
+  Csr csr;
+  csr.instret = 100;
+  csr.store(MINSTRET, 10);
+  csr.instret += 5;
+  EXPECT_EQ(csr.load(MINSTRET), 15);
+  EXPECT_EQ(csr.load(INSTRET), 15);
+
+  csr.store(MCOUNTINHIBIT, 0b100);
+  csr.instret += 5;
+  EXPECT_EQ(csr.load(MINSTRET), 15);
+  csr.store(MCOUNTINHIBIT, 0);
+  csr.instret += 1;
+  EXPECT_EQ(csr.load(MINSTRET), 16);
+}
+
+TEST(CounterTest, FatalTrapIsCounted) {
+  Cpu cpu(assemble("li t0, 1"));  // 之后是全零的非法指令
+  EXPECT_THROW(cpu.run(10), Exception);
+  EXPECT_EQ(cpu.csr.instret, 1);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_TRAP], 1);
+  EXPECT_EQ(cpu.csr.load(MEPC), DRAM_BASE + 4);
+}
+
+TEST(CounterTest, StoreToCodeInvalidatesBlocks) {
+  Cpu cpu(loop_program());
+  cpu.run(4);
+  EXPECT_EQ(cpu.regs[5], 2);
+  cpu.store(DRAM_BASE, 32, encode("addi x5, x5, 10"));
+  cpu.run(4);
+  EXPECT_EQ(cpu.regs[5], 22);
+}
+
+}  // namespace cemu
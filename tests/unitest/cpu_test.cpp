@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
+#include "../assembler.h"
 #include "../../src/cup.h"
+#include "../../src/profiler.h"
 
 namespace cemu {
 
@@ -32,4 +34,208 @@ TEST_F(CpuTest, InvalidStoreTest) {
   EXPECT_THROW(cpu.store(DRAM_BASE, 10, 0x01), Exception);
 }
 
-}  // namespace cemu
\ No newline at end of file
+TEST(CpuInterruptTest, TakenAfterCsrWriteEnablesIt) {
+  // M 模式的软件（ssip 未委托）中断在打开 mstatus.MIE 的指令之后立即响应
+  Cpu cpu(assemble(R"(
+    la t0, handler
+    csrw mtvec, t0
+    li t1, 2
+    csrw mie, t1
+    csrs mip, t1
+    csrsi mstatus, 8
+    addi s0, s0, 1
+    .word 0
+handler:
+    csrr a0, mcause
+    csrr a1, mepc
+    csrc mip, t1
+    addi s1, s1, 1
+    mret
+)"));
+  EXPECT_THROW(cpu.run(100), Exception);
+  EXPECT_EQ(cpu.regs[10], INTERRUPT_BIT | 1);
+  EXPECT_EQ(cpu.regs[11], DRAM_BASE + 28);  // addi s0 的地址
+  EXPECT_EQ(cpu.regs[8], 1);
+  EXPECT_EQ(cpu.regs[9], 1);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_TRAP], 2);  // 中断和最后的非法指令
+}
+
+TEST(CpuInterruptTest, DeviceLineWithVectoredTvec) {
+  Cpu cpu({});
+  cpu.csr.store(MTVEC, (DRAM_BASE + 0x100) | 1);
+  cpu.csr.store(MIE, MASK_MTIP);
+  cpu.csr.set_interrupt_line(MASK_MTIP, true);
+  // M 模式下 mstatus.MIE 为 0 时不响应
+  EXPECT_FALSE(cpu.take_interrupt());
+  cpu.csr.store(MSTATUS, MASK_MIE);
+  ASSERT_TRUE(cpu.take_interrupt());
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 0x100 + 4 * 7);
+  EXPECT_EQ(cpu.csr.load(MCAUSE), INTERRUPT_BIT | 7);
+  EXPECT_EQ(cpu.csr.load(MEPC), DRAM_BASE);
+  EXPECT_EQ(cpu.csr.load(MSTATUS) & (MASK_MIE | MASK_MPIE), MASK_MPIE);
+  // 处理程序中 MIE 被清零，线仍然挂起也不会再次响应
+  EXPECT_FALSE(cpu.take_interrupt());
+}
+
+TEST(CpuInterruptTest, DelegatedToSupervisor) {
+  Cpu cpu({});
+  cpu.mode = User;
+  cpu.csr.store(STVEC, DRAM_BASE + 0x200);
+  cpu.csr.store(MIDELEG, MASK_STIP);
+  cpu.csr.store(MIE, MASK_STIP | MASK_MEIP);
+  cpu.csr.set_interrupt_line(MASK_STIP | MASK_MEIP, true);
+  // 交给 M 模式的外部中断优先
+  EXPECT_EQ(cpu.csr.pending_interrupt(User), 11);
+  cpu.csr.set_interrupt_line(MASK_MEIP, false);
+  ASSERT_TRUE(cpu.take_interrupt());
+  EXPECT_EQ(cpu.mode, Supervisor);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 0x200);
+  EXPECT_EQ(cpu.csr.load(SCAUSE), INTERRUPT_BIT | 5);
+  // S 模式下 sstatus.SIE 为 0，委托的中断不响应
+  EXPECT_FALSE(cpu.csr.interrupt_deliverable(Supervisor));
+}
+
+TEST(CpuThreadedTest, MatchesCallingExecuteFunctions) {
+  // 块中间的 ld 访问不存在的地址：出错时 pc 指向它，之前的指令已退休
+  const char* program = R"(
+    li s0, 1
+    slli s0, s0, 31
+    li s1, 10
+loop:
+    addi s1, s1, -1
+    lui t0, 0x80000
+    slti t1, t0, 0
+    sltiu t2, s1, -1
+    addw t3, t3, t0
+    sd t3, 256(s0)
+    ld t4, 256(s0)
+    sb s1, 264(s0)
+    lbu t5, 264(s0)
+    auipc t6, 0
+    bnez s1, loop
+    jal ra, tail
+    addi s2, s2, 1
+tail:
+    addi s3, s3, 1
+    ld t0, 0(zero)
+    addi s4, s4, 1
+)";
+  Cpu threaded(assemble(program));
+  Cpu call(assemble(program));
+  call.threaded = false;
+  EXPECT_THROW(threaded.run(1000), Exception);
+  EXPECT_THROW(call.run(1000), Exception);
+
+  EXPECT_EQ(threaded.regs, call.regs);
+  EXPECT_EQ(threaded.pc, call.pc);
+  EXPECT_EQ(threaded.csr.instret, call.csr.instret);
+  EXPECT_EQ(threaded.csr.events, call.csr.events);
+  EXPECT_EQ(threaded.regs[6], 1);     // t1：lui 的结果是负数
+  EXPECT_EQ(threaded.regs[7], 1);     // t2：与 -1 无符号比较
+  EXPECT_EQ(threaded.regs[19], 1);    // s3
+  EXPECT_EQ(threaded.regs[18], 0);    // s2 被跳过
+  EXPECT_EQ(threaded.regs[20], 0);    // s4 没有执行
+}
+
+TEST(CpuThreadedTest, FusedPairs) {
+  // 每种融合指令对至少出现一次，最后的 auipc + ld 在第二条指令处出错
+  const char* program = R"(
+    la s0, tail
+    lui s1, 0x12345
+    addi s1, s1, 0x678
+    slli t0, s1, 48
+    srli t0, t0, 48
+    auipc t1, 0
+    ld t2, 0(t1)
+    li s2, 3
+loop:
+    addi s2, s2, -1
+    slti t3, s2, 1
+    beqz t3, loop
+    auipc t4, 0
+    jalr ra, 12(t4)
+    addi s3, s3, 1
+tail:
+    addi s4, s4, 1
+    auipc t5, 0
+    ld t6, -2048(t5)
+)";
+  Cpu threaded(assemble(program));
+  Cpu call(assemble(program));
+  call.threaded = false;
+  EXPECT_THROW(threaded.run(1000), Exception);
+  EXPECT_THROW(call.run(1000), Exception);
+
+  EXPECT_EQ(threaded.regs, call.regs);
+  EXPECT_EQ(threaded.pc, call.pc);
+  EXPECT_EQ(threaded.csr.load(MEPC), DRAM_BASE + 68);  // 出错的 ld
+  EXPECT_EQ(threaded.csr.instret, call.csr.instret);
+  EXPECT_EQ(threaded.regs[8], DRAM_BASE + 60);  // s0
+  EXPECT_EQ(threaded.regs[9], 0x12345678);      // s1
+  EXPECT_EQ(threaded.regs[5], 0x5678);          // t0
+  EXPECT_EQ(threaded.regs[7], threaded.load(DRAM_BASE + 24, 64).value());
+  EXPECT_EQ(threaded.regs[30], DRAM_BASE + 64);  // t5 在出错前已写入
+  EXPECT_EQ(threaded.regs[19], 0);               // s3 被跳过
+
+  // 出错的块没有执行完，其中的 auipc + ld 不计入
+  Profiler profiler;
+  profiler.collect(threaded.blocks);
+  EXPECT_EQ(profiler.fusion_count(Fusion::LuiAddi), 1);
+  EXPECT_EQ(profiler.fusion_count(Fusion::AuipcAddi), 1);
+  EXPECT_EQ(profiler.fusion_count(Fusion::SlliSrli), 1);
+  EXPECT_EQ(profiler.fusion_count(Fusion::AuipcLd), 1);
+  EXPECT_EQ(profiler.fusion_count(Fusion::CompareBranch), 3);
+  EXPECT_EQ(profiler.fusion_count(Fusion::AuipcJalr), 1);
+}
+
+TEST(CpuThreadedTest, UnknownFunct7IsNotTranslated) {
+  // M 扩展与 add/addw 的 opcode 和 funct3 相同，只有 funct7 不同，不能被当作 add/addw 执行
+  for (const char* op : {"mul", "mulw"}) {
+    Cpu cpu(assemble(std::string("li t0, 3\n") + op + " a0, t0, t0\n"));
+    EXPECT_THROW(cpu.run(10), Exception);
+    EXPECT_EQ(cpu.csr.load(MCAUSE), static_cast<uint64_t>(ExceptionType::IllegalInstruction));
+    EXPECT_EQ(cpu.csr.load(MEPC), DRAM_BASE + 4);
+    EXPECT_EQ(cpu.regs[10], 0);
+  }
+}
+
+TEST(CpuSpecializeTest, WritesToX0AreDiscarded) {
+  // 执行前不再清零 x0：每种写 x0 的指令都由特化的执行函数处理，之后读 x0 仍为零。
+  // 有副作用的指令照常执行，最后的 ld 仍然出错
+  const char* program = R"(
+    li s0, 1
+    slli s0, s0, 31
+    li t0, 7
+    addi x0, t0, 5
+    lui x0, 0x12345
+    auipc x0, 1
+    add x0, t0, t0
+    addw x0, t0, t0
+    ld x0, 0(s0)
+    add a0, x0, t0
+    csrrw x0, mscratch, t0
+    add a1, x0, x0
+    jal x0, next
+    addi s1, s1, 1
+next:
+    mv a2, t0
+    li a3, -3
+    csrr a4, mscratch
+    ld x0, 0(zero)
+)";
+  for (bool threaded : {true, false}) {
+    Cpu cpu(assemble(program));
+    cpu.threaded = threaded;
+    EXPECT_THROW(cpu.run(100), Exception);
+    EXPECT_EQ(cpu.regs[0], 0);
+    EXPECT_EQ(cpu.regs[10], 7);  // a0
+    EXPECT_EQ(cpu.regs[11], 0);  // a1
+    EXPECT_EQ(cpu.regs[9], 0);   // s1 被跳过
+    EXPECT_EQ(cpu.regs[12], 7);  // a2
+    EXPECT_EQ(cpu.regs[13], static_cast<uint64_t>(-3));
+    EXPECT_EQ(cpu.regs[14], 7);  // a4
+    EXPECT_EQ(cpu.csr.load(MCAUSE), static_cast<uint64_t>(ExceptionType::LoadAccessFault));
+  }
+}
+
+}  // namespace cemu
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "../../src/csr.h"
+#include "../../src/exception.h"
 
 namespace cemu {
 
@@ -30,4 +31,83 @@ TEST_F(CsrTest, MidelegatedTest) {
     ASSERT_TRUE(csr.is_midelegated(0));
 }
 
-}
\ No newline at end of file
+namespace {
+
+// csrrw x0, addr, x0 的编码，只用于构造异常值
+uint32_t csr_inst(size_t addr) {
+    return static_cast<uint32_t>(addr << 20 | 0x1073);
+}
+
+}  // namespace
+
+TEST_F(CsrTest, AccessOnlyWritesWarlBits) {
+    // mepc 的最低位恒为 0，mstatus 的保留位不可写
+    ASSERT_EQ(csr.access(csr_inst(MEPC), Machine, Csr::Op::Write, 0x1003, true), 0);
+    ASSERT_EQ(csr.load(MEPC), 0x1002);
+    csr.access(csr_inst(MSTATUS), Machine, Csr::Op::Set, MASK_MIE | 0b100, true);
+    ASSERT_EQ(csr.load(MSTATUS), MASK_MIE);
+    // MPP 写入保留的 0b10 时保持原值
+    csr.access(csr_inst(MSTATUS), Machine, Csr::Op::Set, 0b10ULL << 11, true);
+    ASSERT_EQ(csr.load(MSTATUS), MASK_MIE);
+    // sie 只能写被委托的中断
+    csr.store(MIDELEG, MASK_STIP);
+    csr.access(csr_inst(SIE), Supervisor, Csr::Op::Write, MASK_STIP | MASK_SSIP, true);
+    ASSERT_EQ(csr.load(MIE), MASK_STIP);
+    // 只支持 Bare 模式的 satp
+    csr.access(csr_inst(SATP), Supervisor, Csr::Op::Write, 8ULL << 60, true);
+    ASSERT_EQ(csr.load(SATP), 0);
+    ASSERT_EQ(csr.access(csr_inst(MISA), Machine, Csr::Op::Set, 0, false), MISA_VALUE);
+}
+
+TEST_F(CsrTest, AccessTrapsOnIllegalCsr) {
+    auto expect_illegal = [this](size_t addr, Mode mode, bool write) {
+        try {
+            csr.access(csr_inst(addr), mode, Csr::Op::Write, 1, write);
+            FAIL() << "csr 0x" << std::hex << addr;
+        } catch (const Exception& e) {
+            EXPECT_EQ(e.getType(), ExceptionType::IllegalInstruction);
+            EXPECT_EQ(e.getValue(), csr_inst(addr));
+        }
+    };
+    expect_illegal(0x7c0, Machine, false);  // 未实现
+    expect_illegal(MSTATUS, Supervisor, false);  // 特权级不够
+    expect_illegal(SSCRATCH, User, false);
+    expect_illegal(MHARTID, Machine, true);  // 只读
+    expect_illegal(CYCLE, Machine, true);
+    // 只读访问只读 CSR 是合法的
+    EXPECT_EQ(csr.access(csr_inst(MHARTID), Machine, Csr::Op::Set, 0, false), 0);
+}
+
+TEST_F(CsrTest, CounterAccessNeedsCounteren) {
+    csr.instret = 42;
+    EXPECT_THROW(csr.access(csr_inst(INSTRET), Supervisor, Csr::Op::Set, 0, false), Exception);
+    csr.store(MCOUNTEREN, 0b100);
+    EXPECT_EQ(csr.access(csr_inst(INSTRET), Supervisor, Csr::Op::Set, 0, false), 42);
+    // U 模式还需要 scounteren
+    EXPECT_THROW(csr.access(csr_inst(INSTRET), User, Csr::Op::Set, 0, false), Exception);
+    csr.store(SCOUNTEREN, 0b100);
+    EXPECT_EQ(csr.access(csr_inst(INSTRET), User, Csr::Op::Set, 0, false), 42);
+    EXPECT_THROW(csr.access(csr_inst(CYCLE), User, Csr::Op::Set, 0, false), Exception);
+}
+
+TEST_F(CsrTest, InterruptCacheFollowsCsrWrites) {
+    csr.store(MIE, MASK_SSIP);
+    EXPECT_FALSE(csr.interrupt_deliverable(User));
+    csr.access(csr_inst(MIP), Machine, Csr::Op::Set, MASK_SSIP, true);
+    // 未委托：低于 M 模式时总是响应，M 模式需要 mstatus.MIE
+    EXPECT_TRUE(csr.interrupt_deliverable(User));
+    EXPECT_TRUE(csr.interrupt_deliverable(Supervisor));
+    EXPECT_FALSE(csr.interrupt_deliverable(Machine));
+    csr.access(csr_inst(MSTATUS), Machine, Csr::Op::Set, MASK_MIE, true);
+    EXPECT_TRUE(csr.interrupt_deliverable(Machine));
+    // 委托给 S 模式后 M 模式不再响应，S 模式需要 sstatus.SIE
+    csr.store(MIDELEG, MASK_SSIP);
+    EXPECT_FALSE(csr.interrupt_deliverable(Machine));
+    EXPECT_FALSE(csr.interrupt_deliverable(Supervisor));
+    csr.store(SSTATUS, MASK_SIE);
+    EXPECT_TRUE(csr.interrupt_deliverable(Supervisor));
+    csr.access(csr_inst(SIP), Supervisor, Csr::Op::Clear, MASK_SSIP, true);
+    EXPECT_FALSE(csr.interrupt_deliverable(User));
+}
+
+}
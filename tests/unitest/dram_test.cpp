@@ -34,4 +34,23 @@ TEST_F(DramTest, InvalidStoreTest) {
   EXPECT_THROW(dram.store(DRAM_BASE, 10, 0x01), Exception);
 }
 
+TEST_F(DramTest, ResetClearsUsedPages) {
+  uint64_t far = DRAM_BASE + 0x20000;
+  ASSERT_TRUE(dram.store(far, 64, 0x1234));
+  dram.host_ptr(DRAM_BASE + 0x30000, 8)[0] = 0x56;  // 通过宿主机指针写入，不标记脏页
+  dram.clear_dirty();  // 脏页记录被清除后，reset 仍然知道哪些页用过
+
+  dram.reset({0xaa});
+  EXPECT_EQ(dram.load(DRAM_BASE, 64).value(), 0xaa);
+  EXPECT_EQ(dram.load(far, 64).value(), 0);
+  EXPECT_EQ(dram.load(DRAM_BASE + 0x30000, 8).value(), 0);
+  EXPECT_EQ(dram.dirty_pages(), std::vector<uint32_t>{0});
+}
+
+TEST_F(DramTest, HostPtrRejectsWrappingLength) {
+  EXPECT_EQ(dram.host_ptr(DRAM_BASE + 8, UINT64_MAX - 4), nullptr);
+  EXPECT_EQ(dram.host_ptr(DRAM_BASE + DRAM_SIZE + 8, 8), nullptr);
+  EXPECT_NE(dram.host_ptr(DRAM_BASE + DRAM_SIZE - 8, 8), nullptr);
+}
+
 }  // namespace cemu
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "../../src/cup.h"
+#include "../../src/elf.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+std::vector<uint8_t> pattern(size_t n, uint8_t seed) {
+  std::vector<uint8_t> data(n);
+  for (size_t i = 0; i < n; ++i) {
+    data[i] = static_cast<uint8_t>(i * 13 + seed);
+  }
+  return data;
+}
+
+class ElfTest : public testing::Test {
+ protected:
+  void TearDown() override {
+    std::remove(path.c_str());
+  }
+
+  void write(const std::vector<uint8_t>& elf) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(elf.data()), static_cast<std::streamsize>(elf.size()));
+  }
+
+  std::string path = testing::TempDir() + "cemu_elf_test.elf";
+};
+
+}  // namespace
+
+TEST_F(ElfTest, LoadsSegmentsAtPhysicalAddresses) {
+  // 第一个段跨越整页（直接映射）和不足一页的尾部，第二个段在页内偏移不同（只能拷贝）并带有 BSS
+  auto text = pattern(0x1800, 1);
+  uint32_t inst = encode("addi t0, zero, 42");
+  std::memcpy(text.data() + 0x100, &inst, sizeof(inst));
+  auto data = pattern(0x30, 7);
+  write(make_elf(DRAM_BASE + 0x100, {
+      {DRAM_BASE, 0x1000, text, text.size()},
+      {DRAM_BASE + 0x4010, 0x2900, data, 0x3000},
+  }));
+  ASSERT_TRUE(is_elf(path));
+
+  Cpu cpu({});
+  cpu.bus.store(DRAM_BASE + 0x5000, 64, ~0ULL);  // 加载前的内容被丢弃
+  ElfImage image = load_elf(cpu, path);
+  EXPECT_EQ(image.entry, DRAM_BASE + 0x100);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 0x100);
+  ASSERT_EQ(image.segments.size(), 2);
+
+  EXPECT_EQ(std::memcmp(cpu.bus.dram_ptr(DRAM_BASE, text.size()), text.data(), text.size()), 0);
+  EXPECT_EQ(std::memcmp(cpu.bus.dram_ptr(DRAM_BASE + 0x4010, data.size()), data.data(), data.size()), 0);
+  EXPECT_EQ(cpu.bus.load(DRAM_BASE + 0x1800, 64).value(), 0);
+  EXPECT_EQ(cpu.bus.load(DRAM_BASE + 0x5000, 64).value(), 0);
+
+  cpu.run(1);
+  EXPECT_EQ(cpu.regs[5], 42);
+}
+
+TEST_F(ElfTest, MappedPagesAreCopyOnWrite) {
+  auto text = pattern(0x2000, 3);
+  write(make_elf(DRAM_BASE, {{DRAM_BASE, 0x1000, text, text.size()}}));
+
+  Cpu first({});
+  load_elf(first, path);
+  first.bus.store(DRAM_BASE + 8, 64, 0x1234);
+
+  // 写入只影响自己的副本，不会写回文件
+  Cpu second({});
+  load_elf(second, path);
+  EXPECT_EQ(std::memcmp(second.bus.dram_ptr(DRAM_BASE, text.size()), text.data(), text.size()), 0);
+  EXPECT_EQ(first.bus.load(DRAM_BASE + 8, 64).value(), 0x1234);
+  EXPECT_EQ(first.bus.memory().dirty_pages().size(), 2);
+}
+
+TEST_F(ElfTest, PositionIndependentIsRebased) {
+  // 第一个段从文件开头开始，包含程序头表
+  auto text = pattern(0x1000, 5);
+  write(make_elf(0x40, {{0, 0, text, text.size()}}, {}, 3));
+
+  Cpu cpu({});
+  ElfImage image = load_elf(cpu, path);
+  EXPECT_EQ(image.bias, DRAM_BASE);
+  EXPECT_EQ(image.entry, DRAM_BASE + 0x40);
+  EXPECT_EQ(image.phdr, DRAM_BASE + 64);
+  EXPECT_EQ(image.end, DRAM_BASE + 0x1000);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 0x40);
+}
+
+TEST_F(ElfTest, RejectsInvalidFiles) {
+  Cpu cpu({});
+  EXPECT_THROW(load_elf(cpu, path + ".missing"), std::runtime_error);
+
+  write(make_elf(0, {{0x1000, 0x1000, pattern(16, 0), 16}}));  // 段不在 DRAM 中
+  EXPECT_THROW(load_elf(cpu, path), std::runtime_error);
+
+  write(pattern(128, 0));
+  EXPECT_FALSE(is_elf(path));
+  EXPECT_THROW(load_elf(cpu, path), std::runtime_error);
+}
+
+}  // namespace cemu
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "../../src/emulator.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+EmulatorConfig loop_config() {
+  EmulatorConfig config;
+  config.image = assemble(R"(
+  loop:
+      addi t0, t0, 1
+      addi t1, t1, 2
+      j loop
+  )");
+  return config;
+}
+
+}  // namespace
+
+TEST(EmulatorTest, RunForStopsAtExactCount) {
+  Emulator emu(loop_config());
+  RunResult r = emu.run_for(7);
+  EXPECT_EQ(r.reason, StopReason::InstructionLimit);
+  EXPECT_EQ(r.insts, 7);
+  EXPECT_EQ(emu.reg(5), 3);
+  EXPECT_EQ(emu.reg(6), 4);
+  EXPECT_EQ(emu.pc(), DRAM_BASE + 4);
+
+  r = emu.step();
+  EXPECT_EQ(r.insts, 1);
+  EXPECT_EQ(emu.reg(6), 6);
+}
+
+TEST(EmulatorTest, RunUntilAndBreakpoints) {
+  Emulator emu(loop_config());
+  RunResult r = emu.run_until(DRAM_BASE + 8, 100);
+  EXPECT_EQ(r.reason, StopReason::Breakpoint);
+  EXPECT_EQ(r.insts, 2);
+  EXPECT_EQ(emu.pc(), DRAM_BASE + 8);
+
+  // 临时断点已经移除
+  r = emu.run_for(30);
+  EXPECT_EQ(r.reason, StopReason::InstructionLimit);
+  EXPECT_EQ(r.insts, 30);
+
+  emu.add_breakpoint(DRAM_BASE + 4);
+  r = emu.run_for(100);
+  EXPECT_EQ(r.reason, StopReason::Breakpoint);
+  EXPECT_EQ(emu.pc(), DRAM_BASE + 4);
+  emu.remove_breakpoint(DRAM_BASE + 4);
+  EXPECT_EQ(emu.run_for(10).reason, StopReason::InstructionLimit);
+}
+
+TEST(EmulatorTest, Watchpoints) {
+  EmulatorConfig config;
+  config.image = assemble(R"(
+  loop:
+      addi t0, t0, 1
+      sd t0, 0(a0)
+      j loop
+  )");
+  Emulator emu(config);
+  emu.set_reg(10, DRAM_BASE + 0x1000);
+  emu.add_watchpoint(DRAM_BASE + 0x1004, 4);
+
+  // 宿主写入不触发观察点
+  uint32_t zero = 0;
+  EXPECT_TRUE(emu.write_memory(DRAM_BASE + 0x1004, &zero, sizeof(zero)));
+
+  RunResult r = emu.run_for(100);
+  EXPECT_EQ(r.reason, StopReason::Watchpoint);
+  EXPECT_EQ(r.insts, 2);
+  EXPECT_EQ(r.watch_addr, DRAM_BASE + 0x1000);
+  EXPECT_EQ(emu.pc(), DRAM_BASE + 8);
+
+  emu.remove_watchpoint(DRAM_BASE + 0x1004, 4);
+  EXPECT_EQ(emu.run_for(30).reason, StopReason::InstructionLimit);
+  EXPECT_EQ(emu.reg(5), 11);
+}
+
+TEST(EmulatorTest, RegistersAndMemory) {
+  Emulator emu(loop_config());
+  emu.set_reg(5, 100);
+  emu.set_reg(0, 1);
+  EXPECT_EQ(emu.reg(0), 0);
+
+  // 改写代码后重新执行
+  uint32_t inst = encode("addi t0, t0, 10");
+  EXPECT_TRUE(emu.write_memory(DRAM_BASE, &inst, sizeof(inst)));
+  emu.run_for(3);
+  EXPECT_EQ(emu.reg(5), 110);
+
+  uint8_t buf[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  EXPECT_TRUE(emu.write_memory(DRAM_BASE + 0x1000, buf, sizeof(buf)));
+  uint64_t value = 0;
+  EXPECT_TRUE(emu.read_memory(DRAM_BASE + 0x1000, &value, sizeof(value)));
+  EXPECT_EQ(value, 0x0807060504030201);
+  EXPECT_FALSE(emu.read_memory(0x10, &value, sizeof(value)));
+}
+
+TEST(EmulatorTest, MultiPageWriteInvalidatesMiddlePage) {
+  EmulatorConfig config;
+  config.image = assemble("j 0x2000");
+  Emulator emu(config);
+  auto target = assemble("li a0, 1\nloop:\nj loop");
+  ASSERT_TRUE(emu.write_memory(DRAM_BASE + 0x2000, target.data(), target.size()));
+  emu.run_for(5);
+  EXPECT_EQ(emu.reg(10), 1);
+
+  // 一次写入三页，只有中间的页含有已缓存的代码
+  std::vector<uint8_t> pages(3 * 0x1000);
+  auto patched = assemble("li a0, 2\nloop:\nj loop");
+  std::copy(patched.begin(), patched.end(), pages.begin() + 0x1000);
+  ASSERT_TRUE(emu.write_memory(DRAM_BASE + 0x1000, pages.data(), pages.size()));
+  emu.set_pc(DRAM_BASE);
+  emu.run_for(5);
+  EXPECT_EQ(emu.reg(10), 2);
+}
+
+TEST(EmulatorTest, FatalTrapAndCallbacks) {
+  EmulatorConfig config;
+  config.image = assemble("li t0, 1");  // 之后是全零的非法指令
+  Emulator emu(config);
+  int traps = 0;
+  int stops = 0;
+  emu.on_trap([&](const Exception& e) {
+    ++traps;
+    EXPECT_EQ(e.getType(), ExceptionType::IllegalInstruction);
+    return false;
+  });
+  emu.on_stop([&](const RunResult&) { ++stops; });
+  RunResult r = emu.run_for(10);
+  EXPECT_EQ(r.reason, StopReason::FatalTrap);
+  EXPECT_EQ(r.insts, 1);
+  ASSERT_TRUE(r.trap.has_value());
+  EXPECT_EQ(traps, 1);
+  EXPECT_EQ(stops, 1);
+}
+
+TEST(EmulatorTest, GuestExit) {
+  Emulator emu(loop_config());
+  emu.on_trap([](const Exception&) { return true; });
+  emu.raw().exit(3);
+  RunResult r = emu.run_for(100);
+  EXPECT_EQ(r.reason, StopReason::Exited);
+  EXPECT_EQ(emu.exit_code(), 3);
+}
+
+}  // namespace cemu
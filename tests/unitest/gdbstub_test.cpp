@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <thread>
+#include "../../src/cup.h"
+#include "../../src/gdbstub.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t DATA = DRAM_BASE + 0x1000;
+
+// 在另一个线程中运行 GdbStub，测试线程充当 gdb
+class GdbSession {
+ public:
+  explicit GdbSession(Cpu& cpu) : stub(cpu) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fd = fds[0];
+    stub.attach(fds[1]);
+    server = std::thread([this] { stub.serve(); });
+  }
+
+  ~GdbSession() {
+    request("k");
+    server.join();
+    close(fd);
+  }
+
+  std::string request(const std::string& payload) {
+    uint8_t sum = 0;
+    for (char c : payload) {
+      sum += static_cast<uint8_t>(c);
+    }
+    char checksum[3];
+    std::snprintf(checksum, sizeof(checksum), "%02x", sum);
+    std::string packet = "$" + payload + "#" + checksum;
+    EXPECT_EQ(write(fd, packet.data(), packet.size()), static_cast<ssize_t>(packet.size()));
+    if (payload == "k") {
+      return "";
+    }
+
+    // 跳过应答的 '+'，读出 $<内容>#xx
+    char c;
+    do {
+      EXPECT_EQ(read(fd, &c, 1), 1);
+    } while (c != '$');
+    std::string reply;
+    while (read(fd, &c, 1) == 1 && c != '#') {
+      reply.push_back(c);
+    }
+    char tail[2];
+    EXPECT_EQ(read(fd, tail, 2), 2);
+    EXPECT_EQ(write(fd, "+", 1), 1);
+    return reply;
+  }
+
+ private:
+  GdbStub stub;
+  std::thread server;
+  int fd;
+};
+
+// 每轮把计数写到 a0 指向的内存
+std::vector<uint8_t> store_loop_program() {
+  return assemble(R"(
+  loop:
+      addi t0, t0, 1
+      sd t0, 0(a0)
+      j loop
+  )");
+}
+
+}  // namespace
+
+TEST(GdbStubTest, RegistersAndMemory) {
+  Cpu cpu(store_loop_program());
+  cpu.regs[5] = 0x1234;
+  GdbSession gdb(cpu);
+
+  EXPECT_EQ(gdb.request("?"), "S05");
+  std::string regs = gdb.request("g");
+  ASSERT_EQ(regs.size(), 33 * 16);
+  EXPECT_EQ(regs.substr(5 * 16, 16), "3412000000000000");
+  EXPECT_EQ(regs.substr(32 * 16, 16), "0000008000000000");
+
+  EXPECT_EQ(gdb.request("P6=0100000000000000"), "OK");
+  EXPECT_EQ(cpu.regs[6], 1);
+  EXPECT_EQ(gdb.request("p20"), "0000008000000000");
+  EXPECT_EQ(gdb.request("P0=ffffffffffffffff"), "OK");
+  EXPECT_EQ(cpu.regs[0], 0);
+
+  // 寄存器号 65 之后是 CSR
+  cpu.csr.store(MSCRATCH, 0xabcd);
+  char p[16];
+  std::snprintf(p, sizeof(p), "p%x", static_cast<unsigned>(65 + MSCRATCH));
+  EXPECT_EQ(gdb.request(p), "cdab000000000000");
+
+  EXPECT_EQ(gdb.request("m80000000,4"), "93821200");  // addi x5, x5, 1
+  EXPECT_EQ(gdb.request("M80001000,3:aabbcc"), "OK");
+  EXPECT_EQ(cpu.load(DATA, 32).value(), 0xccbbaa);
+  EXPECT_EQ(gdb.request("m80001000,4"), "aabbcc00");
+  EXPECT_EQ(gdb.request("m0,4"), "E14");
+}
+
+TEST(GdbStubTest, BreakpointAndStep) {
+  Cpu cpu(store_loop_program());
+  cpu.regs[10] = DATA;
+  GdbSession gdb(cpu);
+
+  EXPECT_EQ(gdb.request("Z0,80000008,4"), "OK");
+  EXPECT_EQ(gdb.request("c"), "S05");
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 8);
+  EXPECT_EQ(cpu.regs[5], 1);
+
+  // 从断点处继续时不会立即停下，而是在下一次到达断点时停止
+  EXPECT_EQ(gdb.request("c"), "S05");
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 8);
+  EXPECT_EQ(cpu.regs[5], 2);
+
+  EXPECT_EQ(gdb.request("z0,80000008,4"), "OK");
+  EXPECT_EQ(gdb.request("s"), "S05");
+  EXPECT_EQ(cpu.pc, DRAM_BASE);
+  EXPECT_EQ(gdb.request("s"), "S05");
+  EXPECT_EQ(cpu.regs[5], 3);
+}
+
+TEST(GdbStubTest, WriteWatchpoint) {
+  Cpu cpu(store_loop_program());
+  cpu.regs[10] = DATA;
+  GdbSession gdb(cpu);
+
+  EXPECT_EQ(gdb.request("Z2,80001000,8"), "OK");
+  EXPECT_EQ(gdb.request("c"), "T05watch:80001000;");
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 8);  // 停在写指令之后
+  EXPECT_EQ(cpu.load(DATA, 64).value(), 1);
+  EXPECT_EQ(gdb.request("z2,80001000,8"), "OK");
+  EXPECT_EQ(gdb.request("Z3,80001000,8"), "");
+}
+
+TEST(GdbStubTest, QueriesAndTargetDescription) {
+  Cpu cpu(store_loop_program());
+  GdbSession gdb(cpu);
+
+  EXPECT_NE(gdb.request("qSupported:multiprocess+").find("qXfer:features:read+"), std::string::npos);
+  EXPECT_EQ(gdb.request("QStartNoAckMode"), "OK");
+  std::string xml = gdb.request("qXfer:features:read:target.xml:0,fff");
+  ASSERT_FALSE(xml.empty());
+  EXPECT_EQ(xml[0], 'l');
+  EXPECT_NE(xml.find("riscv:rv64"), std::string::npos);
+  EXPECT_EQ(gdb.request("qAttached"), "1");
+  EXPECT_EQ(gdb.request("vMustReplyEmpty"), "");
+}
+
+TEST(GdbStubTest, RejectsBadAddress) {
+  Cpu cpu({});
+  GdbStub stub(cpu);
+  EXPECT_THROW(stub.listen("127.0.0.1:gdb"), std::runtime_error);
+  EXPECT_THROW(stub.listen("127.0.0.1:70000"), std::runtime_error);
+  EXPECT_THROW(stub.listen("localhost:1234"), std::runtime_error);
+}
+
+}  // namespace cemu
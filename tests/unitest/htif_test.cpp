@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t TOHOST = DRAM_BASE + 0x1000;
+constexpr uint64_t FROMHOST = DRAM_BASE + 0x1008;
+constexpr uint64_t DATA = DRAM_BASE + 0x2000;
+
+void put_string(Cpu& cpu, uint64_t addr, const std::string& s) {
+  for (size_t i = 0; i <= s.size(); ++i) {
+    cpu.store(addr + i, 8, i < s.size() ? s[i] : 0);
+  }
+}
+
+class HtifTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    htif.tohost = TOHOST;
+    htif.fromhost = FROMHOST;
+    htif.out = &out;
+  }
+
+  Htif htif;
+  std::ostringstream out;
+};
+
+}  // namespace
+
+TEST_F(HtifTest, ExitStopsImmediately) {
+  Cpu cpu(assemble(R"(
+      li t0, 15  # (7 << 1) | 1，退出码为 7
+      sd t0, 0(a0)
+  loop:
+      j loop
+  )"));
+  cpu.htif = &htif;
+  cpu.regs[10] = TOHOST;
+  cpu.run(1000);
+  ASSERT_TRUE(cpu.exit_code.has_value());
+  EXPECT_EQ(*cpu.exit_code, 7);
+  EXPECT_LE(cpu.csr.instret, 3);
+  EXPECT_EQ(cpu.load(TOHOST, 64).value(), 0);
+}
+
+TEST_F(HtifTest, ConsoleAndSyscalls) {
+  // 先输出一个字符，再通过代理的 write 系统调用输出字符串
+  Cpu cpu(assemble(R"(
+      ld t0, 0(a1)
+      sd t0, 0(a0)
+      addi t1, a1, 8
+      sd t1, 0(a0)
+  loop:
+      j loop
+  )"));
+  cpu.htif = &htif;
+  cpu.regs[10] = TOHOST;
+  cpu.regs[11] = DATA;
+  cpu.store(DATA, 64, (1ULL << 56) | (1ULL << 48) | 'A');
+  cpu.store(DATA + 8, 64, 64);  // write(1, DATA + 0x100, 5)
+  cpu.store(DATA + 16, 64, 1);
+  cpu.store(DATA + 24, 64, DATA + 0x100);
+  cpu.store(DATA + 32, 64, 5);
+  put_string(cpu, DATA + 0x100, "hello");
+
+  cpu.run(5);
+  EXPECT_EQ(out.str(), "Ahello");
+  EXPECT_EQ(cpu.load(DATA + 8, 64).value(), 5);
+  EXPECT_EQ(cpu.load(FROMHOST, 64).value(), 1);
+  EXPECT_EQ(cpu.load(TOHOST, 64).value(), 0);
+  EXPECT_FALSE(cpu.exit_code.has_value());
+}
+
+TEST_F(HtifTest, Semihosting) {
+  htif.semihosting = true;
+  // 半主机调用序列为 slli x0, x0, 0x1f; ebreak; srai x0, x0, 7
+  Cpu cpu(assemble(R"(
+      li a0, 0x04  # SYS_WRITE0
+      mv a1, a2
+      slli zero, zero, 0x1f
+      ebreak
+      srai zero, zero, 7
+      li a0, 0x18  # SYS_EXIT
+      mv a1, a3
+      slli zero, zero, 0x1f
+      ebreak
+      srai zero, zero, 7
+  loop:
+      j loop
+  )"));
+  cpu.htif = &htif;
+  cpu.regs[12] = DATA;
+  cpu.regs[13] = DATA + 0x100;
+  put_string(cpu, DATA, "semihosted\n");
+  cpu.store(DATA + 0x100, 64, 0x20026);  // ADP_Stopped_ApplicationExit
+  cpu.store(DATA + 0x108, 64, 3);
+
+  cpu.run(1000);
+  EXPECT_EQ(out.str(), "semihosted\n");
+  ASSERT_TRUE(cpu.exit_code.has_value());
+  EXPECT_EQ(*cpu.exit_code, 3);
+  EXPECT_EQ(cpu.pc, DRAM_BASE + 9 * 4);
+}
+
+// 客户机只能写和关闭自己通过 SYS_OPEN 打开的文件，不能碰宿主机进程的其他文件描述符
+TEST_F(HtifTest, OnlyGuestOpenedFilesAreAccessible) {
+  htif.semihosting = true;
+  Cpu cpu(assemble(R"(
+      mv a0, s2
+      mv a1, s3
+      slli zero, zero, 0x1f
+      ebreak
+      srai zero, zero, 7
+  loop:
+      j loop
+  )"));
+  cpu.htif = &htif;
+  // 以 op 和参数块 params 执行一次半主机调用，返回 a0
+  auto call = [&cpu](uint64_t op, const std::vector<uint64_t>& params) {
+    for (size_t i = 0; i < params.size(); ++i) {
+      cpu.store(DATA + i * 8, 64, params[i]);
+    }
+    cpu.pc = DRAM_BASE;
+    cpu.regs[18] = op;
+    cpu.regs[19] = DATA;
+    cpu.run(5);
+    return cpu.regs[10];
+  };
+  constexpr uint64_t FAIL = static_cast<uint64_t>(-1);
+  std::string path = testing::TempDir() + "cemu_htif_test.txt";
+  put_string(cpu, DATA + 0x100, "data");
+  put_string(cpu, DATA + 0x200, path);
+
+  int host_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(host_fd, 0);
+  EXPECT_EQ(call(0x05, {static_cast<uint64_t>(host_fd), DATA + 0x100, 4}), 4);  // SYS_WRITE
+  EXPECT_EQ(call(0x13, {}), EBADF);                                             // SYS_ERRNO
+  EXPECT_EQ(call(0x02, {static_cast<uint64_t>(host_fd)}), FAIL);                // SYS_CLOSE
+  // HTIF 代理的 write 系统调用
+  cpu.store(DATA + 0x300, 64, 64);
+  cpu.store(DATA + 0x308, 64, host_fd);
+  cpu.store(DATA + 0x310, 64, DATA + 0x100);
+  cpu.store(DATA + 0x318, 64, 4);
+  cpu.store(TOHOST, 64, DATA + 0x300);
+  EXPECT_EQ(cpu.load(DATA + 0x300, 64).value(), static_cast<uint64_t>(-EBADF));
+  EXPECT_NE(fcntl(host_fd, F_GETFD), -1);
+  close(host_fd);
+
+  uint64_t fd = call(0x01, {DATA + 0x200, 4, path.size()});  // SYS_OPEN，模式 "w"
+  ASSERT_NE(fd, FAIL);
+  EXPECT_EQ(call(0x05, {fd, DATA + 0x100, 4}), 0);
+  EXPECT_EQ(call(0x02, {fd}), 0);
+  EXPECT_EQ(call(0x02, {fd}), FAIL);  // 已经关闭
+  std::string content;
+  std::getline(std::ifstream(path), content);
+  EXPECT_EQ(content, "data");
+  std::remove(path.c_str());
+}
+
+TEST_F(HtifTest, EcallAndEbreakTrap) {
+  Cpu cpu(assemble(R"(
+      ebreak
+      ecall
+  loop:
+      j loop
+  )"));
+  cpu.htif = &htif;  // 未启用半主机时 ebreak 是普通的断点异常
+  cpu.csr.store(MTVEC, DRAM_BASE + 8);
+  cpu.run(1);
+  EXPECT_EQ(cpu.csr.load(MCAUSE), static_cast<uint64_t>(ExceptionType::Breakpoint));
+  EXPECT_EQ(cpu.csr.load(MEPC), DRAM_BASE);
+
+  cpu.pc = DRAM_BASE + 4;
+  cpu.run(1);
+  EXPECT_EQ(cpu.csr.load(MCAUSE), static_cast<uint64_t>(ExceptionType::EnvironmentCallFromMMode));
+  EXPECT_EQ(cpu.csr.load(MEPC), DRAM_BASE + 4);
+}
+
+}  // namespace cemu
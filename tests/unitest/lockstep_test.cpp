@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <sstream>
+#include "../assembler.h"
+#include "../../src/lockstep.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t DATA = DRAM_BASE + 0x10000;
+
+// 循环中做算术、访存和条件分支，每 8 轮用 ecall 陷入一次 M 模式处理程序，并读性能计数器
+const char* const PROGRAM = R"(
+    la t0, handler
+    csrw mtvec, t0
+    li s0, 1
+    slli s0, s0, 31
+    lui t0, 0x10
+    add s0, s0, t0
+    li s1, 0
+    li s2, 100
+loop:
+    addi s1, s1, 1
+    slli t1, s1, 2
+    sd t1, 0(s0)
+    ld t2, 0(s0)
+    add s3, s3, t2
+    andi t3, s1, 7
+    bnez t3, skip
+    ecall
+skip:
+    csrr s4, minstret
+    csrr s5, 0xb03
+    blt s1, s2, loop
+    .word 0
+handler:
+    csrr t4, mepc
+    addi t4, t4, 4
+    csrw mepc, t4
+    addi s6, s6, 1
+    mret
+)";
+
+}  // namespace
+
+TEST(LockstepTest, EnginesAgree) {
+  Cpu cpu(assemble(PROGRAM));
+  cpu.csr.store(MHPMEVENT3, HPM_EVENT_STORE);
+  Lockstep lockstep(cpu);
+  // 程序以非法指令结束，两边都在同一处遇到致命异常
+  std::optional<Divergence> d;
+  EXPECT_THROW(d = lockstep.run(100000), Exception);
+  EXPECT_FALSE(d.has_value());
+
+  Cpu& ref = lockstep.reference();
+  EXPECT_EQ(cpu.regs[9], 100);
+  EXPECT_EQ(cpu.regs[22], 12);  // s6：陷入次数
+  EXPECT_EQ(ref.regs, cpu.regs);
+  EXPECT_EQ(ref.pc, cpu.pc);
+  EXPECT_EQ(ref.csr.load(MINSTRET), cpu.csr.load(MINSTRET));
+  EXPECT_EQ(ref.load(DATA, 64).value(), 400);
+}
+
+TEST(LockstepTest, StopsAtInstructionLimit) {
+  Cpu cpu(assemble(PROGRAM));
+  Lockstep lockstep(cpu);
+  EXPECT_FALSE(lockstep.run(57).has_value());
+  EXPECT_EQ(cpu.csr.instret, 57);
+  EXPECT_EQ(lockstep.reference().csr.instret, 57);
+  EXPECT_EQ(lockstep.reference().pc, cpu.pc);
+}
+
+TEST(LockstepTest, ReusesMachinesAfterReset) {
+  // 模糊测试的用法：两台机器反复用同样的代码 reset，再由调用者提供参考机器
+  Cpu cpu({});
+  Cpu ref({});
+  for (int i = 0; i < 3; ++i) {
+    cpu.reset(assemble(PROGRAM));
+    ref.reset(assemble(PROGRAM));
+    Lockstep lockstep(cpu, ref);
+    EXPECT_FALSE(lockstep.run(300).has_value());
+    EXPECT_EQ(ref.regs, cpu.regs);
+    EXPECT_EQ(&lockstep.reference(), &ref);
+  }
+}
+
+TEST(LockstepTest, WritesToX0AreDiscarded) {
+  Cpu cpu(assemble(R"(
+    li ra, 7
+    addi x0, ra, 5
+    add a0, x0, x0
+    addi a1, x0, 1
+    .word 0
+)"));
+  Lockstep lockstep(cpu);
+  std::optional<Divergence> d;
+  EXPECT_THROW(d = lockstep.run(100), Exception);
+  EXPECT_FALSE(d.has_value());
+  EXPECT_EQ(cpu.regs[0], 0);
+  EXPECT_EQ(cpu.regs[10], 0);
+  EXPECT_EQ(cpu.regs[11], 1);
+  EXPECT_EQ(lockstep.reference().regs, cpu.regs);
+}
+
+TEST(LockstepTest, ReportsRegisterDivergence) {
+  Cpu cpu(assemble(PROGRAM));
+  Lockstep lockstep(cpu);
+  // 模拟快速引擎的错误：第一个块之前只改快速引擎一边的寄存器
+  cpu.regs[7] = 5;
+  auto d = lockstep.run(1000);
+  ASSERT_TRUE(d.has_value());
+  EXPECT_EQ(d->what, "x7");
+  EXPECT_EQ(d->expected, 0);
+  EXPECT_EQ(d->actual, 5);
+  EXPECT_EQ(d->block_pc, DRAM_BASE);
+
+  std::ostringstream os;
+  os << *d;
+  EXPECT_NE(os.str().find("x7 differs after the block at 0x80000000"), std::string::npos);
+}
+
+TEST(LockstepTest, ReportsMemoryDivergence) {
+  Cpu cpu(assemble(PROGRAM));
+  Lockstep lockstep(cpu);
+  ASSERT_FALSE(lockstep.run(10).has_value());
+
+  uint64_t addr = DATA + 0x100;
+  uint64_t value = 0x1234;
+  std::memcpy(cpu.bus.dram_ptr(addr, 8), &value, 8);
+  cpu.bus.memory().mark_dirty(addr, 8);
+  auto d = lockstep.run(1000);
+  ASSERT_TRUE(d.has_value());
+  EXPECT_EQ(d->what, "mem 0x80010100");
+  EXPECT_EQ(d->expected, 0);
+  EXPECT_EQ(d->actual, 0x1234);
+}
+
+TEST(LockstepTest, AgreesOnInterrupts) {
+  // 循环中反复挂起软件中断，处理程序清除它；中断在 csrs 之后的块边界响应
+  Cpu cpu(assemble(R"(
+    la t0, handler
+    csrw mtvec, t0
+    li t1, 2
+    csrw mie, t1
+    csrsi mstatus, 8
+    li s1, 20
+loop:
+    addi s1, s1, -1
+    andi t2, s1, 3
+    bnez t2, skip
+    csrs mip, t1
+skip:
+    bnez s1, loop
+    .word 0
+handler:
+    addi s6, s6, 1
+    csrc mip, t1
+    mret
+)"));
+  Lockstep lockstep(cpu);
+  std::optional<Divergence> d;
+  EXPECT_THROW(d = lockstep.run(10000), Exception);
+  EXPECT_FALSE(d.has_value());
+  EXPECT_EQ(cpu.regs[22], 5);
+  EXPECT_EQ(lockstep.reference().regs[22], 5);
+}
+
+}
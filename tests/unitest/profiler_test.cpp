@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../../src/elf.h"
+#include "../../src/instructions.h"
+#include "../../src/profiler.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+TEST(ProfilerTest, CountsHandlersPcsAndBlocks) {
+  // addi x5, x0, 10; loop: addi x5, x5, -1; bne x5, x0, loop; addi x6, x0, 1
+  Cpu cpu(assemble(R"(
+      addi t0, zero, 10
+  loop:
+      addi t0, t0, -1
+      bnez t0, loop
+      addi t1, zero, 1
+  )"));
+  cpu.run(22);
+
+  Profiler profiler;
+  profiler.collect(cpu.blocks);
+  EXPECT_EQ(profiler.total(), 22);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE), 1);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE + 4), 10);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE + 8), 10);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE + 12), 1);
+  EXPECT_EQ(profiler.handler_count(InstructionExecutor::decode(encode("addi zero, zero, 0"))), 12);
+  EXPECT_EQ(profiler.handler_count(InstructionExecutor::decode(encode("bne zero, zero, 0"))), 10);
+
+  // 再次汇总不会重复计数
+  profiler.collect(cpu.blocks);
+  EXPECT_EQ(profiler.total(), 22);
+}
+
+TEST(ProfilerTest, PartialBlocksAndFlush) {
+  // 之后是全零的非法指令
+  Cpu cpu(assemble(R"(
+      addi t0, zero, 1
+      addi t0, t0, 1
+      addi t0, t0, 1
+  )"));
+  Profiler profiler;
+  cpu.blocks.profiler = &profiler;
+  cpu.run(2);
+  cpu.blocks.flush();
+  EXPECT_EQ(profiler.total(), 2);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE + 8), 0);
+
+  EXPECT_THROW(cpu.run(10), Exception);
+  profiler.collect(cpu.blocks);
+  EXPECT_EQ(profiler.total(), 3);
+  EXPECT_EQ(profiler.pc_count(DRAM_BASE + 8), 1);
+  EXPECT_EQ(profiler.handler_count(executeIllegal), 0);
+}
+
+TEST(ProfilerTest, ReportIsSymbolized) {
+  auto symbols = SymbolTable::parse(make_elf(0, {}, {{"main", DRAM_BASE, 8}, {"loop", DRAM_BASE + 8, 0}}));
+  ASSERT_TRUE(symbols.has_value());
+  EXPECT_EQ(symbols->size(), 2);
+  EXPECT_EQ(symbols->symbolize(DRAM_BASE + 4), "main+0x4");
+  EXPECT_EQ(symbols->symbolize(DRAM_BASE + 0x20), "loop+0x18");
+  EXPECT_EQ(symbols->symbolize(DRAM_BASE - 4), "");
+  EXPECT_FALSE(SymbolTable::parse({1, 2, 3}).has_value());
+
+  Cpu cpu(assemble(R"(
+      addi t0, zero, 3
+  loop:
+      addi t0, t0, -1
+      bnez t0, loop
+  )"));
+  cpu.run(7);
+  Profiler profiler;
+  profiler.collect(cpu.blocks);
+  std::ostringstream os;
+  profiler.report(os, &*symbols, 5);
+  EXPECT_NE(os.str().find("executeAddi"), std::string::npos);
+  EXPECT_NE(os.str().find("main+0x4"), std::string::npos);
+  EXPECT_NE(os.str().find("loop"), std::string::npos);
+}
+
+}  // namespace cemu
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../../src/replay.h"
+#include "../../src/snapshot.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+// 轮询串口，把收到的字节累加到 t1，每轮读一次 time 累加到 t2
+std::vector<uint8_t> echo_program() {
+  return assemble(R"(
+  loop:
+      lbu t0, 5(a0)
+      andi t0, t0, 1
+      beqz t0, skip
+      lbu t0, 0(a0)
+      add t1, t1, t0
+  skip:
+      csrr s0, time
+      add t2, t2, s0
+      j loop
+  )");
+}
+
+class ReplayTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    std::remove(path.c_str());
+  }
+
+  std::string path = testing::TempDir() + "cemu_replay_test.log";
+};
+
+}  // namespace
+
+TEST_F(ReplayTest, ReplaysUartAndTime) {
+  uint64_t sum, time_sum, pc;
+  {
+    InputLog log(InputLog::Mode::Record, path);
+    Cpu cpu(echo_program());
+    cpu.regs[10] = UART_BASE;
+    cpu.attach_input_log(&log);
+    // 模拟输入线程在不确定的时刻收到字节
+    cpu.run(5000);
+    cpu.bus.uart->queue_input(3);
+    cpu.run(7000);
+    cpu.bus.uart->queue_input(40);
+    cpu.bus.uart->queue_input(100);
+    cpu.run(6000);
+    sum = cpu.regs[6];
+    time_sum = cpu.regs[7];
+    pc = cpu.pc;
+  }
+  EXPECT_EQ(sum, 143);
+
+  InputLog log(InputLog::Mode::Replay, path);
+  Cpu cpu(echo_program());
+  cpu.regs[10] = UART_BASE;
+  cpu.attach_input_log(&log);
+  cpu.run(18000);
+  EXPECT_EQ(cpu.regs[6], sum);
+  EXPECT_EQ(cpu.regs[7], time_sum);
+  EXPECT_EQ(cpu.pc, pc);
+
+  // 超出录制范围后读取 time 视为回放失败
+  EXPECT_THROW(cpu.run(100), std::runtime_error);
+}
+
+// 回放时保存检查点不是客户机读取 time，不能消耗日志中的事件
+TEST_F(ReplayTest, SavingStateDoesNotConsumeEvents) {
+  uint64_t time_sum;
+  {
+    InputLog log(InputLog::Mode::Record, path);
+    Cpu cpu(echo_program());
+    cpu.regs[10] = UART_BASE;
+    cpu.attach_input_log(&log);
+    cpu.run(6000);
+    time_sum = cpu.regs[7];
+  }
+
+  InputLog log(InputLog::Mode::Replay, path);
+  Cpu cpu(echo_program());
+  cpu.regs[10] = UART_BASE;
+  cpu.attach_input_log(&log);
+  cpu.run(3000);
+  std::ostringstream state;
+  save_machine_state(cpu, state);
+  cpu.run(3000);
+  EXPECT_EQ(cpu.regs[7], time_sum);
+}
+
+TEST_F(ReplayTest, RejectsBadLog) {
+  EXPECT_THROW(InputLog(InputLog::Mode::Replay, path), std::runtime_error);
+
+  // 未知的事件类型
+  FILE* f = std::fopen(path.c_str(), "wb");
+  std::fputs("CEMUREC1", f);
+  std::fputc(7, f);
+  std::fputc(1, f);
+  std::fputc(1, f);
+  std::fclose(f);
+  EXPECT_THROW(InputLog(InputLog::Mode::Replay, path), std::runtime_error);
+}
+
+}  // namespace cemu
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../../src/sampler.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint64_t STACK = DRAM_BASE + 0x10000;
+
+}  // namespace
+
+TEST(SamplerTest, SamplesEveryInterval) {
+  Cpu cpu(loop_program());
+  Sampler sampler(10);
+  cpu.sampler = &sampler;
+  EXPECT_EQ(cpu.run(105), 105);
+  EXPECT_EQ(sampler.samples(), 10);
+  EXPECT_EQ(cpu.regs[5], 53);
+
+  // 关闭采样后不再记录
+  cpu.sampler = nullptr;
+  cpu.run(100);
+  EXPECT_EQ(sampler.samples(), 10);
+}
+
+TEST(SamplerTest, WalksFramePointers) {
+  Cpu cpu(loop_program());
+  // 两层调用帧：fp1 -> fp2 -> 0
+  uint64_t fp1 = STACK - 0x40, fp2 = STACK;
+  cpu.store(fp1 - 16, 64, fp2);
+  cpu.store(fp1 - 8, 64, 0x80001004);
+  cpu.store(fp2 - 16, 64, 0);
+  cpu.store(fp2 - 8, 64, 0x80002004);
+  cpu.regs[8] = fp1;
+
+  Sampler sampler(2);
+  cpu.sampler = &sampler;
+  cpu.run(8);
+  ASSERT_EQ(sampler.stacks().size(), 1);
+  const auto& [stack, count] = *sampler.stacks().begin();
+  EXPECT_EQ(stack, (std::vector<uint64_t>{DRAM_BASE, 0x80001000, 0x80002000}));
+  EXPECT_EQ(count, 4);
+
+  std::ostringstream os;
+  sampler.write_folded(os, nullptr);
+  EXPECT_EQ(os.str(), "0x80002000;0x80001000;0x80000000 4\n");
+}
+
+TEST(SamplerTest, StopsOnBrokenFrameChain) {
+  Cpu cpu(loop_program());
+  cpu.regs[8] = STACK;
+  cpu.store(STACK - 16, 64, STACK - 0x100);  // 上一帧在更低的地址，帧链损坏
+  cpu.store(STACK - 8, 64, 0x80001004);
+  Sampler sampler(1);
+  cpu.sampler = &sampler;
+  cpu.run(1);
+  EXPECT_EQ(sampler.stacks().begin()->first.size(), 2);
+}
+
+}  // namespace cemu
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include "../../src/cup.h"
+#include "../../src/snapshot.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+class SnapshotTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    std::remove(path.c_str());
+  }
+
+  std::string path = testing::TempDir() + "cemu_snapshot_test.snap";
+};
+
+}  // namespace
+
+TEST_F(SnapshotTest, RoundTrip) {
+  Cpu cpu(loop_program());
+  cpu.run(101);
+  cpu.store(DRAM_BASE + 0x10000, 64, 0x1122334455667788);
+  cpu.store(DRAM_END - 7, 64, 42);
+  cpu.csr.store(MSCRATCH, 0xabcd);
+  cpu.mode = Supervisor;
+  cpu.vreg(3)[5] = 9;
+  cpu.bus.clint.store(CLINT_MTIMECMP, 64, 1000);
+  cpu.bus.store(UART_BASE + UART_LCR, 8, 3);
+  save_snapshot(cpu, path);
+
+  Cpu restored({});
+  restored.store(DRAM_BASE + 0x20000, 64, 7);  // 恢复后应当被清掉
+  restore_snapshot(restored, path);
+  EXPECT_EQ(restored.pc, cpu.pc);
+  EXPECT_EQ(restored.regs, cpu.regs);
+  EXPECT_EQ(restored.mode, Supervisor);
+  EXPECT_EQ(restored.vreg(3)[5], 9);
+  EXPECT_EQ(restored.csr.load(MSCRATCH), 0xabcd);
+  EXPECT_EQ(restored.csr.load(MINSTRET), 101);
+  EXPECT_EQ(restored.bus.clint.load(CLINT_MTIMECMP, 64), 1000);
+  EXPECT_EQ(restored.bus.load(UART_BASE + UART_LCR, 8).value(), 3);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x10000, 64).value(), 0x1122334455667788);
+  EXPECT_EQ(restored.load(DRAM_END - 7, 64).value(), 42);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x20000, 64).value(), 0);
+
+  // 恢复后的机器继续运行，与原机器的结果一致
+  cpu.run(50);
+  restored.run(50);
+  EXPECT_EQ(restored.regs[5], cpu.regs[5]);
+  EXPECT_EQ(restored.pc, cpu.pc);
+  // 特权级统计从恢复时的特权级和 instret 开始
+  EXPECT_EQ(restored.accounting.mode_stats(Supervisor, restored.csr.instret).insts, 50);
+  EXPECT_EQ(restored.accounting.mode_stats(Machine, restored.csr.instret).insts, 0);
+}
+
+TEST_F(SnapshotTest, RestoredPagesAreCopyOnWrite) {
+  Cpu cpu(loop_program());
+  cpu.store(DRAM_BASE + 0x3000, 32, 5);
+  save_snapshot(cpu, path);
+
+  Cpu a({}), b({});
+  restore_snapshot(a, path);
+  restore_snapshot(b, path);
+  a.store(DRAM_BASE + 0x3000, 32, 6);
+  EXPECT_EQ(b.load(DRAM_BASE + 0x3000, 32).value(), 5);
+
+  // 快照文件本身不受影响
+  Cpu c({});
+  restore_snapshot(c, path);
+  EXPECT_EQ(c.load(DRAM_BASE + 0x3000, 32).value(), 5);
+}
+
+TEST_F(SnapshotTest, SparseAndFast) {
+  Cpu cpu(loop_program());
+  save_snapshot(cpu, path);
+  FILE* f = std::fopen(path.c_str(), "rb");
+  ASSERT_NE(f, nullptr);
+  std::fseek(f, 0, SEEK_END);
+  long size = std::ftell(f);
+  std::fclose(f);
+  // 128 MiB 的 DRAM 只有一个非零页，其余主要是 4096 个 CSR
+  EXPECT_LT(size, 16 * SNAPSHOT_PAGE_SIZE);
+
+  auto start = std::chrono::steady_clock::now();
+  restore_snapshot(cpu, path);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+}
+
+TEST_F(SnapshotTest, DirtyPages) {
+  Dram dram;
+  EXPECT_TRUE(dram.dirty_pages().empty());
+  dram.store(DRAM_BASE + 0x1ffe, 32, 1);  // 跨页写
+  dram.store(DRAM_BASE + 0x5000, 8, 1);
+  dram.mark_dirty(DRAM_BASE + 0x9000, 0);
+  EXPECT_EQ(dram.dirty_pages(), (std::vector<uint32_t>{1, 2, 5}));
+  dram.clear_dirty();
+  EXPECT_TRUE(dram.dirty_pages().empty());
+}
+
+TEST_F(SnapshotTest, IncrementalChain) {
+  std::string delta1 = path + ".1", delta2 = path + ".2";
+  Cpu cpu(loop_program());
+  cpu.store(DRAM_BASE + 0x10000, 64, 1);
+  cpu.store(DRAM_BASE + 0x20000, 64, 2);
+  save_snapshot(cpu, path);
+  EXPECT_TRUE(cpu.bus.memory().dirty_pages().empty());
+
+  cpu.run(10);
+  cpu.store(DRAM_BASE + 0x10000, 64, 3);
+  save_incremental_snapshot(cpu, delta1);
+  cpu.store(DRAM_BASE + 0x20000, 64, 0);  // 清零的页也必须写出
+  cpu.store(DRAM_BASE + 0x30000, 64, 4);
+  cpu.run(10);
+  save_incremental_snapshot(cpu, delta2);
+
+  // 增量快照只包含脏页
+  FILE* f = std::fopen(delta1.c_str(), "rb");
+  std::fseek(f, 0, SEEK_END);
+  long size = std::ftell(f);
+  std::fclose(f);
+  EXPECT_LT(size, 16 * SNAPSHOT_PAGE_SIZE);
+
+  Cpu restored({});
+  restore_snapshot(restored, path);
+  restore_snapshot(restored, delta1);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x10000, 64).value(), 3);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x20000, 64).value(), 2);
+  EXPECT_EQ(restored.regs[5], 5);
+  restore_snapshot(restored, delta2);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x20000, 64).value(), 0);
+  EXPECT_EQ(restored.load(DRAM_BASE + 0x30000, 64).value(), 4);
+  EXPECT_EQ(restored.regs, cpu.regs);
+  EXPECT_EQ(restored.pc, cpu.pc);
+  std::remove(delta1.c_str());
+  std::remove(delta2.c_str());
+}
+
+TEST_F(SnapshotTest, RejectsBadFiles) {
+  Cpu cpu({});
+  EXPECT_THROW(restore_snapshot(cpu, path), std::runtime_error);
+  FILE* f = std::fopen(path.c_str(), "wb");
+  std::fputs("not a snapshot", f);
+  std::fclose(f);
+  EXPECT_THROW(restore_snapshot(cpu, path), std::runtime_error);
+
+  // 状态长度超出文件大小
+  save_snapshot(cpu, path);
+  f = std::fopen(path.c_str(), "r+b");
+  uint64_t state_size = 1ULL << 60;
+  std::fseek(f, 16, SEEK_SET);
+  std::fwrite(&state_size, sizeof(state_size), 1, f);
+  std::fclose(f);
+  EXPECT_THROW(restore_snapshot(cpu, path), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, RejectsCorruptedPagesWithoutTouchingCpu) {
+  Cpu cpu(loop_program());
+  cpu.run(101);
+  cpu.store(DRAM_BASE + 0x10000, 64, 7);
+  save_snapshot(cpu, path);
+  auto size = std::filesystem::file_size(path);
+
+  Cpu target({});
+  target.regs[5] = 123;
+  target.store(DRAM_BASE + 0x20000, 64, 9);
+  auto expect_untouched = [&] {
+    EXPECT_EQ(target.pc, DRAM_BASE);
+    EXPECT_EQ(target.regs[5], 123);
+    EXPECT_EQ(target.load(DRAM_BASE + 0x20000, 64).value(), 9);
+  };
+
+  // 页数据被截断，映射后访问会触发 SIGBUS
+  std::filesystem::resize_file(path, size - SNAPSHOT_PAGE_SIZE / 2);
+  EXPECT_THROW(restore_snapshot(target, path), std::runtime_error);
+  expect_untouched();
+
+  // 页号越界
+  save_snapshot(cpu, path);
+  FILE* f = std::fopen(path.c_str(), "r+b");
+  uint64_t state_size = 0;
+  std::fseek(f, 16, SEEK_SET);
+  ASSERT_EQ(std::fread(&state_size, sizeof(state_size), 1, f), 1u);
+  uint32_t page = DRAM_SIZE / SNAPSHOT_PAGE_SIZE;
+  std::fseek(f, static_cast<long>(24 + state_size + sizeof(uint64_t)), SEEK_SET);
+  std::fwrite(&page, sizeof(page), 1, f);
+  std::fclose(f);
+  EXPECT_THROW(restore_snapshot(target, path), std::runtime_error);
+  expect_untouched();
+}
+
+}  // namespace cemu
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include "../../src/cup.h"
+#include "../../src/elf.h"
+
+namespace cemu {
+
+namespace {
+
+constexpr uint32_t ECALL = 0x00000073;
+constexpr uint64_t DATA = DRAM_BASE + 0x1000;
+
+// 程序只有一条 ecall，每个测试设置好寄存器后反复执行它
+class UserModeTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    image.entry = DRAM_BASE;
+    image.end = DRAM_BASE + 0x2000;
+    user.out = &out;
+    user.setup(cpu, image, {"prog", "arg1"}, {"HOME=/"});
+  }
+
+  uint64_t syscall(uint64_t number, std::initializer_list<uint64_t> args) {
+    cpu.regs[17] = number;
+    size_t i = 10;
+    for (uint64_t arg : args) {
+      cpu.regs[i++] = arg;
+    }
+    cpu.pc = DRAM_BASE;
+    cpu.run(1);
+    EXPECT_EQ(cpu.pc, DRAM_BASE + 4);
+    return cpu.regs[10];
+  }
+
+  void put_string(uint64_t addr, const std::string& s) {
+    for (size_t i = 0; i <= s.size(); ++i) {
+      cpu.store(addr + i, 8, i < s.size() ? s[i] : 0);
+    }
+  }
+
+  Cpu cpu{std::vector<uint8_t>{ECALL & 0xff, 0, 0, 0}};
+  ElfImage image{};
+  UserMode user;
+  std::ostringstream out;
+};
+
+}  // namespace
+
+TEST_F(UserModeTest, InitialStack) {
+  EXPECT_EQ(cpu.mode, User);
+  uint64_t sp = cpu.regs[2];
+  EXPECT_EQ(sp % 16, 0);
+  EXPECT_EQ(cpu.load(sp, 64).value(), 2);  // argc
+  uint64_t argv1 = cpu.load(sp + 16, 64).value();
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(cpu.bus.dram_ptr(argv1, 5))), "arg1");
+  EXPECT_EQ(cpu.load(sp + 24, 64).value(), 0);  // argv 结尾
+  uint64_t env0 = cpu.load(sp + 32, 64).value();
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(cpu.bus.dram_ptr(env0, 7))), "HOME=/");
+  EXPECT_EQ(cpu.load(sp + 40, 64).value(), 0);  // envp 结尾
+  EXPECT_EQ(cpu.load(sp + 48, 64).value(), 3);  // 第一个辅助向量 AT_PHDR
+}
+
+TEST_F(UserModeTest, ArgumentsMustFitOnStack) {
+  Cpu other{std::vector<uint8_t>{}};
+  UserMode big;
+  std::string huge(UserMode::STACK_SIZE, 'x');
+  EXPECT_THROW(big.setup(other, image, {"prog", huge}, {}), std::runtime_error);
+}
+
+TEST_F(UserModeTest, WriteAndExit) {
+  put_string(DATA, "hello\n");
+  EXPECT_EQ(syscall(64, {1, DATA, 6}), 6);
+  EXPECT_EQ(out.str(), "hello\n");
+  EXPECT_EQ(static_cast<int64_t>(syscall(64, {1, 0x10, 6})), -EFAULT);
+  EXPECT_EQ(static_cast<int64_t>(syscall(1234, {})), -ENOSYS);
+
+  syscall(94, {3});
+  ASSERT_TRUE(cpu.exit_code.has_value());
+  EXPECT_EQ(*cpu.exit_code, 3);
+  EXPECT_EQ(cpu.csr.events[HPM_EVENT_TRAP], 0);  // 系统调用不经过陷入
+}
+
+TEST_F(UserModeTest, BrkAndMmap) {
+  uint64_t brk = syscall(214, {0});
+  EXPECT_EQ(brk, DRAM_BASE + 0x2000);
+  EXPECT_EQ(syscall(214, {brk + 0x3000}), brk + 0x3000);
+  cpu.store(brk + 0x2ff8, 64, 42);
+  EXPECT_EQ(syscall(214, {brk}), brk);
+  EXPECT_EQ(syscall(214, {brk + 0x3000}), brk + 0x3000);
+  EXPECT_EQ(cpu.load(brk + 0x2ff8, 64).value(), 0);  // 释放后再分配的内存被清零
+
+  uint64_t map = syscall(222, {0, 0x1800, 3, 0x22, static_cast<uint64_t>(-1), 0});  // MAP_PRIVATE | MAP_ANONYMOUS
+  EXPECT_EQ(map, DRAM_BASE + DRAM_SIZE - UserMode::STACK_SIZE - 0x2000);
+  cpu.store(map, 64, 7);
+  EXPECT_EQ(syscall(215, {map, 0x1800}), 0);
+  EXPECT_EQ(syscall(222, {0, 0x2000, 3, 0x22, static_cast<uint64_t>(-1), 0}), map);
+  EXPECT_EQ(cpu.load(map, 64).value(), 0);
+}
+
+TEST_F(UserModeTest, HostFiles) {
+  std::string path = testing::TempDir() + "cemu_usermode_test.txt";
+  put_string(DATA, path);
+  put_string(DATA + 0x200, "file data");
+  constexpr uint64_t AT_FDCWD = static_cast<uint64_t>(-100);
+  uint64_t fd = syscall(56, {AT_FDCWD, DATA, 01101, 0644});  // O_WRONLY | O_CREAT | O_TRUNC
+  ASSERT_LT(static_cast<int64_t>(fd), 1 << 16);
+  EXPECT_GT(fd, 2);
+  EXPECT_EQ(syscall(64, {fd, DATA + 0x200, 9}), 9);
+  EXPECT_EQ(syscall(57, {fd}), 0);
+
+  fd = syscall(56, {AT_FDCWD, DATA, 0, 0});
+  EXPECT_EQ(syscall(80, {fd, DATA + 0x400}), 0);
+  EXPECT_EQ(cpu.load(DATA + 0x400 + 48, 64).value(), 9);  // st_size
+  EXPECT_EQ(syscall(63, {fd, DATA + 0x300, 100}), 9);
+  EXPECT_EQ(std::memcmp(cpu.bus.dram_ptr(DATA + 0x300, 9), "file data", 9), 0);
+  EXPECT_EQ(syscall(57, {fd}), 0);
+  std::remove(path.c_str());
+}
+
+}  // namespace cemu
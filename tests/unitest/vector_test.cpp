@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "../../src/cup.h"
+#include "../../src/vector.h"
+#include "../test_util.h"
+
+namespace cemu {
+
+namespace {
+
+// 向量指令手工编码，避免依赖尚不支持 V 扩展的交叉编译器
+uint32_t vsetvli(uint32_t rd, uint32_t rs1, uint32_t vtypei) {
+  return (vtypei << 20) | (rs1 << 15) | (0x7 << 12) | (rd << 7) | 0x57;
+}
+
+uint32_t vle(uint32_t width, uint32_t vd, uint32_t rs1) {
+  return (1 << 25) | (rs1 << 15) | (width << 12) | (vd << 7) | 0x07;
+}
+
+uint32_t vlse(uint32_t width, uint32_t vd, uint32_t rs1, uint32_t rs2) {
+  return (0b10 << 26) | (1 << 25) | (rs2 << 20) | (rs1 << 15) | (width << 12) | (vd << 7) | 0x07;
+}
+
+uint32_t vse(uint32_t width, uint32_t vs3, uint32_t rs1) {
+  return (1 << 25) | (rs1 << 15) | (width << 12) | (vs3 << 7) | 0x27;
+}
+
+uint32_t opv(uint32_t funct6, uint32_t vm, uint32_t vs2, uint32_t vs1, uint32_t funct3, uint32_t vd) {
+  return (funct6 << 26) | (vm << 25) | (vs2 << 20) | (vs1 << 15) | (funct3 << 12) | (vd << 7) | 0x57;
+}
+
+constexpr uint32_t E8M8 = 0b000011;
+constexpr uint32_t E32M1 = 0b010000;
+constexpr uint32_t E64M1 = 0b011000;
+
+constexpr uint64_t SRC = DRAM_BASE + 0x1000;
+constexpr uint64_t DST = DRAM_BASE + 0x2000;
+
+void run(Cpu& cpu, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    cpu.pc = cpu.execute(cpu.fetch().value()).value();
+  }
+}
+
+}  // namespace
+
+TEST(VectorTest, VsetvliClampsToVlmax) {
+  Cpu cpu(to_code({vsetvli(10, 11, E32M1), vsetvli(12, 0, E8M8)}));
+  cpu.regs[11] = 100;
+  run(cpu, 2);
+  EXPECT_EQ(cpu.regs[10], VLEN / 32);
+  EXPECT_EQ(cpu.regs[12], VLEN);  // e8, m8：VLMAX = 8 * VLEN / 8
+  EXPECT_EQ(cpu.csr.load(VL), VLEN);
+}
+
+TEST(VectorTest, UnitStrideCopy) {
+  Cpu cpu(to_code({vsetvli(5, 12, E8M8), vle(0x0, 8, 10), vse(0x0, 8, 11)}));
+  for (uint64_t i = 0; i < 200; ++i) {
+    cpu.store(SRC + i, 8, i * 7);
+  }
+  cpu.regs[10] = SRC;
+  cpu.regs[11] = DST;
+  cpu.regs[12] = 200;
+  run(cpu, 3);
+  EXPECT_EQ(cpu.regs[5], 200);
+  for (uint64_t i = 0; i < 200; ++i) {
+    EXPECT_EQ(cpu.load(DST + i, 8).value(), (i * 7) & 0xff);
+  }
+  EXPECT_EQ(cpu.load(DST + 200, 8).value(), 0);
+}
+
+TEST(VectorTest, IntegerArithmetic) {
+  Cpu cpu(to_code({
+      vsetvli(0, 12, E32M1),
+      vle(0x6, 1, 10),
+      vle(0x6, 2, 11),
+      opv(0x00, 1, 1, 2, 0x0, 3),   // vadd.vv v3, v1, v2
+      opv(0x25, 1, 3, 13, 0x6, 4),  // vmul.vx v4, v3, a3
+      opv(0x09, 1, 4, 0xf, 0x3, 5), // vand.vi v5, v4, 15
+      opv(0x03, 1, 1, 0, 0x4, 6),   // vrsub.vx v6, v1, zero
+      vse(0x6, 5, 14),
+  }));
+  for (uint64_t i = 0; i < 8; ++i) {
+    cpu.store(SRC + i * 4, 32, i);
+    cpu.store(SRC + 0x100 + i * 4, 32, 10 * i);
+  }
+  cpu.regs[10] = SRC;
+  cpu.regs[11] = SRC + 0x100;
+  cpu.regs[12] = 8;
+  cpu.regs[13] = 3;
+  cpu.regs[14] = DST;
+  run(cpu, 8);
+  for (uint64_t i = 0; i < 8; ++i) {
+    EXPECT_EQ(cpu.load(DST + i * 4, 32).value(), (11 * i * 3) & 0xf);
+    uint32_t neg;
+    std::memcpy(&neg, cpu.vreg(6) + i * 4, 4);
+    EXPECT_EQ(neg, static_cast<uint32_t>(-static_cast<int32_t>(i)));
+  }
+}
+
+TEST(VectorTest, StridedLoadAndReduction) {
+  Cpu cpu(to_code({
+      vsetvli(0, 12, E64M1),
+      vlse(0x7, 1, 10, 11),
+      opv(0x10, 1, 0, 13, 0x6, 2),  // vmv.s.x v2, a3
+      opv(0x00, 1, 1, 2, 0x2, 3),   // vredsum.vs v3, v1, v2
+      opv(0x10, 1, 3, 0, 0x2, 14),  // vmv.x.s a4, v3
+  }));
+  for (uint64_t i = 0; i < 4; ++i) {
+    cpu.store(SRC + i * 16, 64, i + 1);
+  }
+  cpu.regs[10] = SRC;
+  cpu.regs[11] = 16;
+  cpu.regs[12] = 4;
+  cpu.regs[13] = 100;
+  run(cpu, 5);
+  EXPECT_EQ(cpu.regs[14], 110);
+}
+
+TEST(VectorTest, MaskedAdd) {
+  Cpu cpu(to_code({vsetvli(0, 12, E32M1), opv(0x00, 0, 1, 1, 0x3, 2)}));  // vadd.vi v2, v1, 1, v0.t
+  cpu.regs[12] = 8;
+  cpu.vreg(0)[0] = 0b01010101;
+  for (uint32_t i = 0; i < 8; ++i) {
+    std::memcpy(cpu.vreg(1) + i * 4, &i, 4);
+  }
+  run(cpu, 2);
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint32_t value;
+    std::memcpy(&value, cpu.vreg(2) + i * 4, 4);
+    EXPECT_EQ(value, i % 2 == 0 ? i + 1 : 0);
+  }
+}
+
+TEST(VectorTest, MergeIntoFirstOperand) {
+  // vmerge.vvm v1, v2, v1, v0：vd 与 vs1 相同
+  Cpu cpu(to_code({vsetvli(0, 12, E32M1), opv(0x17, 0, 2, 1, 0x0, 1)}));
+  cpu.regs[12] = 8;
+  cpu.vreg(0)[0] = 0b00110011;
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint32_t a = i, b = 100 + i;
+    std::memcpy(cpu.vreg(1) + i * 4, &a, 4);
+    std::memcpy(cpu.vreg(2) + i * 4, &b, 4);
+  }
+  run(cpu, 2);
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint32_t value;
+    std::memcpy(&value, cpu.vreg(1) + i * 4, 4);
+    EXPECT_EQ(value, (0b00110011 >> i) & 1 ? i : 100 + i);
+  }
+}
+
+TEST(VectorTest, VlClampedToVlmax) {
+  // 直接写入的 vl（例如来自损坏的快照）超过 VLMAX 时，只访问寄存器组内的元素
+  Cpu cpu(to_code({vsetvli(5, 12, E32M1), vle(0x6, 8, 10), vse(0x6, 8, 11)}));
+  for (uint64_t i = 0; i < 2 * VLEN_BYTES; ++i) {
+    cpu.store(SRC + i, 8, 0xff);
+  }
+  cpu.regs[10] = SRC;
+  cpu.regs[11] = DST;
+  cpu.regs[12] = 4;
+  run(cpu, 1);
+  cpu.csr.store(VL, 1000);
+  run(cpu, 2);
+  EXPECT_EQ(cpu.load(DST + VLEN_BYTES - 1, 8).value(), 0xff);
+  EXPECT_EQ(cpu.load(DST + VLEN_BYTES, 8).value(), 0);
+}
+
+TEST(VectorTest, VstartResumesMemoryAccess) {
+  Cpu cpu(to_code({vsetvli(5, 12, E8M8), vle(0x0, 8, 10), vle(0x0, 16, 11), opv(0x00, 1, 8, 8, 0x0, 24)}));
+  for (uint64_t i = 0; i < 16; ++i) {
+    cpu.store(SRC + i, 8, i + 1);
+  }
+  cpu.regs[10] = SRC;
+  cpu.regs[11] = DRAM_END - 7;  // 第 8 个元素越过 DRAM
+  cpu.regs[12] = 16;
+  run(cpu, 1);
+
+  // 从 vstart 开始访问，之前的元素保持不变
+  cpu.csr.store(VSTART, 4);
+  run(cpu, 1);
+  EXPECT_EQ(cpu.vreg(8)[3], 0);
+  EXPECT_EQ(cpu.vreg(8)[4], 5);
+  EXPECT_EQ(cpu.csr.load(VSTART), 0);
+
+  // 出错的元素下标记入 vstart
+  EXPECT_THROW(run(cpu, 1), Exception);
+  EXPECT_EQ(cpu.csr.load(VSTART), 8);
+
+  // vstart 非零时运算指令是非法的
+  cpu.pc = DRAM_BASE + 12;
+  EXPECT_THROW(run(cpu, 1), Exception);
+}
+
+TEST(VectorTest, IllegalWithoutVsetvl) {
+  Cpu cpu(to_code({vle(0x0, 1, 10)}));
+  cpu.regs[10] = SRC;
+  EXPECT_THROW(run(cpu, 1), Exception);
+}
+
+TEST(VectorTest, KernelsMatchScalar) {
+  std::vector<uint8_t> a(100), b(100), d(100);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = static_cast<uint8_t>(i * 37);
+    b[i] = static_cast<uint8_t>(200 - i);
+  }
+  vector_binary(VectorOp::Min, 8, d.data(), a.data(), b.data(), a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(static_cast<int8_t>(d[i]), std::min(static_cast<int8_t>(a[i]), static_cast<int8_t>(b[i])));
+  }
+  vector_binary(VectorOp::Mul, 16, d.data(), a.data(), b.data(), a.size() / 2);
+  for (size_t i = 0; i < a.size() / 2; ++i) {
+    uint16_t x, y, r;
+    std::memcpy(&x, &a[i * 2], 2);
+    std::memcpy(&y, &b[i * 2], 2);
+    std::memcpy(&r, &d[i * 2], 2);
+    EXPECT_EQ(r, static_cast<uint16_t>(x * y));
+  }
+  EXPECT_EQ(vector_reduce(VectorRedOp::Maxu, 8, a.data(), 0, a.size()), *std::max_element(a.begin(), a.end()));
+}
+
+}  // namespace cemu